@@ -31,11 +31,14 @@
 #include "db/db.h"
 #include "nsrr-remap.h"
 #include "helper/token-eval.h"
+#include "miscmath/crandom.h"
 
 #include <string>
 #include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
+#include <ctime>
 
 extern writer_t writer;
 
@@ -83,6 +86,8 @@ instance_t * annot_t::add( const std::string & id , const interval_t & interval
   all_instances.insert( instance );
     
   interval_events[ instance_idx_t( this , interval , id2 ) ] = instance; 
+
+  index_valid = false;
   
   return instance; 
   
@@ -112,6 +117,8 @@ void annot_t::remove( const std::string & id , const interval_t & interval )
   // clean up idx
   interval_events.erase( key );
 
+  index_valid = false;
+
 }
 
 
@@ -1725,10 +1732,85 @@ annot_map_t annot_t::extract( const interval_t & window )
   // where overlap is defined as region A to B-1 for interval_t(A,B)
   //
 
+  // (degenerate window: stop-1 wraps, so defer to the scan)
+  if ( window.stop == 0 ) return extract_scan( window );
+  
+  if ( ! index_valid ) build_index();
+  
   annot_map_t r; 
+
+  // only events starting before the end of the window can overlap
+  const int n = std::lower_bound( index_start.begin() , index_start.end() , window.stop ) - index_start.begin();
+  
+  if ( n != 0 ) 
+    query_index( 1 , 0 , index_leaves , n , window , &r );
+  
+  return r;
   
-  // urghhh... need to implement a much better search... 
-  // but for now just use brute force... :-(
+}
+
+
+void annot_t::build_index()
+{
+  
+  const int n = interval_events.size();
+
+  index_events.clear();
+  index_start.clear();
+  index_events.reserve( n );
+  index_start.reserve( n );
+  
+  annot_map_t::const_iterator ii = interval_events.begin();
+  while ( ii != interval_events.end() )
+    {
+      index_events.push_back( ii );
+      index_start.push_back( ii->first.interval.start );
+      ++ii;
+    }
+
+  // implicit binary tree: leaves at index_leaves + i; as overlaps()
+  // tests stop-1 (unsigned), a zero stop is taken as the maximum
+  
+  index_leaves = 1;
+  while ( index_leaves < n ) index_leaves *= 2;
+  
+  index_maxstop.assign( 2 * index_leaves , 0 );
+  for (int i=0; i<n; i++)
+    index_maxstop[ index_leaves + i ] = index_events[i]->first.interval.stop - 1;
+  
+  for (int k = index_leaves - 1 ; k >= 1 ; k-- )
+    index_maxstop[k] = index_maxstop[2*k] > index_maxstop[2*k+1] ? index_maxstop[2*k] : index_maxstop[2*k+1];
+
+  index_valid = true;
+}
+
+
+void annot_t::query_index( int node , int lwr , int upr , int n , const interval_t & window , annot_map_t * r ) const
+{
+
+  // node spans events [lwr,upr); only the first n can start within the window
+  if ( lwr >= n || index_maxstop[ node ] < window.start ) return;
+  
+  if ( upr - lwr == 1 )
+    {
+      const annot_map_t::const_iterator & ii = index_events[ lwr ];
+      // (visited in order, so append)
+      if ( ii->first.interval.overlaps( window ) ) 
+	r->insert( r->end() , *ii );
+      return;
+    }
+  
+  const int mid = ( lwr + upr ) / 2;
+  query_index( 2*node , lwr , mid , n , window , r );
+  query_index( 2*node+1 , mid , upr , n , window , r );
+  
+}
+
+
+annot_map_t annot_t::extract_scan( const interval_t & window ) const
+{
+  
+  annot_map_t r; 
   
   annot_map_t::const_iterator ii = interval_events.begin();
   while ( ii != interval_events.end() )
@@ -1740,77 +1822,78 @@ annot_map_t annot_t::extract( const interval_t & window )
     }
   
   return r;
+  
+}
+
+
+void annot_t::benchmark_extract( int n )
+{
+
+  //
+  // n dense, overlapping events (mixed short and long) over ~n seconds, 
+  // queried with 30-second windows (i.e. epoch-wise) and with 
+  // 1-second windows sliding every 0.5 seconds
+  //
 
+  annot_t annot( "bench" , NULL );
   
-  // // find first interval just /before/ then step over deciding which
-  // // should fit in
-
-  // interval_evt_map_t::const_iterator ii 
-  //   = interval_events.lower_bound( window );
-
-  // interval_evt_map_t::const_iterator jj = ii; 
-  
-  // // if returns iterator to end(), could still overlap the 
-  // // one or more events at the end, so need to check for this
-  // // special case of looking backwards either way; 
-  
-  // // back
-  // while ( 1 ) 
-  //   {
-
-  //     if ( jj == interval_events.begin() ) break;
-  //     --jj;
-  //     const interval_t & a = jj->first;
-      
-  //     //      std::cout << "extract: considering " << a.start << " - " << a.stop << "\n";
-      
-  //     if ( a.overlaps( window ) ) 
-  // 	{
-  // 	  r[ a ] = jj->second;
-  // 	  //std::cout << " found overlap\n";
-  // 	}
-  //     else if ( a.is_before( window ) )
-  // 	{
-  // 	  // also need to consider intervals that start before 'a' but still span window
-  // 	  // i.e. go back until test interval doesn't overlap 'a'
-  // 	  interval_evt_map_t::const_iterator kk = jj; 
-  // 	  interval_t prev = a;
-  // 	  while ( 1 ) 
-  // 	    {
-  // 	      if ( kk == interval_events.begin() ) break;
-  // 	      --kk;
-  // 	      interval_t b = kk->first;
-  // 	      if ( ! prev.overlaps( b ) ) break; // really all done now
-  // 	      if ( b.overlaps( window ) ) 
-  // 		{ 
-  // 		  r[ b ] = kk->second; 
-  // 		  std::cout << " XXX added an extra!\n"; 		  
-  // 		}
-  // 	      prev = b;
-  // 	    }
-  // 	  break;      
-  // 	}
-  //   }
-
-  // std::cout << "now forward...\n";
-  // // forward
-  // while ( 1 ) 
-  //   {      
-  //     if ( ii == interval_events.end() ) break;
-  //     const interval_t & a = ii->first;
-  //     std::cout << "extract: considering " << a.start << " - " << a.stop << "\n";
-  //     if ( a.overlaps( window ) ) 
-  // 	{
-  // 	  r[ a ] = ii->second;
-  // 	  std::cout << " found overlap\n";
-  // 	}
-      
-  //     else if ( a.is_after( window ) ) break;      
-  //     ++ii;
-  //   }
-  // std::cout << "  done...\n";
-  // return r;
+  CRandom::srand( 12345 );
+  
+  const uint64_t len = n * globals::tp_1sec;
+
+  for (int i=0; i<n; i++)
+    {
+      uint64_t start = CRandom::rand() * len;
+      uint64_t dur = ( CRandom::rand( 10 ) == 0 ? 300 : 3 ) * CRandom::rand() * globals::tp_1sec + 1 ;
+      annot.add( Helper::int2str( i ) , interval_t( start , start + dur ) );
+    }
   
+  for (int w = 0 ; w < 2 ; w++ )
+    {
+      
+      const uint64_t wlen = w == 0 ? 30 * globals::tp_1sec : globals::tp_1sec ;
+      const uint64_t winc = w == 0 ? 30 * globals::tp_1sec : globals::tp_1sec / 2 ;
+
+      std::vector<interval_t> windows;
+      for (uint64_t t = 0 ; t < len ; t += winc )
+	windows.push_back( interval_t( t , t + wlen ) );
+
+      // the (quadratic) scan is only timed/checked on a subset of windows
+      const int step = windows.size() > 2000 ? windows.size() / 2000 : 1 ;
+      
+      int nscan = 0 , mismatch = 0;
+      uint64_t found = 0;
+      
+      clock_t c0 = clock();
+      for (int i=0; i<windows.size(); i+=step , ++nscan )
+	annot.extract_scan( windows[i] );
+
+      clock_t c1 = clock();
+      for (int i=0; i<windows.size(); i++)
+	found += annot.extract( windows[i] ).size();
+
+      clock_t c2 = clock();
+      
+      for (int i=0; i<windows.size(); i+=step )
+	{
+	  annot_map_t r = annot.extract( windows[i] );
+	  annot_map_t r0 = annot.extract_scan( windows[i] );
+	  bool same = r.size() == r0.size();
+	  annot_map_t::const_iterator jj = r.begin() , kk = r0.begin();
+	  while ( same && jj != r.end() ) { same = (jj++)->second == (kk++)->second; }
+	  if ( ! same ) ++mismatch;
+	}
+      
+      const double t_scan = 1e6 * ( c1 - c0 ) / (double)CLOCKS_PER_SEC / (double)nscan ;
+      const double t_index = 1e6 * ( c2 - c1 ) / (double)CLOCKS_PER_SEC / (double)windows.size() ;
+      
+      std::cout << n << " events, "
+		<< windows.size() << " windows of " << wlen / (double)globals::tp_1sec << "s "
+		<< "(mean " << found / (double)windows.size() << " overlaps) : "
+		<< "scan " << t_scan << " us/query , "
+		<< "index " << t_index << " us/query , "
+		<< "mismatches " << mismatch << " of " << nscan << "\n";
+    }
 }
 
 
@@ -2183,10 +2266,17 @@ void proc_eval( edf_t & edf , param_t & param )
   logger << "\n";
   
   //
-  // Get all existing annotations
+  // Compile the expression once
+  //
+
+  Eval tok( expression );
+
+
+  //
+  // Get all existing annotations (that can supply variables in the expression)
   //
   
-  std::vector<std::string> names = edf.timeline.annotations.names();
+  std::vector<std::string> names = tok.annotations( edf.timeline.annotations.names() );
 
 
   //
@@ -2223,40 +2313,58 @@ void proc_eval( edf_t & edf , param_t & param )
     }
 
   //
-  // Iterate over epochs
+  // Get annotations for every epoch (considering _ALL_ epochs)
   //
 
+  std::vector<int> es;
+  std::vector<std::map<std::string,annot_map_t> > inputs;
+
   edf.timeline.first_epoch();
   
-  int acc_total = 0 , acc_retval = 0 , acc_valid = 0; 
-
   while ( 1 ) 
     {
-
-      // consider _ALL_ epochs
       
       int e = edf.timeline.next_epoch_ignoring_mask() ;
       
       if ( e == -1 ) break;
       
       interval_t interval = edf.timeline.epoch( e );
-	  
-      std::map<std::string,annot_map_t> inputs;
-
-      // get each annotations
+      
+      es.push_back( e );
+      inputs.resize( es.size() );
+      
+      // get overlapping annotations for this epoch
       for (int a=0;a<names.size();a++)
-	{
-	  
-	  annot_t * annot = edf.timeline.annotations.find( names[a] );
-	  
-	  // get overlapping annotations for this epoch
-	  annot_map_t events = annot->extract( interval );
-	  
-	  // store
-	  inputs[ names[a] ] = events;
-	}
+	inputs.back()[ names[a] ] = edf.timeline.annotations.find( names[a] )->extract( interval );
+    }
+
+  
+  //
+  // Without assignments, evaluate all epochs at once (column-wise) 
+  //
+
+  const bool columnwise = tok.columnwise();
+
+  std::vector<Token> results;
+
+  std::vector<bool> valid;
+  
+  if ( columnwise ) tok.evaluate( inputs , &results , &valid , accumulator );
+
+  
+  //
+  // Iterate over epochs
+  //
+
+  int acc_total = 0 , acc_retval = 0 , acc_valid = 0; 
+
+  for (int i=0; i<es.size(); i++)
+    {
+
+      const int e = es[i];
+      
+      interval_t interval = edf.timeline.epoch( e );
       
-     
       //
       // create new annotation
       //
@@ -2267,15 +2375,23 @@ void proc_eval( edf_t & edf , param_t & param )
       // evaluate the expression
       //
 
-      Eval tok( expression );
-      
-      tok.bind( inputs , new_instance , accumulator , &acc_vars );
-      
-      bool is_valid = tok.evaluate();
-      
+      bool is_valid;
+
       bool retval;
       
-      if ( ! tok.value( retval ) ) is_valid = false;
+      if ( columnwise ) 
+	{
+	  is_valid = valid[i];
+	  if ( ! Eval::value( results[i] , retval ) ) is_valid = false;
+	}
+      else
+	{
+	  tok.bind( inputs[i] , new_instance , accumulator , &acc_vars );
+	  
+	  is_valid = tok.evaluate();
+	  
+	  if ( ! tok.value( retval ) ) is_valid = false;
+	}
       
       //
       // Output
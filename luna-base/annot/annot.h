@@ -119,7 +119,7 @@ struct annot_t
   // Constructor/destructor
   //
 
-  annot_t( const std::string & n , annotation_set_t * p )  : name(n) , parent(p)
+  annot_t( const std::string & n , annotation_set_t * p )  : name(n) , parent(p) , index_valid(false)
   { 
     file = description = "";
     type = globals::A_NULL_T;
@@ -183,6 +183,12 @@ struct annot_t
   
   annot_map_t extract( const interval_t & window );
   
+  // as above, via a linear scan of all events (i.e. w/out the index)
+  annot_map_t extract_scan( const interval_t & window ) const;
+
+  // timing/check of extract() vs extract_scan() on synthetic events 
+  static void benchmark_extract( int n );
+  
   
   std::set<std::string> instance_ids() const;
 
@@ -197,9 +203,32 @@ struct annot_t
     description = "";
     types.clear();
     interval_events.clear();
+    index_valid = false;
     wipe();
   }
 
+  
+  //
+  // Overlap index for extract(): events in (interval) order, and a
+  // max-tree over each event's last point (stop-1), so that a query
+  // only descends into ranges that can reach the window; built on
+  // first use, and invalidated by add()/remove()
+  //
+  
+  void build_index();
+
+  void query_index( int node , int lwr , int upr , int n , const interval_t & window , annot_map_t * r ) const;
+  
+  bool index_valid;
+
+  std::vector<annot_map_t::const_iterator> index_events;
+
+  std::vector<uint64_t> index_start;
+  
+  std::vector<uint64_t> index_maxstop;
+
+  int index_leaves;
+
 
   // helper functions 
   
@@ -28,6 +28,8 @@
 
 #include "helper/helper.h"
 #include "helper/logger.h"
+#include "helper/threads.h"
+#include "timeline/epoch-map.h"
 #include "eval.h"
 #include "db/db.h"
 
@@ -341,6 +343,17 @@ annot_t * buckelmuller_artifact_detection( edf_t & edf ,
 // SIGSTATS
 //
 
+// per-epoch SIGSTATS results (see rms_per_epoch())
+
+struct sigstats_epoch_t
+{
+  double c, f, m, x;
+  double activity, mobility, complexity;
+  double turning_rate_mean;
+  std::vector<double> subepoch_tr;
+};
+
+
 void  rms_per_epoch( edf_t & edf , param_t & param )
 {
 
@@ -567,110 +580,89 @@ void  rms_per_epoch( edf_t & edf , param_t & param )
   
   
   //
-  // For each signal
+  // Per-epoch statistics, in parallel over signal x epoch pairs
   //
 
+  epoch_map_t emap( edf , signals );
+  
   int si = -1;
 
-  for (int s=0;s<ns_all;s++)
-    {
-
+  emap.run<sigstats_epoch_t>( [&]( const epoch_view_t & v ) {
+      
+      sigstats_epoch_t r;
+      
+      std::vector<double> * d = v.data;
+      
       //
-      // only consider data tracks
+      // get clipped, flat and/or maxxed points (each is a proportion of points in the epoch)
       //
       
-      if ( edf.header.is_annotation_channel( signals(s) ) ) continue;
-
-      ++si;
-
+      r.c = calc_clipped ? MiscMath::clipped( *d ) : 0 ;
+      
+      r.f = calc_flat ? MiscMath::flat( *d , flat_eps ) : 0 ;
+      
+      r.m = calc_maxxed ? MiscMath::max( *d , max_value ) : 0 ; 
+      
+      
       //
-      // output stratifier (only needed at this stage if verbose, epoch-level output will
-      // also be written)
+      // Mean-centre 30-second window, calculate RMS
       //
-
-      if ( verbose ) 
-	writer.level( signals.label(s) , globals::signal_strat );
-
+      
+      MiscMath::centre( d );
+      
+      r.x = calc_rms ? MiscMath::rms( *d ) : 0 ;
+      
+      
       //
-      // reset to first epoch
+      // Hjorth parameters
       //
       
-      edf.timeline.first_epoch();
-
+      r.activity = 0 ; r.mobility = 0 ; r.complexity = 0;
+      
+      MiscMath::hjorth( d , &r.activity , &r.mobility , &r.complexity );
+      
+      
       //
-      // Get sampling rate
+      // Turning rate
       //
       
-      int sr = edf.header.sampling_freq( s );
+      r.turning_rate_mean = 0;
+      
+      if ( turning_rate )
+	r.turning_rate_mean = MiscMath::turning_rate( d , v.sr , tr_epoch_sec , tr_d , &r.subepoch_tr );
+      
+      return r;
+    } , 
+    [&]( int s , std::vector<sigstats_epoch_t> & res ) {
+      
+      ++si;
+      
+      //
+      // output stratifier (only needed at this stage if verbose, epoch-level output will
+      // also be written)
+      //
+      
+      if ( verbose ) 
+	writer.level( signals.label(s) , globals::signal_strat );
       
       //
       // for each each epoch 
       //
       
-      while ( 1 ) 
+      for (int e = 0 ; e < res.size() ; e++ )
 	{
 	  
-	  //
-	  // Get next epoch
-	  //
-	  
-	  int epoch = edf.timeline.next_epoch();
-	  
-	  if ( epoch == -1 ) break;
-	  
-	  interval_t interval = edf.timeline.epoch( epoch );
-	  	  
-	  slice_t slice( edf , signals(s) , interval );
-	  
-	  std::vector<double> * d = slice.nonconst_pdata();
-
-	  //
-	  // get clipped, flat and/or maxxed points (each is a proportion of points in the epoch)
-	  //
-
-	  double c = calc_clipped ? MiscMath::clipped( *d ) : 0 ;
-
-	  double f = calc_flat ? MiscMath::flat( *d , flat_eps ) : 0 ;
-	  
-	  double m = calc_maxxed ? MiscMath::max( *d , max_value ) : 0 ; 
-
-
-	  //
-	  // Mean-centre 30-second window, calculate RMS
-	  //
-
-	  MiscMath::centre( d );
+	  const int epoch = emap.epochs[e];
 	  
-	  double x = calc_rms ? MiscMath::rms( *d ) : 0 ;
-	  	  
+	  const sigstats_epoch_t & r = res[e];
 	  
-
-	  //
-	  // Hjorth parameters
-	  //
-
-	  double activity = 0 , mobility = 0 , complexity = 0;
-	  
-	  MiscMath::hjorth( d , &activity , &mobility , &complexity );
-
-
-	  //
-	  // Turning rate
-	  //
+	  const double c = r.c , f = r.f , m = r.m , x = r.x;
+	  const double activity = r.activity , mobility = r.mobility , complexity = r.complexity;
 	  
-	  double turning_rate_mean = 0;
-
 	  if ( turning_rate )
-	    {
-
-	      std::vector<double> subepoch_tr;
-	      
-	      turning_rate_mean = MiscMath::turning_rate( d , sr, tr_epoch_sec , tr_d , &subepoch_tr );
-	      
-	      for (int i=0;i<subepoch_tr.size();i++)
-		e_tr[s].push_back( subepoch_tr[i] );
-	    }
-
+	    for (int i=0;i<r.subepoch_tr.size();i++)
+	      e_tr[s].push_back( r.subepoch_tr[i] );
+	  
 	  //
 	  // Verbose output
 	  //
@@ -702,7 +694,7 @@ void  rms_per_epoch( edf_t & edf , param_t & param )
 		writer.value( "MAX" , c , "Proportion of epoch with maxed signal" );
 	      
 	      if ( turning_rate ) 
-		writer.value( "TR" , turning_rate_mean , "Turning rate mean per epoch" );
+		writer.value( "TR" , r.turning_rate_mean , "Turning rate mean per epoch" );
 	    }
 
 
@@ -768,7 +760,7 @@ void  rms_per_epoch( edf_t & edf , param_t & param )
       // Next signal
       //
       
-    } 
+    } );
 
   if ( verbose )
     writer.unlevel( globals::signal_strat );
@@ -1356,20 +1348,20 @@ void  mse_per_epoch( edf_t & edf , param_t & param )
   
   
   //
-  // For each signal  
+  // MSE per epoch (in parallel, over channel x epoch pairs)
   //
-  
-  for (int s=0;s<ns;s++)
-    {
 
-      //
-      // only consider data tracks
-      //
-      
-      if ( edf.header.is_annotation_channel( signals(s) ) ) continue;
+  epoch_map_t emap( edf , signals );
+
+  if ( emap.epochs.size() == 0 ) return;
 
+  logger << " estimating MSE for " << emap.chs.size() << " channel(s)\n";
 
-      logger << " estimating MSE for " << signals.label(s) << "\n";
+  emap.run<std::map<int,double> >( [&]( const epoch_view_t & v ) {
+      mse_t mse( scale[0] , scale[1] , scale[2] , m , r );
+      return mse.calc( *v.data );
+    } ,
+    [&]( int s , std::vector<std::map<int,double> > & epoch_mses ) {
       
       //
       // output stratifier
@@ -1383,49 +1375,16 @@ void  mse_per_epoch( edf_t & edf , param_t & param )
       
       std::map<int,std::vector<double> > all_mses;
 
-
-      //
-      // Point to first epoch (assume 30 seconds, but could be different)
-      //
-      
-      int ne = edf.timeline.first_epoch();
-      
-      if ( ne == 0 ) return;
-      
-
       //
       // for each each epoch 
       //
 
-      while ( 1 ) 
+      for (int e = 0 ; e < epoch_mses.size() ; e++ )
 	{
 	  
-	  //
-	  // Get next epoch
-	  //
-	  
-	  int epoch = edf.timeline.next_epoch();
-	  
-	  if ( epoch == -1 ) break;
-	  
-	  interval_t interval = edf.timeline.epoch( epoch );
-	  	  
-	  //
-	  // get data
-	  //
-
-	  slice_t slice( edf , signals(s) , interval );
-	  
-	  std::vector<double> * d = slice.nonconst_pdata();
-
+	  const int epoch = emap.epochs[e];
 	  
-	  //
-	  // Mean-centre 30-second window, calculate RMS
-	  //
-
-	  mse_t mse( scale[0] , scale[1] , scale[2] , m , r );
-	  
-	  std::map<int,double> mses = mse.calc( *d );
+	  const std::map<int,double> & mses = epoch_mses[e];
 	  
 	  //
 	  // track
@@ -1481,7 +1440,7 @@ void  mse_per_epoch( edf_t & edf , param_t & param )
 	}
       writer.unlevel( "SCALE" );
       
-    } // next signal
+    } ); // next signal
   
   writer.unlevel( globals::signal_strat );
   
@@ -1525,7 +1484,51 @@ void lzw_per_epoch( edf_t & edf , param_t & param )
   int ne = edf.timeline.first_epoch();
 
   if ( ne == 0 ) return;
+
+
+  //
+  // Epoch level analyses: each epoch is coarse-grained and
+  // compressed separately, so map over channel x epoch pairs
+  //
   
+  if ( epoched )
+    {
+      
+      epoch_map_t emap( edf , signals );
+      
+      emap.run<double>( [&]( const epoch_view_t & v ) {
+	  
+	  // lzw_t class is designed for per-epoch data to be taken 
+	  // all in one structure
+	  std::vector<std::vector<double> > track_lzw( 1 );
+	  track_lzw[0].swap( *v.data );
+	  
+	  // coarse-grain signal
+	  coarse_t c( track_lzw , nbins , nsmooth );
+	  
+	  // compress	  
+	  lzw_t lzw( c );
+	  
+	  // index	  
+	  return lzw.size(0) / (double)track_lzw[0].size();
+	} ,
+	[&]( int s , std::vector<double> & index ) {
+	  
+	  writer.level( signals.label(s) , globals::signal_strat );
+	  
+	  for (int e=0; e<index.size(); e++)
+	    {
+	      writer.epoch( edf.timeline.display_epoch( emap.epochs[e] ) );
+	      writer.value( "LZW" , index[e] );
+	      writer.unepoch();
+	    }
+	  
+	  writer.unlevel( globals::signal_strat );
+	} );
+      
+      return;
+    }
+
   
   //
   // For each signal  
@@ -1549,104 +1552,31 @@ void lzw_per_epoch( edf_t & edf , param_t & param )
       
 
       //
-      // per-epoch, or whole-signal calculation?
+      // whole-signal calculation
       //
       
-      if ( ! epoched ) 
-	{
-
-	  // get all data
-	  interval_t interval = edf.timeline.wholetrace();
-	  
-	  slice_t slice( edf , s , interval );
-	  const std::vector<double> * d = slice.pdata();
-	  const int sz = d->size();
-
-	  // designed for per-epoch data, but just use first 
-	  // slot for entire signal
-	  std::vector<std::vector<double> > track_lzw;
-	  track_lzw.push_back( *d );
-	  	  
-	  // coarse-grain signal
-	  coarse_t c( track_lzw , nbins , nsmooth );
-	  
-	  // compress	  
-	  lzw_t lzw( c );
+      // get all data
+      interval_t interval = edf.timeline.wholetrace();
       
-	  // index	  
-	  double index = lzw.size(0) / (double)track_lzw[0].size();
-
-	  // output
-	  writer.value( "LZW" , index );
-	  	  
-	}
-     
-
-      //
-      // Epoch level analyses
-      //
-     
-      if ( epoched )
-	{
-	  
-	  
-	  int ne = edf.timeline.first_epoch();
-	  
-	  if ( ne == 0 ) return;
-
-	  // track all signals here
-
-	  std::vector<std::vector<double> > track_lzw;
-	  std::vector<int> track_e;
-
-	  //
-	  // for each each epoch 
-	  //
-	  
-	  while ( 1 ) 
-	    {
-	      
-	      // Get next epoch
-	  
-	      int epoch = edf.timeline.next_epoch();
-	  
-	      if ( epoch == -1 ) break;
-	  
-	      interval_t interval = edf.timeline.epoch( epoch );
-	      
-	      // get data
-	      
-	      slice_t slice( edf , signals(s) , interval );
-	      
-	      std::vector<double> * d = slice.nonconst_pdata();
-	      
-	      // lzw_t class is designed for per-epoch data to be taken 
-	      // all in one structure	      
-	      track_lzw.push_back( *d );
-	      track_e.push_back( epoch );
-	      
-	    } // next epoch	      
-	      	      
-	  // coarse-grain signal
-	  coarse_t c( track_lzw , nbins , nsmooth );
-	  
-	  // compress	  
-	  lzw_t lzw( c );
+      slice_t slice( edf , s , interval );
+      const std::vector<double> * d = slice.pdata();
       
-	  // index	  
-	  for (int e=0; e<track_e.size(); e++)
-	    {
-
-	      double index = lzw.size(e) / (double)track_lzw[e].size();
-	      
-	      // output
-	      writer.epoch( edf.timeline.display_epoch( track_e[e] ) );
-	      writer.value( "LZW" , index );
-	      writer.unepoch();
-			     
-	    }
-	  
-	}
+      // designed for per-epoch data, but just use first 
+      // slot for entire signal
+      std::vector<std::vector<double> > track_lzw;
+      track_lzw.push_back( *d );
+      
+      // coarse-grain signal
+      coarse_t c( track_lzw , nbins , nsmooth );
+      
+      // compress	  
+      lzw_t lzw( c );
+      
+      // index	  
+      double index = lzw.size(0) / (double)track_lzw[0].size();
+      
+      // output
+      writer.value( "LZW" , index );
       
       writer.unlevel( globals::signal_strat );
     } // next signal
@@ -489,6 +489,7 @@ void cmddefs_t::init()
   add_url( "RESAMPLE" , "manipulations/#resample" );
   add_param( "RESAMPLE" , "sig" , "C3,C4" , "List of channels to resample" );
   add_param( "RESAMPLE" , "sr" , "200" , "New sampling rate (Hz) [required]" );
+  add_param( "RESAMPLE" , "method" , "fastest" , "Converter: best, medium, fastest (default), zoh or linear" );
   
   // REFERENCE
 
@@ -1580,6 +1581,8 @@ void cmddefs_t::init()
   add_param( "EXE" , "t" , "1" , "PDC span" );
 
   add_param( "EXE" , "k" , "10" , "Number of clusters" );
+  add_param( "EXE" , "mat" , "m1" , "Write distance matrix to m1-{id}.mat (binary, packed upper triangle)" );
+  add_param( "EXE" , "txt" , "" , "Write the distance matrix as (full) text instead" );
     
   add_table( "EXE" , "E,CH" , "Epoch cluster assignment" );
   add_var( "EXE" , "E,CH" , "CL" , "Cluster code" );
@@ -28,6 +28,7 @@
 
 #include "miscmath/miscmath.h"
 #include "fftw/fftwrap.h"
+#include "helper/threads.h"
 
 
 std::vector<dcomp> CWT::wavelet( const int fi )
@@ -124,412 +125,380 @@ void CWT::run()
 {
 
   //
-  // Any baseline normalization?
+  // Convolve (in the frequency domain) with each wavelet; power is
+  // baseline normalized (result()) based on 'all' time-points, i.e. to
+  // get dB
   //
 
-  bool baseline_normalization = true;
-  
-  
-  //
-  // Initialize
-  //
-  
-  // Frex x ( time x trials )
-  
-  eegpower.resize( num_frex );
-  rawpower.resize( num_frex );
-  ph.resize( num_frex ); 
-  for (int i=0;i<num_frex;i++) 
-    {
-      eegpower[i].resize( num_pnts , 0 );
-      rawpower[i].resize( num_pnts , 0 );
-      ph[i].resize( num_pnts , 0 );
-    }
+  convolve( false , 0 );
 
+}
 
-  if ( store_real_imag )
-    {
-      conv_complex.resize( num_frex );
-    }
-  
-  const double SQRT_PI = sqrt(M_PI);
 
 
-  //
-  // Does the timeframe vary for different wavlets?  If not, precompute FFT of data just once
-  //
+void CWT::run_wrapped()
+{
 
-  std::set<double> tf;
-  for (int i=0;i<wlen.size();i++) tf.insert(wlen[i]);
-  bool fixed_wlen = alt_spec && tf.size() == 1;
-    
   //
-  // Initial FFT of data 
+  // Alternate parameterization, for a wrapped wavelet and fixed time-frame
+  // following Cox & Fell
   //
 
-  FFT eegfft;
-  std::vector<dcomp> eegfftX;
-
-  if ( fixed_wlen ) 
-    {
-      set_timeframe( 50.0 / wlen[0] );      
-      eegfft.init( data->size() , n_conv_pow2 , srate );
-      eegfft.apply( *data );
-      eegfftX = eegfft.transform();
-    }
+  // i.e. the wavelet (second half, padding, first half) is centred at
+  // zero, and so output i is aligned to conv[ i + Ltapr/2 ] (rather
+  // than conv[ i + Ltapr/2 - 1 ] as in run()); the kernel is scaled by
+  // its spectral peak on an Lconv-point grid
   
+  int Ldata = data->size();
 
-  //
-  // loop through frequencies and compute synchronization
-  //
-
-  for (int fi=0;fi<num_frex;fi++)
-    {
-      
-       //
-      // Set timeline for this wavelet (or is fixed already under alt_spec) 
-      //
-	    
-      if ( ! alt_spec ) 
-	{
-	  set_timeframe( fc[fi] );  
-	}
-      else
-	set_timeframe( 50.0 / wlen[fi] );
-
-      
-      //
-      // Do we need FFT of data?
-      //
-
-      if ( ! fixed_wlen ) 
-	{
-	  if ( fi != 0 ) eegfft.reset();
-	  eegfft.init( data->size() ,  n_conv_pow2 , srate );
-	  eegfft.apply( *data );
-	  eegfftX = eegfft.transform();
-	}
-
-      
-      //
-      // Generate wavelet 
-      //
-
-      std::vector<dcomp> w = alt_spec ? alt_wavelet(fi) : wavelet(fi);
-      
-      // std::cerr << "n_conv_pow2 = " << n_conv_pow2 << "\n"
-      // 	    << "n_data = " << n_data << "\n"
-      // 	    << "n_convolution " << n_convolution << "\n"
-      // 	    << "half_of_wavelet_size " << half_of_wavelet_size << "\n"
-      // 	    << "n_wavelet " << n_wavelet << "\n";
-
-
-      //
-      // First FFT
-      //
-
-      FFT fft1( w.size() , n_conv_pow2 , 1 , FFT_FORWARD );
-
-      fft1.apply( w );
-
-      std::vector<dcomp> wt = fft1.transform();
-
-
-
-      //
-      // Scaling factor to ensure similar amplitudes of original traces and wavelet-filtered signal
-      // kernelFFT = 2*kernelFFT./max(kernelFFT);
-      //
-      
-      const bool rescale_wavelet = true;
-
-      if ( rescale_wavelet ) 
-	{
-	  dcomp max = MiscMath::max( wt );
-	  
-	  for ( int i = 0 ; i < wt.size() ; i++ )
-	    wt[i] = ( dcomp( 2, 0 ) * wt[i] ) / max;
-	}
-
-      
-      //
-      // Convolution in the frequency domain 
-      //
-
-      std::vector<dcomp> y( n_conv_pow2 );
-      for (int i=0;i<eegfftX.size();i++) y[i] = eegfftX[i] * wt[i]; 
-
-      
-      //
-      // Inverse FFT, normalized by 1/Nfft, back to time-domain
-      //
-
-      FFT ifft( n_conv_pow2 , n_conv_pow2 , 1 , FFT_INVERSE );
-
-      ifft.apply( y );
-
-      std::vector<dcomp> eegconv_tmp = ifft.scaled_transform() ;
-     
-      
-      //
-      // Trim
-      //
-      
-      eegconv_tmp.resize( n_convolution );      
-      std::vector<dcomp> eegconv;
-      for (int i=half_of_wavelet_size-1;
-	   i < ( n_convolution - half_of_wavelet_size ); 
-	   i++ ) 
-	eegconv.push_back( eegconv_tmp[i] );
-
-
-      //
-      // extract phase from the convolution
-      //
-
-      for (int i=0; i<num_pnts*num_trials; i++)
-	ph[fi][i] = atan2( eegconv[i].imag() , eegconv[i].real() );
+  int Ltapr = time.size();
 
+  int Lconv1 = Ldata + Ltapr - 1;  
 
-      //
-      // optionally, extract real/imag parts
-      //
+  int Lconv  = MiscMath::nextpow2( Lconv1 );
 
-      if ( store_real_imag )
-	{	  
-	  // nb. num_trials == 1 always... 
-	  conv_complex[fi].resize( num_pnts * num_trials ); 
-	  for (int i=0; i<num_pnts*num_trials; i++)
-	    conv_complex[fi][i] = eegconv[i] ;
+  convolve( true , Lconv );
+    
+}
 
-	}
-      
-      //
-      // Put results back into pnts x trials matrix; take power
-      // abs(X)^2; average over trials to get a pnts-length vector of
-      // average power
-      //
-      
-      int cnt = 0;
-      std::vector<double> temppower( num_pnts , 0 );
-      for (int i=0; i<num_pnts; i++)
-	{
-	  double x = 0;
-	  for (int t=0; t<num_trials; t++)
-	    x += pow( abs( eegconv[ cnt + t*num_pnts ] ) , 2 ); 
-	  ++cnt;
-	  temppower[i] = num_trials > 1 ? x / (double)num_trials : x ;
-	}
 
-      //
-      // Record in freq x time-point matrix; use the 'baseline
-      // correction based on 'all' time-points, i.e. to get dB
-      //
+dcomp CWT::peak( const std::vector<dcomp> & w , const int shift , const int nfft , const double f ) const
+{
 
-      double baseline       = 0;
-      int    baseline_n     = 0;
-      int    baseline_start = 0;
-      int    baseline_stop  = num_pnts; // 1 past index
+  //
+  // Stands in for MiscMath::max() of the nfft-point FFT of the
+  // zero-padded wavelet (or, if shift = Ltapr/2, of the wrapped
+  // wavelet), as in the original run() and run_wrapped(): as the
+  // spectrum of a (Gaussian-windowed) wavelet has a single peak near
+  // f, single bins are evaluated directly, stepping uphill from the
+  // bin closest to f.  'luna -d cwt-peak' checks this against the full
+  // FFT, for both parameterizations over a range of wavelets
+  //
 
-      if ( baseline_normalization )
-	{
+  long k = lround( f * nfft / (double)srate ) % nfft;
+  if ( k < 0 ) k += nfft;
 
-	  for (int i = baseline_start; i < baseline_stop; i++ ) { baseline += temppower[i]; baseline_n++; } 
-	  baseline /= (double)baseline_n;
-	  
-	  // i.e. express as dB over entire night, i.e. 10log10(ratio)
-	  for (int i=0; i<num_pnts; i++) eegpower[fi][i] = 10*log10( temppower[i]/baseline );
-	}
-      else
+  dcomp best = dft_bin( w , shift , nfft , k );
+  double mx = std::abs( best );
+  
+  for (int dir = 1 ; dir >= -1 ; dir -= 2 )
+    {
+      bool moved = false;
+      while ( 1 )
 	{
-	  for (int i=0; i<num_pnts; i++) eegpower[fi][i] = 10*log10( temppower[i] );
+	  long k2 = ( k + dir + nfft ) % nfft;
+	  dcomp x = dft_bin( w , shift , nfft , k2 );
+	  if ( std::abs( x ) <= mx ) break;
+	  k = k2;
+	  best = x;
+	  mx = std::abs( x );
+	  moved = true;
 	}
-
-      // save non-dB version too
-      rawpower[fi] = temppower;
+      if ( moved ) break;
     }
 
+  return best;
 }
 
 
-
-
-void CWT::run_wrapped()
+bool CWT::selftest()
 {
 
-  //
-  // Alternate parameterization, for a wrapped wavelet and fixed time-frame
-  // following Cox & Fell
-  //
+  // peak() vs MiscMath::max() of the full FFT, as in the original
+  // code, for standard (Fc, cycles) and alternate (Fc, FWHM, length)
+  // wavelets, including very low Fc (i.e. the closest bin is 0), and
+  // both zero-padded and wrapped
 
-  //
-  // Initialize
-  //
+  bool okay = true;
+
+  const double srs[] = { 128 , 256 , 400 };
   
-  // num_frex  : number of wavelets to apply
+  const double fcs[] = { 0.02 , 0.1 , 0.5 , 1 , 4 , 11 , 13.5 , 30 , 60 };
+  const int nfc = 9;
+  
+  const int cycles[] = { 3 , 7 , 12 };
+  const double fwhms[] = { 0.1 , 0.5 , 2 , 5 };
+  const double wlens[] = { 10 , 20 };
+  
+  for (int si=0; si<3; si++)
+    for (int alt=0; alt<2; alt++)
+      {
+	const double sr = srs[si];
+	
+	CWT cwt;
+	cwt.set_sampling_rate( sr );
+	std::vector<double> d( ( alt ? 30 : 10 ) * (int)sr , 0 );
+	cwt.load( &d );
+	
+	for (int i=0; i<nfc; i++)
+	  {
+	    if ( fcs[i] >= sr / 2.0 ) continue;
+	    if ( alt ) 
+	      {
+		for (int j=0; j<4; j++)
+		  for (int k=0; k<2; k++)
+		    cwt.alt_add_wavelet( fcs[i] , fwhms[j] , wlens[k] );
+	      }
+	    else if ( fcs[i] >= 0.5 ) // i.e. T = 50/fc seconds
+	      for (int j=0; j<3; j++)
+		cwt.add_wavelet( fcs[i] , cycles[j] );
+	  }
+
+	for (int fi=0; fi<cwt.num_frex; fi++)
+	  {
+	    cwt.set_timeframe( alt ? 50.0 / cwt.wlen[fi] : cwt.fc[fi] );
+	    const std::vector<dcomp> w = alt ? cwt.alt_wavelet( fi ) : cwt.wavelet( fi );
+	    const int nw = w.size();
+	    const int nfft = cwt.n_conv_pow2;
+	    
+	    for (int wrapped=0; wrapped<2; wrapped++)
+	      {
+		const int shift = wrapped ? nw / 2 : 0;
+		std::vector<dcomp> x( nfft , dcomp(0,0) );
+		for (int j=0; j<nw; j++) x[ ( j - shift + nfft ) % nfft ] = w[j];
+		
+		FFT fft( nfft , nfft , 1 , FFT_FORWARD );
+		fft.apply( x );
+		const dcomp mx = MiscMath::max( fft.transform() );
+		const dcomp pk = cwt.peak( w , shift , nfft , cwt.fc[fi] );
+		
+		if ( std::abs( pk - mx ) > 1e-9 * std::abs( mx ) ) 
+		  {
+		    std::cerr << "CWT::peak() mismatch: sr " << sr << " fc " << cwt.fc[fi] 
+			      << ( alt ? " (alt)" : "" ) << ( wrapped ? " (wrapped)" : "" ) 
+			      << " " << pk << " vs " << mx << "\n";
+		    okay = false;
+		  }
+	      }
+	  }
+      }
+  
+  return okay;
+}
+
 
-  eegpower.resize( num_frex );
-  rawpower.resize( num_frex );
-  ph.resize( num_frex ); 
-  for (int i=0;i<num_frex;i++) 
+dcomp CWT::dft_bin( const std::vector<dcomp> & w , const int shift , const int nfft , const long k )
+{
+  // sum_j w[j] exp( -2 pi i (j-shift) k / nfft ), w/ exact phase reduction
+  const int nw = w.size();
+  dcomp s(0,0);
+  for (int j=0;j<nw;j++)
     {
-      eegpower[i].resize( num_pnts , 0 );
-      rawpower[i].resize( num_pnts , 0 );
-      ph[i].resize( num_pnts , 0 );
-      conv_complex.resize( num_frex );
+      long long e = ( (long long)( j - shift ) * k ) % nfft;
+      double a = -2 * M_PI * e / (double)nfft;
+      s += w[j] * dcomp( cos(a) , sin(a) );
     }
+  return s;
+}
 
-  const double SQRT_PI = sqrt(M_PI);
- 
-  int Ldata = data->size();
-
-  int Ltapr = time.size();
-
-  int Lconv1 = Ldata + Ltapr - 1;  
-
-  int Lconv  = MiscMath::nextpow2( Lconv1 );
-
-  // for wrapped wavelet
-  int middlePaddingLength = Lconv - Ltapr ;
-
-  int half1_idx = floor( Ltapr / 2 ) - 1 ;
-  int half2_idx = floor( Ltapr / 2 ) ;
 
-  // std::cout << " sizes : Ldata " << Ldata << "\n"
-  // 	    << " Ltapr " << Ltapr << "\n"
-  // 	    << " Lconv1 " << Lconv1 << "\n"
-  // 	    << " Lconv " << Lconv << "\n"
-  // 	    << " middlePaddingLength " << middlePaddingLength << "\n";
-  
-  // std::cout << "hh = " << half1_idx << " " << half1_idx << " " << Ltapr << "\n";
+void CWT::convolve( const bool wrapped , const int nfft_wrapped )
+{
   
-  //
-  // Initial FFT of data 
-  //
-      
-  FFT eegfft( data->size() , Lconv , srate );
-  eegfft.apply( *data );
-  std::vector<dcomp> eegfftX = eegfft.transform();
+  const int nd = data->size();
 
   //
-  // loop through frequencies and compute synchronization
+  // Generate wavelets: output i is conv[ i + offset ] of the full linear 
+  // convolution of data and wavelet
   //
 
+  std::vector<std::vector<dcomp> > w( num_frex );
+  std::vector<int> offset( num_frex );
+  std::vector<int> nfft( num_frex );
+  
+  int nw_max = 0 , off_max = 0;
+  
   for (int fi=0;fi<num_frex;fi++)
     {
       
       //
-      // Generate wavelet 
+      // Set timeline for this wavelet
       //
 
-      set_timeframe( 50.0 / wlen[fi] );
-
-      std::vector<dcomp> w0 = alt_wavelet(fi) ;
-      
-      //
-      // Wrap wavelet? ( second half, padding, first half )
-      //
-      
-      std::vector<dcomp> w( Lconv , dcomp(0,0) );
-      int cc = 0;
-      for (int i= half2_idx; i < Ltapr ; i++ ) w[ cc++ ] = w0[ i ];
-      // skip middle zeros
-      cc += middlePaddingLength;
-      for (int i= 0; i <= half1_idx ; i++ ) w[ cc++ ] = w0[ i ];
-      
-      // padded, unwrapped
-      // std::vector<dcomp> w( Lconv , dcomp(0,0) );
-      // for (int i= 0; i <= w0.size() ; i++ ) w[ i ] = w0[i];
-      
+      if ( ! alt_spec ) 
+	set_timeframe( fc[fi] );  
+      else
+	set_timeframe( 50.0 / wlen[fi] );
       
+      w[fi] = alt_spec ? alt_wavelet(fi) : wavelet(fi);
       
-      //
-      // FFT of wrapped wavelet
-      //
+      const int nw = w[fi].size();
       
-      FFT kernelFFT( w.size() , Lconv , 1 , FFT_FORWARD );
+      offset[fi] = wrapped ? nw / 2 : half_of_wavelet_size - 1;
 
-      kernelFFT.apply( w );
-
-      std::vector<dcomp> wt = kernelFFT.transform();
-
-      //
-      // Scaling factor to ensure similar amplitudes of original traces and wavelet-filtered signal
-      // kernelFFT = 2*kernelFFT./max(kernelFFT);
-      //
+      // size of the single, whole-signal FFT: sets the grid for wavelet scaling 
+      nfft[fi] = wrapped ? nfft_wrapped : n_conv_pow2;
+      
+      if ( nw > nw_max ) nw_max = nw;
+      if ( offset[fi] > off_max ) off_max = offset[fi];
+    }
+  
+  
+  //
+  // Overlap-save tiles of L points: each gives 'step' outputs, after
+  // the first P; a single tile if the signal is short.  Only conv[0..K-1]
+  // are needed
+  //
 
-      dcomp max = MiscMath::max( wt );
+  const int P = nw_max - 1;
+  const int K = nd + off_max;
 
-      for ( int i = 0 ; i < wt.size() ; i++ )
-       	wt[i] = ( dcomp( 2, 0 ) * wt[i] ) / max;
+  int L = MiscMath::nextpow2( 4 * nw_max );
+  if ( L < 65536 ) L = 65536;
+  if ( MiscMath::nextpow2( K + P ) < L ) L = MiscMath::nextpow2( K + P );
+  
+  const int step = L - P;
+  
+  fftw_plan p_fwd = fftw_cache::dft_1d( L , FFTW_FORWARD );
+  fftw_plan p_inv = fftw_cache::dft_1d( L , FFTW_BACKWARD );
+  fftw_plan p_r2c = fftw_cache::r2c_1d( L );
+  
 
+  //
+  // Wavelet spectra; scaling factor to ensure similar amplitudes of
+  // original traces and wavelet-filtered signal:
+  // kernelFFT = 2*kernelFFT./max(kernelFFT);
+  //
 
-      //
-      // Convolution in the frequency domain 
-      //
+  const size_t cbytes = sizeof(fftw_complex) * L;
+  
+  std::vector<fftw_complex*> wt( num_frex );
+  
+  luna_threads::parallel_for( num_frex , globals::n_threads , [&]( int fi ) {
       
-      std::vector<dcomp> y( Lconv );
-      for (int i=0; i<Lconv; i++)
-	y[i] = eegfftX[i] * wt[i]; 
+      const dcomp max = peak( w[fi] , wrapped ? w[fi].size() / 2 : 0 , nfft[fi] , fc[fi] );
       
-               
-      //
-      // Inverse FFT back to time-domain
-      //
-
-      FFT ifft( y.size() , Lconv , 1 , FFT_INVERSE );
-      ifft.apply( y );
-
-      // nb. using scaled transform here
-      std::vector<dcomp> eegconv = ifft.scaled_transform();
+      fftw_complex * in = (fftw_complex*)fftw_cache::alloc( cbytes );
+      wt[fi] = (fftw_complex*)fftw_cache::alloc( cbytes );
       
-      //
-      // Trim
-      // 
-
-      //  m = m(1:Lconv1);
-      eegconv.resize( Lconv1 );
+      const int nw = w[fi].size();
+      for (int i=0;i<L;i++) 
+	{
+	  in[i][0] = i < nw ? std::real( w[fi][i] ) : 0 ;
+	  in[i][1] = i < nw ? std::imag( w[fi][i] ) : 0 ;
+	}
       
-      // m = m(1:end-Ltapr+1);  
-      eegconv.resize( Lconv1 - Ltapr + 1 ); 
-	
+      fftw_execute_dft( p_fwd , in , wt[fi] );
+      
+      for (int i=0;i<L;i++)
+	{
+	  dcomp x = ( dcomp( 2, 0 ) * dcomp( wt[fi][i][0] , wt[fi][i][1] ) ) / max;
+	  wt[fi][i][0] = std::real( x );
+	  wt[fi][i][1] = std::imag( x );
+	}
+      
+      fftw_cache::release( in , cbytes );
 
-      //
-      // extract phase from the convolution
-      //
+    } );
+  
 
-      for (int i=0; i < Ldata ; i++)
-	ph[fi][i] = atan2( eegconv[i].imag() , eegconv[i].real() );
+  //
+  // Outputs (only those requested)
+  //
 
+  rawpower.assign( store_power ? num_frex : 0 , std::vector<double>() );
+  ph.assign( store_phase ? num_frex : 0 , std::vector<double>() );
+  conv_complex.assign( store_real_imag ? num_frex : 0 , std::vector<dcomp>() );
+  baseline.assign( num_frex , 1 );
 
-      //
-      // extract real/imag parts
-      //
+  for (int fi=0;fi<num_frex;fi++)
+    {
+      if ( store_power ) rawpower[fi].resize( num_pnts , 0 );
+      if ( store_phase ) ph[fi].resize( nd , 0 );
+      if ( store_real_imag ) conv_complex[fi].resize( nd );
+    }
+  
 
-      conv_complex[fi] = eegconv;
+  //
+  // Each tile: FFT of data (once), then for each wavelet, convolution
+  // in the frequency domain and inverse FFT (normalized by 1/L) back to
+  // the time-domain
+  //
+  
+  double * x = (double*)fftw_cache::alloc( sizeof(double) * L );
+  fftw_complex * X = (fftw_complex*)fftw_cache::alloc( cbytes );
+  
+  for (int k0 = 0 ; k0 < K ; k0 += step )
+    {
 
-      //
-      // wavelet power: abx(X)^2, dB/normalized and raw
-      //
+      for (int p=0;p<L;p++)
+	{
+	  const int idx = k0 - P + p;
+	  x[p] = idx >= 0 && idx < nd ? (*data)[ idx ] : 0 ;
+	}
       
-      for (int i=0;i<num_pnts;i++)
+      fftw_execute_dft_r2c( p_r2c , x , X );
+      
+      // negative frequencies, from conjugate symmetry
+      for (int k = L/2+1 ; k < L ; k++ )
 	{
-	  rawpower[fi][i] = pow( abs( eegconv[i] ) , 2 );
+	  X[k][0] = X[L-k][0];
+	  X[k][1] = - X[L-k][1];
 	}
+      
+      luna_threads::parallel_for( num_frex , globals::n_threads , [&]( int fi ) {
+	  
+	  fftw_complex * y = (fftw_complex*)fftw_cache::alloc( cbytes );
+	  fftw_complex * z = (fftw_complex*)fftw_cache::alloc( cbytes );
+	  
+	  for (int i=0;i<L;i++)
+	    {
+	      dcomp c = dcomp( X[i][0] , X[i][1] ) * dcomp( wt[fi][i][0] , wt[fi][i][1] );
+	      y[i][0] = std::real( c );
+	      y[i][1] = std::imag( c );
+	    }
+	  
+	  fftw_execute_dft( p_inv , y , z );
+	  
+	  const double fac = 1.0 / (double)L;
+	  
+	  for (int q = 0 ; q < step ; q++ )
+	    {
+	      const int i = k0 + q - offset[fi];
+	      if ( i < 0 ) continue;
+	      if ( i >= nd ) break;
+	      
+	      const dcomp c( z[P+q][0] * fac , z[P+q][1] * fac );
+	      
+	      if ( store_phase ) 
+		ph[fi][i] = atan2( c.imag() , c.real() );
+	      
+	      if ( store_real_imag )
+		conv_complex[fi][i] = c;
+	      
+	      // abs(X)^2, summed over trials
+	      if ( store_power )
+		rawpower[fi][ i % num_pnts ] += pow( abs( c ) , 2 );
+	    }
+	  
+	  fftw_cache::release( y , cbytes );
+	  fftw_cache::release( z , cbytes );
+	  
+	} );
+      
+    }
+  
+  fftw_cache::release( x , sizeof(double) * L );
+  fftw_cache::release( X , cbytes );
+  
+  for (int fi=0;fi<num_frex;fi++)
+    fftw_cache::release( wt[fi] , cbytes );
 
-      //
-      // Baseline normalized
-      //
-
-      double baseline = MiscMath::mean( rawpower[fi] );
 
-      // i.e. express as dB over entire night, i.e. 10log10(ratio)
-      for (int i=0; i<num_pnts; i++) eegpower[fi][i] = 10*log10( rawpower[fi][i]/baseline );
-        
+  //
+  // Average power over trials, and get the baseline (mean over all
+  // time-points) for dB normalization 
+  //
 
-      //
-      // next frequency/wavelet
-      //
-    }
-    
+  if ( store_power )
+    for (int fi=0;fi<num_frex;fi++)
+      {
+	if ( num_trials > 1 ) 
+	  for (int i=0; i<num_pnts; i++) rawpower[fi][i] /= (double)num_trials;
+	
+	double b = 0;
+	for (int i=0; i<num_pnts; i++) b += rawpower[fi][i];
+	baseline[fi] = b / (double)num_pnts;
+      }
+  
 }
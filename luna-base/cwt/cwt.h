@@ -164,15 +164,41 @@ class CWT {
   double freq(const int fi) const { return fc[fi]; }
   int    points() const { return num_pnts; }
   int    freqs() const { return num_frex; }
-  double result(const int fi, const int ti) const { return eegpower[fi][ti]; }
-  double raw_result(const int fi, const int ti) const { return rawpower[fi][ti]; }
-  const std::vector<double> & results(const int fi) const { return rawpower[fi]; }
+
+  // baseline-normalized (dB) and raw power
+  double result(const int fi, const int ti) const 
+  { 
+    if ( ! store_power ) Helper::halt( "CWT power not stored" );
+    return 10*log10( rawpower[fi][ti] / baseline[fi] ); 
+  }
+  double raw_result(const int fi, const int ti) const 
+  { 
+    if ( ! store_power ) Helper::halt( "CWT power not stored" );
+    return rawpower[fi][ti]; 
+  }
+  const std::vector<double> & results(const int fi) const 
+  { 
+    if ( ! store_power ) Helper::halt( "CWT power not stored" );
+    return rawpower[fi]; 
+  }
 
   // same as above 'results' function
 
-  std::vector<double> amplitude(const int fi) const { return rawpower[fi]; }
-  std::vector<double> phase(const int fi) const { return ph[fi]; }
-  std::vector<dcomp> get_complex( const int fi ) { return conv_complex[fi] ; } 
+  std::vector<double> amplitude(const int fi) const 
+  { 
+    if ( ! store_power ) Helper::halt( "CWT power not stored" );
+    return rawpower[fi]; 
+  }
+  std::vector<double> phase(const int fi) const 
+  { 
+    if ( ! store_phase ) Helper::halt( "CWT phase not stored" );
+    return ph[fi]; 
+  }
+  std::vector<dcomp> get_complex( const int fi ) 
+  { 
+    if ( ! store_real_imag ) Helper::halt( "CWT complex values not stored" );
+    return conv_complex[fi] ; 
+  } 
 
   
   //
@@ -187,12 +213,22 @@ class CWT {
   // options
   //
 
+  // which outputs run() keeps (default: power and phase); 
+  // arrays not requested are never allocated
+
   void store_real_imag_vectors( const int b ) { store_real_imag = b; } 
 
+  void store_power_vectors( const bool b ) { store_power = b; } 
+
+  void store_phase_vectors( const bool b ) { store_phase = b; } 
+
   void use_alt() { alt_spec = true; }
 
   void alt_timeline( double t ) { set_timeframe( 50.0 / t ); }
 
+  // spectral peak (wavelet scaling) vs the full FFT (-d cwt-peak)
+  static bool selftest();
+
   
  private:
   
@@ -256,16 +292,19 @@ class CWT {
 
 
   //
-  // Transformation (output)
+  // Transformation (output): raw power, and the mean power (per
+  // wavelet) that result() normalizes by
   //
 
-  std::vector<std::vector<double> > eegpower;
+  bool store_power;
   std::vector<std::vector<double> > rawpower;
+  std::vector<double> baseline;
 
   //
   // Phase information (output)
   //
 
+  bool store_phase;
   std::vector<std::vector<double> > ph; 
 
   //
@@ -274,6 +313,17 @@ class CWT {
 
   bool store_real_imag;
   std::vector<std::vector<dcomp> > conv_complex; 
+
+  //
+  // Convolution engine: data FFT'ed once (per overlap-save tile),
+  // times each wavelet's spectrum, inverse FFTs over threads
+  //
+  
+  void convolve( const bool wrapped , const int nfft_wrapped );
+
+  dcomp peak( const std::vector<dcomp> & w , const int shift , const int nfft , const double f ) const;
+
+  static dcomp dft_bin( const std::vector<dcomp> & w , const int shift , const int nfft , const long k );
   
   //
   // Misc
@@ -288,9 +338,12 @@ class CWT {
     fb.clear();
     srate = 0;
     num_pnts = num_trials = 1;
-    eegpower.clear();
     rawpower.clear();
+    baseline.clear();
+    ph.clear();
     conv_complex.clear();
+    store_power = true;
+    store_phase = true;
     store_real_imag = false;
   }
   
@@ -0,0 +1,628 @@
+//    --------------------------------------------------------------------
+//
+//    This file is part of Luna.
+//
+//    LUNA is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    Luna is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Luna. If not, see <http://www.gnu.org/licenses/>.
+//
+//    Please see LICENSE.txt for more details.
+//
+//    --------------------------------------------------------------------
+
+#include "db/colstore.h"
+
+#include "helper/helper.h"
+
+#include <zlib.h>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+
+static const char * colstore_magic = "LUNACOL1";
+static const int colstore_magic_len = 8;
+static const int colstore_trailer_len = 8 + 4 + 4 + 8;
+
+
+//
+// (de)serialisation helpers
+//
+
+static void put_u8( std::string & b , const uint8_t x ) { b.push_back( (char)x ); }
+static void put_u32( std::string & b , const uint32_t x ) { b.append( (const char*)&x , 4 ); }
+static void put_u64( std::string & b , const uint64_t x ) { b.append( (const char*)&x , 8 ); }
+static void put_dbl( std::string & b , const double x ) { b.append( (const char*)&x , 8 ); }
+static void put_str( std::string & b , const std::string & s ) { put_u32( b , s.size() ); b.append( s ); }
+
+// a double as text, without loss (i.e. %.17g, unless %.15g reads back
+// exactly): for doubles held in text (mixed-type) columns
+static std::string dbl2txt( const double d )
+{
+  char buf[32];
+  snprintf( buf , sizeof buf , "%.15g" , d );
+  if ( strtod( buf , NULL ) != d ) snprintf( buf , sizeof buf , "%.17g" , d );
+  return buf;
+}
+
+struct colstore_cursor_t
+{
+  colstore_cursor_t( const std::string & b ) : b(b) , p(0) { }
+  const std::string & b;
+  size_t p;
+  void need( const size_t n ) { if ( p + n > b.size() ) Helper::halt( "corrupt columnar file (truncated block)" ); }
+  uint8_t u8() { need(1); return (uint8_t)b[p++]; }
+  uint32_t u32() { uint32_t x; need(4); memcpy( &x , b.data() + p , 4 ); p += 4; return x; }
+  uint64_t u64() { uint64_t x; need(8); memcpy( &x , b.data() + p , 8 ); p += 8; return x; }
+  double dbl() { double x; need(8); memcpy( &x , b.data() + p , 8 ); p += 8; return x; }
+  std::string str() { const uint32_t n = u32(); need(n); std::string s( b , p , n ); p += n; return s; }
+};
+
+static std::string colstore_compress( const std::string & u )
+{
+  uLongf clen = compressBound( u.size() );
+  std::string c( clen , '\0' );
+  if ( compress2( (Bytef*)&c[0] , &clen , (const Bytef*)u.data() , u.size() , Z_DEFAULT_COMPRESSION ) != Z_OK )
+    Helper::halt( "problem compressing columnar chunk" );
+  c.resize( clen );
+  return c;
+}
+
+static std::string colstore_uncompress( const std::vector<char> & c , const uint32_t ulen )
+{
+  std::string u( ulen , '\0' );
+  uLongf len = ulen;
+  if ( uncompress( (Bytef*)&u[0] , &len , (const Bytef*)c.data() , c.size() ) != Z_OK || len != ulen )
+    Helper::halt( "corrupt columnar file (could not decompress block)" );
+  return u;
+}
+
+
+//
+// colstore_column_t
+//
+
+void colstore_column_t::resize( const int n )
+{
+  present.resize( n , 0 );
+  if ( type == COL_TXT ) txt.resize( n );
+  else num.resize( n , 0 );
+}
+
+void colstore_column_t::set_int( const int r , const int i )
+{
+  if ( type == COL_TXT ) { txt[r] = Helper::int2str( i ); present[r] = 1; return; }
+  if ( type == COL_NA ) type = COL_INT;
+  num[r] = i;
+  present[r] = 1;
+}
+
+void colstore_column_t::set_dbl( const int r , const double d )
+{
+  if ( type == COL_TXT )
+    {
+      txt[r] = dbl2txt( d );
+      present[r] = 1;
+      return;
+    }
+  type = COL_DBL;
+  num[r] = d;
+  present[r] = 1;
+}
+
+void colstore_column_t::set_txt( const int r , const std::string & s )
+{
+  if ( type != COL_TXT ) promote_to_txt();
+  txt[r] = s;
+  present[r] = 1;
+}
+
+void colstore_column_t::promote_to_txt()
+{
+  // mixed types: keep as text (doubles at full precision)
+  const int n = present.size();
+  txt.resize( n );
+  for (int r=0;r<n;r++)
+    if ( present[r] ) txt[r] = type == COL_DBL ? dbl2txt( num[r] ) : str( r );
+  num.clear();
+  type = COL_TXT;
+}
+
+std::string colstore_column_t::str( const int r ) const
+{
+  if ( ! present[r] ) return "NA";
+  if ( type == COL_TXT ) return txt[r];
+  std::stringstream ss;
+  if ( type == COL_INT ) ss << (int)num[r];
+  else ss << num[r];
+  return ss.str();
+}
+
+
+//
+// colstore_table_t
+//
+
+int colstore_table_t::row( const std::vector<std::string> & l )
+{
+  std::string k;
+  for (int f=0;f<l.size();f++) { k += l[f]; k.push_back( '\0' ); }
+
+  std::unordered_map<std::string,int>::const_iterator rr = rowidx.find( k );
+  if ( rr != rowidx.end() ) return rr->second;
+
+  for (int f=0;f<l.size();f++) lvls[f].push_back( l[f] );
+  for (int v=0;v<cols.size();v++) cols[v].resize( nrows + 1 );
+  rowidx[ k ] = nrows;
+  return nrows++;
+}
+
+int colstore_table_t::col( const std::string & v )
+{
+  std::map<std::string,int>::const_iterator cc = colidx.find( v );
+  if ( cc != colidx.end() ) return cc->second;
+  const int c = vars.size();
+  vars.push_back( v );
+  cols.resize( c + 1 );
+  cols[c].resize( nrows );
+  colidx[ v ] = c;
+  return c;
+}
+
+void colstore_table_t::clear()
+{
+  nrows = 0;
+  vars.clear();
+  cols.clear();
+  for (int f=0;f<lvls.size();f++) lvls[f].clear();
+  rowidx.clear();
+  colidx.clear();
+}
+
+
+//
+// colstore_chunk_t
+//
+
+bool colstore_chunk_t::may_include( const std::string & f , const std::set<std::string> & l ) const
+{
+  for (int i=0;i<facs.size();i++)
+    {
+      if ( facs[i] != f ) continue;
+      if ( ! complete[i] ) return true;
+      std::set<std::string>::const_iterator ll = l.begin();
+      while ( ll != l.end() )
+	{
+	  if ( lvls[i].find( *ll ) != lvls[i].end() ) return true;
+	  ++ll;
+	}
+      return false;
+    }
+  return false;
+}
+
+
+//
+// colstore_writer_t
+//
+
+colstore_writer_t::colstore_writer_t( const std::string & filename )
+  : filename( filename ) , pos( 0 )
+{
+  OUT.open( filename.c_str() , std::ios::out | std::ios::binary | std::ios::trunc );
+  if ( ! OUT.good() ) Helper::halt( "could not open " + filename + " for writing" );
+  OUT.write( colstore_magic , colstore_magic_len );
+  pos = colstore_magic_len;
+}
+
+colstore_table_t * colstore_writer_t::table( const std::string & indiv ,
+					     const std::string & cmd ,
+					     const std::vector<std::string> & facs )
+{
+  std::string k = indiv;
+  k.push_back( '\0' );
+  k += cmd;
+  for (int f=0;f<facs.size();f++) { k.push_back( '\0' ); k += facs[f]; }
+
+  std::map<std::string,colstore_table_t>::iterator tt = tables.find( k );
+  if ( tt != tables.end() ) return &tt->second;
+
+  colstore_table_t & t = tables[ k ];
+  t.indiv = indiv;
+  t.cmd = cmd;
+  t.facs = facs;
+  t.lvls.resize( facs.size() );
+  return &t;
+}
+
+void colstore_writer_t::flush()
+{
+  std::map<std::string,colstore_table_t>::iterator tt = tables.begin();
+  while ( tt != tables.end() )
+    {
+      write_chunk( tt->second );
+      ++tt;
+    }
+  tables.clear();
+}
+
+void colstore_writer_t::write_chunk( colstore_table_t & t )
+{
+
+  if ( t.nrows == 0 ) return;
+
+  colstore_chunk_t c;
+  c.nrows = t.nrows;
+  c.indiv = t.indiv;
+  c.cmd = t.cmd;
+  c.facs = t.facs;
+  c.vars = t.vars;
+  c.lvls.resize( t.facs.size() );
+  c.complete.resize( t.facs.size() , 1 );
+
+  std::string b;
+  put_u32( b , t.nrows );
+
+  for (int f=0;f<t.facs.size();f++)
+    for (int r=0;r<t.nrows;r++)
+      {
+	put_str( b , t.lvls[f][r] );
+	if ( c.complete[f] )
+	  {
+	    c.lvls[f].insert( t.lvls[f][r] );
+	    if ( c.lvls[f].size() > max_levels ) { c.complete[f] = 0; c.lvls[f].clear(); }
+	  }
+      }
+
+  for (int v=0;v<t.vars.size();v++)
+    {
+      const colstore_column_t & col = t.cols[v];
+      put_u8( b , col.type );
+
+      // null bitmap
+      std::string bits( ( t.nrows + 7 ) / 8 , '\0' );
+      for (int r=0;r<t.nrows;r++)
+	if ( col.present[r] ) bits[ r / 8 ] |= 1 << ( r % 8 );
+      b += bits;
+
+      if ( col.type == colstore_column_t::COL_INT )
+	for (int r=0;r<t.nrows;r++) put_u32( b , (uint32_t)(int32_t)col.num[r] );
+      else if ( col.type == colstore_column_t::COL_DBL )
+	for (int r=0;r<t.nrows;r++) put_dbl( b , col.num[r] );
+      else if ( col.type == colstore_column_t::COL_TXT )
+	for (int r=0;r<t.nrows;r++) put_str( b , col.txt[r] );
+    }
+
+  const std::string z = colstore_compress( b );
+
+  c.offset = pos;
+  c.clen = z.size();
+  c.ulen = b.size();
+
+  OUT.write( z.data() , z.size() );
+  pos += z.size();
+
+  index.push_back( c );
+
+  t.clear();
+}
+
+void colstore_writer_t::append( const std::string & f )
+{
+  flush();
+
+  colstore_reader_t reader( f );
+  std::vector<char> b;
+
+  for (int i=0;i<reader.index.size();i++)
+    {
+      colstore_chunk_t c = reader.index[i];
+      reader.read_raw( c , &b );
+      OUT.write( b.data() , b.size() );
+      c.offset = pos;
+      pos += b.size();
+      index.push_back( c );
+    }
+}
+
+void colstore_writer_t::close()
+{
+
+  if ( ! OUT.is_open() ) return;
+
+  flush();
+
+  std::string b;
+  put_u32( b , index.size() );
+
+  for (int i=0;i<index.size();i++)
+    {
+      const colstore_chunk_t & c = index[i];
+      put_u64( b , c.offset );
+      put_u32( b , c.clen );
+      put_u32( b , c.ulen );
+      put_u32( b , c.nrows );
+      put_str( b , c.indiv );
+      put_str( b , c.cmd );
+      put_u32( b , c.facs.size() );
+      for (int f=0;f<c.facs.size();f++)
+	{
+	  put_str( b , c.facs[f] );
+	  put_u8( b , c.complete[f] );
+	  if ( ! c.complete[f] ) continue;
+	  put_u32( b , c.lvls[f].size() );
+	  std::set<std::string>::const_iterator ll = c.lvls[f].begin();
+	  while ( ll != c.lvls[f].end() ) { put_str( b , *ll ); ++ll; }
+	}
+      put_u32( b , c.vars.size() );
+      for (int v=0;v<c.vars.size();v++) put_str( b , c.vars[v] );
+    }
+
+  const std::string z = colstore_compress( b );
+  OUT.write( z.data() , z.size() );
+
+  std::string t;
+  put_u64( t , pos );
+  put_u32( t , z.size() );
+  put_u32( t , b.size() );
+  t.append( colstore_magic , colstore_magic_len );
+  OUT.write( t.data() , t.size() );
+
+  OUT.close();
+  index.clear();
+}
+
+
+//
+// colstore_reader_t
+//
+
+bool colstore_reader_t::is_colstore( const std::string & filename )
+{
+  std::ifstream IN1( filename.c_str() , std::ios::in | std::ios::binary );
+  char m[ colstore_magic_len ];
+  IN1.read( m , colstore_magic_len );
+  return IN1.good() && memcmp( m , colstore_magic , colstore_magic_len ) == 0;
+}
+
+colstore_reader_t::colstore_reader_t( const std::string & filename )
+  : filename( filename )
+{
+
+  IN.open( filename.c_str() , std::ios::in | std::ios::binary );
+  if ( ! IN.good() ) Helper::halt( "could not open " + filename );
+
+  IN.seekg( 0 , std::ios::end );
+  const std::streamoff fsize = IN.tellg();
+  if ( fsize < colstore_magic_len + colstore_trailer_len )
+    Helper::halt( "corrupt or incomplete columnar file " + filename );
+
+  std::string t( colstore_trailer_len , '\0' );
+  IN.seekg( fsize - colstore_trailer_len );
+  IN.read( &t[0] , colstore_trailer_len );
+  if ( memcmp( t.data() + 16 , colstore_magic , colstore_magic_len ) != 0 )
+    Helper::halt( "corrupt or incomplete columnar file (no footer) " + filename );
+
+  colstore_cursor_t tc( t );
+  const uint64_t foffset = tc.u64();
+  const uint32_t fclen = tc.u32();
+  const uint32_t fulen = tc.u32();
+
+  std::vector<char> z( fclen );
+  IN.seekg( foffset );
+  IN.read( z.data() , fclen );
+  if ( ! IN.good() ) Helper::halt( "problem reading footer of " + filename );
+
+  const std::string b = colstore_uncompress( z , fulen );
+  colstore_cursor_t bc( b );
+
+  const uint32_t n = bc.u32();
+  index.resize( n );
+  for (int i=0;i<n;i++)
+    {
+      colstore_chunk_t & c = index[i];
+      c.offset = bc.u64();
+      c.clen = bc.u32();
+      c.ulen = bc.u32();
+      c.nrows = bc.u32();
+      c.indiv = bc.str();
+      c.cmd = bc.str();
+      const uint32_t nf = bc.u32();
+      c.facs.resize( nf );
+      c.lvls.resize( nf );
+      c.complete.resize( nf );
+      for (int f=0;f<nf;f++)
+	{
+	  c.facs[f] = bc.str();
+	  c.complete[f] = bc.u8();
+	  if ( ! c.complete[f] ) continue;
+	  const uint32_t nl = bc.u32();
+	  for (int l=0;l<nl;l++) c.lvls[f].insert( bc.str() );
+	}
+      const uint32_t nv = bc.u32();
+      c.vars.resize( nv );
+      for (int v=0;v<nv;v++) c.vars[v] = bc.str();
+    }
+}
+
+void colstore_reader_t::read_raw( const colstore_chunk_t & c , std::vector<char> * b )
+{
+  b->resize( c.clen );
+  IN.seekg( c.offset );
+  IN.read( b->data() , c.clen );
+  if ( ! IN.good() ) Helper::halt( "problem reading chunk from " + filename );
+}
+
+void colstore_reader_t::read( const colstore_chunk_t & c , colstore_table_t * t )
+{
+
+  std::vector<char> z;
+  read_raw( c , &z );
+  const std::string b = colstore_uncompress( z , c.ulen );
+  colstore_cursor_t bc( b );
+
+  t->clear();
+  t->indiv = c.indiv;
+  t->cmd = c.cmd;
+  t->facs = c.facs;
+  t->vars = c.vars;
+
+  const int n = bc.u32();
+  t->nrows = n;
+
+  t->lvls.resize( c.facs.size() );
+  for (int f=0;f<c.facs.size();f++)
+    {
+      t->lvls[f].resize( n );
+      for (int r=0;r<n;r++) t->lvls[f][r] = bc.str();
+    }
+
+  t->cols.resize( c.vars.size() );
+  for (int v=0;v<c.vars.size();v++)
+    {
+      colstore_column_t & col = t->cols[v];
+      col.type = bc.u8();
+      col.resize( n );
+
+      const int nb = ( n + 7 ) / 8;
+      bc.need( nb );
+      for (int r=0;r<n;r++)
+	col.present[r] = ( b[ bc.p + r / 8 ] >> ( r % 8 ) ) & 1;
+      bc.p += nb;
+
+      if ( col.type == colstore_column_t::COL_INT )
+	for (int r=0;r<n;r++) col.num[r] = (int32_t)bc.u32();
+      else if ( col.type == colstore_column_t::COL_DBL )
+	for (int r=0;r<n;r++) col.num[r] = bc.dbl();
+      else if ( col.type == colstore_column_t::COL_TXT )
+	for (int r=0;r<n;r++) col.txt[r] = bc.str();
+    }
+}
+
+bool colstore_reader_t::selftest( const std::string & filename )
+{
+
+  // expected value (as str()) for each indiv/cmd/levels/var
+  std::map<std::string,std::string> expected;
+
+  const int nf = 5000;
+  int nchunks = 0;
+  
+  {
+    colstore_writer_t writer( filename );
+    
+    for (int i=0;i<2;i++)
+      {
+	const std::string indiv = "id" + Helper::int2str( i + 1 );
+
+	// one multi-chunk table, CH x F
+	std::vector<std::string> facs( 2 );
+	facs[0] = "CH"; facs[1] = "F";
+	std::vector<std::string> lvls( 2 );
+	for (int ch=0;ch<4;ch++)
+	  for (int f=0;f<nf;f++)
+	    {
+	      colstore_table_t * t = writer.table( indiv , "PSD" , facs );
+	      writer.done( t );
+	      lvls[0] = "C" + Helper::int2str( ch + 1 );
+	      lvls[1] = Helper::int2str( f );
+	      const int r = t->row( lvls );
+	      const double x = ( i + 1 ) * 0.5 + f / 4.0;
+	      t->cols[ t->col( "PSD" ) ].set_dbl( r , x );
+	      expected[ indiv + "/PSD/" + lvls[0] + "/" + lvls[1] + "/PSD" ] = t->cols[ t->col( "PSD" ) ].str( r );
+	    }
+	
+	// a small table, CH only: int, double, text, mixed and missing
+	// values, and a variable name shared with PSD
+	facs.resize( 1 );
+	lvls.resize( 1 );
+	colstore_table_t * t = writer.table( indiv , "STATS" , facs );
+	for (int ch=0;ch<4;ch++)
+	  {
+	    lvls[0] = "C" + Helper::int2str( ch + 1 );
+	    const int r = t->row( lvls );
+	    const std::string k = indiv + "/STATS/" + lvls[0] + "/";
+	    t->cols[ t->col( "N" ) ].set_int( r , ch * 100 - 7 );
+	    expected[ k + "N" ] = Helper::int2str( ch * 100 - 7 );
+	    t->cols[ t->col( "PSD" ) ].set_dbl( r , ch + 0.125 );
+	    expected[ k + "PSD" ] = t->cols[ t->col( "PSD" ) ].str( r );
+	    t->cols[ t->col( "LAB" ) ].set_txt( r , "lab " + lvls[0] );
+	    expected[ k + "LAB" ] = "lab " + lvls[0];
+	    if ( ch % 2 ) { t->cols[ t->col( "MIX" ) ].set_txt( r , "x" ); expected[ k + "MIX" ] = "x"; }
+	    else { t->cols[ t->col( "MIX" ) ].set_int( r , ch ); expected[ k + "MIX" ] = Helper::int2str( ch ); }
+	    // doubles before (promoted) and after a column becomes text
+	    const double dx = ch + 1.0 / 3.0;
+	    if ( ch % 2 ) { t->cols[ t->col( "MIXD" ) ].set_txt( r , "y" ); expected[ k + "MIXD" ] = "y"; }
+	    else { t->cols[ t->col( "MIXD" ) ].set_dbl( r , dx ); expected[ k + "MIXD" ] = dbl2txt( dx ); }
+	    if ( ch != 2 ) { t->cols[ t->col( "MISS" ) ].set_dbl( r , -1.5 ); expected[ k + "MISS" ] = "-1.5"; }
+	    else { t->col( "MISS" ); expected[ k + "MISS" ] = "NA"; }
+	  }
+      }
+
+    // flush + footer
+    writer.close();
+  }
+
+  //
+  // read back
+  //
+
+  bool okay = true;
+  
+  std::map<std::string,std::string> observed;
+  
+  {
+    colstore_reader_t reader( filename );
+    
+    colstore_table_t t;
+    
+    for (int i=0;i<reader.index.size();i++)
+      {
+	const colstore_chunk_t & c = reader.index[i];
+	reader.read( c , &t );
+	++nchunks;
+	
+	if ( t.nrows != c.nrows || t.vars != c.vars || t.facs != c.facs ) okay = false;
+	
+	// level pushdown must never exclude a chunk that has the level
+	for (int f=0;f<c.facs.size();f++)
+	  for (int r=0;r<t.nrows;r++)
+	    if ( ! c.may_include( c.facs[f] , std::set<std::string>( &t.lvls[f][r] , &t.lvls[f][r] + 1 ) ) ) okay = false;
+	
+	if ( c.facs.size() && c.facs[0] == "CH" && c.may_include( "CH" , std::set<std::string>( &c.cmd , &c.cmd + 1 ) ) ) okay = false;
+	
+	for (int r=0;r<t.nrows;r++)
+	  {
+	    std::string k = t.indiv + "/" + t.cmd + "/";
+	    for (int f=0;f<t.facs.size();f++) k += t.lvls[f][r] + "/";
+	    for (int v=0;v<t.vars.size();v++)
+	      {
+		if ( observed.find( k + t.vars[v] ) != observed.end() ) okay = false;
+		observed[ k + t.vars[v] ] = t.cols[v].str( r );
+	      }
+	  }
+      }
+  }
+
+  // PSD tables should span more than one chunk each
+  if ( nchunks <= 4 ) okay = false;
+  
+  if ( observed != expected ) okay = false;
+
+  // and such doubles read back exactly, but are not padded
+  if ( strtod( dbl2txt( 1.0 / 3.0 ).c_str() , NULL ) != 1.0 / 3.0 || dbl2txt( 0.1 ) != "0.1" ) okay = false;
+
+  remove( filename.c_str() );
+
+  return okay;
+  
+}
@@ -0,0 +1,219 @@
+//    --------------------------------------------------------------------
+//
+//    This file is part of Luna.
+//
+//    LUNA is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    Luna is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Luna. If not, see <http://www.gnu.org/licenses/>.
+//
+//    Please see LICENSE.txt for more details.
+//
+//    --------------------------------------------------------------------
+
+#ifndef __LUNA_COLSTORE_H__
+#define __LUNA_COLSTORE_H__
+
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <unordered_map>
+#include <fstream>
+#include <stdint.h>
+
+//
+// Columnar output store (luna -c file ; read by destrat)
+//
+// One 'table' is an individual x command x set of factors, as for the
+// -t text-tables.  Each table is buffered and written as one or more
+// zlib-compressed chunks, with one (string) column per factor and one
+// typed column per variable (int, double or text, with a null bitmap)
+//
+// File layout:
+//
+//   "LUNACOL1" | chunk | chunk | ... | footer | trailer
+//
+// where the (compressed) footer indexes every chunk (offset, sizes,
+// individual, command, factors, variables and, for factors with up to
+// max_levels distinct values, the levels present), and the trailer is
+// the footer offset (u64), compressed and raw sizes (u32) and the magic
+// string again.  Readers load only the footer, and can then skip whole
+// chunks based on individual, command, factors, levels or variables
+// without decompressing them.  Integers are stored in native byte order.
+//
+
+struct colstore_column_t
+{
+
+  enum { COL_NA = 0 , COL_INT = 1 , COL_DBL = 2 , COL_TXT = 3 };
+
+  colstore_column_t() : type( COL_NA ) { }
+
+  // widest type seen so far: NA < INT < DBL < TXT
+  int type;
+
+  std::vector<char> present;
+  std::vector<double> num;  // INT and DBL
+  std::vector<std::string> txt;
+
+  int size() const { return present.size(); }
+  void resize( const int n );
+
+  void set_int( const int r , const int i );
+  void set_dbl( const int r , const double d );
+  void set_txt( const int r , const std::string & s );
+
+  bool missing( const int r ) const { return ! present[r]; }
+
+  // as value_t::str(), i.e. "NA" if missing
+  std::string str( const int r ) const;
+
+ private:
+
+  void promote_to_txt();
+
+};
+
+
+struct colstore_table_t
+{
+
+  colstore_table_t() : nrows(0) { }
+
+  std::string indiv;
+  std::string cmd;
+  std::vector<std::string> facs;
+  std::vector<std::string> vars;
+
+  int nrows;
+
+  // [fac][row] and [var][row]
+  std::vector<std::vector<std::string> > lvls;
+  std::vector<colstore_column_t> cols;
+
+  // writer: find/add a row (by the levels of all factors, in facs[] order)
+  // and a variable column
+  int row( const std::vector<std::string> & l );
+  int col( const std::string & v );
+
+  void clear();
+
+ private:
+
+  std::unordered_map<std::string,int> rowidx;
+  std::map<std::string,int> colidx;
+
+};
+
+
+struct colstore_chunk_t
+{
+
+  uint64_t offset;
+  uint32_t clen;
+  uint32_t ulen;
+  uint32_t nrows;
+
+  std::string indiv;
+  std::string cmd;
+  std::vector<std::string> facs;
+  std::vector<std::string> vars;
+
+  // distinct levels per factor, only if complete[f]
+  std::vector<std::set<std::string> > lvls;
+  std::vector<char> complete;
+
+  // F if this chunk cannot contain any of the levels 'l' of factor 'f'
+  bool may_include( const std::string & f , const std::set<std::string> & l ) const;
+
+};
+
+
+class colstore_writer_t
+{
+
+ public:
+
+  colstore_writer_t( const std::string & filename );
+
+  ~colstore_writer_t() { close(); }
+
+  // get (buffered) table; a full table is written out as a chunk
+  // by the caller, via done()
+  colstore_table_t * table( const std::string & indiv ,
+			    const std::string & cmd ,
+			    const std::vector<std::string> & facs );
+
+  void done( colstore_table_t * t ) { if ( t->nrows >= chunk_rows ) write_chunk( *t ); }
+
+  // write all buffered tables as chunks
+  void flush();
+
+  // copy all chunks (without recompressing) from another file
+  void append( const std::string & filename );
+
+  // flush, then write footer and trailer
+  void close();
+
+  std::string name() const { return filename; }
+
+  static const int chunk_rows = 16384;
+
+  static const int max_levels = 256;
+
+ private:
+
+  std::string filename;
+
+  std::ofstream OUT;
+
+  uint64_t pos;
+
+  std::map<std::string,colstore_table_t> tables;
+
+  std::vector<colstore_chunk_t> index;
+
+  void write_chunk( colstore_table_t & t );
+
+};
+
+
+class colstore_reader_t
+{
+
+ public:
+
+  static bool is_colstore( const std::string & filename );
+
+  // reads footer index
+  colstore_reader_t( const std::string & filename );
+
+  std::vector<colstore_chunk_t> index;
+
+  // decompress and decode one chunk
+  void read( const colstore_chunk_t & c , colstore_table_t * t );
+
+  // raw (compressed) bytes of one chunk
+  void read_raw( const colstore_chunk_t & c , std::vector<char> * b );
+
+  // write, read back and compare a small store (-d colstore)
+  static bool selftest( const std::string & filename );
+
+ private:
+
+  std::string filename;
+
+  std::ifstream IN;
+
+};
+
+#endif
@@ -20,6 +20,7 @@
 //    --------------------------------------------------------------------
 
 #include "db.h"
+#include "db/colstore.h"
 
 #include <iostream>
 #include <set>
@@ -361,6 +362,7 @@ void StratOutDBase::read_all( writer_t * w )
       indiv_t indiv;
       indiv.indiv_id = sql.get_int( stmt_dump_individuals , 0 );
       indiv.indiv_name = sql.get_text( stmt_dump_individuals , 1 );
+      indiv.file_name = sql.get_text( stmt_dump_individuals , 2 );
       w->individuals[ indiv.indiv_id ] = indiv;
       w->individuals_idmap[ indiv.indiv_name ] = indiv.indiv_id;
     }
@@ -480,6 +482,7 @@ void StratOutDBase::read_all( writer_t * w )
   //
 
   w->strata_idmap.clear();
+  w->strata_hashmap.clear();
   std::map<int,strata_t>::const_iterator ss = w->strata.begin();
   while ( ss != w->strata.end() )
     {
@@ -610,12 +613,21 @@ bool StratOutDBase::init()
   stmt_insert_value   = sql.prepare(" INSERT OR REPLACE INTO datapoints ( indiv_id, cmd_id, variable_id, strata_id, timepoint_id, value ) "
 				    " values( :indiv_id, :cmd_id, :variable_id, :strata_id, :timepoint_id, :value ) ; ");  
 
+  std::string q = " INSERT OR REPLACE INTO datapoints ( indiv_id, cmd_id, variable_id, strata_id, timepoint_id, value ) values ";
+  for (int r=0; r<insert_batch; r++)
+    q += r ? ", (?,?,?,?,?,?)" : "(?,?,?,?,?,?)";
+  q += " ; ";
+  stmt_insert_values = sql.prepare( q );
+
   return true;
 }
 
 bool StratOutDBase::release()
 {
 
+  // write any pending datapoints before the statements go
+  flush();
+
   sql.finalise( stmt_insert_indiv );
   sql.finalise( stmt_insert_factor );   
   sql.finalise( stmt_insert_level);    
@@ -624,6 +636,7 @@ bool StratOutDBase::release()
   sql.finalise( stmt_insert_variable); 
   sql.finalise( stmt_insert_timepoint);    
   sql.finalise( stmt_insert_value);    
+  sql.finalise( stmt_insert_values);    
 
   sql.finalise( stmt_dump_factors);	      
   sql.finalise( stmt_dump_levels);	      
@@ -647,6 +660,7 @@ bool StratOutDBase::release()
 bool StratOutDBase::index()
 {
   if ( ! attached() ) return false;
+  flush();
   sql.query( "CREATE INDEX IF NOT EXISTS vIndex ON datapoints(strata_id); " );
   // schema changed, so update prepared queries
   release();
@@ -658,6 +672,7 @@ bool StratOutDBase::index()
 bool StratOutDBase::drop_index()
 {
   if ( ! attached() ) return false;
+  flush();
   sql.query( "DROP INDEX IF EXISTS vIndex;" );
   // schema changed, so update prepared queries
   release();
@@ -835,37 +850,85 @@ bool      StratOutDBase::insert_value( const int indiv_id , const int cmd_id , c
 				       const value_t & x )
 {
 
-  //  std::cout << " v s value " << variable_id << "\t" << strata_id << "\t" << x.d << "\n";
-  //  std::cout << writer.strata[ strata_id ].num_print() << "\n";
+  // rows are buffered, and written by flush() in multi-row INSERTs
+  // (always within the current transaction, as flush() is called by commit())
 
-  sql.bind_int( stmt_insert_value , ":indiv_id" , indiv_id );
-  sql.bind_int( stmt_insert_value , ":cmd_id" , cmd_id );
-  sql.bind_int( stmt_insert_value , ":variable_id" , variable_id );
-
-  if ( strata_id == -1 ) 
-    sql.bind_null( stmt_insert_value , ":strata_id" );
-  else
-    sql.bind_int( stmt_insert_value , ":strata_id" , strata_id );
-  
-  if ( timepoint_id == -1 )
-    sql.bind_null( stmt_insert_value , ":timepoint_id" );
-  else
-    sql.bind_int( stmt_insert_value , ":timepoint_id" , timepoint_id );
+  packet_t row;
+  row.indiv_id = indiv_id;
+  row.cmd_id = cmd_id;
+  row.var_id = variable_id;
+  row.strata_id = strata_id;
+  row.timepoint_id = timepoint_id;
+  row.value = x;
 
-  if      ( x.missing ) sql.bind_null( stmt_insert_value ,   ":value" );
-  else if ( x.numeric ) sql.bind_double( stmt_insert_value , ":value" , x.d );
-  else if ( x.integer ) sql.bind_int( stmt_insert_value ,    ":value" , x.i );
-  else                  sql.bind_text( stmt_insert_value ,   ":value" , x.s );
+  buffer.push_back( row );
   
-  sql.step( stmt_insert_value );
-  sql.reset( stmt_insert_value );
+  if ( buffer.size() >= buffer_size ) flush();
   
   return true;
 }
 
 
+void StratOutDBase::bind_value( sqlite3_stmt * stmt , const int p , const packet_t & row )
+{
+
+  // positional binds p+1 .. p+6: indiv, cmd, var, strata, timepoint, value 
+
+  sql.bind_int( stmt , p + 1 , row.indiv_id );
+  sql.bind_int( stmt , p + 2 , row.cmd_id );
+  sql.bind_int( stmt , p + 3 , row.var_id );
+
+  if ( row.strata_id == -1 ) sql.bind_null( stmt , p + 4 );
+  else sql.bind_int( stmt , p + 4 , row.strata_id );
+
+  if ( row.timepoint_id == -1 ) sql.bind_null( stmt , p + 5 );
+  else sql.bind_int( stmt , p + 5 , row.timepoint_id );
+
+  const value_t & x = row.value;
+  if      ( x.missing ) sql.bind_null( stmt ,   p + 6 );
+  else if ( x.numeric ) sql.bind_double( stmt , p + 6 , x.d );
+  else if ( x.integer ) sql.bind_int( stmt ,    p + 6 , x.i );
+  else                  sql.bind_text( stmt ,   p + 6 , x.s );
+
+}
+
+
+void StratOutDBase::flush()
+{
+
+  if ( buffer.size() == 0 ) return;
+
+  const int n = buffer.size();
+
+  int r = 0;
+
+  // full batches via the multi-row statement
+  while ( n - r >= insert_batch )
+    {
+      for (int j=0; j<insert_batch; j++)
+	bind_value( stmt_insert_values , j * 6 , buffer[ r + j ] );
+      sql.step( stmt_insert_values );
+      sql.reset( stmt_insert_values );
+      r += insert_batch;
+    }
+
+  // any remainder, one row at a time
+  while ( r < n )
+    {
+      bind_value( stmt_insert_value , 0 , buffer[ r ] );
+      sql.step( stmt_insert_value );
+      sql.reset( stmt_insert_value );
+      ++r;
+    }
+
+  buffer.clear();
+
+}
+
+
 int StratOutDBase::num_values() 
 {
+  flush();
   sql.step( stmt_count_values );
   int n = sql.get_int( stmt_count_values , 0 );
   sql.reset( stmt_count_values );
@@ -875,6 +938,7 @@ int StratOutDBase::num_values()
 
 std::map<int,int> StratOutDBase::count_strata()
 {
+  flush();
   std::map<int,int> ret;
   while ( sql.step( stmt_count_strata ) )
     ret[ sql.get_int( stmt_count_strata , 0 ) ] = sql.get_int(stmt_count_strata , 1 ) ;
@@ -884,6 +948,7 @@ std::map<int,int> StratOutDBase::count_strata()
 
 std::map<int,std::set<int> > StratOutDBase::dump_vars_by_strata()
 {
+  flush();
   std::map<int,std::set<int> > r;
   while ( sql.step( stmt_dump_vars_by_strata ) )
     {
@@ -898,6 +963,7 @@ std::map<int,std::set<int> > StratOutDBase::dump_vars_by_strata()
 
 packets_t StratOutDBase::enumerate( int strata_id )
 {
+  flush();
 
   packets_t packets;
 
@@ -971,6 +1037,7 @@ std::set<int> StratOutDBase::all_matching_cmds( const std::set<std::string> & cm
 
 packets_t StratOutDBase::dump_all() 
 {
+  flush();
   
   packets_t packets;
 
@@ -1032,6 +1099,7 @@ packets_t StratOutDBase::dump_all()
 
 packets_t StratOutDBase::dump_indiv( const int indiv_id ) 
 {
+  flush();
   
   packets_t packets;
   
@@ -1094,6 +1162,7 @@ packets_t StratOutDBase::dump_indiv( const int indiv_id )
 
 void StratOutDBase::fetch( int strata_id , int time_mode, packets_t * packets, std::set<int> * indivs_id , std::set<int> * cmds_id , std::set<int> * vars_id )
 {
+  flush();
 
   if ( packets == NULL ) return;
   
@@ -1201,11 +1270,18 @@ bool writer_t::close()
       
     }
 
-
+  // likewise, for a columnar file, write remaining chunks and the footer
+  if ( columnar )
+    {
+      delete colstore; // closes file
+      colstore = NULL;
+      curr_coltable = NULL;
+      columnar = false;
+    }
 
   // otherwise, handle any DB-related stuff
   if ( ! attached() ) return false;
-  clear(); 
+  clear_caches(); 
   db.dettach();
   
   return true; 
@@ -1331,6 +1407,96 @@ retval_t writer_t::dump_to_retval( const std::string & dbname , const std::set<s
 
 }
 
+bool writer_t::append_from( const std::string & dbname )
+{
+
+  //
+  // Copies all datapoints from another database (e.g. as written by
+  // a separate worker process) into the currently attached one;
+  // individuals, commands, strata, timepoints and variables are all
+  // re-encoded via the usual writer_t functions
+  //
+
+  if ( ! open_db() ) return false;
+  
+  const bool IS_READONLY = true;
+  
+  writer_t w;
+  
+  w.attach( dbname , IS_READONLY );
+
+  // in order of original indiv_id, i.e. order of insertion
+  std::map<int,indiv_t>::const_iterator ii = w.individuals.begin();
+  while ( ii != w.individuals.end() )
+    {
+
+      id( ii->second.indiv_name , ii->second.file_name );
+      
+      packets_t packets = w.db.dump_indiv( ii->first );
+      
+      packets_t::const_iterator pp = packets.begin();
+      while ( pp != packets.end() )
+	{
+
+	  const command_t & c = w.commands[ pp->cmd_id ];
+	  cmd( c.cmd_name , c.cmd_number , c.cmd_parameters );
+
+	  //
+	  // strata: reset, then add each factor/level in turn
+	  //
+	  
+	  unlevel();
+	  
+	  if ( pp->strata_id != -1 )
+	    {
+	      const strata_t & s = w.strata[ pp->strata_id ];
+	      std::map<factor_t,level_t>::const_iterator ll = s.levels.begin();
+	      while ( ll != s.levels.end() )
+		{
+		  if ( ll->first.is_numeric ) numeric_factor( ll->first.factor_name );
+		  else string_factor( ll->first.factor_name );
+		  level( ll->second.level_name , ll->first.factor_name );
+		  ++ll;
+		}
+	    }
+	  
+	  //
+	  // timepoint
+	  //
+
+	  const timepoint_t & tp = w.timepoints[ pp->timepoint_id ];
+	  
+	  if ( tp.is_epoch() ) epoch( tp.epoch );
+	  else if ( tp.is_interval() ) interval( interval_t( tp.start , tp.stop ) );
+	  else curr_timepoint.timeless();
+
+	  //
+	  // variable (w/ any label) and value
+	  //
+
+	  const var_t & v = w.variables[ pp->var_id ];
+	  
+	  if ( v.var_label != "." && v.var_label != "" ) 
+	    var( v.var_name , v.var_label );
+	  
+	  value( v.var_name , pp->value );
+	  
+	  ++pp;
+	}
+      
+      ++ii;
+    }
+  
+  unlevel();
+  
+  curr_timepoint.timeless();
+  
+  w.close();
+  
+  return true;
+}
+
+
 bool writer_t::to_plaintext( const std::string & var_name , const value_t & x ) 
 {
 
@@ -1359,6 +1525,85 @@ bool writer_t::to_plaintext( const std::string & var_name , const value_t & x )
 }
 
 
+void writer_t::use_columnar( const std::string & filename )
+{
+  // as for plaintext mode, factor information etc is still tracked in
+  // an in-memory DB, but values are sent to the columnar file
+  close();
+  attach( ":memory:" );
+  dbless = true;
+  plaintext = false;
+  zfiles = NULL;
+  curr_zfile = NULL;
+  retval = NULL;
+
+  columnar = true;
+  columnar_file = filename;
+  colstore = new colstore_writer_t( filename );
+  curr_coltable = NULL;
+}
+
+
+bool writer_t::to_columnar( const std::string & var_name , const value_t & x )
+{
+
+  // has the table/row changed since the last value?
+  std::string k = curr_strata.key();
+  k.append( (const char*)&curr_timepoint.timepoint_id , sizeof(int) );
+  k.append( (const char*)&curr_command.cmd_id , sizeof(int) );
+  k.append( (const char*)&curr_indiv.indiv_id , sizeof(int) );
+
+  if ( curr_coltable == NULL || k != curr_colkey )
+    {
+      // as for -t, table is defined by command and factors (with E/T levels
+      // taken from the timepoint; command factors skipped)
+      std::map<std::string,std::string> fl = faclvl();
+      std::vector<std::string> facs, lvls;
+      std::map<std::string,std::string>::const_iterator ff = fl.begin();
+      while ( ff != fl.end() )
+	{
+	  facs.push_back( ff->first );
+	  lvls.push_back( ff->second );
+	  ++ff;
+	}
+
+      curr_coltable = colstore->table( curr_indiv.indiv_name , curr_command.cmd_name , facs );
+
+      // write out as a chunk first, if full
+      colstore->done( curr_coltable );
+
+      curr_colrow = curr_coltable->row( lvls );
+      curr_colkey = k;
+    }
+
+  colstore_column_t & col = curr_coltable->cols[ curr_coltable->col( var_name ) ];
+
+  // missing values are left as NA
+  if ( x.is_missing() ) return true;
+  else if ( x.is_numeric() ) col.set_dbl( curr_colrow , x.d );
+  else if ( x.is_integer() ) col.set_int( curr_colrow , x.i );
+  else col.set_txt( curr_colrow , x.s );
+
+  return true;
+}
+
+
+void writer_t::flush_columnar()
+{
+  if ( colstore == NULL ) return;
+  colstore->flush();
+  curr_coltable = NULL;
+}
+
+
+void writer_t::append_columnar( const std::string & filename )
+{
+  if ( ! columnar ) return;
+  colstore->append( filename );
+  curr_coltable = NULL;
+}
+
+
 void writer_t::update_plaintext_curr_strata()
 {
 
@@ -26,6 +26,7 @@
 #include "sqlwrap.h"
 #include "retval.h"
 #include <string>
+#include <unordered_map>
 #include "intervals/intervals.h"
 #include "cmddefs.h"
 #include "helper/zfile.h"
@@ -33,6 +34,9 @@
 class writer_t;
 extern writer_t writer;
 
+class colstore_writer_t;
+struct colstore_table_t;
+
 struct value_t;
 struct strata_t;
 struct indiv_t;
@@ -191,6 +195,21 @@ struct level_t;
       return true;
     }
     
+    // compact (binary) key of factor/level IDs, for hashed lookups
+    std::string key() const
+    {
+      std::string k;
+      k.reserve( levels.size() * 2 * sizeof(int) );
+      std::map<factor_t,level_t>::const_iterator ii = levels.begin();
+      while ( ii != levels.end() )
+	{
+	  k.append( (const char*)&ii->first.factor_id , sizeof(int) );
+	  k.append( (const char*)&ii->second.level_id , sizeof(int) );
+	  ++ii;
+	}
+      return k;
+    }
+    
     std::string num_print() const
     {
       std::stringstream ss;
@@ -457,7 +476,10 @@ class StratOutDBase {
   bool index();
   bool drop_index();
   void begin() { sql.begin_exclusive(); }
-  void commit() { sql.commit(); }
+  void commit() { flush(); sql.commit(); }
+
+  // write any buffered datapoints (called before any commit or read)
+  void flush();
   
 
   //
@@ -501,6 +523,7 @@ class StratOutDBase {
   sqlite3_stmt * stmt_insert_variable; 
   sqlite3_stmt * stmt_insert_timepoint;    
   sqlite3_stmt * stmt_insert_value;    
+  sqlite3_stmt * stmt_insert_values;  // multi-row version, for flush()
 
   sqlite3_stmt * stmt_dump_factors;	      
   sqlite3_stmt * stmt_dump_levels;	      
@@ -527,6 +550,18 @@ class StratOutDBase {
   sqlite3_stmt * stmt_match_vars;
   sqlite3_stmt * stmt_match_cmds;
 
+  //
+  // Datapoints are buffered by insert_value(), and written in
+  // multi-row INSERTs of insert_batch rows by flush()
+  //
+
+  packets_t buffer;
+
+  void bind_value( sqlite3_stmt * stmt , const int p , const packet_t & row );
+
+  static const int insert_batch = 128;   // rows per INSERT (x6 < SQLITE_MAX_VARIABLE_NUMBER)
+  static const size_t buffer_size = 16384;  // rows held before flushing
+
 
 };
 
@@ -555,13 +590,16 @@ class writer_t
   // database
   //
   
-  writer_t() { dbless = true; plaintext = false; zfiles = NULL ; curr_zfile = NULL ; retval = NULL; } 
+  writer_t() { dbless = true; plaintext = false; zfiles = NULL ; curr_zfile = NULL ; retval = NULL; columnar = false; colstore = NULL; curr_coltable = NULL; } 
   
   bool attach( const std::string & filename , bool readonly = false )
   {
 
     dbless = false; plaintext = false; zfiles = NULL ; curr_zfile = NULL; retval = NULL;
 
+    // start from this DB's own encodings only
+    clear_caches();
+
     db.attach( filename , readonly , this );
 
     //
@@ -623,6 +661,8 @@ class writer_t
     plaintext_root = r ;
   } 
 
+  void use_columnar( const std::string & filename );
+
   
   bool open_db() const 
   { 
@@ -632,7 +672,7 @@ class writer_t
   }
 
   
-  std::string name() const { return plaintext ? plaintext_root : ( dbless ? "." : db.name() ) ; } 
+  std::string name() const { return plaintext ? plaintext_root : ( columnar ? columnar_file : ( dbless ? "." : db.name() ) ) ; } 
 
   void index() { if ( open_db() ) db.index(); } 
   void drop_index() { if ( open_db() ) db.drop_index(); } 
@@ -655,6 +695,12 @@ class writer_t
   // open db and send to a retval
   static retval_t dump_to_retval( const std::string & dbname , const std::set<std::string> * = NULL , std::vector<std::string> * ids = NULL );
 
+  // copy all values from another db into this one (re-encoding all IDs)
+  bool append_from( const std::string & dbname );
+
+  // as above, for columnar files (chunks are copied as is)
+  void append_columnar( const std::string & filename );
+
   bool close(); 
   
   ~writer_t() { close(); } 
@@ -747,6 +793,9 @@ class writer_t
 	  }	
       }
 
+    // write out all buffered tables from the previous individual
+    if ( columnar ) flush_columnar();
+
     return true;
   }
   
@@ -824,15 +873,23 @@ class writer_t
     // when being set up, we always enter a first 'default' baseline
     // stratum this has level code of '0'
     
-    // if this is here, it will have an ID
-    if ( strata_idmap.find( s ) != strata_idmap.end() ) 
+    // hashed lookup on factor/level IDs (called for every value)
+    const std::string k = s.key();
+    std::unordered_map<std::string,int>::const_iterator kk = strata_hashmap.find( k );
+    if ( kk != strata_hashmap.end() ) return kk->second;
+
+    // if this is here (e.g. read from an existing DB), it will have an ID
+    std::map<strata_t,int>::const_iterator ss = strata_idmap.find( s );
+    if ( ss != strata_idmap.end() ) 
       {
-	return strata_idmap[ s ];
+	strata_hashmap[ k ] = ss->second;
+	return ss->second;
       }
     
     // if not, add to DB and track ID
     strata_t new_strata = db.insert_strata( s );
     strata_idmap[ new_strata ] = new_strata.strata_id;
+    strata_hashmap[ k ] = new_strata.strata_id;
     strata[ new_strata.strata_id ] = new_strata;
     return new_strata.strata_id;
   }
@@ -849,9 +906,10 @@ class writer_t
       }
     
     std::string tp_key = Helper::int2str(e) + ":"; 
-    if ( timepoints_idmap.find( tp_key ) != timepoints_idmap.end() )
+    std::unordered_map<std::string,int>::const_iterator tt = timepoints_idmap.find( tp_key );
+    if ( tt != timepoints_idmap.end() )
       {
-	curr_timepoint = timepoints[ timepoints_idmap[ tp_key ] ];	
+	curr_timepoint = timepoints[ tt->second ];	
       }
     else
       {
@@ -932,7 +990,7 @@ class writer_t
   {    
     //    std::cout << "add-v :" << var_name << " " << d << "\n";
     if ( retval != NULL ) return to_retval( var_name , d );
-    else if ( dbless ) return plaintext ? to_plaintext( var_name , value_t( d ) ) : to_stdout( var_name , value_t( d ) ) ;
+    else if ( dbless ) return plaintext ? to_plaintext( var_name , value_t( d ) ) : ( columnar ? to_columnar( var_name , value_t( d ) ) : to_stdout( var_name , value_t( d ) ) ) ;
     if ( desc != "" ) var( var_name , desc );
     return value( var_name , value_t( d ) ) ;
   }
@@ -940,7 +998,7 @@ class writer_t
   bool value( const std::string & var_name , int i , const std::string & desc = "" ) 
   { 
     if ( retval != NULL ) return to_retval( var_name , i ); 
-    else if ( dbless ) return plaintext ? to_plaintext( var_name , value_t( i ) ) : to_stdout( var_name , value_t( i ) ) ; 
+    else if ( dbless ) return plaintext ? to_plaintext( var_name , value_t( i ) ) : ( columnar ? to_columnar( var_name , value_t( i ) ) : to_stdout( var_name , value_t( i ) ) ) ; 
     if ( desc != "" ) var( var_name , desc ); 
     return value( var_name , value_t( i ) ) ; 
   } 
@@ -948,7 +1006,7 @@ class writer_t
   bool value( const std::string & var_name , const std::string & s , const std::string & desc = "" )
   {
     if ( retval != NULL ) return to_retval( var_name , s );
-    if ( dbless ) return plaintext ? to_plaintext( var_name , value_t( s ) ) : to_stdout( var_name , value_t( s ) ); 
+    if ( dbless ) return plaintext ? to_plaintext( var_name , value_t( s ) ) : ( columnar ? to_columnar( var_name , value_t( s ) ) : to_stdout( var_name , value_t( s ) ) ); 
     if ( desc != "" ) var( var_name , desc );
     return value( var_name , value_t( s ) ) ;
   }
@@ -956,7 +1014,7 @@ class writer_t
   bool missing_value( const std::string & var_name , const std::string & desc = "" )
   {
     if ( retval != NULL ) return to_retval( var_name ); // missing value 
-    if ( dbless ) return plaintext ? to_plaintext( var_name , value_t() ) : to_stdout( var_name , value_t() ); 
+    if ( dbless ) return plaintext ? to_plaintext( var_name , value_t() ) : ( columnar ? to_columnar( var_name , value_t() ) : to_stdout( var_name , value_t() ) ); 
     if ( desc != "" ) var( var_name , desc );
     return value( var_name , value_t() );
   }
@@ -967,27 +1025,29 @@ class writer_t
     // this should never be called in retval mode, but just in case... 
     if ( retval != NULL ) Helper::halt( "internal error in value(), should not get here" );
 
-    if ( dbless ) return plaintext ? to_plaintext( var_name , x ) : to_stdout( var_name , x );
+    if ( dbless ) return plaintext ? to_plaintext( var_name , x ) : ( columnar ? to_columnar( var_name , x ) : to_stdout( var_name , x ) );
 
     // use 'command.var' as the unique identifier
 
     std::string var_key = curr_command.cmd_name + ":" + var_name;
     
     // should be already here, but incase it is not
-    if ( variables_idmap.find( var_key ) == variables_idmap.end() )
+    std::unordered_map<std::string,int>::const_iterator vv = variables_idmap.find( var_key );
+    if ( vv == variables_idmap.end() )
       {
 	var_t var = db.insert_variable( var_name , curr_command.cmd_name , "." );
         variables_idmap[ var_key ] = var.var_id;
         variables[ var.var_id ] = var;
+	vv = variables_idmap.find( var_key );
       }      
 
     // check curr_strata is registered; add to DB if not
     curr_strata.strata_id = get_strata_id( curr_strata );    
 
-    // store value    
+    // store (buffer) value    
     db.insert_value( curr_indiv.indiv_id , 
 		     curr_command.cmd_id , 	
-		     variables_idmap[ var_key ] , 		     
+		     vv->second , 		     
 		     curr_strata.empty() ? -1 : curr_strata.strata_id , 
 		     curr_timepoint.none() ? -1 : curr_timepoint.timepoint_id , 
 		     x );
@@ -1016,6 +1076,10 @@ class writer_t
   
   bool to_plaintext( const std::string & var_name , const value_t & x ) ;
 
+  bool to_columnar( const std::string & var_name , const value_t & x ) ;
+
+  void flush_columnar();
+
   
   bool to_retval( const std::string & var_name , double d )
   {
@@ -1109,13 +1173,23 @@ class writer_t
   // lookup of ID based on textual identifier
   std::map<std::string,int> factors_idmap;
   std::map<std::string,int> levels_idmap;
-  std::map<std::string,int> variables_idmap;
+  std::unordered_map<std::string,int> variables_idmap;
   std::map<std::string,int> individuals_idmap;
-  std::map<std::string,int> timepoints_idmap;
+  std::unordered_map<std::string,int> timepoints_idmap;
   std::map<strata_t,int>    strata_idmap;
+  std::unordered_map<std::string,int> strata_hashmap; // strata_t::key() --> ID, filled on demand
   std::map<std::string,int> commands_idmap;
 
   void clear() 
+  {
+    clear_caches();
+    // but reset types
+    set_types();
+  }
+
+  // as above, but without re-registering the standard factors, i.e. 
+  // when about to detach (these then belong to the next attached DB)
+  void clear_caches()
   {
     factors.clear();     factors_idmap.clear();
     levels.clear();      levels_idmap.clear();
@@ -1123,15 +1197,12 @@ class writer_t
     individuals.clear(); individuals_idmap.clear();
     commands.clear();    commands_idmap.clear();
     timepoints.clear();  timepoints_idmap.clear();
-    strata.clear();      strata_idmap.clear();
+    strata.clear();      strata_idmap.clear();  strata_hashmap.clear();
     
     curr_indiv.clear();
     curr_strata.clear();
     curr_timepoint.timeless();
     curr_command.clear();    
-
-    // but reset types
-    set_types();
   }
 
   
@@ -1166,6 +1237,24 @@ class writer_t
   
   zfile_t * curr_zfile;
 
+  //
+  // alternatively, still dbless but write to a single columnar file
+  // (db/colstore.h); the current table and row are cached, and only
+  // looked up again when the individual, command, strata or timepoint change
+  //
+
+  bool columnar;
+
+  std::string columnar_file;
+
+  colstore_writer_t * colstore;
+
+  colstore_table_t * curr_coltable;
+
+  int curr_colrow;
+
+  std::string curr_colkey;
+
   //
   // write to a retval_t, instead of a DB
   //
@@ -204,6 +204,26 @@ void SQL::bind_text( sqlite3_stmt * stmt , const std::string index , const std::
 }
   
 
+void SQL::bind_int( sqlite3_stmt * stmt , const int index , int value )
+{
+  sqlite3_bind_int( stmt , index , value );
+}
+
+void SQL::bind_double( sqlite3_stmt * stmt , const int index , double value )
+{
+  sqlite3_bind_double( stmt , index , value );
+}
+
+void SQL::bind_text( sqlite3_stmt * stmt , const int index , const std::string & value )
+{
+  sqlite3_bind_text( stmt , index , value.c_str() , value.size() , 0 );
+}
+
+void SQL::bind_null( sqlite3_stmt * stmt , const int index )
+{
+  sqlite3_bind_null( stmt , index );
+}
+
 void SQL::bind_blob( sqlite3_stmt * stmt , const std::string index , blob & value )
 {
     rc = sqlite3_bind_blob( stmt , 
@@ -109,6 +109,12 @@ class SQL {
   void bind_blob( sqlite3_stmt * stmt , const std::string index , blob & );
   void bind_null( sqlite3_stmt * stmt , const std::string index );
 
+  // positional (1-based) versions, avoiding the by-name lookup
+  void bind_int( sqlite3_stmt * stmt , const int index , int value );
+  void bind_double( sqlite3_stmt * stmt , const int index , double value );
+  void bind_text( sqlite3_stmt * stmt , const int index , const std::string & value );
+  void bind_null( sqlite3_stmt * stmt , const int index );
+
   int get_int( sqlite3_stmt *, int );
   uint64_t get_uint64( sqlite3_stmt *, int );
   double get_double( sqlite3_stmt *, int );
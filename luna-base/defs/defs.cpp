@@ -80,6 +80,14 @@ std::string globals::indiv_wildcard;
 
 bool globals::force_edf;
 bool globals::skip_edf_annots;
+bool globals::edf_mmap;
+bool globals::edf_store;
+int globals::edfz_threads;
+int globals::edfz_blocks;
+int globals::fftw_plan_effort;
+std::string globals::fftw_wisdom;
+int globals::n_threads;
+uint64_t globals::cache_budget;
 bool globals::skip_nonedf_annots;
 bool globals::set_annot_inst2hms;
 bool globals::set_annot_inst2hms_force;
@@ -388,6 +396,14 @@ void globals::init_defs()
 
   force_edf = false;
   skip_edf_annots = false;
+  edf_mmap = false;
+  edf_store = false;
+  edfz_threads = 0;
+  edfz_blocks = 0;
+  fftw_plan_effort = 0;
+  fftw_wisdom = "";
+  n_threads = 1;
+  cache_budget = 0;
   skip_nonedf_annots = false;
 
   set_annot_inst2hms = true;
@@ -145,6 +145,27 @@ struct globals
   
   static bool force_edf;
   static bool skip_edf_annots;
+
+  // memory-map standard EDFs rather than fseek()/fread() per record
+  static bool edf_mmap;
+
+  // keep a contiguous, channel-major copy of signal data (edf_t::store)
+  static bool edf_store;
+
+  // worker threads (and blocks in flight) for EDFZ (de)compression
+  static int edfz_threads;
+  static int edfz_blocks;
+
+  // FFTW planner effort (0 estimate, 1 measure, 2 patient) and wisdom file
+  static int fftw_plan_effort;
+  static std::string fftw_wisdom;
+
+  // worker threads for commands that split work within an EDF (e.g. PSD)
+  static int n_threads;
+
+  // byte budget for the inter-command caches (0 = no limit)
+  static uint64_t cache_budget;
+
   static bool skip_nonedf_annots;
 
   static bool set_annot_inst2hms;
@@ -29,9 +29,12 @@
 #include "dsp/hilbert.h"
 #include "edf/slice.h"
 #include "miscmath/crandom.h"
+#include "dsp/surrogates.h"
 #include "cwt/cwt.h"
 #include "stats/matrix.h"
 
+#include <cmath>
+
 extern writer_t writer;
 
 extern logger_t logger;
@@ -512,6 +515,8 @@ void conncoupl_t::pre_calc()
 	  //
 
 	  cwt.store_real_imag_vectors( true );
+	  cwt.store_power_vectors( false );
+	  cwt.store_phase_vectors( false );
 	  cwt.load( d );  
 	  cwt.run_wrapped();
 	
@@ -619,21 +624,12 @@ void conncoupl_t::calc()
       
       
       //
-      // Surrogate time-series (pre-calculate, fixed for all tests in a given epoch)
+      // Surrogate time-series (circular shifts, fixed for all tests in a given epoch)
       // although independent between epochs (not that this should matter...)
       //      
       
-      std::vector<std::vector<int> > shuffle( nreps );
-      for (int r=0;r<nreps;r++)
-	{
-	  int offset = CRandom::rand( es_pts );
-	  shuffle[r].resize( es_pts );
-	  for (int i=0;i<es_pts;i++)
-	    {
-	      if ( offset >= es_pts ) offset = 0;
-	      shuffle[r][i] = offset++;
-	    }
-	}
+      surrogates_t surr( nreps , globals::n_threads );
+      surr.draw( 0 , es_pts );
 
 
       //
@@ -672,12 +668,13 @@ void conncoupl_t::calc()
 
 	      dcomp debias_term(0,0);
 	      
-	      std::vector<dcomp> ph( es_pts ) , mag( es_pts );
+	      std::vector<dcomp> ph( es_pts );
+	      std::vector<double> mag( es_pts );
 
 	      for (int i=0; i<es_pts; i++)
 		{		  
 		  ph[i] = exp( dcomp( 0 , arg( x[i] ) ) );
-		  mag[i] = dcomp( pow( abs( y[i] ) , 2 ) , 0 );
+		  mag[i] = pow( abs( y[i] ) , 2 );
 		  // accrue debias term (which is similar across all null perms)
 		  debias_term += ph[i];
 		}
@@ -685,15 +682,20 @@ void conncoupl_t::calc()
 	      // get mean
 	      debias_term /= dcomp( (double)es_pts , 0 );
 
+	      // debiased phase, as contiguous real/imaginary parts
+	      std::vector<double> dre( es_pts ) , dim( es_pts );
+	      for (int i=0; i<es_pts; i++)
+		{
+		  dcomp d = ph[i] - debias_term;
+		  dre[i] = d.real();
+		  dim[i] = d.imag();
+		}
 	      	      
 	      //
 	      // dPAC 
 	      //
 
-	      dcomp dPAC(0,0);
-	      
-	      for (int i=0; i<es_pts; i++)
-		dPAC += ( ph[i] - debias_term ) * mag[i] ;
+	      dcomp dPAC = surrogates_t::circular_dot( dre , dim , mag , 0 );
 	      
 	      dPAC /= dcomp( es_pts , 0 );
 
@@ -707,25 +709,20 @@ void conncoupl_t::calc()
 	      // Surrogates
 	      //
 
-	      std::vector<double> null_stats( nreps );
 	      std::vector<double> null_stats2( nreps );
-	      
-	      for (int r=0; r<nreps; r++)
-		{
-		  
-		  dcomp perm_dPAC(0,0);
 
-		  const std::vector<int> & sh = shuffle[r];
+	      surr.run( obs_dPAC , [&]( int r ) {
 		  
-		  for (int i=0; i<es_pts; i++)
-		    perm_dPAC += ( ph[i] - debias_term ) * mag[ sh[i] ] ;
+		  dcomp perm_dPAC = surrogates_t::circular_dot( dre , dim , mag , surr.shift[r] );
 		  
 		  perm_dPAC /= dcomp( es_pts , 0 );
 		  
-		  null_stats[r] = abs( perm_dPAC );
 		  null_stats2[r] = arg( perm_dPAC );
-		  
-		}
+
+		  return abs( perm_dPAC );
+		} );
+
+	      const std::vector<double> & null_stats = surr.null;
 
 	      if ( nreps )
 		{
@@ -782,10 +779,10 @@ void conncoupl_t::calc()
 	      for (int i=0; i<np; i++)
 		{
 		  numer += isxy[i] ;
-		  denom += abs( isxy[i] );
+		  denom += fabs( isxy[i] );
 		}
 	      
-	      double wPLI = abs( numer / (double)np ) / ( denom / (double)np );
+	      double wPLI = fabs( numer / (double)np ) / ( denom / (double)np );
 	      
 	      results[ "wPLI" ].stats( e , t ) = wPLI;
 
@@ -808,77 +805,57 @@ void conncoupl_t::calc()
 
 	  // assume just one test (for now...)
 
-	  std::vector<double> null_stats( nreps ) ;
+	  std::vector<double> null_stats( nreps , 0 ) ;
 
-	  std::vector<dcomp> sxy( es_pts );
-	  std::vector<double> isxy( es_pts );
-	
 	  //
-	  // For each null replicate 
+	  // phase-amplitude coupling test?  (null handled above)
+	  //
+
+	  const bool pac = cfc[t];
+
+	  //
+	  // Connectivity
 	  //
 	  
-	  for (int r=0; r<nreps; r++)
+	  if ( ! pac && nreps )
 	    {
 	      
+	      const std::string & flabel = f1[ t ] ;
+	      
 	      //
-	      // phase-amplitude coupling test?
+	      // extract two relevant vectors (cross-channel), with one shuffled
 	      //
-
-	      const bool pac = cfc[t];
 	      
+	      const std::vector<dcomp> & x = a[ e ][ s1[t] ][ flabel ];
+	      const std::vector<dcomp> & y_conj = a_conj[ e ][ s2[t] ][ flabel ];		  
+	      
+	      if ( x.size() != es_pts ) Helper::halt( "probo" );
 
-	      //
-	      // Connectivity
+	      std::vector<double> xre( es_pts ) , xim( es_pts ) , yre( es_pts ) , yim( es_pts );
+	      for (int i=0; i<es_pts; i++)
+		{
+		  xre[i] = x[i].real();
+		  xim[i] = x[i].imag();
+		  yre[i] = y_conj[i].real();
+		  yim[i] = y_conj[i].imag();
+		}
+	      
+	      //	      
+	      // cross-spectral density, except with one channel shuffled; 
+	      // wPLI: abs( mean( imag(X) )  ) / mean( abs( imag(X) ) )
 	      //
 	      
-	      if ( ! pac )
-		{
-		  
-		  const std::string & flabel = f1[ t ] ;
+	      surr.run( results[ "wPLI" ].stats( e , t ) , [&]( int r ) {
 		  
-		  //
-		  // extract two relevant vectors (cross-channel), with one shuffled
-		  //
-		  
-		  const std::vector<dcomp> & x = a[ e ][ s1[t] ][ flabel ];
-		  const std::vector<dcomp> & y_conj = a_conj[ e ][ s2[t] ][ flabel ];		  
-		  
-		  if ( x.size() != es_pts ) Helper::halt( "probo" );
-
-		  //	      
-		  // cross-spectral density, except with one channel shuffled
-		  //
-
 		  double wPLI_numer = 0 , wPLI_denom = 0;
 		  
-		  for (int i=0; i< es_pts; i++)
-		    {
-		      //sxy[i] = x[i] * conj( y[ shuffle[r][i] ] );
-		      sxy[i] = x[i] * y_conj[ shuffle[r][i] ];
-		      isxy[i] = std::imag( sxy[i] );
-		      
-		  
-		      //
-		      // wPLI: abs( mean( imag(X) )  ) / mean( abs( imag(X) ) )
-		      //
-		  
-		      wPLI_numer += isxy[i] ;
-		      wPLI_denom += abs( isxy[i] );
-		    }
-
-		  //
-		  // calc stats for this epoch 
-		  //
-
-		  double wPLI = abs( wPLI_numer / (double)es_pts ) / ( wPLI_denom / (double)es_pts );
+		  surrogates_t::circular_imag( xre , xim , yre , yim , surr.shift[r] , 
+					       &wPLI_numer , &wPLI_denom );
 		  
-		  null_stats[ r ] = wPLI ;
-
-		}
+		  return fabs( wPLI_numer / (double)es_pts ) / ( wPLI_denom / (double)es_pts );
+		} );
 	      
-	      //
-	      // Next null replicate
-	      //
+	      null_stats = surr.null;
 	      
 	    }
 	  
@@ -37,8 +37,71 @@ extern logger_t logger;
 extern writer_t writer;
 
 
+//
+// Overlap-save state: the FFT size and step, the (scaled) filter
+// spectrum, and a single pair of buffers for the r2c/c2r plans; built
+// on the first call to fft_filter(), and re-used for subsequent calls
+//
+
+struct fir_ols_t {
+
+  fir_ols_t( const std::vector<double> & h , const int nfft );
+
+  ~fir_ols_t()
+  {
+    fftw_free( in );
+    fftw_free( out );
+    fftw_free( H );
+  }
+  
+  int nfft;
+  
+  // number of new output samples per block
+  int step;
+
+  double * in;
+  fftw_complex * out;
+  fftw_complex * H;
+
+  // shared (fftw_cache) plans
+  fftw_plan fwd, inv;
+
+};
+
+
+fir_ols_t::fir_ols_t( const std::vector<double> & h , const int nfft )
+  : nfft( nfft ) , step( nfft - h.size() + 1 )
+{
+
+  const int nc = nfft / 2 + 1;
+
+  in  = (double*)fftw_malloc( sizeof(double) * nfft );
+  out = (fftw_complex*)fftw_malloc( sizeof(fftw_complex) * nc );
+  H   = (fftw_complex*)fftw_malloc( sizeof(fftw_complex) * nc );
+
+  if ( in == NULL || out == NULL || H == NULL ) 
+    Helper::halt( "fir_impl_t: could not allocate FFT buffers" );
+  
+  fwd = fftw_cache::r2c_1d( nfft );
+  inv = fftw_cache::c2r_1d( nfft );
+
+  // filter spectrum, with the 1/N for the inverse folded in
+  for (int i=0;i<nfft;i++) in[i] = i < h.size() ? h[i] / (double)nfft : 0 ;
+  fftw_execute_dft_r2c( fwd , in , out );
+  for (int i=0;i<nc;i++) { H[i][0] = out[i][0]; H[i][1] = out[i][1]; }
+  
+}
+
+
+fir_impl_t::~fir_impl_t()
+{
+  if ( ols != NULL ) delete ols;
+}
+
+
 fir_impl_t::fir_impl_t( const std::vector<double> & coefs_ ) 
 {
+  ols = NULL;
   count = 0;
   length = coefs_.size();
   coefs = coefs_;
@@ -1149,54 +1212,73 @@ std::vector<double> fir_impl_t::filter( const std::vector<double> * x )
 
 std::vector<double> fir_impl_t::fft_filter( const std::vector<double> * px )
 {
+
+  // overlap-save: y = x * h (full linear convolution), returned
+  // (as for filter()) as y[ delay .. delay + M - 1 ]; each block takes
+  // nfft inputs, starting L-1 before the first new output, and yields
+  // 'step' outputs free of circular wrap-around
   
-  std::vector<double> x = *px;
-  std::vector<double> h = coefs;
-  
+  const std::vector<double> & x = *px;
+
   // signal length
   const int M = x.size();
   
   // filter length
-  const int L = h.size();
-  
-  // next power of 2 greater than M+L-1
-  long int Nfft = MiscMath::nextpow2( M + L - 1 );
-  
-  // zero-padding
-  x.resize( Nfft , 0 );
-  h.resize( Nfft , 0 );
+  const int L = coefs.size();
+
+  std::vector<double> conv( M );
 
-  // FFT
-  FFT fftx( Nfft , Nfft , 1 , FFT_FORWARD );
-  fftx.apply( x );
-  std::vector<dcomp> rfftx = fftx.transform();
+  if ( M == 0 ) return conv;
   
-  FFT ffth( Nfft , Nfft , 1 , FFT_FORWARD );
-  ffth.apply( h );
-  std::vector<dcomp> rffth = ffth.transform();
+  // block FFT size: a few times the filter length, but no larger
+  // than a single transform of the whole signal would need
+  const int nfft = std::min( std::max( MiscMath::nextpow2( 4 * L ) , 4096L ) , 
+			     MiscMath::nextpow2( M + L - 1 ) );
   
-  // convolution in the frequency domain
-  std::vector<dcomp> y( Nfft );
-  for (int i=0;i<rfftx.size();i++) y[i] = rfftx[i] * rffth[i]; 
+  if ( ols == NULL || ols->nfft != nfft ) 
+    {
+      if ( ols != NULL ) delete ols;
+      ols = new fir_ols_t( coefs , nfft );
+    }
   
-  // inverse FFT
-
-  FFT ifft( Nfft , Nfft , 1 , FFT_INVERSE );
-  ifft.apply( y );
-  std::vector<dcomp> conv_tmp = ifft.transform();
+  const int nc = nfft / 2 + 1;
+  const int delay_idx = (length-1)/2;
+  const int step = ols->step;
+  double * in = ols->in;
+  fftw_complex * out = ols->out;
+  const fftw_complex * H = ols->H;
   
-  dcomp denom( 1.0/(double)Nfft , 0 );
+  // first output is y[ delay_idx ]
+  for (int j=0; j<M; j+=step)
+    {
+      
+      const int s0 = j + delay_idx - ( L - 1 );
+      
+      for (int i=0;i<nfft;i++)
+	{
+	  const int k = s0 + i;
+	  in[i] = k >= 0 && k < M ? x[k] : 0 ;
+	}
+      
+      fftw_execute_dft_r2c( ols->fwd , in , out );
+      
+      // convolution in the frequency domain
+      for (int i=0;i<nc;i++)
+	{
+	  const double re = out[i][0] * H[i][0] - out[i][1] * H[i][1];
+	  const double im = out[i][0] * H[i][1] + out[i][1] * H[i][0];
+	  out[i][0] = re;
+	  out[i][1] = im;
+	}
+      
+      fftw_execute_dft_c2r( ols->inv , out , in );
+      
+      const int n = std::min( step , M - j );
+      for (int i=0;i<n;i++)
+	conv[ j + i ] = in[ L - 1 + i ];
+      
+    }
   
-  // Normalize
-  for (int i=0;i<Nfft;i++) conv_tmp[i] *= denom;
-
-  // Trim and return read component
-  std::vector<double> conv;
-  const int delay_idx = (length-1)/2;
-  int j = delay_idx;
-  for (int i=0;i<M;i++)
-    conv.push_back( std::real( conv_tmp[j++] ) );
-
   return conv;
   
 }
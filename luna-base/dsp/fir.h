@@ -34,6 +34,9 @@ struct param_t;
 
 struct edf_t;
 
+// FFTW plans/buffers and filter spectrum for fir_impl_t::fft_filter()
+struct fir_ols_t;
+
 // https://ptolemy.eecs.berkeley.edu/eecs20/week12/implementation.html
 
 struct fir_impl_t { 
@@ -44,10 +47,24 @@ struct fir_impl_t {
   int count;
   
   fir_impl_t( const std::vector<double> & coefs_ ); 
+
+  ~fir_impl_t();
   
   std::vector<double> filter( const std::vector<double> * x );
 
+  // block-wise (overlap-save) FFT convolution: same output as filter(),
+  // but O(N log L), and only a few FFT-sized buffers besides the output
   std::vector<double> fft_filter( const std::vector<double> * x );
+
+ private:
+
+  fir_ols_t * ols;
+
+  // plans etc are owned, so no copies
+  fir_impl_t( const fir_impl_t & );
+  fir_impl_t & operator=( const fir_impl_t & );
+
+ public:
   
   double getOutputSample(double inputSample) 
   {
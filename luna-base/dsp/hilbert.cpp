@@ -25,6 +25,7 @@
 #include "fftw/fftwrap.h"
 #include "miscmath/crandom.h"
 #include "miscmath/miscmath.h"
+#include "dsp/surrogates.h"
 #include "dsp/fir.h"
 #include "defs/defs.h"
 
@@ -443,24 +444,44 @@ itpc_t hilbert_t::phase_events( const std::vector<int> & e ,
   // (for within-SO permutation, each spindle will have its own shuffle boundaries)
   
   const int maxshuffle = es ? es : mx ;
-   
+
+  // get permutation shift for unconstrained OR within-epoch permutation; this is applied similarly across
+  // all spindles; within-SO shifts are drawn from a per-replicate random stream
+  
+  surrogates_t surr( nreps , globals::n_threads );
+
+  surr.draw( 0 , maxshuffle , mask != NULL );
+
+  // per-replicate results, filled by worker threads
+  
+  std::vector<int> perm_overlap( nreps , 0 );
+  std::vector<int> perm_counted( nreps , 0 );
+  std::vector<dcomp> perm_s( nreps );
+  std::vector<std::vector<int> > perm_pbacc( by_phase ? nreps : 0 );
+  std::vector<char> perm_bad( nreps , 0 );
+  
   //
   // Each null replicate
   //
 
-  for (int r = 0 ; r < nreps ; r++ ) 
-    {
+  surr.run( itpc.itpc.obs , [&]( int r ) {
       
-      // get permutation shift for unconstrained OR within-epoch permutation; this is applied similarly across
-      // all spindles
+      const int pp = surr.shift[r];
+      
+      CRandomStream rng( mask != NULL ? surr.seed[r] : 1 );
       
-      int pp = CRandom::rand( maxshuffle );
-            
       // overlap stats (i.e. based on standard permutation)
       
       int overlap = 0;  // for overlap statistic
 
-      std::vector<int> pbacc( nbins , 0 ); // phase-bin accumulator                                                                                        
+      std::vector<int> pbacc( by_phase ? nbins : 0 , 0 ); // phase-bin accumulator                                                                                        
+
+      // as bin(), but flags rather than halts, as called from worker threads
+      auto pbin = [&]( double p ) {
+	int b = (int)floor( MiscMath::as_angle_0_pos2neg( p ) ) / binsize;
+	if ( b < 0 || b >= nbins ) perm_bad[r] = 1;
+	else ++pbacc[b];
+      };
       
       // magnitude stats (may be from within-SO permutation if mask defined
 
@@ -510,17 +531,9 @@ itpc_t hilbert_t::phase_events( const std::vector<int> & e ,
 
 	      // SO-phase stratified overlap counts when no mask/SO given
 	      if ( by_phase )
-		bin( ph[ pei ] , binsize , &pbacc );
+		pbin( ph[ pei ] );
 	    }
 
-
-	  
-// 	  std::cerr << "pp " << i << "\t" << e[i] << " " << ( mask == NULL ? "noM" : "M" ) << " " 
-// 		    << ( mask == NULL || (*mask)[e[i]] ) 
-// 		    << " - "
-// 		    << pei << " " << ( mask == NULL || (*mask)[pei] ) ;
-	  
-	 
 	  //
 	  // within-SO permutation, optionally modifies 'pei' for spindles that are originally in a SO (so_size>0)
 	  //
@@ -529,7 +542,7 @@ itpc_t hilbert_t::phase_events( const std::vector<int> & e ,
 	    {
 	      
 	      // different random shift for each event, based on the spanning SO
-	      int shift = CRandom::rand( so_size[ i ] );
+	      int shift = rng.rand( so_size[ i ] );
 	      
 	      pei = e[i] + shift; 
 
@@ -537,13 +550,10 @@ itpc_t hilbert_t::phase_events( const std::vector<int> & e ,
 	      if ( so_offset[i] + shift >= so_size[i] ) pei -= so_size[i] ; 
 	      
 	      // check: this should never happen, i.e. as we are controlling for SO overlap in this case 
-	      if ( mask != NULL && ! (*mask)[ pei ] ) Helper::halt( "internal error in phase_events() perm" );
+	      if ( ! (*mask)[ pei ] ) { perm_bad[r] = 1; continue; }
 
 	    }
 
-// 	  std::cerr << " - "
-// 		    << pei << " " << ( mask == NULL || (*mask)[pei] )  << "\n";
-	  
 	  //
 	  // now, pei should be correctly set, *either* based on default permutation (unconstrained or within-epoch) *or* 
 	  // within SO, if a mask has been specified (in which case, the within-epoch option is ignored, as it implicitly holds anyway, 
@@ -566,7 +576,7 @@ itpc_t hilbert_t::phase_events( const std::vector<int> & e ,
 	      
 	      // SO-phase stratified overlap counts using within-SO permutation
 	      if ( by_phase )
-		bin( ph[ pei ] , binsize , &pbacc );
+		pbin( ph[ pei ] );
 	      
 	    }
 	  
@@ -576,21 +586,35 @@ itpc_t hilbert_t::phase_events( const std::vector<int> & e ,
 	  
 	}
 
+      perm_overlap[r] = overlap;
+      perm_counted[r] = counted;
+      perm_s[r] = s;
+      if ( by_phase ) perm_pbacc[r] = pbacc;
+      
+      return counted == 0 ? 0 : abs( s / double(counted) );
+      
+    } );
 
-      //
-      // record stats
-      //
-            
 
+  //
+  // record stats (serially, in replicate order)
+  //
+
+  for (int r = 0 ; r < nreps ; r++ ) 
+    {
+
+      if ( perm_bad[r] ) 
+	Helper::halt( "internal error in phase_events() perm" );
+      
       // overlap statistics
-      //      std::cerr << "po = " << overlap << "\n";
       
-      itpc.ninc.perm.push_back( overlap );
+      itpc.ninc.perm.push_back( perm_overlap[r] );
       
       if ( by_phase ) 
 	for (int b=0; b < nbins; b++) 
-	  itpc.phasebin[b].perm.push_back ( pbacc[b] );
+	  itpc.phasebin[b].perm.push_back ( perm_pbacc[r][b] );
       
+      const int counted = perm_counted[r];
 
       // this should not happen now, i.e. given within-SO permutation is employed is a SO-mask is set
       // and so we likely do not need to handle this as a special case
@@ -607,7 +631,7 @@ itpc_t hilbert_t::phase_events( const std::vector<int> & e ,
       else
 	{
 	  // normalise ITPC and return
-	  s /= double(counted);
+	  dcomp s = perm_s[r] / double(counted);
 	  
           double itpc_perm =  abs( s );
           itpc.itpc.perm.push_back( itpc_perm );
@@ -24,6 +24,8 @@
 #include "mse.h"
 
 #include "miscmath/miscmath.h"
+#include "miscmath/crandom.h"
+#include "helper/threads.h"
 
   
 #include <iostream>
@@ -55,9 +57,10 @@ _______________________________________________________________________________
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <algorithm>
 
 
-std::map<int,double> mse_t::calc( const std::vector<double> & d )
+std::map<int,double> mse_t::calc( const std::vector<double> & d , int nthreads )
 {
   
   std::map<int,double> retval;
@@ -69,20 +72,28 @@ std::map<int,double> mse_t::calc( const std::vector<double> & d )
   
   // get SD for data
   //double sdev = SD( zd );
-    
-  // Iterate over each scale j
+  
+  std::vector<int> scales;
   for (int j = 1; j <= scale_max; j += scale_step)
-    {      
+    scales.push_back( j );
+  
+  std::vector<double> se( scales.size() );
+  
+  // Iterate over each scale j
+  luna_threads::parallel_for( scales.size() , nthreads , [&]( int k ) {
       
-      std::vector<double> y = coarse_graining( zd , j ) ;
+      std::vector<double> y = coarse_graining( zd , scales[k] ) ;
       
       // faster version (from mse.c)
       //retval[j] = sample_entropy( y , 1.0 );
       
-      // old version (slower)
-      retval[j] = sampen( y , m , r );
+      // old version (slower) : sampen( y , m , r )
+      se[k] = sampen_fast( y , m , r );
       
-    }
+    } );
+
+  for (int k = 0 ; k < scales.size() ; k++ )
+    retval[ scales[k] ] = se[k];
   
   return retval;
 
@@ -244,3 +255,155 @@ double mse_t::sampen( const std::vector<double> y , int M , double r )
 
 
 
+
+
+// sampen_fast() should give identical counts, and so an identical
+// value, to sampen(): checked for white noise, a random walk, a
+// quantized signal (many ties, and differences of exactly r), a
+// large offset, and with a NaN, for m = 1..4 and a range of r
+
+bool mse_t::selftest()
+{
+  
+  CRandomStream rnd( 4321 );
+
+  bool okay = true;
+
+  const int n = 1500;
+
+  for (int s = 0 ; s < 5 ; s++)
+    {
+      std::vector<double> y( n );
+      double walk = 0;
+      for (int i = 0 ; i < n ; i++)
+	{
+	  // approx. N(0,1)
+	  double z = -6;
+	  for (int j = 0 ; j < 12 ; j++) z += rnd.rand();
+	  walk += 0.1 * z;
+	  if      ( s == 0 ) y[i] = z;
+	  else if ( s == 1 ) y[i] = walk;
+	  else if ( s == 2 ) y[i] = 0.05 * floor( z / 0.05 );
+	  else y[i] = 1000 + z;
+	}
+      if ( s == 4 ) y[ n / 2 ] = NAN;
+      
+      const double rs[] = { 0.05 , 0.1 , 0.15 , 0.2 , 0.5 , 1.0 };
+      
+      for (int m = 1 ; m <= 4 ; m++)
+	for (int k = 0 ; k < 6 ; k++)
+	  {
+	    // nb. sampen() reports SampEn for the member m
+	    mse_t mse( 1 , 20 , 1 , m , rs[k] );
+	    const double a = mse.sampen( y , m , rs[k] );
+	    const double b = mse.sampen_fast( y , m , rs[k] );
+	    if ( a != b && ! ( std::isnan( a ) && std::isnan( b ) ) )
+	      {
+		std::cerr << "sampen_fast() mismatch: signal " << s << " m " << m << " r " << rs[k] 
+			  << " : " << b << " vs " << a << "\n";
+		okay = false;
+	      }
+	  }
+    }
+  
+  return okay;
+}
+
+
+// sampen_fast() gives identical counts to sampen(): a pair of templates
+// can only match (|difference| < r at every point) if their first
+// (two) points fall in the same or adjacent cells of a grid of width
+// (just over) r; templates are sorted by cell, and for each template
+// only the 3 (or 3x3) neighbouring cells are scanned
+
+double mse_t::sampen_fast( const std::vector<double> & y , int M , double r )
+{
+  
+  const int n = y.size();
+
+  // number of templates of length M that can be extended to M+1
+  const int nt = n - M;
+
+  if ( M < 1 || ! ( r > 0 ) || nt < 1 ) 
+    return sampen( y , M , r );
+  
+  for (int i = 0 ; i < n ; i++) 
+    if ( ! std::isfinite( y[i] ) ) return sampen( y , M , r );
+
+  // grid on first one or two points of each template
+  const int dims = M < 2 ? 1 : 2 ;
+  
+  // slightly wider than r, so rounding in y/w can never
+  // place two matching points more than one cell apart
+  const double w = r * ( 1 + 1e-6 );
+
+  typedef std::pair<long,long> cell_t;
+  
+  std::vector<std::pair<cell_t,int> > tmpl( nt );
+  for (int a = 0 ; a < nt ; a++)
+    {
+      const long cx = floor( y[a] / w );
+      const long cy = dims == 2 ? floor( y[a+1] / w ) : 0 ;
+      tmpl[a] = std::make_pair( cell_t( cx , cy ) , a );
+    }
+  
+  std::sort( tmpl.begin() , tmpl.end() );
+
+  // distinct cells, and their [start,end) in tmpl
+  std::vector<cell_t> cells;
+  std::vector<int> start;
+  for (int k = 0 ; k < nt ; k++)
+    if ( k == 0 || tmpl[k].first != tmpl[k-1].first )
+      {
+	cells.push_back( tmpl[k].first );
+	start.push_back( k );
+      }
+  start.push_back( nt );
+  
+  const int nc = cells.size();
+
+  // pairs matching on M points (B) and on M+1 points (A) 
+  long A = 0 , B = 0;
+  
+  std::vector<int> nbr;
+  
+  for (int c = 0 ; c < nc ; c++)
+    {
+      
+      // neighbouring (non-empty) cells
+      nbr.clear();
+      for (int dx = -1 ; dx <= 1 ; dx++)
+	for (int dy = ( dims == 2 ? -1 : 0 ) ; dy <= ( dims == 2 ? 1 : 0 ) ; dy++)
+	  {
+	    cell_t key( cells[c].first + dx , cells[c].second + dy );
+	    std::vector<cell_t>::const_iterator ii = std::lower_bound( cells.begin() , cells.end() , key );
+	    if ( ii != cells.end() && *ii == key ) nbr.push_back( ii - cells.begin() );
+	  }
+      
+      for (int k = start[c] ; k < start[c+1] ; k++)
+	{
+	  const int a = tmpl[k].second;
+	  
+	  for (int q = 0 ; q < nbr.size() ; q++)
+	    for (int l = start[ nbr[q] ] ; l < start[ nbr[q]+1 ] ; l++)
+	      {
+		// count each pair once
+		const int b = tmpl[l].second;
+		if ( b <= a ) continue;
+		
+		int t = 0;
+		while ( t < M && ( y[b+t] - y[a+t] ) < r && ( y[a+t] - y[b+t] ) < r ) ++t;
+		if ( t < M ) continue;
+		
+		++B;
+		if ( ( y[b+M] - y[a+M] ) < r && ( y[a+M] - y[b+M] ) < r ) ++A;
+	      }
+	}
+    }
+  
+  const double p = A / (double)B;
+
+  if ( p == 0 ) return -1;
+  return -log( p );
+
+}
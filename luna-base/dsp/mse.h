@@ -37,8 +37,16 @@ struct mse_t
 
   double SD( const std::vector<double> & x );
   
+  // reference O(N^2) implementation 
   double sampen( const std::vector<double> y , int M , double r );
 
+  // same statistic, but counting matches only between templates in
+  // neighbouring (r-sized) grid cells
+  double sampen_fast( const std::vector<double> & y , int M , double r );
+
+  // sampen_fast() vs sampen() over a range of signals, m and r (-d sampen)
+  static bool selftest();
+
   // MSE
   
   mse_t( const int scale_min = 1 , 
@@ -53,7 +61,8 @@ struct mse_t
         scale_step(scale_step)  
     {   }
   
-  std::map<int,double> calc( const std::vector<double> & d );
+  // scales are evaluated over up to 'nthreads' threads
+  std::map<int,double> calc( const std::vector<double> & d , int nthreads = 1 );
   
 private:
 
@@ -27,6 +27,7 @@
 
 #include <cstdio>
 #include <cmath>
+#include <vector>
 
 #include "nrutil.h"
 #include "mtm.h"
@@ -43,7 +44,6 @@ int mtm::adwait(double *sqr_spec,  double *dcf,
   // Thomson's algorithm for calculating the adaptive spectrum estimate
 
   double as,das,tol,a1,scale,ax,fn,fx;
-  double *spw, *bias;
   double test_tol, dif;
   int jitter, i,j,k, kpoint, jloop;
   double df;
@@ -70,10 +70,14 @@ int mtm::adwait(double *sqr_spec,  double *dcf,
     //  in this application we scale the eigenspectra by the bias in order to avoid
     //  possible floating point overflow
 
-    spw=dvector(0,nwin);
-    bias=dvector(0,nwin);
+    // eigenspectra are frequency-major, sqr_spec[ jloop * nwin + i ]
+    
+    std::vector<double> spw( nwin ) , bias( nwin ) , sqrtel( nwin );
     for( i=0;i<nwin; i++)
-      bias[i]=(1.00-el[i]);
+      {
+	bias[i]=(1.00-el[i]);
+	sqrtel[i]=sqrt(el[i]);
+      }
     
     /*
       for( i=1;i<=nwin; i++) fprintf(stderr,"%f %f\n",el[i], bias[i]);
@@ -85,11 +89,9 @@ int mtm::adwait(double *sqr_spec,  double *dcf,
     for( jloop=0; jloop<num_freq; jloop++)
       {   
 	
+	const double * ss = sqr_spec + (size_t)jloop * nwin;
 	for( i=0;i<nwin; i++)
-	  {
-	    kpoint=jloop+i*num_freq;
-            spw[i]=(sqr_spec[kpoint])/scale ;
-	  }
+	  spw[i] = ss[i] / scale ;
 
 	
 	// first guess is the average of the two 
@@ -108,7 +110,7 @@ int mtm::adwait(double *sqr_spec,  double *dcf,
 	    
 	    for( i=0;i<nwin; i++)
 	      {
-		a1=sqrt(el[i])*as/(el[i]*as+bias[i]);
+		a1=sqrtel[i]*as/(el[i]*as+bias[i]);
 		a1=a1*a1;
 		fn=fn+a1*spw[i];
 		fx=fx+a1;
@@ -141,11 +143,11 @@ int mtm::adwait(double *sqr_spec,  double *dcf,
 	// calculate degrees of freedom
 
 	df=0.0;
+	kpoint=jloop*nwin;
 	for( i=0;i< nwin; i++)
 	  {
-	    kpoint=jloop+i*num_freq;
-	    dcf[kpoint]=sqrt(el[i])*as/(el[i]*as+bias[i]);
-	    df=df+dcf[kpoint]*dcf[kpoint];
+	    dcf[kpoint+i]=sqrtel[i]*as/(el[i]*as+bias[i]);
+	    df=df+dcf[kpoint+i]*dcf[kpoint+i];
 	  }
 
 	
@@ -153,14 +155,11 @@ int mtm::adwait(double *sqr_spec,  double *dcf,
 	// the first eigenspectrum this way we never have
 	// fewer than two degrees of freedom
 	
-	degf[jloop]=df*2./(dcf[jloop]*dcf[jloop]);
+	degf[jloop]=df*2./(dcf[kpoint]*dcf[kpoint]);
 	
       } //  end 100
     
     /*fprintf(stderr,"%d failed iterations\n",jitter);*/
 
-    free_dvector(spw,0,nwin);
-    free_dvector(bias,0,nwin);
-    
     return jitter;
 }
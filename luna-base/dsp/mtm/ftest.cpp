@@ -41,34 +41,34 @@ void mtm::get_F_values(double *sr, double *si, int nf, int nwin, double *Fvalue,
   // eigenspectra amu contains line frequency estimates and f-test
   // parameter
  
+  // sr and si are frequency-major, [ i * nwin + j ]
+
   double          sum, sumr, sumi, sum2;
   int             i, j, k;
-  double         *amur, *amui;
+  double          amur, amui;
   sum = 0.;
-  amur = dvector((long) 0, (long) nf);
-  amui = dvector((long) 0, (long) nf);
   
   for (i = 0; i < nwin; i++)
     sum = sum + b[i] * b[i];
   
   for (i = 0; i < nf; i++) {
-    amur[i] = 0.;
-    amui[i] = 0.;
+    amur = 0.;
+    amui = 0.;
     for (j = 0; j < nwin; j++) {
-      k = i + j * nf;
-      amur[i] = amur[i] + sr[k] * b[j];
-      amui[i] = amui[i] + si[k] * b[j];
+      k = i * nwin + j;
+      amur = amur + sr[k] * b[j];
+      amui = amui + si[k] * b[j];
     }
-    amur[i] = amur[i] / sum;
-    amui[i] = amui[i] / sum;
+    amur = amur / sum;
+    amui = amui / sum;
     sum2 = 0.;
     for (j = 0; j < nwin; j++) {
-      k = i + j * nf;
-      sumr = sr[k] - amur[i] * b[j];
-      sumi = si[k] - amui[i] * b[j];
+      k = i * nwin + j;
+      sumr = sr[k] - amur * b[j];
+      sumi = si[k] - amui * b[j];
       sum2 = sum2 + sumr * sumr + sumi * sumi;
     }
-    Fvalue[i] = (double) (nwin - 1) * (SQR(amui[i]) + SQR(amur[i])) * sum / sum2;
+    Fvalue[i] = (double) (nwin - 1) * (SQR(amui) + SQR(amur)) * sum / sum2;
     /* percival and walden, eq 499c, p499 */
     /* sum = Hk(0) squared  */
   }
@@ -39,11 +39,11 @@ int mtm::hires(double *sqr_spec,  double *el, int nwin, int num_freq, double *ar
   for (j = 0; j < num_freq; j++)
     ares[j] = 0.;
   
+  // sqr_spec is frequency-major, [ j * nwin + i ]
   for (i = 0; i < nwin; i++) {
-    k = i * num_freq;
     a = 1. / (el[i] * nwin);
     for (j = 0; j < num_freq; j++) {
-      kpoint = j + k;
+      kpoint = j * nwin + i;
       ares[j] = ares[j] +
 	a * ( sqr_spec[kpoint] );
     }
@@ -26,6 +26,8 @@
 #include "edf/slice.h"
 #include "eval.h"
 #include "fftw/fftwrap.h"
+#include "helper/threads.h"
+#include "timeline/epoch-map.h"
 
 #include "db/db.h"
 #include "helper/helper.h"
@@ -35,6 +37,50 @@
 extern writer_t writer;
 extern logger_t logger; 
 
+// write one (possibly binned) spectrum, under the current strata
+
+static void output_spectrum( const mtm_t & mtm , const double min_f , const double max_f , const int fac_f )
+{
+  
+  if ( fac_f > 1 )  // binned output
+    {
+      
+      // 'x' Hz bins
+      bin_t bin( min_f , max_f , fac_f );
+      
+      bin.bin( mtm.f , mtm.spec );
+      
+      // output
+      for ( int i = 0 ; i < bin.bfa.size() ; i++ ) 
+	{
+	  writer.level( ( bin.bfa[i] + bin.bfb[i] ) / 2.0 , globals::freq_strat );
+	  writer.value( "MTM" , bin.bspec[i] );
+	  if ( bin.nominal[i] != "" )
+	    writer.value( "INT" , bin.nominal[i] );
+	}
+      writer.unlevel( globals::freq_strat );
+      
+    }
+  
+  // otherwise, original entire spectrum
+  else
+    {
+      
+      for ( int i = 0 ; i < mtm.f.size() ; i++ ) 
+	{
+	  if ( mtm.f[i] <= max_f ) 
+	    {
+	      writer.level( mtm.f[i] , globals::freq_strat  );
+	      writer.value( "MTM" , mtm.spec[i] );
+	    }
+	}
+      writer.unlevel( globals::freq_strat );
+      
+    }
+  
+}
+
+
 void mtm::wrapper( edf_t & edf , param_t & param )
 {
   
@@ -76,7 +122,15 @@ void mtm::wrapper( edf_t & edf , param_t & param )
   
   if ( param.has( "full-spectrum" ) ) fac_f = 1 ; // return full spectrum, no binning.
   
+  //
+  // Spectra are computed in parallel (over channels for the whole
+  // signal, over channel x epoch pairs otherwise), and then written
+  // serially, in order; tapers are shared via mtm::dpss()
+  //
+
+  const int nt = globals::n_threads;
   
+
   //
   // Whole signal analyses
   //
@@ -87,84 +141,54 @@ void mtm::wrapper( edf_t & edf , param_t & param )
       interval_t interval = edf.timeline.wholetrace();
       
       //
-      // Get each signal
+      // Get each signal, in blocks of nt channels
       //
       
-      for (int s = 0 ; s < ns; s++ )
+      for (int s0 = 0 ; s0 < ns; s0 += nt )
 	{
 	  
-	  //
-	  // only consider data tracks
-	  //
-	  
-	  if ( edf.header.is_annotation_channel( signals(s) ) )
-	    continue;
+	  const int s1 = s0 + nt < ns ? s0 + nt : ns ;
 	  
 	  //
-	  // Stratify output by channel
+	  // Get data (only consider data tracks)
 	  //
 	  
-	  writer.level( signals.label(s) , globals::signal_strat );
+	  std::vector<int> chs;
+	  std::vector<std::vector<double> > block_data;
 	  
-	  //
-	  // Get data
-	  //
-	  
-	  slice_t slice( edf , signals(s) , interval );
-	  
-	  const std::vector<double> * d = slice.pdata();	   
+	  for (int s = s0 ; s < s1 ; s++ )
+	    {
+	      if ( edf.header.is_annotation_channel( signals(s) ) )
+		continue;
+	      
+	      slice_t slice( edf , signals(s) , interval );
+	      chs.push_back( s );
+	      block_data.push_back( *slice.pdata() );
+	    }
 	  
 	  //
 	  // call MTM
 	  //
 	  
-	  mtm_t mtm( npi , nwin );
+	  std::vector<mtm_t> block_mtm( chs.size() , mtm_t( npi , nwin ) );
 	  
-	  mtm.dB = dB;
-
-	  mtm.apply( d , Fs[s] );
+	  luna_threads::parallel_for( chs.size() , nt , [&]( int j ) {
+	      block_mtm[j].dB = dB;
+	      block_mtm[j].apply( &block_data[j] , Fs[ chs[j] ] );
+	      std::vector<double>().swap( block_data[j] );
+	    } );
 	  
-	  // for 1-sided spectrum, scale by x2
-	  // (skipping DC and NQ)
-	  
-	  if ( fac_f > 1 )
-	    {
-	      
-	      // 'x' Hz bins
-	      //	      std::cout << "DETS: " << wid_f << " " << max_f << " " << Fs[s] << "\n";
-	      bin_t bin( min_f , max_f , fac_f );
-	      
-	      bin.bin( mtm.f , mtm.spec );
-	      
-	      // output
-	      for ( int i = 0 ; i < bin.bfa.size() ; i++ ) 
-		{
-		  writer.level( ( bin.bfa[i] + bin.bfb[i] ) / 2.0 , globals::freq_strat );
-		  writer.value( "MTM" , bin.bspec[i] );
-		  if ( bin.nominal[i] != "" )
-		    writer.value( "INT" , bin.nominal[i] );
-		}
-	      writer.unlevel( globals::freq_strat );
-	      
-	    }
+	  //
+	  // Output, stratified by channel
+	  //
 	  
-	  // otherwise, original entire spectrum
-	  else
+	  for (int j = 0 ; j < chs.size() ; j++ )
 	    {
-	      
-	      for ( int i = 0 ; i < mtm.f.size() ; i++ ) 
-		{
-		  if ( mtm.f[i] <= max_f ) 
-		    {
-		      writer.level( mtm.f[i] , globals::freq_strat  );
-		      writer.value( "MTM" , mtm.spec[i] );
-		    }
-		}
-	      writer.unlevel( globals::freq_strat );
-	      
+	      writer.level( signals.label( chs[j] ) , globals::signal_strat );
+	      output_spectrum( block_mtm[j] , min_f , max_f , fac_f );
 	    }
 	  
-	} // next signal
+	} // next block of signals
       
       writer.unlevel( globals::signal_strat );
       
@@ -182,139 +206,34 @@ void mtm::wrapper( edf_t & edf , param_t & param )
  
    
   //
-  // Get each signal
+  // Each signal x epoch, via epoch_map_t
   //
   
-  for (int s = 0 ; s < ns; s++ )
-    {
-  
-      //
-      // reset timeline 
-      //
+  epoch_map_t emap( edf , signals );
 
-      edf.timeline.first_epoch();
-
-    
-      //
-      // only consider data tracks
-      //
-      
-      if ( edf.header.is_annotation_channel( signals(s) ) )
-	continue;
+  emap.run<mtm_t>( [&]( const epoch_view_t & v ) {
+      mtm_t mtm( npi , nwin );
+      mtm.dB = dB;
+      mtm.apply( v.data , Fs[ v.s ] );
+      return mtm;
+    } ,
+    [&]( int s , std::vector<mtm_t> & res ) {
       
       //
-      // Stratify output by channel
+      // Output, stratified by channel and epoch
       //
       
       writer.level( signals.label(s) , globals::signal_strat );
       
-
-      //
-      // for each each epoch 
-      //
-
-      int total_epochs = 0;
-      
-      
-      //
-      // Recycle tapers
-      //
-
-      std::vector<double> tapers, tapsum, lambda;
-      
-      while ( 1 ) 
+      for (int e = 0 ; e < res.size() ; e++ )
 	{
-	  
-	  int epoch = edf.timeline.next_epoch();      
-	  
-	  if ( epoch == -1 ) break;              
-	  
-	  //
-	  // stratify output by epoch
-	  //
-	  
-	  writer.epoch( edf.timeline.display_epoch( epoch ) );
-
-	  ++total_epochs;
-	  
-      	  
-	  //
-	  // Get data
-	  //
-	  
-	  interval_t interval = edf.timeline.epoch( epoch );
- 
-	  slice_t slice( edf , signals(s) , interval );
-	  
-	  const std::vector<double> * d = slice.pdata();	   
-	  
-	  //	  
-	  // call MTM
-	  //
-
-	  mtm_t mtm( npi , nwin );
-	  
-	  mtm.dB = dB;
-	  
-	  
-	  if ( total_epochs == 1 ) 
-	    {
-	      // write mode for tapers on the 1st epoch
-	      mtm.apply( d , Fs[s] , &tapers , &tapsum, &lambda );
-	    }
-	  else
-	    {
-	      // re-read tapers on subsequent 
-	      mtm.apply( d , Fs[s] , NULL, NULL, NULL, &tapers , &tapsum, &lambda );	      
-	    }
-	  
-
-	  //
-	  // Ouput
-	  //
-
-	  if ( fac_f > 1 )  // binned output
-	    {	       
-	      
-	      // wid_f (default 1) Hz bins
-	      bin_t bin( min_f , max_f , fac_f );
-	      
-	      bin.bin( mtm.f , mtm.spec );
-	      
-	      // output	       
-	      for ( int i = 0 ; i < bin.bfa.size() ; i++ ) 
-		{
-		  //writer.level( Helper::dbl2str( bin.bfa[i] ) + "-" + Helper::dbl2str( bin.bfb[i] ) ,  globals::freq_strat  );
-		  writer.level(  ( bin.bfa[i] + bin.bfb[i] ) / 2.0 , globals::freq_strat );
-		  writer.value( "MTM" , bin.bspec[i] );
-		  if ( bin.nominal[i] != "" )
-		    writer.value( "INT" , bin.nominal[i] );
-		}
-	      writer.unlevel( globals::freq_strat );
-	      
-	    }
-	  
-	  else // full-spectrum output
-	    {
-	      
-	      for ( int i = 0 ; i < mtm.f.size() ; i++ ) 
-		{
-		  if ( mtm.f[i] <= max_f ) 
-		    {
-		      writer.level( mtm.f[i] , globals::freq_strat  );
-		      writer.value( "MTM" , mtm.spec[i] );
-		    }
-		}
-	      
-	      writer.unlevel( globals::freq_strat );
-	      
-	    }
-	  
-	} // next epoch
+	  writer.epoch( edf.timeline.display_epoch( emap.epochs[e] ) );
+	  output_spectrum( res[e] , min_f , max_f , fac_f );
+	}
       
       writer.unepoch();
       
-    } // next signal
+    } );
   
   writer.unlevel( globals::signal_strat );
   
@@ -338,18 +257,10 @@ mtm_t::mtm_t( const double npi , const int nwin ) : npi(npi) , nwin(nwin)
 
 
 
-void mtm_t::apply( const std::vector<double> * d , const int fs , 
-		   std::vector<double> * write_tapers , 
-		   std::vector<double> * write_tapsum , 
-		   std::vector<double> * write_lambda , 
-		   const std::vector<double> * read_tapers , 
-		   const std::vector<double> * read_tapsum , 
-		   const std::vector<double> * read_lambda )
+void mtm_t::apply( const std::vector<double> * d , const int fs )
 {
   
-  std::vector<double> d2 = *d;
-  
-  double * data = (double*)&d2[0];
+  const double * data = d->size() ? &(*d)[0] : NULL ;
   
   // Fs is samples per second
   
@@ -357,10 +268,6 @@ void mtm_t::apply( const std::vector<double> * d , const int fs ,
   
   int num_points = d->size();
   
-  double fWidth =  npi/((double)num_points*dt);
-  
-  int K = (int) 2*num_points*fWidth*dt;
-  
   double nyquist = 0.5/dt;
   
   int klen = mtm::get_pow_2( num_points );
@@ -371,34 +278,19 @@ void mtm_t::apply( const std::vector<double> * d , const int fs ,
   
   int npoints = num_points;
   
-  int k = 1;
-  
   //  logger << "  running MTM based on " << klen << "-point FFT\n";
   
-  if ( 0 ) 
-    {
-      logger << "  MTM: number of points " << num_points << "\n"
-	     << "       fWidth           " << fWidth << "\n"
-	     << "       klen             " << klen << "\n"
-	     << "       df               " << df << "\n"
-	     << "       num_freqs        " << num_freqs << "\n";
-	}
+  // shared Slepian tapers (made on first use)
 
-
-  // mean-center
-  
-  if ( 0 ) 
-    {
-      double mean = mtm::remove_mean( data, npoints ); 
-    }
+  std::shared_ptr<const mtm_tapers_t> tapers = mtm::dpss( npoints , nwin , npi );
 
   spec.resize( klen ,  0 );  
   
   std::vector<double> dof( klen );
   std::vector<double> Fvalues( klen );
   
-  mtm::do_mtap_spec(&(data)[0], npoints, kind,  nwin,  npi, inorm, dt,
-		    &(spec)[0], &(dof)[0], &(Fvalues)[0], klen , display_tapers );
+  mtm::do_mtap_spec( data, npoints, kind, *tapers, inorm, dt,
+		     &(spec)[0], &(dof)[0], &(Fvalues)[0], klen , display_tapers );
   
   // shrink to positive spectrum 
   // and scale x2 for 
@@ -417,12 +309,6 @@ void mtm_t::apply( const std::vector<double> * d , const int fs ,
       // report dB?
       if ( dB ) spec[i] = 10 * log10( spec[i] );
       
-      // std::cerr << i << "\t" 
-      //           << f[i] << "\t" 
-      // 	   << spec[i] << "\t"
-      //           << 10*log10(spec[i]) << "\n";
-      
     }  
   
 }
-
@@ -28,20 +28,37 @@ struct param_t;
 
 #include <vector>
 #include <string>
+#include <memory>
 #include <stdint.h>
 
+
+//
+// Slepian (DPSS) tapers for a given number of points, NW and number
+// of tapers (K), packed taper-major, i.e. tapers[ k * npoints + i ];
+// tapsum (sum of each taper, for the F-test) and lambda (eigenvalues)
+// are of size K
+//
+
+struct mtm_tapers_t
+{
+  int npoints;
+  int nwin;
+  double npi;
+  
+  std::vector<double> tapers;
+  std::vector<double> tapsum;
+  std::vector<double> lambda;
+};
+
+
 struct mtm_t
 {
   
   mtm_t( const double npi = 3 , const int nwin = 5 );
-  
-  void apply( const std::vector<double> * , const int fs , 
-	      std::vector<double> * write_tapers = NULL , 
-	      std::vector<double> * write_tapsum = NULL , 
-	      std::vector<double> * write_lambda = NULL , 
-	      const std::vector<double> * read_tapers = NULL , 
-	      const std::vector<double> * read_tapsum = NULL , 
-	      const std::vector<double> * read_lambda = NULL );
+
+  // tapers are taken from mtm::dpss(); apply() can be called from
+  // several threads at once (on different mtm_t objects)
+  void apply( const std::vector<double> * , const int fs );
 
   // MTM parameters
   
@@ -89,6 +106,20 @@ namespace mtm
 {  
 
   void wrapper( edf_t & edf , param_t & param );
+
+  // shared, process-wide DPSS tapers: made once per (N, NW, K) by
+  // multitap() (which is not re-entrant, so this is serialised); the
+  // cache is cleared if it would grow beyond max_taper_cache_bytes
+  std::shared_ptr<const mtm_tapers_t> dpss( int npoints , int nwin , double npi );
+
+  const uint64_t max_taper_cache_bytes = 256 * 1024 * 1024;
+
+  // tapered FFTs are run in batches of up to this many (zero-padded) points
+  const int max_batch_points = 1 << 22;
+
+  // eigenspectra (sqr_spec, dcf, and sr/si below) are frequency-major,
+  // i.e. [ freq * nwin + taper ], so that per-frequency loops over tapers
+  // are contiguous
   
   int adwait(double *sqr_spec,
 	     double *dcf,
@@ -140,8 +171,7 @@ namespace mtm
   // npoints = number of points in data
 
   // kind = flag for choosing hires or adaptive weighting coefficients
-  // nwin = number of taper windows to calculate
-  // npi = order of the slepian functions
+  // tapers = slepian tapers (from dpss())
   // inorm = flag for choice of normalization
   // dt = sampling interval (time)
   
@@ -150,12 +180,10 @@ namespace mtm
   // Fvalues = Ftest value at each frequency estimate
   // klen = number of frequecies calculated (power of 2)
 
-  void  do_mtap_spec(double *data, int npoints, int kind,
-		     int nwin, double npi, int inorm, double dt,
+  void  do_mtap_spec(const double *data, int npoints, int kind,
+		     const mtm_tapers_t & tapers, int inorm, double dt,
 		     double *ospec, double *dof, double *Fvalues, int klen, 
-		     bool display_tapers , 
-		     std::vector<double> * write_tapers = NULL, std::vector<double> * write_tapsum = NULL, std::vector<double> * write_lambda = NULL , 
-		     const std::vector<double> * read_tapers = NULL , const std::vector<double> * read_tapsum = NULL, const std::vector<double> * read_lambda = NULL );
+		     bool display_tapers );
   
   
   // NR utilities
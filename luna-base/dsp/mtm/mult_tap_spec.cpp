@@ -26,11 +26,14 @@
 
 #include "mtm.h"
 #include "helper/helper.h"
+#include "fftw/fftwrap.h"
 
 #include <cstdio>
 #include <cstdlib>
 #include <cmath>
 #include <iostream>
+#include <map>
+#include <mutex>
 
 #define ABS(a) ((a) < (0) ? -(a) : (a))
 
@@ -75,24 +78,56 @@ void  mtm::mt_get_spec(double *series, int inum, int klength, double *amp)
   
 }
 
-void  mtm::do_mtap_spec( double *data, 
+std::shared_ptr<const mtm_tapers_t> mtm::dpss( int npoints , int nwin , double npi )
+{
+
+  static std::mutex lock;
+  static std::map<std::pair<std::pair<int,int>,double>,std::shared_ptr<const mtm_tapers_t> > cache;
+  static uint64_t cache_bytes = 0;
+  
+  std::lock_guard<std::mutex> lk( lock );
+
+  std::pair<std::pair<int,int>,double> key( std::make_pair( npoints , nwin ) , npi );
+
+  std::map<std::pair<std::pair<int,int>,double>,std::shared_ptr<const mtm_tapers_t> >::const_iterator ii = cache.find( key );
+  if ( ii != cache.end() ) return ii->second;
+
+  std::shared_ptr<mtm_tapers_t> t( new mtm_tapers_t );
+  t->npoints = npoints;
+  t->nwin = nwin;
+  t->npi = npi;
+  t->tapers.resize( (size_t)npoints * nwin );
+  t->tapsum.resize( nwin );
+  t->lambda.resize( nwin );
+  
+  multitap( npoints , nwin , &(t->lambda)[0] , npi , &(t->tapers)[0] , &(t->tapsum)[0] );
+  
+  // entries still in use elsewhere are kept alive by their shared_ptr
+  const uint64_t bytes = sizeof(double) * ( t->tapers.size() + 2 * nwin );
+  if ( cache_bytes + bytes > max_taper_cache_bytes )
+    {
+      cache.clear();
+      cache_bytes = 0;
+    }
+  
+  cache[ key ] = t;
+  cache_bytes += bytes;
+  
+  return t;
+}
+
+
+void  mtm::do_mtap_spec( const double *data, 
 			 int npoints, 
 			 int kind,
-			 int nwin, 
-			 double npi, 
+			 const mtm_tapers_t & slepian , 
 			 int inorm, 
 			 double dt,
 			 double *ospec, 
 			 double *dof, 
 			 double *Fvalues, 
 			 int klen, 
-			 bool display_tapers , 
-			 std::vector<double> * write_tapers , 
-			 std::vector<double> * write_tapsum , 
-			 std::vector<double> * write_lambda , 
-			 const std::vector<double> * read_tapers , 
-			 const std::vector<double> * read_tapsum , 
-			 const std::vector<double> * read_lambda )
+			 bool display_tapers )
 
 {
 
@@ -101,9 +136,7 @@ void  mtm::do_mtap_spec( double *data,
     npoints = number of points in data
     kind = flag for choosing hires or adaptive weighting coefficients
 
-    nwin = number of taper windows to calculate
-
-    npi = order of the slepian functions
+    slepian = tapers, tapsum and lambda (nwin, npi), from dpss()
 
     inorm = flag for choice of normalization
 
@@ -120,92 +153,24 @@ void  mtm::do_mtap_spec( double *data,
 */
 
   
-  int             i, j, k;
-  double         *lambda, *tapers;
-  long            len, longlen;
-  double          *xt;
-  
-  int             logg;
-  int             nn;
-  double          *b;
-  int             iwin, kk;
+  int             i, j;
   
-  /*************/
   double          anrm, norm;
-  double            *ReSpec, *ImSpec;
-  double         *sqr_spec,  *amu;
-  double          *amp, *fv;
-  double          avamp, temp, sqramp;
-  double          sum, *tapsum;
-  /************/
   int num_freqs;
-  int len_taps, num_freq_tap;
-  
-  double         *dcf, *degf, avar;
-  int             n1, n2, kf;
-  int             flag;
-  int             one = 1;
+  double avar;
   
-  double tem1, tem2;
-  
-  /* lambda = vector of eigenvalues   
-     tapsum = sum of each taper, saved for use in adaptive weighting  
-     tapers =  matrix of slepian tapers, packed in a 1D double array    
-  */
+  const int nwin = slepian.nwin;
+
+  if ( slepian.npoints != npoints ) 
+    Helper::halt( "internal error, wrong taper length" );
   
-  lambda = dvector((long)0, (long)nwin);
-  tapsum=dvector((long)0,(long)nwin);
-  len_taps = npoints * nwin;
-  tapers = dvector((long)0,(long) len_taps);
+  const double * tapers = &(slepian.tapers)[0];
   
   num_freqs = 1+klen/2;
-  num_freq_tap = num_freqs*nwin;
   
-  //  std::cerr << "dets = " << klen << " " << num_freqs << "\n";
-
-    
-  //
-  // calculate or read in Slepian tapers
-  //
+  const int num_freq_tap = num_freqs*nwin;
   
-  if ( read_tapers && read_tapsum && read_lambda ) 
-    {
-      if ( read_tapers->size() != len_taps ) Helper::halt( "internal error, wrong saved taper length" );
-      if ( read_tapsum->size() != nwin ) Helper::halt( "internal error, wrong saved taper length" );
-      if ( read_lambda->size() != nwin ) Helper::halt( "internal error, wrong saved taper length" );
-      for (int i=0;i<len_taps;i++) tapers[i] = (*read_tapers)[i];
-      for (int i=0;i<nwin;i++) tapsum[i] = (*read_tapsum)[i];
-      for (int i=0;i<nwin;i++) lambda[i] = (*read_lambda)[i];
-    }
-  else  // calculate tapers
-    {
-      k = multitap(npoints, nwin, lambda,  npi, tapers, tapsum);
-    }
   
-
-  
-  //
-  // write tapers?
-  //
-
-  if ( write_tapers ) 
-    {
-      write_tapers->resize( len_taps );
-      for (int i=0;i<len_taps;i++) (*write_tapers)[i] = tapers[i];
-    }
-
-  if ( write_tapsum ) 
-    {
-      write_tapsum->resize( nwin );
-      for (int i=0;i<nwin;i++) (*write_tapsum)[i] = tapsum[i];
-    }
-
-  if ( write_lambda ) 
-    {
-      write_lambda->resize( nwin );
-      for (int i=0;i<nwin;i++) (*write_lambda)[i] = lambda[i];
-    }
-
   // display tapers
   if ( display_tapers ) 
     {  
@@ -218,7 +183,7 @@ void  mtm::do_mtap_spec( double *data,
         
       for(j=0; j<nwin; j++) 
 	{
-	  std::cout << "LAMBDA " << j+1 << "\t" << lambda[j] << "\n";
+	  std::cout << "LAMBDA " << j+1 << "\t" << slepian.lambda[j] << "\n";
 	}
       
     }
@@ -250,77 +215,75 @@ void  mtm::do_mtap_spec( double *data,
     break;
   }
   
+  norm = 1.0/(anrm*anrm);
   
-  /* apply the taper in the loop.  do this nwin times  */
-  
-  b = vector((long)0, (long)npoints);
-  amu = dvector((long)0,(long) num_freqs);
-  sqr_spec = dvector((long)0,(long) num_freq_tap);
-  ReSpec = dvector((long)0,(long) num_freq_tap);
-  ImSpec = dvector((long)0,(long) num_freq_tap);
+  //
+  // Eigenspectra: all nwin tapered series are transformed through a
+  // single (cached) many-r2c FFTW plan, in batches of up to
+  // max_batch_points; spectra are stored frequency-major, [ i * nwin + taper ]
+  //
+
+  std::vector<double> sqr_spec( num_freq_tap );
+  std::vector<double> ReSpec( num_freq_tap );
+  std::vector<double> ImSpec( num_freq_tap );
   
+  const int nout = klen/2+1;
   
-  for (iwin = 0; iwin < nwin; iwin++) {
-    kk = iwin * npoints;
-    kf = iwin * num_freqs;
-    
-    for (j = 0; j < npoints; j++)
-      b[j] = data[j] * tapers[kk + j];   /*  application of  iwin-th taper   */
-    
-    amp = vector((long)0,(long) klen);
-    
-    mt_get_spec(b, npoints, klen, amp);  /* calculate the eigenspectrum */
-    
-    sum = 0.0;
+  int bs = max_batch_points / klen;
+  if ( bs < 1 ) bs = 1;
+  if ( bs > nwin ) bs = nwin;
 
-    
-    /* get spectrum from real fourier transform    */
-    
-    norm = 1.0/(anrm*anrm);
-    
-    for(i=1; i<num_freqs-1; i++){
-      if(2*i+1 > klen) Helper::halt( "mtm_t error in index");
-      if(i+kf > num_freq_tap ) Helper::halt( "mtm_t error in index");
+  double * in = (double*)fftw_cache::alloc( sizeof(double) * klen * bs );
+  fftw_complex * out = (fftw_complex*)fftw_cache::alloc( sizeof(fftw_complex) * nout * bs );
+  
+  for (int w0 = 0; w0 < nwin; w0 += bs )
+    {
       
-      sqramp = SQR(amp[2*i+1])+SQR(amp[2*i]);
+      const int nb = w0 + bs > nwin ? nwin - w0 : bs ;
+
+      // apply tapers, and zero-pad to klen
+      for (int k = 0; k < nb; k++)
+	{
+	  const double * tt = tapers + (size_t)( w0 + k ) * npoints;
+	  double * ii = in + (size_t)k * klen;
+	  for (j = 0; j < npoints; j++)
+	    ii[j] = data[j] * tt[j];
+	  for (j = npoints; j < klen; j++)
+	    ii[j] = 0;
+	}
       
-      ReSpec[i+kf] = amp[2*i];
-      ImSpec[i+kf] = amp[2*i+1];
+      fftw_execute_dft_r2c( fftw_cache::r2c_many( klen , nb ) , in , out );
       
-      sqr_spec[i+kf] =    norm*(sqramp);
+      // get spectrum from real fourier transform; nb. the original
+      // (NR realft) code used the opposite sign convention, so keep
+      // the imaginary parts conjugated, as before
       
-      sum += sqr_spec[i+kf];
-    }
-    sqr_spec[0+kf] = norm*SQR(fabs(amp[0]));
-    sqr_spec[num_freqs-1+kf] = norm*SQR(fabs(amp[1]));
-    
-    ReSpec[0+kf] = amp[0];
-    ImSpec[0+kf] = 0.0;
-    
-    ReSpec[num_freqs-1+kf] = amp[1];
-    ImSpec[num_freqs-1+kf] = 0.0;
-    
-    sum += sqr_spec[0+kf] + sqr_spec[num_freqs-1+kf];
-    
-    if(num_freqs-1+kf>num_freq_tap ) Helper::halt( "mtm_t error in index");
-    
-    temp = sum / (double) num_freqs;
-    if (temp > 0.0)
-      avamp = sqrt(temp) / anrm;
-    else {
-      avamp = 0.0;
-      /* fprintf(stderr," avamp = 0.0! \n"); */ 
+      for (int k = 0; k < nb; k++)
+	{
+	  const fftw_complex * oo = out + (size_t)k * nout;
+	  const int iwin = w0 + k;
+	  
+	  for(i=0; i<num_freqs; i++)
+	    {
+	      const int kf = i * nwin + iwin;
+	      const double re = oo[i][0];
+	      const double im = i == 0 || i == num_freqs - 1 ? 0.0 : - oo[i][1];
+	      ReSpec[kf] = re;
+	      ImSpec[kf] = im;
+	      sqr_spec[kf] = norm * ( SQR( im ) + SQR( re ) );
+	    }
+	}
     }
-    
-    
-    free_vector(amp,(long) 0,(long) klen);
-    
-  }
   
-  free_vector(b, (long)0, (long)npoints);
-  fv = vector((long)0,(long) num_freqs);
-
-
+  fftw_cache::release( in , sizeof(double) * klen * bs );
+  fftw_cache::release( out , sizeof(fftw_complex) * nout * bs );
+  
+  std::vector<double> amu( num_freqs );
+  std::vector<double> fv( num_freqs );
+  
+  // tapsum and lambda are not modified below
+  double * tapsum = const_cast<double*>( &(slepian.tapsum)[0] );
+  double * lambda = const_cast<double*>( &(slepian.lambda)[0] );
   
   //
   // Hi-res or adaptive weighting for spectra
@@ -335,8 +298,8 @@ void  mtm::do_mtap_spec( double *data,
 
     case 1:
       
-      hires(sqr_spec,  lambda, nwin, num_freqs, amu);
-      get_F_values(ReSpec, ImSpec, num_freqs, nwin, fv, tapsum);
+      hires(&sqr_spec[0],  lambda, nwin, num_freqs, &amu[0]);
+      get_F_values(&ReSpec[0], &ImSpec[0], num_freqs, nwin, &fv[0], tapsum);
       
       for (i = 0; i < num_freqs; i++) 
 	{
@@ -357,12 +320,9 @@ void  mtm::do_mtap_spec( double *data,
       
       /* get avar = variance*/
       
-      n1 = 0;
-      n2 = npoints;
-      
       avar = 0.0;
       
-      for (i = n1; i < n2; i++)
+      for (i = 0; i < npoints; i++)
 	avar += (data[i]) * (data[i]);
       
       
@@ -390,12 +350,12 @@ void  mtm::do_mtap_spec( double *data,
       }
       
       
-      dcf = dvector((long)0,(long) num_freq_tap);
-      degf = dvector((long)0,(long) num_freqs);
+      std::vector<double> dcf( num_freq_tap );
+      std::vector<double> degf( num_freqs );
       
-      adwait(sqr_spec, dcf, lambda, nwin, num_freqs, amu, degf, avar);
+      adwait(&sqr_spec[0], &dcf[0], lambda, nwin, num_freqs, &amu[0], &degf[0], avar);
       
-      get_F_values(ReSpec, ImSpec, num_freqs, nwin, fv, tapsum);
+      get_F_values(&ReSpec[0], &ImSpec[0], num_freqs, nwin, &fv[0], tapsum);
     
       /* rap up   */
       
@@ -405,32 +365,7 @@ void  mtm::do_mtap_spec( double *data,
 	Fvalues[i] = fv[i];
       }
     
-      
-      free_dvector(dcf,(long)0,(long) num_freq_tap);
-      free_dvector(degf,(long)0,(long) num_freqs);
-      free_vector(fv,(long)0,(long) num_freqs);
-      
-      
       break;
     }
   
-
-  //
-  // Free up memory, return...
-  //
-  
-  free_dvector(amu,(long)0,(long) num_freqs);  
-  
-  free_dvector(sqr_spec, (long)0,(long) num_freq_tap);
-
-  free_dvector(ReSpec, (long)0,(long) num_freq_tap);
-  
-  free_dvector(ImSpec, (long)0,(long) num_freq_tap);
-  
-  free_dvector(lambda,(long) 0,(long) nwin);
-  
-  free_dvector(tapers,(long) 0, (long)len_taps);
-
-  free_dvector(tapsum,(long) 0, (long)nwin);
-  
 }
@@ -25,6 +25,7 @@
 #include "eval.h"
 
 #include "cwt/cwt.h"
+#include "dsp/surrogates.h"
 #include "miscmath/crandom.h"
 #include "edf/edf.h"
 #include "edf/slice.h"
@@ -68,6 +69,9 @@ void dsptools::pac( edf_t & edf , param_t & param )
   // by default, 1000 replicates for permutation
   const int nreps = param.has("nreps") ? param.requires_int( "nreps" ) : 1000;
 
+  // optionally, stop early once this many null PACs exceed the observed
+  const int perm_stop = param.has( "perm-stop" ) ? param.requires_int( "perm-stop" ) : 0;
+
   // using epochs or not?
   bool epoched = param.has( "epoch" );
   
@@ -128,7 +132,7 @@ void dsptools::pac( edf_t & edf , param_t & param )
 	  // Calculate PAC
 	  //
 	  
-	  pac_t pac( signal , f4p , f4a , srate , nreps );
+	  pac_t pac( signal , f4p , f4a , srate , nreps , globals::n_threads , perm_stop );
 	  
 	  bool okay = pac.calc();
 	  
@@ -193,6 +197,7 @@ bool pac_t::calc()
 	CWT phase_cwt;	
 	phase_cwt.set_sampling_rate( srate );  
 	phase_cwt.add_wavelet( frq4phase[fa] , n_cycles );  
+	phase_cwt.store_power_vectors( false );
 	phase_cwt.load( data );
 	phase_cwt.run();
 	
@@ -203,6 +208,7 @@ bool pac_t::calc()
 	CWT pow_cwt;	
 	pow_cwt.set_sampling_rate( srate );  
 	pow_cwt.add_wavelet( frq4pow[fb] , n_cycles );  
+	pow_cwt.store_phase_vectors( false );
 	pow_cwt.load( data );
 	pow_cwt.run();
 	
@@ -231,14 +237,14 @@ bool pac_t::calc()
 	// Precalculate x and exp(y) 
 	//
 
-	std::vector<std::complex<double> > x(n);
- 
-	std::vector<std::complex<double> > y(n);
+	// exp(i.phase), as contiguous real/imaginary parts
+	std::vector<double> yre(n), yim(n);
 
 	for (int i=0;i<n;i++)
 	  {
-	    x[i] = std::complex<double>( pwr[i] , 0 );
-	    y[i] = exp( std::complex<double>( 0 , angle[i] ) );
+	    dcomp y = exp( std::complex<double>( 0 , angle[i] ) );
+	    yre[i] = y.real();
+	    yim[i] = y.imag();
 	  }
 	
 	//
@@ -247,48 +253,24 @@ bool pac_t::calc()
 	
 	// obsPAC = abs(mean(pwr.*exp(1i*phase)));
 	
-	dcomp sm = 0;
-	
-	for (int i=0; i<n; i++)
-	  sm += x[i] * y[i] ;
-	
-	double pac = abs( sm / (double)n );
+	double pac = abs( surrogates_t::circular_dot( yre , yim , pwr , 0 ) / (double)n );
 	
 	//
-	// Permute
+	// Permute: circularly shift power by a random time-point
+	// (from within 10-90% of signal)
 	// 
 	
-	std::vector<double> ppac( nreps , 0 ); // permuted PACs
-	double p = 1;
-	
-	for (int r=0; r<nreps ; r++ ) 
-	  {
+	surrogates_t surr( nreps , nthreads , stop );
 
-	    // from 0..n, select a random time-point (from within 10-90% of signal)
+	surr.draw( n * 0.1 , int( n * 0.8 ) );
 
-	    int pp = n * 0.1 + CRandom::rand( int( n * 0.8 ) );
-	    
-	    dcomp sm = 0;
-	
-	    for (int i=0; i<n; i++)
-	      {
+	surr.run( pac , [&]( int r ) {
+	    return abs( surrogates_t::circular_dot( yre , yim , pwr , surr.shift[r] ) / (double)n );
+	  } );
 
-		sm += x[pp] * y[i] ;
-		
-		// advance permuted position, 
-		++pp;
+	const std::vector<double> & ppac = surr.null;
 
-		// wrapping around when needed
-		if ( pp == n ) pp = 0;
-	      }
-	    
-	    ppac[r] = abs( sm / (double)n );
-	    
-	    if ( ppac[r] >= pac ) ++p;
-	    
-	  }
-	
-	p /= (double)(nreps+1);
+	double p = surr.pvalue();
 	
 	//
 	// Z-transform observed PAC
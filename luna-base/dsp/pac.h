@@ -37,7 +37,9 @@ struct pac_t
   pac_t( const std::vector<double> * d , 
 	 double a , double b ,
 	 const int sr ,
-	 const int nr = 1000 )
+	 const int nr = 1000 ,
+	 const int nt = 1 , 
+	 const int st = 0 )
   {
     frq4phase.clear();
     frq4pow.clear();
@@ -47,6 +49,8 @@ struct pac_t
     na = nb = 1;
     srate = sr;
     nreps = nr;
+    nthreads = nt;
+    stop = st;
     size();
   }
   
@@ -54,7 +58,9 @@ struct pac_t
 	 const std::vector<double> & a ,
 	 const std::vector<double> & b ,
 	 const int sr ,
-	 const int nr = 1000 )
+	 const int nr = 1000 ,
+	 const int nt = 1 , 
+	 const int st = 0 )
   {
     frq4phase = a;
     frq4pow = b;
@@ -63,6 +69,8 @@ struct pac_t
     data = d;
     srate = sr;
     nreps = nr;
+    nthreads = nt;
+    stop = st;
     size();
   }
 
@@ -119,6 +127,8 @@ struct pac_t
   int srate;
   int na,nb;
   int nreps;
+  int nthreads; // threads for the permutation
+  int stop;     // if >0, stop permuting once this many null PACs >= observed
 };
 
 
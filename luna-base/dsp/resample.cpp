@@ -23,6 +23,7 @@
 
 #include "resample.h"
 #include <iostream>
+#include <algorithm>
 
 #include "libsamplerate/samplerate.h"
 
@@ -32,37 +33,102 @@
 
 #include "helper/helper.h"
 #include "helper/logger.h"
+#include "helper/threads.h"
 
 extern logger_t logger;
 
-std::vector<double> dsptools::resample( const std::vector<double> * d , 
-					int sr1 , int sr2 )
+
+int dsptools::resample_converter( const std::string & method )
 {
+  if ( method == "best" ) return SRC_SINC_BEST_QUALITY;
+  if ( method == "medium" ) return SRC_SINC_MEDIUM_QUALITY;
+  if ( method == "fastest" ) return SRC_SINC_FASTEST;
+  if ( method == "zoh" ) return SRC_ZERO_ORDER_HOLD;
+  if ( method == "linear" ) return SRC_LINEAR;
+  Helper::halt( "method should be best, medium, fastest, zoh or linear" );
+  return SRC_SINC_FASTEST;
+}
 
 
-  int n = d->size();
-  std::vector<float> f( n );
-  for (int i=0;i<n;i++) f[i] = (*d)[i];
+// returns 0 or an SRC error code; does not halt, so can be called
+// from worker threads
+
+static int resample_stream( const std::vector<double> * d , 
+			    int sr1 , int sr2 , 
+			    const int converter , const int block , 
+			    std::vector<double> * out )
+{
+
+  const int n = d->size();
   
-  double ratio = sr2 / (double)sr1;
+  const double ratio = sr2 / (double)sr1;
+
   const int n2 = n * ratio;
-  std::vector<float> f2( n2 );
+
+  out->assign( n2 , 0 );
+
+  if ( n2 == 0 ) return 0;
+  
+  int err = 0;
+
+  SRC_STATE * state = src_new( converter , 1 , &err );
+
+  if ( state == NULL ) return err;
 
   // pad a little at end (probably not necessary)
-  for (int i=0;i<10;i++) 
-    {
-      ++n;
-      f.push_back(0);
-    }
+  const int npad = n + 10;
 
+  const int bs = block > 0 ? block : 4096 ;
+
+  std::vector<float> fin( bs );
+  std::vector<float> fout( bs * ratio + 16 );
+  
   SRC_DATA src;
-  src.data_in = &(f[0]);
-  src.input_frames = n;
-  src.data_out = &(f2[0]);
-  src.output_frames = n2;
   src.src_ratio = ratio;
 
-  int r = src_simple( &src, SRC_SINC_FASTEST , 1 );
+  int pos = 0; // input samples consumed
+  int o = 0;   // output samples generated
+
+  while ( o < n2 )
+    {
+      const int nin = std::min( bs , npad - pos );
+
+      for (int i=0; i<nin; i++) 
+	fin[i] = pos + i < n ? (*d)[ pos + i ] : 0 ;
+      
+      src.data_in = &(fin[0]);
+      src.input_frames = nin;
+      src.data_out = &(fout[0]);
+      src.output_frames = std::min( (int)fout.size() , n2 - o );
+      src.end_of_input = pos + nin == npad;
+      
+      err = src_process( state , &src );
+      
+      if ( err ) break;
+
+      for (int i=0; i<src.output_frames_gen; i++) 
+	(*out)[ o++ ] = fout[i];
+      
+      pos += src.input_frames_used;
+      
+      // all input used, and nothing more to flush
+      if ( src.end_of_input && src.output_frames_gen == 0 ) break;
+    }
+  
+  src_delete( state );
+
+  return err;
+}
+
+
+std::vector<double> dsptools::resample( const std::vector<double> * d , 
+					int sr1 , int sr2 , 
+					const int converter , const int block )
+{
+
+  std::vector<double> out;
+
+  int r = resample_stream( d , sr1 , sr2 , converter , block , &out );
   
   // problem?
   if ( r ) 
@@ -71,74 +137,81 @@ std::vector<double> dsptools::resample( const std::vector<double> * d ,
       Helper::halt( "problem in resample()" );
     }
 
-  std::vector<double> out( n2 );
-  for (int i=0;i<n2;i++) out[i] = f2[i];
-
   return out;
 }
 
 
-void dsptools::resample_channel( edf_t & edf , const int s , const int nsr )
+// resample a set of channels (all needing it): signals are pulled out
+// and placed back serially, in order; up to nt are resampled in parallel
+
+static void resample_block( edf_t & edf , const std::vector<int> & chs , const int nsr , const int converter , const int nt )
 {
-  
-  // s is in 0..ns space  (not 0..ns_all)  
 
-  if ( edf.header.is_annotation_channel(s) ) return;
-    
-  //
-  // Original sample rate 
-  //
+  const int nb = chs.size();
   
-  const int Fs = edf.header.sampling_freq(  s ) ;
-  
-  // already done?
-  if ( Fs == nsr ) return; 
-
+  std::vector<std::vector<double> > in( nb ) , out( nb );
+  std::vector<int> Fs( nb ) , err( nb );
 
-  //
-  // Ouput
-  //
-
-  logger << "  resampling channel " << edf.header.label[ s ] << " from sample rate " << Fs << " to " << nsr << "\n";
-  
   //
   // Pull entire signals out
   //
-  
-  interval_t interval = edf.timeline.wholetrace();
 
-  slice_t slice( edf , s , interval );
+  for (int j=0; j<nb; j++)
+    {
+      const int s = chs[j];
+      Fs[j] = edf.header.sampling_freq( s );
+      logger << "  resampling channel " << edf.header.label[ s ] << " from sample rate " << Fs[j] << " to " << nsr << "\n";
+      slice_t slice( edf , s , edf.timeline.wholetrace() );
+      in[j] = *slice.pdata();
+    }
 
-  const std::vector<double> * d = slice.pdata();
-  
   //
-  // Resample to new SR
+  // Resample to new SR, one EDF record at a time
   //
 
-  std::vector<double> resampled = resample( d , Fs , nsr );
-  
-  // 
-  // Ensure that resultant signal is the exact correct length 
-  //
+  luna_threads::parallel_for( nb , nt , [&]( int j ) {
+      err[j] = resample_stream( &in[j] , Fs[j] , nsr , converter , Fs[j] * edf.header.record_duration , &out[j] );
+      std::vector<double>().swap( in[j] );
+    } );
+
+  for (int j=0; j<nb; j++)
+    {
+      
+      // problem?
+      if ( err[j] ) 
+	{
+	  logger << src_strerror ( err[j] ) << "\n";
+	  Helper::halt( "problem in resample()" );
+	}
+      
+      const int s = chs[j];
+
+      // ensure that resultant signal is the exact correct length (zero-pad if necessary)
+      out[j].resize( edf.header.nr * edf.header.record_duration * nsr , 0 );
+
+      // update EDF header with new sampling rate: n_samples_all[] is mapped against the
+      // contents of the EDF (to skip signals when reading) and so stays as is
+      edf.header.n_samples[ s ] = nsr * edf.header.record_duration ;
+
+      // place back
+      edf.update_signal( s , &out[j] );
+      std::vector<double>().swap( out[j] );
+    }
   
-  resampled.resize( edf.header.nr * edf.header.record_duration * nsr , 0 ); // i.e. zero-pad if necessary
+}
 
 
-  //
-  // Update EDF header with new sampling rate
-  //
-  
-  // note: the EDF header also contains n_samples_all[], which is mapped against the contents of the EDF, 
-  // rather than the set of selected signals.   This should stay as is, in any case, i.e. it is only used 
-  // to know how to skip signals when reading the EDF, i.e. and this won't change.
-  
-  edf.header.n_samples[ s ] = nsr * edf.header.record_duration ;
+void dsptools::resample_channel( edf_t & edf , const int s , const int nsr , const int converter )
+{
   
-  //
-  // Place back
-  //
+  // s is in 0..ns space  (not 0..ns_all)  
+
+  if ( edf.header.is_annotation_channel(s) ) return;
+    
+  // already done?
+  if ( edf.header.sampling_freq( s ) == nsr ) return; 
 
-  edf.update_signal( s , &resampled );
+  resample_block( edf , std::vector<int>( 1 , s ) , nsr , converter , 1 );
 
 }
 
@@ -148,14 +221,29 @@ void dsptools::resample_channel( edf_t & edf , param_t & param )
   
   std::string signal_label = param.requires( "sig" );
   signal_list_t signals = edf.header.signal_list( signal_label );      
-  std::vector<double> Fs = edf.header.sampling_freq( signals );
 
   // new sampling rate for all channels
   int sr = param.requires_int("sr");
 
-  const int ns = signals.size();
+  // SRC converter
+  const int converter = resample_converter( param.has( "method" ) ? param.value( "method" ) : "fastest" );
   
-  for (int s=0;s<ns;s++)
-    resample_channel( edf , signals(s) , sr );
+  //
+  // Up to nt channels at a time are resampled in parallel
+  //
 
+  const int nt = globals::n_threads > 1 ? globals::n_threads : 1 ;
+  
+  std::vector<int> todo;
+  for (int s=0; s<signals.size(); s++)
+    if ( ! edf.header.is_annotation_channel( signals(s) ) 
+	 && edf.header.sampling_freq( signals(s) ) != sr )
+      todo.push_back( signals(s) );
+
+  for (int b0 = 0 ; b0 < todo.size() ; b0 += nt )
+    {
+      const int nb = std::min( nt , (int)todo.size() - b0 );
+      resample_block( edf , std::vector<int>( todo.begin() + b0 , todo.begin() + b0 + nb ) , sr , converter , nt );
+    }
+  
 }
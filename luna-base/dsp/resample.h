@@ -31,14 +31,24 @@
 struct edf_t;
 struct param_t;
 
+#include <string>
+
 namespace dsptools 
 {
 
+  // SRC converter types: SRC_SINC_BEST_QUALITY (0), SRC_SINC_MEDIUM_QUALITY (1), 
+  // SRC_SINC_FASTEST (2, the default), SRC_ZERO_ORDER_HOLD (3) and SRC_LINEAR (4)
+  // from method=best, medium, fastest, zoh or linear
+  int resample_converter( const std::string & method );
+
   void resample_channel( edf_t & , param_t & );
 
-  void resample_channel( edf_t & , const int , const int );
+  void resample_channel( edf_t & , const int , const int , const int converter = 2 );
 
-  std::vector<double> resample( const std::vector<double> * d , int sr1 , int sr2 );
+  // streams the signal through a single SRC state, 'block' input samples
+  // at a time (so without whole-signal float copies)
+  std::vector<double> resample( const std::vector<double> * d , int sr1 , int sr2 , 
+				const int converter = 2 , const int block = 4096 );
 }
 
 
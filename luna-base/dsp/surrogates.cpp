@@ -0,0 +1,122 @@
+//    --------------------------------------------------------------------
+//
+//    This file is part of Luna.
+//
+//    LUNA is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    Luna is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Luna. If not, see <http://www.gnu.org/licenses/>.
+//
+//    Please see LICENSE.txt for more details.
+//
+//    --------------------------------------------------------------------
+
+#include "dsp/surrogates.h"
+
+#include "miscmath/crandom.h"
+#include "helper/helper.h"
+
+#include <cmath>
+
+surrogates_t::surrogates_t( const int nreps , const int nthreads , const int stop )
+  : nreps(nreps) , nthreads(nthreads) , stop(stop) , nexceed(0) , stopped(false)
+{
+  if ( nreps < 0 ) Helper::halt( "nreps cannot be negative" );
+  if ( stop < 0 ) Helper::halt( "perm-stop cannot be negative" );
+}
+
+void surrogates_t::draw( const int lwr , const int range , const bool streams )
+{
+  shift.resize( nreps );
+  seed.clear();
+  if ( streams ) seed.resize( nreps );
+
+  for (int r=0;r<nreps;r++)
+    {
+      shift[r] = lwr + CRandom::rand( range );
+      if ( streams ) seed[r] = 1 + CRandom::rand( CRandom::IM - 1 );
+    }
+}
+
+
+std::complex<double> surrogates_t::circular_dot( const std::vector<double> & are ,
+						 const std::vector<double> & aim ,
+						 const std::vector<double> & b ,
+						 const int shift )
+{
+
+  // two contiguous runs: i = 0 .. n-shift-1 against b[shift..], then the
+  // wrapped remainder against b[0..]; same summation order as a single
+  // pass with an explicit wrap
+
+  const int n = are.size();
+  const int n1 = n - shift;
+
+  const double * pa = are.data();
+  const double * pi = aim.data();
+  const double * pb = b.data() + shift;
+
+  double sre = 0 , sim = 0;
+
+  for (int i=0; i<n1; i++)
+    {
+      sre += pb[i] * pa[i];
+      sim += pb[i] * pi[i];
+    }
+
+  pa += n1; pi += n1; pb = b.data();
+
+  for (int i=0; i<shift; i++)
+    {
+      sre += pb[i] * pa[i];
+      sim += pb[i] * pi[i];
+    }
+
+  return std::complex<double>( sre , sim );
+}
+
+
+void surrogates_t::circular_imag( const std::vector<double> & xre ,
+				  const std::vector<double> & xim ,
+				  const std::vector<double> & yre ,
+				  const std::vector<double> & yim ,
+				  const int shift ,
+				  double * numer , double * denom )
+{
+  const int n = xre.size();
+  const int n1 = n - shift;
+
+  const double * a = xre.data();
+  const double * b = xim.data();
+  const double * c = yre.data() + shift;
+  const double * d = yim.data() + shift;
+
+  double s = 0 , sa = 0;
+
+  for (int i=0; i<n1; i++)
+    {
+      const double im = a[i] * d[i] + b[i] * c[i];
+      s += im;
+      sa += fabs( im );
+    }
+
+  a += n1; b += n1; c = yre.data(); d = yim.data();
+
+  for (int i=0; i<shift; i++)
+    {
+      const double im = a[i] * d[i] + b[i] * c[i];
+      s += im;
+      sa += fabs( im );
+    }
+
+  *numer = s;
+  *denom = sa;
+}
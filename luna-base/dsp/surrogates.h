@@ -0,0 +1,134 @@
+//    --------------------------------------------------------------------
+//
+//    This file is part of Luna.
+//
+//    LUNA is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    Luna is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Luna. If not, see <http://www.gnu.org/licenses/>.
+//
+//    Please see LICENSE.txt for more details.
+//
+//    --------------------------------------------------------------------
+
+#ifndef __SURROGATES_H__
+#define __SURROGATES_H__
+
+#include <vector>
+#include <complex>
+
+#include "helper/threads.h"
+
+//
+// Circular-shift surrogate engine, shared by PAC, CC and the SO/spindle
+// coupling (hilbert_t::phase_events()) permutation tests
+//
+// One shift (and, optionally, one seed for a per-replicate CRandomStream)
+// is drawn serially from CRandom for every replicate up-front, so results
+// do not depend on the number of threads, nor on whether early stopping
+// kicks in.  Replicates are then evaluated in batches, split over threads.
+//
+// Early stopping (stop = h > 0) follows Besag & Clifford (1991): sampling
+// stops at the replicate l at which the h-th null statistic equals or
+// exceeds the observed, and p = h / l; otherwise, p = ( h' + 1 ) / ( n + 1 )
+// for h' exceedances in all n replicates.  Replicates of the last batch
+// after the l-th are discarded, so null.size() == l
+//
+
+struct surrogates_t
+{
+
+  surrogates_t( const int nreps , const int nthreads = 1 , const int stop = 0 );
+
+  // shift[r] = lwr + CRandom::rand( range ); if streams, also seed[r]
+  void draw( const int lwr , const int range , const bool streams = false );
+
+  // calls f(r) for each replicate, which returns the (primary) null
+  // statistic; anything else the caller needs can be written to its
+  // own per-replicate slots, indexed by r.  f() is called from worker
+  // threads, so must not use the writer, logger or Helper::halt()
+  // Returns the number of replicates kept (== null.size())
+
+  template<class F>
+    int run( const double obs , F f )
+    {
+      null.clear();
+      nexceed = 0;
+      stopped = false;
+
+      std::vector<double> res;
+
+      int done = 0;
+
+      while ( done < nreps && ! stopped )
+	{
+	  const int nb = stop ? std::min( batch_size , nreps - done ) : nreps ;
+	  res.resize( nb );
+	  luna_threads::parallel_for( nb , nthreads , [&]( int i ) { res[i] = f( done + i ); } );
+
+	  for (int i=0;i<nb;i++)
+	    {
+	      null.push_back( res[i] );
+	      if ( res[i] >= obs ) ++nexceed;
+	      if ( stop && nexceed == stop ) { stopped = true; break; }
+	    }
+
+	  done += nb;
+	}
+
+      return null.size();
+    }
+
+  // Besag-Clifford: h / l if stopped early, else ( #null >= obs + 1 ) / ( #replicates + 1 )
+  double pvalue() const
+  {
+    if ( stopped ) return nexceed / (double)null.size();
+    return ( nexceed + 1 ) / (double)( null.size() + 1 );
+  }
+
+  //
+  // Kernels: contiguous circular cross-products, i.e. without
+  // materialised index vectors; b[] is the shifted series
+  //
+
+  // sum_i ( are[i] + i.aim[i] ) * b[ ( i + shift ) % n ]
+  static std::complex<double> circular_dot( const std::vector<double> & are ,
+					    const std::vector<double> & aim ,
+					    const std::vector<double> & b ,
+					    const int shift );
+
+  // wPLI terms for X = x * y[ ( i + shift ) % n ], with y already conjugated:
+  // *numer = sum_i imag(X), *denom = sum_i |imag(X)|
+  static void circular_imag( const std::vector<double> & xre ,
+			     const std::vector<double> & xim ,
+			     const std::vector<double> & yre ,
+			     const std::vector<double> & yim ,
+			     const int shift ,
+			     double * numer , double * denom );
+
+  int nreps;
+  int nthreads;
+  int stop;
+
+  std::vector<int> shift;
+  std::vector<long unsigned> seed;
+
+  std::vector<double> null;
+  int nexceed;
+
+  // did sampling stop early (i.e. at the stop-th exceedance)?
+  bool stopped;
+
+  static const int batch_size = 100;
+
+};
+
+#endif
@@ -232,7 +232,7 @@ void dsptools::alt_run_cwt( const std::vector<double> & data ,
 
   cwt.alt_add_wavelet( fc , FWHM , tlen );
   
-  cwt.store_real_imag_vectors( true );
+  cwt.store_phase_vectors( phase != NULL );
 
   cwt.load( &data );
 
@@ -263,6 +263,8 @@ void dsptools::run_cwt( const std::vector<double> & data ,
   cwt.set_sampling_rate( Fs );
   
   cwt.add_wavelet( fc , num_cycles ); 
+
+  cwt.store_phase_vectors( phase != NULL );
   
   cwt.load( &data );
   
@@ -1266,7 +1266,7 @@ void edf_t::seg_dumper( param_t & param )
 
   int r = timeline.first_record();
   
-  uint64_t tp0 = timeline.rec2tp[r];
+  uint64_t tp0 = timeline.timepoint(r);
 
   uint64_t tp_start = tp0;
   
@@ -1291,7 +1291,7 @@ void edf_t::seg_dumper( param_t & param )
 	}
       else
 	{
-	  tp = timeline.rec2tp[r] ;
+	  tp = timeline.timepoint(r) ;
 
 	  // discontinuity / end of segment?
 	  segend = tp - tp0 != header.record_duration_tp ;
@@ -40,6 +40,18 @@
 
 #include <iostream>
 #include <fstream>
+#include <cstring>
+
+#ifndef WINDOWS
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 extern writer_t writer;
 extern logger_t logger;
@@ -147,6 +159,55 @@ inline int16_t edf_record_t::phys2dig( double d , double bv , double offset )
   return d / bv - offset ; 
 }
 
+void edf_record_t::dig2phys( const int16_t * d , int n , int step , double bv , double offset , double * out )
+{
+
+  // as per the scalar dig2phys(), i.e. bv * ( offset + d ), so results
+  // are identical whichever path is taken below; SIMD only for
+  // contiguous (step == 1) blocks, of 8 samples at a time
+  
+  int i = 0;
+  
+  if ( step == 1 )
+    {
+#if defined(__AVX2__)
+      const __m256d vbv = _mm256_set1_pd( bv );
+      const __m256d vos = _mm256_set1_pd( offset );
+      for ( ; i + 8 <= n ; i += 8 )
+	{
+	  const __m256i x = _mm256_cvtepi16_epi32( _mm_loadu_si128( (const __m128i*)( d + i ) ) );
+	  const __m256d lo = _mm256_cvtepi32_pd( _mm256_castsi256_si128( x ) );
+	  const __m256d hi = _mm256_cvtepi32_pd( _mm256_extracti128_si256( x , 1 ) );
+	  _mm256_storeu_pd( out + i     , _mm256_mul_pd( vbv , _mm256_add_pd( vos , lo ) ) );
+	  _mm256_storeu_pd( out + i + 4 , _mm256_mul_pd( vbv , _mm256_add_pd( vos , hi ) ) );
+	}
+#elif defined(__SSE2__)
+      const __m128d vbv = _mm_set1_pd( bv );
+      const __m128d vos = _mm_set1_pd( offset );
+      for ( ; i + 8 <= n ; i += 8 )
+	{
+	  const __m128i x  = _mm_loadu_si128( (const __m128i*)( d + i ) );
+	  // sign-extend int16 --> int32
+	  const __m128i x0 = _mm_srai_epi32( _mm_unpacklo_epi16( x , x ) , 16 );
+	  const __m128i x1 = _mm_srai_epi32( _mm_unpackhi_epi16( x , x ) , 16 );
+	  const __m128d p0 = _mm_cvtepi32_pd( x0 );
+	  const __m128d p1 = _mm_cvtepi32_pd( _mm_shuffle_epi32( x0 , _MM_SHUFFLE(3,2,3,2) ) );
+	  const __m128d p2 = _mm_cvtepi32_pd( x1 );
+	  const __m128d p3 = _mm_cvtepi32_pd( _mm_shuffle_epi32( x1 , _MM_SHUFFLE(3,2,3,2) ) );
+	  _mm_storeu_pd( out + i     , _mm_mul_pd( vbv , _mm_add_pd( vos , p0 ) ) );
+	  _mm_storeu_pd( out + i + 2 , _mm_mul_pd( vbv , _mm_add_pd( vos , p1 ) ) );
+	  _mm_storeu_pd( out + i + 4 , _mm_mul_pd( vbv , _mm_add_pd( vos , p2 ) ) );
+	  _mm_storeu_pd( out + i + 6 , _mm_mul_pd( vbv , _mm_add_pd( vos , p3 ) ) );
+	}
+#endif
+    }
+
+  // remainder (or all, if downsampling / no SIMD)
+  for ( ; i < n ; i++ )
+    out[i] = dig2phys( d[ i * step ] , bv , offset );
+  
+}
+
 
 inline int16_t edf_record_t::tc2dec( char a , char b )
 {        
@@ -794,16 +855,23 @@ bool edf_record_t::read( int r )
   // skip if already loaded?
   if ( edf->loaded( r ) ) return false;
   
-  // allocate space in the buffer for a single record, and read from file
-  
-  byte_t * p = new byte_t[ edf->record_size ];
-  
-  byte_t * p0 = p;
+  // either point directly into the memory-mapped EDF, or allocate
+  // space in the buffer for a single record, and read from file
+
+  byte_t * p0 = NULL;
 
-  // EDF?
-  if ( edf->file ) 
+  const byte_t * p = NULL;
+  
+  // memory-mapped EDF? (file size already checked in attach())
+  if ( edf->mapped )
+    {
+      p = edf->mapped + edf->header_size + (uint64_t)(edf->record_size) * r;
+    }
+  else if ( edf->file ) // EDF?
     {
       
+      p0 = new byte_t[ edf->record_size ];
+      
       // determine offset into EDF
       uint64_t offset = edf->header_size + (uint64_t)(edf->record_size) * r;
       
@@ -811,14 +879,19 @@ bool edf_record_t::read( int r )
       fseek( edf->file , offset , SEEK_SET );
   
       // and read it
-      size_t rdsz = fread( p , 1, edf->record_size , edf->file );
+      size_t rdsz = fread( p0 , 1, edf->record_size , edf->file );
+
+      p = p0;
     }
   else // EDFZ
     {
+
+      p0 = new byte_t[ edf->record_size ];
       
-      if ( ! edf->edfz->read_record( r , p , edf->record_size ) ) 
+      if ( ! edf->edfz->read_record( r , p0 , edf->record_size ) ) 
 	Helper::halt( "corrupt .edfz or .idx" );      
 
+      p = p0;
     }
 
   // which signals/channels do we actually want to read?
@@ -859,7 +932,14 @@ bool edf_record_t::read( int r )
       // s  : where this signal will land in edf_t
       //
       
-      if ( ! annotation ) 
+      if ( ! annotation && edf_t::endian == edf_t::MACHINE_LITTLE_ENDIAN ) 
+	{
+	  // EDF is little-endian 2-byte two's complement, i.e. as
+	  // int16_t, so the whole block can be copied in one go
+	  memcpy( data[s].data() , p , 2 * nsamples );
+	  p += 2 * nsamples;
+	}
+      else if ( ! annotation ) 
 	{
 	  
 	  for (int j=0; j < nsamples ; j++)
@@ -932,7 +1012,26 @@ bool edf_record_t::read( int r )
   // Clean up
   //
 
-  delete [] p0;
+  if ( p0 != NULL ) 
+    delete [] p0;
+
+#ifndef WINDOWS
+  // memory-mapped: the record is now decoded, so drop its pages from
+  // this process (they stay in the page cache); otherwise every page
+  // touched stays resident, i.e. the whole file for a full pass.  As
+  // the kernel also maps neighbouring pages on a fault ('fault-around',
+  // 64kB by default), a margin before the record is dropped too
+  if ( edf->mapped )
+    {
+      static const uint64_t pg = sysconf( _SC_PAGESIZE );
+      static const uint64_t margin = 1 << 20;
+      uint64_t a = edf->header_size + (uint64_t)(edf->record_size) * r;
+      const uint64_t b = a + edf->record_size;
+      a = a > margin ? a - margin : 0;
+      a -= a % pg;
+      madvise( (void*)( edf->mapped + a ) , b - a , MADV_DONTNEED );
+    }
+#endif
   
   return true;
 
@@ -1260,7 +1359,7 @@ bool edf_t::attach( const std::string & f ,
       edfz = new edfz_t;
       
       // this also looks for the .idx, which sets the record size
-      if ( ! edfz->open_for_reading( filename ) ) 
+      if ( ! edfz->open_for_reading( filename , globals::edfz_threads , globals::edfz_blocks ) ) 
 	{
 	  delete edfz;
 	  edfz = NULL;
@@ -1380,6 +1479,16 @@ bool edf_t::attach( const std::string & f ,
 	  Helper::halt( "corrupt EDF: expecting " + Helper::int2str(implied) 
 			+ " but observed " + Helper::int2str( fileSize) + " bytes" + "\n" + msg.str() );
 	}
+
+      //
+      // Optionally, map the whole file for subsequent record reads
+      //
+      
+      if ( globals::edf_mmap ) 
+	{
+	  if ( ! map_file( fileSize ) )
+	    logger << "  could not memory-map " << filename << ", reverting to standard reads\n";
+	}
     }
 
 
@@ -1415,6 +1524,165 @@ bool edf_t::attach( const std::string & f ,
 
 
 
+void edf_t::build_store()
+{
+
+  release_store();
+
+  // records are keyed by original record number: size the store up to
+  // the last retained record (or any record already in memory)
+  int nr = records.size() ? records.rbegin()->first + 1 : 0 ;
+  for (int r = header.nr_all - 1 ; r >= nr ; r--)
+    if ( timeline.retained( r ) ) { nr = r + 1; break; }
+  
+  if ( nr == 0 ) return;
+  
+  store.data.resize( header.ns );
+  store.nsamples.resize( header.ns , 0 );
+  store.loaded.resize( nr , false );
+  
+  for (int s=0;s<header.ns;s++)
+    if ( ! header.is_annotation_channel( s ) ) 
+      {
+	store.nsamples[s] = header.n_samples[s];
+	store.data[s].resize( (uint64_t)nr * store.nsamples[s] , 0 );
+      }
+
+  // records already in memory: move those with the expected sizes
+  // into the store and free their vectors
+  std::map<int,edf_record_t>::iterator rr = records.begin();
+  while ( rr != records.end() )
+    {
+      edf_record_t & record = rr->second;
+      bool okay = record.data.size() == header.ns;
+      for (int s=0;s<header.ns && okay;s++)
+	if ( store.nsamples[s] != 0 && record.data[s].size() != store.nsamples[s] ) okay = false;
+      store.loaded[ rr->first ] = okay;
+      if ( okay )
+	for (int s=0;s<header.ns;s++)
+	  if ( store.nsamples[s] != 0 ) 
+	    {
+	      memcpy( &store.data[s][ (uint64_t)rr->first * store.nsamples[s] ] , record.data[s].data() , 2 * store.nsamples[s] );
+	      std::vector<int16_t>().swap( record.data[s] );
+	    }
+      ++rr;
+    }
+  
+  // all other retained records: decode each into a single reused
+  // buffer and copy straight into the store; the record itself only
+  // keeps any annotation channels, so no per-record signal vectors
+  // are allocated (and then freed) along the way
+
+  edf_record_t buffer( this );
+  edf_record_t shell( this );
+  for (int s=0;s<header.ns;s++)
+    if ( store.nsamples[s] != 0 ) std::vector<int16_t>().swap( shell.data[s] );
+  
+  for (int r=0;r<nr;r++)
+    {
+      if ( ! timeline.retained( r ) ) continue;
+      if ( ! buffer.read( r ) ) continue; // already loaded
+      
+      edf_record_t & record = records.insert( std::map<int,edf_record_t>::value_type( r , shell ) ).first->second;
+      for (int s=0;s<header.ns;s++)
+	{
+	  if ( store.nsamples[s] != 0 )
+	    memcpy( &store.data[s][ (uint64_t)r * store.nsamples[s] ] , buffer.data[s].data() , 2 * store.nsamples[s] );
+	  else
+	    record.data[s] = buffer.data[s];
+	}
+      store.loaded[r] = true;
+    }
+  
+  store.valid = true;
+  
+}
+
+
+void edf_t::release_store()
+{
+
+  if ( ! store.valid ) 
+    {
+      store.clear();
+      return;
+    }
+
+  for (int s=0;s<store.nsamples.size();s++)
+    {
+      if ( store.nsamples[s] == 0 ) continue;
+      
+      std::map<int,edf_record_t>::iterator rr = records.begin();
+      while ( rr != records.end() )
+	{
+	  if ( store.has( s , rr->first ) ) 
+	    {
+	      const int16_t * d = store.record( s , rr->first );
+	      rr->second.data[s].assign( d , d + store.nsamples[s] );
+	    }
+	  ++rr;
+	}
+      
+      std::vector<int16_t>().swap( store.data[s] );
+    }
+  
+  store.clear();
+  
+}
+
+
+int16_span_t signal_store_t::span( const int s , const int r1 , const int j1 , const int r2 , const int j2 ) const
+{
+  if ( r2 < r1 ) return int16_span_t();
+  for (int r=r1;r<=r2;r++)
+    if ( ! has( s , r ) ) return int16_span_t();
+  const uint64_t a = (uint64_t)r1 * nsamples[s] + j1;
+  const uint64_t b = (uint64_t)r2 * nsamples[s] + j2;
+  if ( b < a ) return int16_span_t();
+  return int16_span_t( &data[s][a] , b - a + 1 );
+}
+
+
+int16_span_t edf_t::digital_span( const int s , const int r1 , const int j1 , const int r2 , const int j2 )
+{
+  if ( ! globals::edf_store ) return int16_span_t();
+  if ( ! store.valid ) build_store();
+  return store.span( s , r1 , j1 , r2 , j2 );
+}
+
+
+bool edf_t::map_file( uint64_t sz )
+{
+#ifdef WINDOWS
+  return false;
+#else
+  
+  if ( file == NULL || sz == 0 ) return false;
+
+  void * m = mmap( NULL , sz , PROT_READ , MAP_PRIVATE , fileno( file ) , 0 );
+  
+  if ( m == MAP_FAILED ) return false;
+
+  // records are typically visited in order
+  madvise( m , sz , MADV_SEQUENTIAL );
+  
+  mapped = (const byte_t*)m;
+  mapped_size = sz;
+  return true;
+#endif
+}
+
+void edf_t::unmap_file()
+{
+#ifndef WINDOWS
+  if ( mapped != NULL ) 
+    munmap( (void*)mapped , mapped_size );
+#endif
+  mapped = NULL;
+  mapped_size = 0;
+}
+
+
 void edf_t::swap_in_aliases()
 {
 
@@ -1503,40 +1771,72 @@ std::vector<double> edf_t::fixedrate_signal( uint64_t start ,
   double bitvalue = header.bitvalue[ signal ];
   double offset   = header.offset[ signal ];
 
+  // read from the contiguous store, if requested
+  if ( globals::edf_store && ! store.valid ) 
+    build_store();
+
+  //
+  // First pass: count samples, so that outputs can be sized once
+  //
+
+  uint64_t total = 0;
+
   int r = start_record;
 
   while ( r <= stop_record )
     {
-      //std::cerr << "rec " << r << "\n";
+      const int start = r == start_record ? start_sample : 0 ;
+      const int stop  = r == stop_record  ? stop_sample  : n_samples_per_record - 1;
+      if ( stop >= start ) total += ( stop - start ) / downsample + 1;
+      r = timeline.next_record(r);
+      if ( r == -1 ) break;
+    }
 
-      // std::cout << records.size() << " is REC SIZE\n";
-      // std::cout << "foudn " << ( records.find( r ) != records.end() ? " FOUND " : "NOWHERE" ) << "\n";
+  if ( total == 0 ) return ret;
 
-      const edf_record_t * record = &(records.find( r )->second);
+  ret.resize( total );
+  if ( tp != NULL ) tp->resize( total );
+  if ( rec != NULL ) rec->resize( total );
+  
+  //
+  // Second pass: convert a record at a time
+  //
+  
+  uint64_t k = 0;
+
+  r = start_record;
 
-      //std::cerr << " test for NULL " << ( record == NULL ? "NULL" : "OK" ) << "\n";
+  while ( r <= stop_record )
+    {
+
+      const int16_t * data = store.has( signal , r ) 
+	? store.record( signal , r ) 
+	: records.find( r )->second.data[ signal ].data();
       
       const int start = r == start_record ? start_sample : 0 ;
       const int stop  = r == stop_record  ? stop_sample  : n_samples_per_record - 1;
+      const int nk    = stop >= start ? ( stop - start ) / downsample + 1 : 0 ;
 
-      // std::cerr << " start, stop = " << start << "   " << stop << "\n";
-      
-      // std::cerr << "OUT\t"
-      // 		<< record->data.size() << " "
-      // 		<< signal << " " 
-      // 		<< header.ns << "\n";
+      // convert from digital to physical on-the-fly
+      edf_record_t::dig2phys( data + start , nk , downsample , bitvalue , offset , ret.data() + k );
       
-      for (int s=start;s<=stop;s+=downsample)
+      // time-points: record start plus within-record offset (as timeline_t::timepoint())
+      if ( tp != NULL ) 
 	{
-	  // convert from digital to physical on-the-fly
-	  ret.push_back( edf_record_t::dig2phys( record->data[ signal ][ s ] , bitvalue , offset ) );
-	  
-	  if ( tp != NULL ) 
-	    tp->push_back( timeline.timepoint( r , s , n_samples_per_record ) );
-	  if ( rec != NULL ) 
-	    rec->push_back( r );
+	  const uint64_t tp0 = timeline.timepoint( r );
+	  const uint64_t dur = header.record_duration_tp;
+	  for (int i=0;i<nk;i++)
+	    {
+	      const uint64_t s = start + i * downsample;
+	      (*tp)[k+i] = tp0 + dur * s / n_samples_per_record ;
+	    }
 	}
       
+      if ( rec != NULL ) 
+	std::fill( rec->begin() + k , rec->begin() + k + nk , r );
+
+      k += nk;
+      
       r = timeline.next_record(r);
       if ( r == -1 ) break;
     }
@@ -1763,6 +2063,9 @@ bool edf_record_t::write( edfz_t * edfz )
 bool edf_t::write( const std::string & f , bool as_edfz )
 {
 
+  // records are written from records[]
+  release_store();
+
   reset_start_time();
 
   filename = f;
@@ -1808,7 +2111,7 @@ bool edf_t::write( const std::string & f , bool as_edfz )
 
       edfz_t edfz;
 
-      if ( ! edfz.open_for_writing( filename ) )
+      if ( ! edfz.open_for_writing( filename , globals::edfz_threads , globals::edfz_blocks ) )
 	{
 	  logger << " ** could not open " << filename << " for writing **\n";
 	  return false;
@@ -1832,7 +2135,7 @@ bool edf_t::write( const std::string & f , bool as_edfz )
 	
 	  // set index	  
 	  int64_t offset = edfz.tell();	  
-	  edfz.add_index( r , offset );
+	  edfz.add_index( offset );
 	  
 	  // now write to the .edfz
 	  records.find(r)->second.write( &edfz );
@@ -1846,7 +2149,7 @@ bool edf_t::write( const std::string & f , bool as_edfz )
       // Write .idx
       //
       
-      logger << "  writing EDFZ index to " << filename << ".idx\n";
+      logger << "  writing EDFZ index to " << filename << ".idx (and .bidx)\n";
 
       edfz.write_index( record_size );
 
@@ -1870,6 +2173,8 @@ bool edf_t::write( const std::string & f , bool as_edfz )
 void edf_t::drop_signal( const int s )
 {
 
+  release_store();
+
   if ( s < 0 || s >= header.ns ) return;  
   --header.ns;
 
@@ -1947,6 +2252,8 @@ void edf_record_t::drop( const int s )
 
 void edf_t::add_signal( const std::string & label , const int Fs , const std::vector<double> & data )
 {
+
+  release_store();
   const int ndata = data.size();
 
   const int n_samples = Fs * header.record_duration ;
@@ -2092,6 +2399,8 @@ void edf_record_t::add_annot( const std::string & str , const int signal )
 void edf_t::reset_record_size( const double new_record_duration )
 {
 
+  release_store();
+
   if ( ! header.continuous )
     Helper::halt( "can only change record size for EDF, not EDF+, currently" );
 
@@ -2234,6 +2543,8 @@ void edf_t::reset_record_size( const double new_record_duration )
 
 void edf_t::reference_and_scale( const int s , const int r , const double rescale )
 {
+
+  release_store();
   
   //
   // reference and/or rescale 
@@ -2305,6 +2616,8 @@ void edf_t::reference( const signal_list_t & signals0 ,
 		       bool dereference )
 {
 
+  release_store();
+
   // copy as we may modify this
   signal_list_t signals = signals0;
   
@@ -2885,6 +3198,8 @@ void edf_header_t::check_channels()
 
 bool edf_t::restructure()
 {
+
+  release_store();
   
   //
   // Map back onto original epochs
@@ -3183,6 +3498,8 @@ void edf_t::copy_signal( const std::string & from_label , const std::string & to
 void edf_t::update_records( int a , int b , int s , const std::vector<double> * d )
 {
 
+  release_store();
+
   if ( header.is_annotation_channel(s) ) 
     Helper::halt( "edf_t:: internal error, cannot update an annotation channel" );
 
@@ -3251,6 +3568,8 @@ void edf_t::update_records( int a , int b , int s , const std::vector<double> *
 
 void edf_t::update_signal( int s , const std::vector<double> * d , bool force_minmax )
 {
+
+  release_store();
   
   if ( header.is_annotation_channel(s) ) 
     Helper::halt( "edf_t:: internal error, cannot update an annotation channel" );
@@ -3441,6 +3760,8 @@ void edf_t::set_edf()
 
 void edf_t::drop_time_track()
 {
+
+  release_store();
   // means that the EDF will become 'continuous'
   set_continuous();
 
@@ -3453,6 +3774,8 @@ void edf_t::drop_time_track()
 
 int edf_t::add_continuous_time_track()
 {
+
+  release_store();
   
   // this can only add a time-track to a continuous record
   // i.e. if discontinuous, it must already (by definition) 
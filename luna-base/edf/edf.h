@@ -312,10 +312,75 @@ struct edf_record_t
   // directly give bit-value and offset
   inline static double dig2phys( int16_t , double , double );
   inline static int16_t phys2dig( double , double , double );
+
+  // bulk version: n samples from d (every step-th), written to out[0..n-1]
+  static void dig2phys( const int16_t * d , int n , int step , double bv , double offset , double * out );
+  
+};
+
+
+
+
+
+//
+// Optional, alternate in-memory layout (edf-store=T): a single
+// contiguous int16_t buffer per (data) channel, spanning all records,
+// i.e. sample j of record r is at r * n_samples[s] + j; when built, it
+// takes over the data channels of records[] (annotation channels stay
+// in the records), and hands them back before records are altered
+//
+
+struct int16_span_t
+{
+  int16_span_t() : p(NULL) , n(0) { } 
+  int16_span_t( const int16_t * p , uint64_t n ) : p(p) , n(n) { } 
   
+  const int16_t * p;
+  uint64_t n;
+
+  uint64_t size() const { return n; } 
+  bool empty() const { return n == 0; } 
+  const int16_t & operator[]( const uint64_t i ) const { return p[i]; } 
+  const int16_t * begin() const { return p; } 
+  const int16_t * end() const { return p + n; } 
 };
 
 
+struct signal_store_t
+{
+
+  signal_store_t() { clear(); } 
+
+  void clear()
+  {
+    valid = false;
+    data.clear();
+    nsamples.clear();
+    loaded.clear();
+  }
+
+  // view of a single channel, from sample j1 of record r1 to sample
+  // j2 of record r2 (inclusive); empty if any record is not in the store
+  int16_span_t span( const int s , const int r1 , const int j1 , const int r2 , const int j2 ) const;
+
+  bool has( const int s , const int r ) const 
+  { return valid && s >= 0 && s < nsamples.size() && nsamples[s] != 0 && r >= 0 && r < loaded.size() && loaded[r]; } 
+
+  const int16_t * record( const int s , const int r ) const 
+  { return &data[s][ (uint64_t)r * nsamples[s] ]; } 
+  
+  bool valid;
+
+  // channel x ( record x sample ) 
+  std::vector<std::vector<int16_t> > data;
+
+  // samples per record, per channel (0 for annotation channels)
+  std::vector<int> nsamples;
+
+  // which records are present in the store
+  std::vector<bool> loaded;
+  
+};
 
 
 
@@ -341,6 +406,8 @@ public:
   
   std::map<int,edf_record_t> records;
 
+  signal_store_t             store;         // optional contiguous record data
+
   std::set<int>              inp_signals_n; // read these signals
   
   int                        record_size;   // bytes per record (for ns_all signals)
@@ -395,6 +462,18 @@ public:
   }
 
   
+  // (re)build the contiguous store from all retained records, moving
+  // the data channels out of records[]
+  void build_store();
+
+  // move data back into records[] and drop the store (called before
+  // records are altered or written; rebuilt lazily on the next read)
+  void release_store();
+  
+  // zero-copy view of digital data for a run of records (builds the
+  // store if needed; empty if not enabled or not a contiguous run)
+  int16_span_t digital_span( const int s , const int r1 , const int j1 , const int r2 , const int j2 );
+  
   std::vector<double> fixedrate_signal( uint64_t start , 
 					uint64_t stop , 
 					const int signal , 
@@ -486,6 +565,20 @@ private:
   
   FILE * file;
 
+  
+  //
+  // Optional read-only memory map of a standard EDF (mmap=T); if
+  // set, records are decoded directly from the mapped pages
+  //
+
+  const byte_t * mapped;
+
+  uint64_t mapped_size;
+
+  bool map_file( uint64_t sz );
+
+  void unmap_file();
+  
 
   //
   // Alternate buffer for EDFZ
@@ -521,6 +614,8 @@ public:
     endian = determine_endian();    
     file = NULL;
     edfz = NULL;
+    mapped = NULL;
+    mapped_size = 0;
     init();
   } 
 
@@ -532,6 +627,8 @@ public:
 
   void init()
   {
+    unmap_file();
+
     if ( file != NULL ) 
       fclose(file);
     file = NULL;
@@ -545,6 +642,7 @@ public:
     
     header.init();
     records.clear();    
+    store.clear();
     inp_signals_n.clear();
   }
   
@@ -49,7 +49,7 @@ slice_t::slice_t( edf_t & edf ,
 		  int signal ,
 		  const interval_t & interval ,
 		  int downsample )   
-  : edf(edf) , signal(signal) , interval(interval) , downsample(downsample) 
+  : edf(edf) , signal(signal) , downsample(downsample) 
 {
 
   //
@@ -61,6 +61,9 @@ slice_t::slice_t( edf_t & edf ,
   time_points.clear();
   records.clear();
 
+  rec1 = smp1 = rec2 = smp2 = -1;
+  n_digital = 0;
+  
   //
   // Empty?
   //
@@ -78,13 +81,33 @@ slice_t::slice_t( edf_t & edf ,
 		    + " of " + Helper::int2str( edf.header.ns ) );
     }
       
+  //
+  // Backed by edf_t::store? Then also track record/sample bounds,
+  // for zero-copy digital() views
+  //
+
+  if ( globals::edf_store && downsample == 1 ) 
+    {
+      uint64_t stop = interval.stop;
+      if ( stop > edf.timeline.last_time_point_tp + 1 )
+	stop = edf.timeline.last_time_point_tp + 1 ;
+      
+      if ( edf.timeline.interval2records( interval_t( interval.start , stop ) , 
+					  edf.header.n_samples[ signal ] , 
+					  &rec1 , &smp1 , &rec2 , &smp2 ) ) 
+	{
+	  int16_span_t span = edf.digital_span( signal , rec1 , smp1 , rec2 , smp2 );
+	  n_digital = span.size();
+	}
+      
+      if ( n_digital == 0 ) 
+	rec1 = smp1 = rec2 = smp2 = -1;
+    }
 
   // 
   // Populate data matrix
   //
   
-  const uint64_t duration = interval.duration();
-  
   //
   // use fixed channel/signal sampling rate (i.e. array can be ragged)
   //
@@ -95,7 +118,17 @@ slice_t::slice_t( edf_t & edf ,
 			       downsample , 
 			       &time_points , 
 			       &records );
+  
+}
 
+
+int16_span_t slice_t::digital() const
+{
+  if ( rec1 == -1 ) return int16_span_t();
+  int16_span_t span = edf.digital_span( signal , rec1 , smp1 , rec2 , smp2 );
+  // i.e. if the EDF has since been altered, this no longer corresponds to the slice
+  if ( span.size() != n_digital ) return int16_span_t();
+  return span;
 }
  
 
@@ -122,6 +155,12 @@ mslice_t::mslice_t( edf_t & edf ,
 
 
 
+int16_span_t mslice_t::digital( const int s ) const
+{
+  return channel[s]->digital();
+}
+
+
 Data::Matrix<double> mslice_t::extract()
 {
   const int nr = channel[0]->size(); 
@@ -184,6 +223,59 @@ matslice_t::matslice_t( edf_t & edf ,
 
 
   
+  //
+  // if backed by edf_t::store, convert each channel straight into its
+  // column (all channels have the same SR, so span the same samples)
+  //
+
+  if ( globals::edf_store ) 
+    {
+      uint64_t stop = interval.stop;
+      if ( stop > edf.timeline.last_time_point_tp + 1 )
+	stop = edf.timeline.last_time_point_tp + 1 ;
+      
+      int r1, j1, r2, j2;
+      
+      if ( edf.timeline.interval2records( interval_t( interval.start , stop ) , Fs , &r1 , &j1 , &r2 , &j2 ) )
+	{
+	  std::vector<int16_span_t> spans( ns );
+	  bool okay = true;
+	  for (int s=0;s<ns && okay;s++)
+	    {
+	      spans[s] = edf.digital_span( signals(s) , r1 , j1 , r2 , j2 );
+	      if ( spans[s].empty() ) okay = false;
+	    }
+	  
+	  if ( okay ) 
+	    {
+	      const int n = spans[0].size();
+	      
+	      data.resize( n , ns );
+	      
+	      for (int s=0;s<ns;s++)
+		edf_record_t::dig2phys( spans[s].begin() , n , 1 , 
+					edf.header.bitvalue[ signals(s) ] , 
+					edf.header.offset[ signals(s) ] , 
+					data.col_data( s ) );
+	      
+	      // time-points, as fixedrate_signal()
+	      time_points.resize( n );
+	      const uint64_t dur = edf.header.record_duration_tp;
+	      int k = 0;
+	      for (int r=r1;r<=r2;r++)
+		{
+		  const uint64_t tp0 = edf.timeline.timepoint( r );
+		  const int a = r == r1 ? j1 : 0;
+		  const int b = r == r2 ? j2 : Fs - 1;
+		  for (int j=a;j<=b;j++)
+		    time_points[k++] = tp0 + dur * j / Fs;
+		}
+	      
+	      return;
+	    }
+	}
+    }
+
   //
   // use fixed channel/signal sampling rate (i.e. array can be ragged), and populate time-points
   //
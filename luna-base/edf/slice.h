@@ -33,6 +33,7 @@ struct signal_list_t;
 struct interval_t;
 struct edf_t;
 struct timeline_t;
+struct int16_span_t;
 
 
 class slice_t
@@ -70,6 +71,11 @@ class slice_t
   { 
     return data.size(); 
   }
+
+  // zero-copy view of the digital samples in edf_t::store (only if
+  // edf-store=T, no downsampling, and a single run of records);
+  // otherwise empty.  physical = bitvalue * ( offset + digital ) 
+  int16_span_t digital() const;
   
   interval_t duration() const ;
 
@@ -79,6 +85,8 @@ class slice_t
     time_points.clear();
     records.clear();
     start = stop = 0;
+    rec1 = smp1 = rec2 = smp2 = -1;
+    n_digital = 0;
   }
 
  private:
@@ -86,7 +94,6 @@ class slice_t
   // input
   edf_t & edf;
   const int signal;
-  const interval_t & interval;
   const int downsample;
   
   // output
@@ -95,6 +102,10 @@ class slice_t
   std::vector<int> records;
   
   double start, stop;
+
+  // first/last record and sample spanned, and size of that span
+  int rec1, smp1, rec2, smp2;
+  uint64_t n_digital;
   
 };
 
@@ -127,6 +138,8 @@ class mslice_t {
 
   std::string label(const int s) const { return labels[s]; } 
 
+  int16_span_t digital(const int s) const;
+
   void clear() // nb. leaves in an invalid state, so do not try to reuse...
   { 
     for (int s=0;s<channel.size();s++)
@@ -155,7 +168,8 @@ class matslice_t {
     }
 
   
-  const std::vector<double> * col( const int s ) const { return data.col_pointer(s)->data_pointer(); } 
+  // column s, i.e. col(s)[0 .. data_ref().dim1()-1], no copy
+  const double * col( const int s ) const { return data.col_data(s); } 
   
   const Data::Matrix<double> & data_ref() const { return data; } 
 
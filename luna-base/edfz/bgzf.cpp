@@ -30,6 +30,12 @@
 #include <sys/types.h>
 #include "bgzf.h"
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+
 #ifdef _USE_KNETFILE
 #include "knetfile.h"
 typedef knetFile *_bgzf_file_t;
@@ -231,33 +237,59 @@ static int deflate_block(BGZF *fp, int block_length)
   return compressed_length;
 }
 
-// Inflate the block in fp->compressed_block into fp->uncompressed_block
-static int inflate_block(BGZF* fp, int block_length)
+// Inflate a compressed BGZF block (incl. header) into _uncompressed_; -1 on error
+static int inflate_raw(uint8_t *compressed, int block_length, uint8_t *uncompressed)
 {
   z_stream zs;
   zs.zalloc = NULL;
   zs.zfree = NULL;
-  zs.next_in = (Bytef*)fp->compressed_block + 18;
+  zs.next_in = (Bytef*)compressed + 18;
   zs.avail_in = block_length - 16;
-  zs.next_out = (Bytef*)fp->uncompressed_block;
+  zs.next_out = (Bytef*)uncompressed;
   zs.avail_out = BGZF_BLOCK_SIZE;
 
-  if (inflateInit2(&zs, -15) != Z_OK) {
-    fp->errcode |= BGZF_ERR_ZLIB;
-    return -1;
-  }
+  if (inflateInit2(&zs, -15) != Z_OK) return -1;
   if (inflate(&zs, Z_FINISH) != Z_STREAM_END) {
     inflateEnd(&zs);
-    fp->errcode |= BGZF_ERR_ZLIB;
-    return -1;
-  }
-  if (inflateEnd(&zs) != Z_OK) {
-    fp->errcode |= BGZF_ERR_ZLIB;
     return -1;
   }
+  if (inflateEnd(&zs) != Z_OK) return -1;
   return zs.total_out;
 }
 
+// Inflate the block in fp->compressed_block into fp->uncompressed_block
+static int inflate_block(BGZF* fp, int block_length)
+{
+  int count = inflate_raw((uint8_t*)fp->compressed_block, block_length, (uint8_t*)fp->uncompressed_block);
+  if (count < 0) fp->errcode |= BGZF_ERR_ZLIB;
+  return count;
+}
+
+// Deflate _input_length_ (<= BGZF_MT_BLOCK_SIZE) bytes into a single
+// BGZF block in _buffer_; returns the block length, or -1 on error
+static int deflate_raw(int level, const uint8_t *input, int input_length, uint8_t *buffer)
+{
+  z_stream zs;
+  int status, compressed_length;
+  uint32_t crc;
+  memcpy(buffer, g_magic, BLOCK_HEADER_LENGTH);
+  zs.zalloc = NULL;
+  zs.zfree = NULL;
+  zs.next_in = (Bytef*)input;
+  zs.avail_in = input_length;
+  zs.next_out = (Bytef*)&buffer[BLOCK_HEADER_LENGTH];
+  zs.avail_out = BGZF_BLOCK_SIZE - BLOCK_HEADER_LENGTH - BLOCK_FOOTER_LENGTH;
+  if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) return -1;
+  status = deflate(&zs, Z_FINISH);
+  if (deflateEnd(&zs) != Z_OK || status != Z_STREAM_END) return -1;
+  compressed_length = zs.total_out + BLOCK_HEADER_LENGTH + BLOCK_FOOTER_LENGTH;
+  packInt16(&buffer[16], compressed_length - 1);
+  crc = crc32(crc32(0L, NULL, 0L), (const Bytef*)input, input_length);
+  packInt32(&buffer[compressed_length-8], crc);
+  packInt32(&buffer[compressed_length-4], input_length);
+  return compressed_length;
+}
+
 static int check_header(const uint8_t *header)
 {
   return (header[0] == 31 && header[1] == 139 && header[2] == 8 && (header[3] & 4) != 0
@@ -325,11 +357,252 @@ static int load_block_from_cache(BGZF *fp, int64_t block_address) {return 0;}
 static void cache_block(BGZF *fp, int size) {}
 #endif
 
+
+//
+// Multi-threaded (de)compression: a pool of workers inflates (reading)
+// or deflates (writing) whole blocks; the calling thread alone does all
+// file I/O, and consumes/writes blocks strictly in file order
+//
+
+typedef struct {
+  int64_t address;    // read: file address of block; write: block number
+  int64_t end_offset; // read: file address of the following block
+  int in_length, out_length;
+  int status;         // 0 pending, 1 done, -1 error
+  uint8_t *in, *out;  // read: compressed -> uncompressed; write: vice versa
+} bgzf_mt_slot_t;
+
+struct bgzf_mt_t {
+  int n_blocks, level;
+  bool reading, stop, eof;
+  std::vector<std::thread> workers;
+  std::mutex lock;
+  std::condition_variable todo, done;
+  std::deque<bgzf_mt_slot_t*> queue; // submitted, not yet started
+  std::deque<bgzf_mt_slot_t*> ring;  // in flight, in file order (calling thread only)
+  std::vector<bgzf_mt_slot_t*> pool; // free slots
+  int64_t next_address;              // read: address of the next block to consume
+  int64_t file_address;              // write: file address of the next block written
+  std::vector<int64_t> block_starts; // write: block number -> file address
+};
+
+static void mt_worker(bgzf_mt_t *mt)
+{
+  while (1) {
+    bgzf_mt_slot_t *s;
+    {
+      std::unique_lock<std::mutex> lk(mt->lock);
+      while (!mt->stop && mt->queue.empty()) mt->todo.wait(lk);
+      if (mt->queue.empty()) return;
+      s = mt->queue.front();
+      mt->queue.pop_front();
+    }
+    int n = mt->reading
+      ? inflate_raw(s->in, s->in_length, s->out)
+      : deflate_raw(mt->level, s->in, s->in_length, s->out);
+    {
+      std::lock_guard<std::mutex> lk(mt->lock);
+      s->out_length = n;
+      s->status = n < 0 ? -1 : 1;
+    }
+    mt->done.notify_all();
+  }
+}
+
+static bgzf_mt_slot_t *mt_get_slot(bgzf_mt_t *mt)
+{
+  bgzf_mt_slot_t *s;
+  if (mt->pool.empty()) {
+    s = new bgzf_mt_slot_t;
+    s->in = (uint8_t*)malloc(BGZF_BLOCK_SIZE);
+    s->out = (uint8_t*)malloc(BGZF_BLOCK_SIZE);
+  } else {
+    s = mt->pool.back();
+    mt->pool.pop_back();
+  }
+  s->status = 0;
+  return s;
+}
+
+static void mt_submit(bgzf_mt_t *mt, bgzf_mt_slot_t *s)
+{
+  {
+    std::lock_guard<std::mutex> lk(mt->lock);
+    mt->queue.push_back(s);
+  }
+  mt->ring.push_back(s);
+  mt->todo.notify_one();
+}
+
+static bool mt_done(bgzf_mt_t *mt, bgzf_mt_slot_t *s)
+{
+  std::lock_guard<std::mutex> lk(mt->lock);
+  return s->status != 0;
+}
+
+static int mt_wait(bgzf_mt_t *mt, bgzf_mt_slot_t *s)
+{
+  std::unique_lock<std::mutex> lk(mt->lock);
+  while (s->status == 0) mt->done.wait(lk);
+  return s->status;
+}
+
+static void mt_release_front(bgzf_mt_t *mt)
+{
+  bgzf_mt_slot_t *s = mt->ring.front();
+  mt_wait(mt, s);
+  mt->ring.pop_front();
+  mt->pool.push_back(s);
+}
+
+static void mt_destroy(BGZF *fp)
+{
+  bgzf_mt_t *mt = (bgzf_mt_t*)fp->mt;
+  if (mt == 0) return;
+  {
+    std::lock_guard<std::mutex> lk(mt->lock);
+    mt->stop = true;
+  }
+  mt->todo.notify_all();
+  for (size_t i = 0; i < mt->workers.size(); ++i) mt->workers[i].join();
+  while (!mt->ring.empty()) mt_release_front(mt);
+  for (size_t i = 0; i < mt->pool.size(); ++i) {
+    free(mt->pool[i]->in);
+    free(mt->pool[i]->out);
+    delete mt->pool[i];
+  }
+  delete mt;
+  fp->mt = 0;
+}
+
+// address of the block following the current one
+static inline int64_t next_block_address(BGZF *fp)
+{
+  return fp->mt ? ((bgzf_mt_t*)fp->mt)->next_address : _bgzf_tell((_bgzf_file_t)fp->fp);
+}
+
+// Read the next compressed block from the file; block length, 0 on EOF, -1 on error
+static int mt_read_raw(BGZF *fp, bgzf_mt_slot_t *s)
+{
+  int count, block_length, remaining;
+  count = _bgzf_read((_bgzf_file_t)fp->fp, s->in, BLOCK_HEADER_LENGTH);
+  if (count == 0) return 0;
+  if (count != BLOCK_HEADER_LENGTH || !check_header(s->in)) {
+    fp->errcode |= BGZF_ERR_HEADER;
+    return -1;
+  }
+  block_length = unpackInt16(&s->in[16]) + 1;
+  remaining = block_length - BLOCK_HEADER_LENGTH;
+  if (_bgzf_read((_bgzf_file_t)fp->fp, &s->in[BLOCK_HEADER_LENGTH], remaining) != remaining) {
+    fp->errcode |= BGZF_ERR_IO;
+    return -1;
+  }
+  s->in_length = block_length;
+  return block_length;
+}
+
+static int mt_read_block(BGZF *fp)
+{
+  bgzf_mt_t *mt = (bgzf_mt_t*)fp->mt;
+  bgzf_mt_slot_t *s;
+  int64_t block_address = mt->next_address;
+  // drop read-ahead blocks skipped over by a seek; if none are
+  // wanted, restart read-ahead from the new position
+  while (!mt->ring.empty() && mt->ring.front()->address != block_address) mt_release_front(mt);
+  if (mt->ring.empty()) {
+    if (_bgzf_seek((_bgzf_file_t)fp->fp, block_address, SEEK_SET) < 0) {
+      fp->errcode |= BGZF_ERR_IO;
+      return -1;
+    }
+    mt->eof = false;
+  }
+  // top up read-ahead
+  while ((int)mt->ring.size() < mt->n_blocks && !mt->eof) {
+    int64_t address = _bgzf_tell((_bgzf_file_t)fp->fp);
+    int n;
+    s = mt_get_slot(mt);
+    if ((n = mt_read_raw(fp, s)) <= 0) {
+      mt->pool.push_back(s);
+      if (n < 0) return -1;
+      mt->eof = true;
+      break;
+    }
+    s->address = address;
+    s->end_offset = address + n;
+    mt_submit(mt, s);
+  }
+  if (mt->ring.empty()) { // no data read
+    fp->block_length = 0;
+    return 0;
+  }
+  s = mt->ring.front();
+  if (mt_wait(mt, s) < 0) {
+    fp->errcode |= BGZF_ERR_ZLIB;
+    return -1;
+  }
+  memcpy(fp->uncompressed_block, s->out, s->out_length);
+  if (fp->block_length != 0) fp->block_offset = 0; // Do not reset offset if this read follows a seek.
+  fp->block_address = block_address;
+  fp->block_length = s->out_length;
+  mt->next_address = s->end_offset;
+  mt_release_front(mt);
+  return 0;
+}
+
+// Write the block at the front of the queue, once deflated
+static int mt_write_front(BGZF *fp)
+{
+  bgzf_mt_t *mt = (bgzf_mt_t*)fp->mt;
+  bgzf_mt_slot_t *s = mt->ring.front();
+  if (mt_wait(mt, s) < 0) {
+    fp->errcode |= BGZF_ERR_ZLIB;
+    return -1;
+  }
+  if (fwrite(s->out, 1, s->out_length, (_bgzf_file_t)fp->fp) != s->out_length) {
+    fp->errcode |= BGZF_ERR_IO; // possibly truncated file
+    return -1;
+  }
+  mt->block_starts.push_back(mt->file_address);
+  mt->file_address += s->out_length;
+  mt_release_front(mt);
+  return 0;
+}
+
+static int mt_flush(BGZF *fp)
+{
+  bgzf_mt_t *mt = (bgzf_mt_t*)fp->mt;
+  if (fp->block_offset > 0) {
+    bgzf_mt_slot_t *s;
+    while ((int)mt->ring.size() >= mt->n_blocks)
+      if (mt_write_front(fp) != 0) return -1;
+    s = mt_get_slot(mt);
+    memcpy(s->in, fp->uncompressed_block, fp->block_offset);
+    s->in_length = fp->block_offset;
+    s->address = fp->block_address;
+    mt_submit(mt, s);
+    ++fp->block_address; // i.e. block number
+    fp->block_offset = 0;
+  }
+  while (!mt->ring.empty() && mt_done(mt, mt->ring.front()))
+    if (mt_write_front(fp) != 0) return -1;
+  return 0;
+}
+
+// Write all pending blocks
+static int mt_drain(BGZF *fp)
+{
+  bgzf_mt_t *mt = (bgzf_mt_t*)fp->mt;
+  while (!mt->ring.empty())
+    if (mt_write_front(fp) != 0) return -1;
+  return 0;
+}
+
 int bgzf_read_block(BGZF *fp)
 {
   uint8_t header[BLOCK_HEADER_LENGTH], *compressed_block;
   int count, size = 0, block_length, remaining;
   int64_t block_address;
+  if (fp->mt) return mt_read_block(fp);
   block_address = _bgzf_tell((_bgzf_file_t)fp->fp);
   if (load_block_from_cache(fp, block_address)) return 0;
   count = _bgzf_read((_bgzf_file_t)fp->fp, header, sizeof(header));
@@ -382,7 +655,7 @@ ssize_t bgzf_read(BGZF *fp, void *data, ssize_t length)
     bytes_read += copy_length;
   }
   if (fp->block_offset == fp->block_length) {
-    fp->block_address = _bgzf_tell((_bgzf_file_t)fp->fp);
+    fp->block_address = next_block_address(fp);
     fp->block_offset = fp->block_length = 0;
   }
   return bytes_read;
@@ -391,6 +664,7 @@ ssize_t bgzf_read(BGZF *fp, void *data, ssize_t length)
 int bgzf_flush(BGZF *fp)
 {
   assert(fp->open_mode == 'w');
+  if (fp->mt) return mt_flush(fp);
   while (fp->block_offset > 0) {
     int block_length;
     block_length = deflate_block(fp, fp->block_offset);
@@ -406,7 +680,7 @@ int bgzf_flush(BGZF *fp)
 
 int bgzf_flush_try(BGZF *fp, ssize_t size)
 {
-  if (fp->block_offset + size > BGZF_BLOCK_SIZE)
+  if (fp->block_offset + size > (fp->mt ? BGZF_MT_BLOCK_SIZE : BGZF_BLOCK_SIZE))
     return bgzf_flush(fp);
   return -1;
 }
@@ -414,7 +688,7 @@ int bgzf_flush_try(BGZF *fp, ssize_t size)
 ssize_t bgzf_write(BGZF *fp, const void *data, ssize_t length)
 {
   const uint8_t *input = (const uint8_t*)data;
-  int block_length = BGZF_BLOCK_SIZE, bytes_written;
+  int block_length = fp->mt ? BGZF_MT_BLOCK_SIZE : BGZF_BLOCK_SIZE, bytes_written;
   assert(fp->open_mode == 'w');
   input = (const uint8_t*)data;
   bytes_written = 0;
@@ -436,6 +710,7 @@ int bgzf_close(BGZF* fp)
   if (fp == 0) return -1;
   if (fp->open_mode == 'w') {
     if (bgzf_flush(fp) != 0) return -1;
+    if (fp->mt && mt_drain(fp) != 0) return -1;
     block_length = deflate_block(fp, 0); // write an empty block
     count = fwrite(fp->compressed_block, 1, block_length, (_bgzf_file_t)fp->fp);
     if (fflush((_bgzf_file_t)fp->fp) != 0) {
@@ -443,6 +718,7 @@ int bgzf_close(BGZF* fp)
       return -1;
     }
   }
+  mt_destroy(fp);
   ret = fp->open_mode == 'w'? fclose((_bgzf_file_t)fp->fp) : _bgzf_close((_bgzf_file_t)fp->fp);
   if (ret != 0) return -1;
   free(fp->uncompressed_block);
@@ -457,6 +733,41 @@ void bgzf_set_cache_size(BGZF *fp, int cache_size)
   if (fp) fp->cache_size = cache_size;
 }
 
+int bgzf_mt(BGZF *fp, int n_threads, int n_blocks)
+{
+  bgzf_mt_t *mt;
+  if (fp == 0 || fp->mt != 0) return -1;
+  if (n_threads < 1) return 0;
+  // must be set before anything is read or written
+  if (fp->block_address != 0 || fp->block_offset != 0 || fp->block_length != 0) {
+    fp->errcode |= BGZF_ERR_MISUSE;
+    return -1;
+  }
+  mt = new bgzf_mt_t;
+  mt->n_blocks = n_blocks > 0 ? n_blocks : 2 * n_threads;
+  mt->level = fp->compress_level;
+  mt->reading = fp->open_mode == 'r';
+  mt->stop = mt->eof = false;
+  mt->next_address = mt->reading ? _bgzf_tell((_bgzf_file_t)fp->fp) : 0;
+  mt->file_address = 0;
+  for (int i = 0; i < n_threads; ++i)
+    mt->workers.push_back(std::thread(mt_worker, mt));
+  fp->mt = mt;
+  return 0;
+}
+
+int64_t bgzf_mt_resolve(BGZF *fp, int64_t voffset)
+{
+  bgzf_mt_t *mt = (bgzf_mt_t*)fp->mt;
+  int64_t block = voffset >> 16;
+  if (mt == 0 || fp->open_mode != 'w') return voffset;
+  if (block >= (int64_t)mt->block_starts.size())
+    if (bgzf_flush(fp) != 0 || mt_drain(fp) != 0) return -1;
+  // an offset at the start of a block not yet written (i.e. no data after it)
+  int64_t address = block < (int64_t)mt->block_starts.size() ? mt->block_starts[block] : mt->file_address;
+  return (address << 16) | (voffset & 0xFFFF);
+}
+
 
 int bgzf_check_EOF(BGZF *fp)
 {
@@ -481,7 +792,9 @@ int64_t bgzf_seek(BGZF* fp, int64_t pos, int where)
   }
   block_offset = pos & 0xFFFF;
   block_address = pos >> 16;
-  if (_bgzf_seek((_bgzf_file_t)fp->fp, block_address, SEEK_SET) < 0) {
+  if (fp->mt) // read-ahead queue is repositioned on the next block read
+    ((bgzf_mt_t*)fp->mt)->next_address = block_address;
+  else if (_bgzf_seek((_bgzf_file_t)fp->fp, block_address, SEEK_SET) < 0) {
     fp->errcode |= BGZF_ERR_IO;
     return -1;
   }
@@ -513,7 +826,7 @@ int bgzf_getc(BGZF *fp)
   }
   c = ((unsigned char*)fp->uncompressed_block)[fp->block_offset++];
   if (fp->block_offset == fp->block_length) {
-    fp->block_address = _bgzf_tell((_bgzf_file_t)fp->fp);
+    fp->block_address = next_block_address(fp);
     fp->block_offset = 0;
     fp->block_length = 0;
   }
@@ -548,7 +861,7 @@ int bgzf_getline(BGZF *fp, int delim, kstring_t *str)
     str->l += l;
     fp->block_offset += l + 1;
     if (fp->block_offset >= fp->block_length) {
-      fp->block_address = _bgzf_tell((_bgzf_file_t)fp->fp);
+      fp->block_address = next_block_address(fp);
       fp->block_offset = 0;
       fp->block_length = 0;
     } 
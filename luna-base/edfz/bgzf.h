@@ -37,6 +37,10 @@ typedef unsigned char byte_t;
 
 #define BGZF_BLOCK_SIZE 0x10000 // 64k
 
+// in multi-threaded write mode, uncompressed blocks are capped so that
+// each is guaranteed to deflate into a single BGZF block
+#define BGZF_MT_BLOCK_SIZE 0xff00
+
 #define BGZF_ERR_ZLIB   1
 #define BGZF_ERR_HEADER 2
 #define BGZF_ERR_IO     4
@@ -49,6 +53,7 @@ typedef struct {
   int64_t block_address;
   void *uncompressed_block, *compressed_block;
   void *cache; // a pointer to a hash table
+  void *mt; // multi-threaded (de)compression state; 0 if single-threaded
   void *fp; // actual file handler; FILE* on writing; FILE* or knetFile* on reading
 } BGZF;
 
@@ -189,6 +194,30 @@ extern "C" {
    */
   int bgzf_read_block(BGZF *fp);
 
+  /**
+   * Use a pool of worker threads for (de)compression. In read mode, up
+   * to _n_blocks_ blocks following the current one are read and inflated
+   * ahead of time; in write mode, up to _n_blocks_ blocks are deflated
+   * concurrently, and written in order.
+   *
+   * In write mode, bgzf_tell() then returns a provisional virtual offset
+   * (block number, rather than file address, in the upper 48 bits); use
+   * bgzf_mt_resolve() to obtain the actual virtual offset.
+   *
+   * @param fp         BGZF file handler; must be called before any read/write
+   * @param n_threads  number of worker threads (0 to disable)
+   * @param n_blocks   blocks in flight; 0 for a default of 2 * n_threads
+   * @return           0 on success and -1 on error
+   */
+  int bgzf_mt(BGZF *fp, int n_threads, int n_blocks);
+
+  /**
+   * Map a provisional (multi-threaded write mode) virtual offset to the
+   * actual one; flushes and waits for pending blocks if needed. In other
+   * modes, returns _voffset_ unchanged.
+   */
+  int64_t bgzf_mt_resolve(BGZF *fp, int64_t voffset);
+
 #ifdef __cplusplus
 }
 #endif
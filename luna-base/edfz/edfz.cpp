@@ -27,8 +27,437 @@
 #include <cstdlib>
 #include <vector>
 #include <map>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <chrono>
 #include "helper/helper.h"
 
+#include <sys/stat.h>
+
+#ifndef WINDOWS
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+//
+// The text .edfz.idx (record size, then one offset per line) is always
+// written, as before.  A binary .edfz.bidx is written alongside (once
+// the .edfz is closed), and is used instead when reading, unless it is
+// missing, older than the .idx, from a machine with a different byte
+// order, or does not match the size and modification time of the .edfz
+//
+// Binary .bidx format (version 2), native byte order; all int64_t
+// arrays are 8-byte aligned, so can be used directly from the mapping:
+//
+//   char[8]   magic       "EDFZIDX" + '\0'
+//   int32_t   byte order  0x01020304 
+//   int32_t   version     2
+//   int32_t   record size
+//   int32_t   (reserved, 0)
+//   int64_t   size of the .edfz (bytes)
+//   int64_t   modification time of the .edfz (ns, where available)
+//   int64_t   number of records, N
+//   int64_t   number of blocks, B
+//   int64_t   N record (virtual) offsets
+//   int64_t   B block-start (virtual) offsets
+//
+
+static const char edfz_idx_magic[8] = { 'E','D','F','Z','I','D','X','\0' };
+static const int32_t edfz_idx_byte_order = 0x01020304;
+static const int32_t edfz_idx_version = 2;
+static const size_t edfz_idx_header = 56;
+
+// size and modification time of a file, to tie a .bidx to its .edfz
+static bool edfz_file_stamp( const std::string & fn , int64_t * size , int64_t * mtime )
+{
+  struct stat st;
+  if ( stat( fn.c_str() , &st ) != 0 ) return false;
+  *size = st.st_size;
+#if defined(__linux__)
+  *mtime = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#elif defined(__APPLE__)
+  *mtime = (int64_t)st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+  *mtime = (int64_t)st.st_mtime * 1000000000LL;
+#endif
+  return true;
+}
+
+
+bool edfz_t::read_index()
+{
+  
+  std::string indexname = filename + ".idx";
+  std::string binaryname = filename + ".bidx";
+  
+  clear_index();
+
+  //
+  // Binary index, if present and up-to-date with the text index
+  //
+
+  struct stat st_txt, st_bin;
+  const bool has_txt = stat( indexname.c_str() , &st_txt ) == 0;
+  const bool has_bin = stat( binaryname.c_str() , &st_bin ) == 0;
+
+  if ( has_bin && ( ! has_txt || st_bin.st_mtime >= st_txt.st_mtime ) )
+    if ( read_binary_index( binaryname ) ) return true;
+
+  if ( ! has_txt ) return false;
+  
+  return read_text_index( indexname );
+}
+
+
+bool edfz_t::read_binary_index( const std::string & indexname )
+{
+
+  FILE * f = fopen( indexname.c_str() , "rb" );
+  if ( f == NULL ) return false;
+  char hdr[ edfz_idx_header ];
+  size_t nhdr = fread( hdr , 1 , edfz_idx_header , f );
+  fclose( f );
+
+  if ( nhdr < edfz_idx_header || memcmp( hdr , edfz_idx_magic , 8 ) != 0 )
+    return false;
+
+  int32_t order, version;
+  int32_t rs;
+  int64_t zsize, ztime;
+  int64_t n , b;
+  memcpy( &order , hdr + 8 , 4 );
+  memcpy( &version , hdr + 12 , 4 );
+  memcpy( &rs , hdr + 16 , 4 );
+  memcpy( &zsize , hdr + 24 , 8 );
+  memcpy( &ztime , hdr + 32 , 8 );
+  memcpy( &n , hdr + 40 , 8 );
+  memcpy( &b , hdr + 48 , 8 );
+
+  // other byte order, or an older version: use the text .idx instead
+  if ( order != edfz_idx_byte_order || version != edfz_idx_version ) 
+    return false;
+
+  // stale, i.e. the .edfz has changed since the .bidx was written
+  int64_t size1, time1;
+  if ( ! edfz_file_stamp( filename , &size1 , &time1 ) ) return false;
+  if ( size1 != zsize || time1 != ztime ) return false;
+  
+  if ( n < 0 || b < 0 ) 
+    Helper::halt( "corrupt .bidx " + indexname );
+
+  const size_t expected = edfz_idx_header + 8 * ( n + b );
+
+  struct stat st;
+  if ( stat( indexname.c_str() , &st ) != 0 || (size_t)st.st_size < expected )
+    Helper::halt( "corrupt .bidx " + indexname );
+
+  record_size = rs;
+  
+#ifndef WINDOWS
+
+  int fd = open( indexname.c_str() , O_RDONLY );
+  if ( fd == -1 ) return false;
+  void * m = mmap( NULL , expected , PROT_READ , MAP_PRIVATE , fd , 0 );
+  ::close( fd );
+  if ( m == MAP_FAILED ) return false;
+  
+  mapped = m;
+  mapped_size = expected;
+  
+  offsets = (const int64_t*)( (const char*)m + edfz_idx_header );
+  block_starts = offsets + n;
+  
+#else
+
+  // no mapping: read into 'index' and 'blocks' directly
+  index.resize( n );
+  blocks.resize( b );
+  f = fopen( indexname.c_str() , "rb" );
+  fseek( f , edfz_idx_header , SEEK_SET );
+  size_t nr = fread( index.data() , 8 , n , f );
+  nr += fread( blocks.data() , 8 , b , f );
+  fclose( f );
+  if ( nr != n + b ) Helper::halt( "corrupt .bidx " + indexname );
+  offsets = index.data();
+  block_starts = blocks.data();
+
+#endif
+
+  noffsets = n;
+  nblocks = b;
+  
+  return true;
+}
+
+
+bool edfz_t::read_text_index( const std::string & indexname )
+{
+  std::ifstream I1( indexname.c_str() , std::ios::in );
+  // record size first
+  I1 >> record_size;
+  while ( ! I1.eof() )
+    {
+      int64_t offset;
+      I1 >> offset;
+      if ( I1.eof() ) break;
+      index.push_back( offset );
+    }    
+  I1.close();
+  offsets = index.data();
+  noffsets = index.size();
+  return true;
+}
+
+
+bool edfz_t::write_index( const int rs )
+{
+  
+  record_size = rs;
+
+  // if deflating in parallel, offsets are provisional until blocks are written
+  if ( file != NULL ) 
+    for (int r=0; r<index.size(); r++)
+      index[r] = bgzf_mt_resolve( file , index[r] );
+
+  // BGZF block starts (i.e. upper 48 bits of the virtual offsets)
+  blocks.clear();
+  for (int r=0; r<index.size(); r++)
+    {
+      const int64_t b = ( index[r] >> 16 ) << 16;
+      if ( blocks.size() == 0 || blocks.back() != b ) 
+	blocks.push_back( b );
+    }
+  block_starts = blocks.data();
+  nblocks = blocks.size();
+
+  //
+  // text .idx
+  //
+  
+  std::string indexname = filename + ".idx";
+  std::ofstream O1( indexname.c_str() , std::ios::out );
+  // first write record size
+  O1 << record_size << "\n";
+  for (int r=0; r<index.size(); r++)
+    O1 << index[r] << "\n";
+  O1.close();
+  if ( O1.fail() ) return false;
+
+  // the binary .bidx records the final size and time of the .edfz, so
+  // is written by close() (i.e. second, so never older than the .idx)
+  pending_bidx = true;
+  
+  return true;
+}
+
+
+bool edfz_t::write_binary_index()
+{
+  
+  std::string binaryname = filename + ".bidx";
+
+  int64_t zsize, ztime;
+  if ( ! edfz_file_stamp( filename , &zsize , &ztime ) ) return false;
+  
+  FILE * f = fopen( binaryname.c_str() , "wb" );
+  if ( f == NULL ) return false;
+
+  const int32_t order = edfz_idx_byte_order;
+  const int32_t version = edfz_idx_version;
+  const int32_t rs32 = record_size;
+  const int32_t reserved = 0;
+  const int64_t n = index.size();
+  const int64_t b = blocks.size();
+
+  bool okay = fwrite( edfz_idx_magic , 1 , 8 , f ) == 8 ;
+  okay = okay && fwrite( &order , 4 , 1 , f ) == 1;
+  okay = okay && fwrite( &version , 4 , 1 , f ) == 1;
+  okay = okay && fwrite( &rs32 , 4 , 1 , f ) == 1;
+  okay = okay && fwrite( &reserved , 4 , 1 , f ) == 1;
+  okay = okay && fwrite( &zsize , 8 , 1 , f ) == 1;
+  okay = okay && fwrite( &ztime , 8 , 1 , f ) == 1;
+  okay = okay && fwrite( &n , 8 , 1 , f ) == 1;
+  okay = okay && fwrite( &b , 8 , 1 , f ) == 1;
+  if ( n ) okay = okay && fwrite( index.data() , 8 , n , f ) == n;
+  if ( b ) okay = okay && fwrite( blocks.data() , 8 , b , f ) == b;
+  
+  if ( fclose( f ) != 0 ) okay = false;
+
+  // a partial .bidx would only be ignored, but do not leave one 
+  if ( ! okay ) remove( binaryname.c_str() );
+  
+  return okay;
+}
+
+
+void edfz_t::unmap_index()
+{
+#ifndef WINDOWS
+  if ( mapped != NULL ) 
+    munmap( mapped , mapped_size );
+#endif
+  mapped = NULL;
+  mapped_size = 0;
+}
+
+
+
+//
+// Round-trip check (luna -d edfz): records are written to an .edfz, and
+// read back via the binary .bidx and via the text .idx
+//
+
+static bool edfz_check_records( edfz_t & edfz , const int nr , const int rs )
+{
+  if ( edfz.noffsets != nr || edfz.record_size != rs ) return false;
+  std::vector<byte_t> buffer( rs );
+  for (int r=0; r<nr; r++)
+    {
+      if ( ! edfz.read_record( r , buffer.data() , rs ) ) return false;
+      for (int i=0; i<rs; i++)
+	if ( buffer[i] != (byte_t)( r * 31 + i * 7 ) ) return false;
+    }
+  return true;
+}
+
+bool edfz_t::selftest( const std::string & fn )
+{
+
+  const int nr = 500;
+  const int rs = 1234; // i.e. records span BGZF block boundaries
+
+  edfz_t edfz;
+  if ( ! edfz.open_for_writing( fn ) ) return false;
+  std::vector<byte_t> buffer( rs );
+  for (int r=0; r<nr; r++)
+    {
+      for (int i=0; i<rs; i++) buffer[i] = (byte_t)( r * 31 + i * 7 );
+      edfz.add_index( edfz.tell() );
+      if ( edfz.write( buffer.data() , rs ) == -1 ) return false;
+    }
+  bool okay = edfz.write_index( rs );
+  edfz.close();
+  okay = okay && Helper::fileExists( fn + ".bidx" );
+  
+  // read back via the binary index 
+  edfz_t bin;
+  okay = okay && bin.open_for_reading( fn );
+#ifndef WINDOWS
+  okay = okay && bin.mapped != NULL;
+#endif
+  okay = okay && edfz_check_records( bin , nr , rs );
+  
+  // text index should give the same offsets
+  edfz_t txt;
+  okay = okay && txt.read_text_index( fn + ".idx" );
+  okay = okay && txt.noffsets == bin.noffsets && txt.record_size == bin.record_size;
+  for (int r=0; r<nr && okay; r++)
+    if ( txt.get_index(r) != bin.get_index(r) ) okay = false;
+  
+  bin.close();
+
+  // a .bidx that does not match the .edfz is ignored
+  FILE * z = fopen( fn.c_str() , "ab" );
+  okay = okay && z != NULL;
+  if ( z != NULL ) { fputc( 0 , z ); fclose( z ); }
+  edfz_t stale;
+  stale.filename = fn;
+  okay = okay && stale.read_index();
+  okay = okay && stale.mapped == NULL && stale.noffsets == nr;
+  
+  // and without a .bidx, read via the text index
+  remove( ( fn + ".bidx" ).c_str() );
+  edfz_t txt2;
+  okay = okay && txt2.open_for_reading( fn );
+  okay = okay && txt2.mapped == NULL;
+  okay = okay && edfz_check_records( txt2 , nr , rs );
+  txt2.close();
+
+  remove( fn.c_str() );
+  remove( ( fn + ".idx" ).c_str() );
+  
+  return okay;
+}
+
+
+//
+// Throughput (luna -d bgzf): writes and reads back ~mb MB of EDF-like
+// records (int16_t sinusoids plus noise), single-threaded and with 1,
+// 2 and 4 inflate/deflate worker threads; wall-clock MB/s of record data
+//
+
+void edfz_t::benchmark( const std::string & fn , const int mb )
+{
+
+  const int ns = 8;           // channels
+  const int sr = 256;         // samples per record
+  const int rs = 2 * ns * sr; // bytes per record 
+  const int nr = (int)( ( mb * 1048576.0 ) / rs ) + 1;
+
+  std::vector<int16_t> data( (size_t)nr * ns * sr );
+  uint32_t seed = 12345;
+  for (size_t i=0; i<data.size(); i++)
+    {
+      seed = seed * 1103515245u + 12345u;
+      const int s = ( i / sr ) % ns;
+      data[i] = (int16_t)( 2000 * sin( 0.01 * ( s + 1 ) * i ) + ( ( seed >> 16 ) & 255 ) );
+    }
+  
+  const double total_mb = (double)nr * rs / 1048576.0;
+
+  const int threads[] = { 0 , 1 , 2 , 4 };
+
+  for (int t=0; t<4; t++)
+    {
+      const int nt = threads[t];
+
+      std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+      
+      edfz_t w;
+      if ( ! w.open_for_writing( fn , nt ) ) Helper::halt( "could not write " + fn );
+      for (int r=0; r<nr; r++)
+	{
+	  w.add_index( w.tell() );
+	  w.write( (byte_t*)( data.data() + (size_t)r * ns * sr ) , rs );
+	}
+      w.write_index( rs );
+      w.close();
+
+      std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+
+      edfz_t rd;
+      if ( ! rd.open_for_reading( fn , nt ) ) Helper::halt( "could not read " + fn );
+      std::vector<byte_t> buffer( rs );
+      int mismatch = 0;
+      for (int r=0; r<nr; r++)
+	{
+	  if ( ! rd.read_record( r , buffer.data() , rs ) || 
+	       memcmp( buffer.data() , data.data() + (size_t)r * ns * sr , rs ) != 0 ) 
+	    ++mismatch;
+	}
+      rd.close();
+      
+      std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+
+      const double tw = std::chrono::duration<double>( t1 - t0 ).count();
+      const double tr = std::chrono::duration<double>( t2 - t1 ).count();
+
+      std::cout << nr << " records (" << total_mb << " MB), "
+		<< nt << " worker thread(s) : "
+		<< "deflate " << total_mb / tw << " MB/s , "
+		<< "inflate " << total_mb / tr << " MB/s , "
+		<< "mismatches " << mismatch << "\n";
+    }
+
+  remove( fn.c_str() );
+  remove( ( fn + ".idx" ).c_str() );
+  remove( ( fn + ".bidx" ).c_str() );
+
+}
+
 
 // int test()
 // {
@@ -40,10 +40,21 @@ struct edfz_t {
     filename = "";
     record_size = 0;
     mode = 0;
-    index.clear();
+    mapped = NULL;
+    mapped_size = 0;
+    block_starts = NULL;
+    nblocks = 0;
+    pending_bidx = false;
+    clear_index();
+  }
+
+  ~edfz_t()
+  {
+    unmap_index();
   }
 
-  bool open_for_reading( const std::string & fn )
+  // optionally, with nt worker threads to inflate/deflate up to nb blocks ahead
+  bool open_for_reading( const std::string & fn , int nt = 0 , int nb = 0 )
   {    
     filename = fn;
 
@@ -54,14 +65,18 @@ struct edfz_t {
       return false;
     file = bgzf_open( filename.c_str() , "r" );
     mode = -1;
+    if ( file != NULL && bgzf_mt( file , nt , nb ) != 0 ) 
+      Helper::halt( "could not start EDFZ worker threads" );
     return file != NULL;
   }
 
-  bool open_for_writing( const std::string & fn )
+  bool open_for_writing( const std::string & fn , int nt = 0 , int nb = 0 )
   {    
     filename = fn;
     file = bgzf_open( filename.c_str() , "w" );
     mode = +1;
+    if ( file != NULL && bgzf_mt( file , nt , nb ) != 0 ) 
+      Helper::halt( "could not start EDFZ worker threads" );
     return file != NULL;
   }
 
@@ -71,6 +86,14 @@ struct edfz_t {
 
     if ( bgzf_close( file ) == -1 ) 
       Helper::halt( "problem closing " + filename );
+
+    file = NULL;
+    
+    // text .idx only, if this fails
+    if ( pending_bidx ) write_binary_index();
+    pending_bidx = false;
+    
+    unmap_index();
   }
   
   inline size_t read( byte_t * p , const int n )
@@ -110,9 +133,9 @@ struct edfz_t {
   // primary read, given an index (for record)
   inline bool read_record( int r, byte_t * p , const int n )
   {
-    std::map<int,int64_t>::const_iterator ii = index.find( r );
-    if ( ii == index.end() ) return false;
-    if ( ! seek( ii->second ) ) return false;
+    if ( r < 0 || r >= noffsets ) return false;
+    // sequential reads: do not seek (which would discard the current block)
+    if ( tell() != offsets[r] && ! seek( offsets[r] ) ) return false;
     return bgzf_read( file , p , n ) == n ;
   }
 
@@ -146,58 +169,52 @@ struct edfz_t {
 
   void clear_index() 
   {
+    unmap_index();
     index.clear();
+    blocks.clear();
+    offsets = NULL;
+    noffsets = 0;
+    block_starts = NULL;
+    nblocks = 0;
   }
 
-  void add_index( int r , int64_t offset )
+  // records are added (when writing) in order, 0, 1, 2, ...
+  void add_index( int64_t offset )
   {
-    index[ r ] =  offset ; 
+    index.push_back( offset );
+    offsets = index.data();
+    noffsets = index.size();
   }
   
-  int64_t get_index( int r ) 
+  int64_t get_index( int r ) const
   {
-    std::map<int,int64_t>::const_iterator ii = index.find( r );
-    if ( ii == index.end() ) return -1;
-    return ii->second;
+    if ( r < 0 || r >= noffsets ) return -1;
+    return offsets[r];
   }
 
-  bool read_index()
+  int64_t n_blocks() const
   {
-    std::string indexname = filename + ".idx";
-    if ( ! Helper::fileExists( indexname ) ) return false;
-    index.clear();
-    std::ifstream I1( indexname.c_str() , std::ios::in );
-    // record size first
-    I1 >> record_size;
-    int r = 0;
-    while ( ! I1.eof() )
-      {
-	int64_t offset;
-	I1 >> offset;
-	if ( I1.eof() ) break;
-	index[ r ] = offset ;
-	++r;
-      }    
-    I1.close();
-    return true;
+    return nblocks;
   }
-
-  bool write_index( const int rs )
+  
+  int64_t get_block( int b ) const
   {
-    record_size = rs;
-    std::string indexname = filename + ".idx";
-    std::ofstream O1( indexname.c_str() , std::ios::out );
-    // first write record size
-    O1 << record_size << "\n";
-    std::map<int,int64_t>::const_iterator ii = index.begin();
-    while ( ii != index.end() )
-      {
-	O1 << ii->second << "\n";
-	++ii;
-      }
-    O1.close();
-    return true;
+    if ( b < 0 || b >= nblocks ) return -1;
+    return block_starts[b];
   }
+
+  // reads binary (mapped) .bidx if present, otherwise text .idx
+  bool read_index();
+
+  // writes text .idx now, and binary .bidx on close()
+  bool write_index( const int rs );
+
+  // write/read round-trip check (luna -d edfz)
+  static bool selftest( const std::string & filename );
+
+  // deflate/inflate throughput, with 0, 1, 2 and 4 worker threads (luna -d bgzf)
+  static void benchmark( const std::string & filename , const int mb );
+  
   
   BGZF * file;
   
@@ -205,8 +222,40 @@ struct edfz_t {
 
   int mode;  // 0 closed, -1 read from , +1 write to
 
-  // record index number -> index into .edfz
-  std::map<int,int64_t> index;
+  // record index number -> (virtual) offset into .edfz; points either into
+  // the mapped binary .bidx, or to 'index' (text .idx, or when writing)
+  const int64_t * offsets;
+  int64_t noffsets;
+
+  // sorted virtual offsets of the BGZF blocks that hold record starts
+  const int64_t * block_starts;
+  int64_t nblocks;
+  
+  std::vector<int64_t> index;
+  std::vector<int64_t> blocks;
+
+ private:
+
+  // not copyable: 'offsets' may point into 'index', or into the mapping
+  edfz_t( const edfz_t & );
+  edfz_t & operator=( const edfz_t & );
+  
+  // binary .bidx, mapped read-only
+  void * mapped;
+  size_t mapped_size;
+
+  // write_index() called, so write .bidx once closed
+  bool pending_bidx;
+  
+  bool write_binary_index();
+
+  bool read_binary_index( const std::string & );
+
+  bool read_text_index( const std::string & );
+
+  void unmap_index();
+
+ public:
   
   // as specified by EDF header
   int record_size;
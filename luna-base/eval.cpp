@@ -722,6 +722,7 @@ bool cmd_t::read( const std::string * str , bool silent )
   logger << "input(s): " << input << "\n";
   logger << "output  : " << writer.name() 
 	 << ( cmd_t::plaintext_mode ? " [dir for text-tables]" : "" ) 
+	 << ( cmd_t::columnar_mode ? " [columnar file]" : "" ) 
 	 << "\n";
 
   if ( signallist.size() > 0 )
@@ -2072,6 +2073,10 @@ void proc_dump_cache( edf_t & edf , param_t & param )
       if ( cache == NULL ) Helper::halt( "could not find tp-cache " + cname );
       cache->dump();
     }
+
+  logger << "  all caches use " << edf.timeline.cache.bytes() / ( 1024.0 * 1024.0 ) << " MB";
+  if ( globals::cache_budget ) logger << " (budget " << globals::cache_budget / ( 1024.0 * 1024.0 ) << " MB)";
+  logger << "\n";
   
 }
 
@@ -2627,6 +2632,70 @@ void cmd_t::parse_special( const std::string & tok0 , const std::string & tok1 )
       return;
     }
 
+  // read standard EDF records via a read-only memory map
+  if ( Helper::iequals( tok0 , "mmap" ) )
+    {
+      globals::edf_mmap = Helper::yesno( tok1 );
+      return;
+    }
+
+  // contiguous channel-major signal store
+  if ( Helper::iequals( tok0 , "edf-store" ) )
+    {
+      globals::edf_store = Helper::yesno( tok1 );
+      return;
+    }
+
+  // threaded EDFZ read-ahead / parallel deflate
+  if ( Helper::iequals( tok0 , "edfz-threads" ) )
+    {
+      if ( ! Helper::str2int( tok1 , &globals::edfz_threads ) || globals::edfz_threads < 0 )
+	Helper::halt( "edfz-threads requires a non-negative integer, e.g. edfz-threads=4" );
+      return;
+    }
+
+  if ( Helper::iequals( tok0 , "edfz-blocks" ) )
+    {
+      if ( ! Helper::str2int( tok1 , &globals::edfz_blocks ) || globals::edfz_blocks < 0 )
+	Helper::halt( "edfz-blocks requires a non-negative integer, e.g. edfz-blocks=16" );
+      return;
+    }
+
+  // FFTW planner effort, and wisdom file (read, and updated at exit)
+  if ( Helper::iequals( tok0 , "fftw-plan" ) )
+    {
+      if      ( Helper::iequals( tok1 , "estimate" ) ) globals::fftw_plan_effort = 0;
+      else if ( Helper::iequals( tok1 , "measure" ) ) globals::fftw_plan_effort = 1;
+      else if ( Helper::iequals( tok1 , "patient" ) ) globals::fftw_plan_effort = 2;
+      else Helper::halt( "fftw-plan should be estimate, measure or patient" );
+      return;
+    }
+
+  if ( Helper::iequals( tok0 , "fftw-wisdom" ) )
+    {
+      globals::fftw_wisdom = Helper::expand( tok1 );
+      fftw_cache::load_wisdom();
+      return;
+    }
+
+  // within-EDF worker threads (cf. -j, which runs EDFs in parallel)
+  if ( Helper::iequals( tok0 , "nthreads" ) )
+    {
+      if ( ! Helper::str2int( tok1 , &globals::n_threads ) || globals::n_threads < 1 )
+	Helper::halt( "nthreads requires a positive integer, e.g. nthreads=4" );
+      return;
+    }
+
+  // memory budget (MB) for inter-command caches (SPINDLES cache=, etc)
+  if ( Helper::iequals( tok0 , "cache-mb" ) )
+    {
+      double mb = 0;
+      if ( ! Helper::str2dbl( tok1 , &mb ) || mb < 0 )
+	Helper::halt( "cache-mb requires a non-negative number (0 = no limit)" );
+      globals::cache_budget = mb * 1024 * 1024;
+      return;
+    }
+
   // skip anyt EDF Annotations from EDF+
   if ( Helper::iequals( tok0 , "skip-edf-annots" ) )
     {
@@ -3044,6 +3113,14 @@ void cmd_t::register_specials()
   specials.insert( "alias" ) ;
   specials.insert( "bail-on-fail" ) ;
   specials.insert( "force-edf" ) ;
+  specials.insert( "mmap" ) ;
+  specials.insert( "edf-store" ) ;
+  specials.insert( "edfz-threads" ) ;
+  specials.insert( "edfz-blocks" ) ;
+  specials.insert( "fftw-plan" ) ;
+  specials.insert( "fftw-wisdom" ) ;
+  specials.insert( "nthreads" ) ;
+  specials.insert( "cache-mb" ) ;
   specials.insert( "skip-edf-annots" ) ;
   specials.insert( "skip-annots" ) ;
   specials.insert( "skip-all-annots" ) ;
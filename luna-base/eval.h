@@ -163,7 +163,10 @@ class cmd_t
   static bool                               append_stout_file;
   static bool                               plaintext_mode;
   static std::string                        plaintext_root;
+  static bool                               columnar_mode;
+  static std::string                        columnar_file;
   static bool                               has_indiv_wildcard;
+  static int                                n_workers;
   static std::string resolved_outdb( const std::string & id , const std::string & str );
   
   // command-specific parameters (i.e. from command-file)
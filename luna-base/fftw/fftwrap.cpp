@@ -28,6 +28,178 @@
 
 #include "defs/defs.h"
 
+#include <mutex>
+#include <cstdlib>
+
+#ifndef WINDOWS
+#include <unistd.h>
+#endif
+
+
+//
+// fftw_cache: plans are created once per (type, size), under a lock as
+// the FFTW planner is not re-entrant; buffers released are kept for
+// re-use (up to a few per size)
+//
+
+namespace fftw_cache
+{
+  
+  static std::mutex lock;
+  
+  // key: type (0 = forward DFT, 1 = backward DFT, 2 = r2c, 3 = c2r),
+  // size, and number of transforms (r2c only, otherwise 1)
+  static std::map<std::pair<int,std::pair<int,int> >,fftw_plan> plans;
+  
+  static std::map<size_t,std::vector<void*> > pool;
+
+  static const int max_pooled = 8;
+  
+  static bool wisdom_loaded = false;
+
+  static fftw_plan get( int type , int n , int howmany = 1 );
+
+#ifndef WINDOWS
+  // the process that loaded the wisdom: forked -j workers inherit the
+  // atexit() handler below, but should not all write the same file
+  static pid_t wisdom_pid = 0;
+  static void save_wisdom_atexit() { if ( getpid() == wisdom_pid ) save_wisdom(); } 
+#else
+  static void save_wisdom_atexit() { save_wisdom(); } 
+#endif
+}
+
+
+unsigned fftw_cache::flags()
+{
+  if ( globals::fftw_plan_effort == 2 ) return FFTW_PATIENT;
+  if ( globals::fftw_plan_effort == 1 ) return FFTW_MEASURE;
+  return FFTW_ESTIMATE;
+}
+
+
+void fftw_cache::load_wisdom()
+{
+  // called once, from the main thread when 'fftw-wisdom' is set (i.e.
+  // not from get(), which may run on worker threads)
+  if ( wisdom_loaded || globals::fftw_wisdom == "" ) return;
+  wisdom_loaded = true;
+  
+  if ( Helper::fileExists( globals::fftw_wisdom ) )
+    {
+      if ( fftw_import_wisdom_from_filename( globals::fftw_wisdom.c_str() ) )
+	logger << "  read FFTW wisdom from " << globals::fftw_wisdom << "\n";
+      else
+	logger << "  ** could not read FFTW wisdom from " << globals::fftw_wisdom << "\n";
+    }
+
+  // write back any new plans at exit 
+#ifndef WINDOWS
+  wisdom_pid = getpid();
+#endif
+  std::atexit( save_wisdom_atexit );
+}
+
+
+void fftw_cache::save_wisdom()
+{
+  if ( globals::fftw_wisdom == "" ) return;
+  bool okay;
+  {
+    std::lock_guard<std::mutex> lk( lock );
+    okay = fftw_export_wisdom_to_filename( globals::fftw_wisdom.c_str() );
+  }
+  if ( ! okay )
+    logger << "  ** could not write FFTW wisdom to " << globals::fftw_wisdom << "\n";
+}
+
+
+void * fftw_cache::alloc( size_t bytes )
+{
+  {
+    std::lock_guard<std::mutex> lk( lock );
+    std::map<size_t,std::vector<void*> >::iterator ii = pool.find( bytes );
+    if ( ii != pool.end() && ii->second.size() != 0 )
+      {
+	void * p = ii->second.back();
+	ii->second.pop_back();
+	return p;
+      }
+  }
+  void * p = fftw_malloc( bytes );
+  if ( p == NULL ) Helper::halt( "FFT failed to allocate buffer" );
+  return p;
+}
+
+
+void fftw_cache::release( void * p , size_t bytes )
+{
+  if ( p == NULL ) return;
+  std::lock_guard<std::mutex> lk( lock );
+  std::vector<void*> & f = pool[ bytes ];
+  if ( f.size() < max_pooled ) f.push_back( p );
+  else fftw_free( p );
+}
+
+
+fftw_plan fftw_cache::get( int type , int n , int howmany )
+{
+
+  std::lock_guard<std::mutex> lk( lock );
+  
+  std::pair<int,std::pair<int,int> > key( type , std::make_pair( n , howmany ) );
+  std::map<std::pair<int,std::pair<int,int> >,fftw_plan>::const_iterator ii = plans.find( key );
+  if ( ii != plans.end() ) return ii->second;
+
+  // plan on scratch arrays: (for _MEASURE/_PATIENT) the planner overwrites them
+  const bool real = type >= 2;
+  double * r = real ? (double*)fftw_malloc( sizeof(double) * n * howmany ) : NULL ;
+  fftw_complex * a = (fftw_complex*)fftw_malloc( sizeof(fftw_complex) * n * howmany );
+  fftw_complex * b = real ? NULL : (fftw_complex*)fftw_malloc( sizeof(fftw_complex) * n );
+
+  fftw_plan p = NULL;
+  if      ( type == 0 ) p = fftw_plan_dft_1d( n , a , b , FFTW_FORWARD , flags() );
+  else if ( type == 1 ) p = fftw_plan_dft_1d( n , a , b , FFTW_BACKWARD , flags() );
+  else if ( type == 2 && howmany == 1 ) p = fftw_plan_dft_r2c_1d( n , r , a , flags() );
+  else if ( type == 2 ) p = fftw_plan_many_dft_r2c( 1 , &n , howmany ,
+						    r , NULL , 1 , n ,
+						    a , NULL , 1 , n/2+1 ,
+						    flags() );
+  else if ( type == 3 ) p = fftw_plan_dft_c2r_1d( n , a , r , flags() );
+  
+  if ( r != NULL ) fftw_free( r );
+  if ( a != NULL ) fftw_free( a );
+  if ( b != NULL ) fftw_free( b );
+  
+  if ( p == NULL ) Helper::halt( "could not create FFTW plan, size " + Helper::int2str( n ) );
+  
+  plans[ key ] = p;
+  return p;
+}
+
+
+fftw_plan fftw_cache::dft_1d( int n , int sign )
+{
+  return get( sign == FFTW_FORWARD ? 0 : 1 , n );
+}
+
+fftw_plan fftw_cache::r2c_1d( int n )
+{
+  return get( 2 , n );
+}
+
+fftw_plan fftw_cache::c2r_1d( int n )
+{
+  return get( 3 , n );
+}
+
+fftw_plan fftw_cache::r2c_many( int n , int howmany )
+{
+  return get( 2 , n , howmany );
+}
+
+
+
 void FFT::init( int Ndata_, int Nfft_, int Fs_ , fft_t type_ , window_function_t window_ )
 {
   
@@ -40,17 +212,14 @@ void FFT::init( int Ndata_, int Nfft_, int Fs_ , fft_t type_ , window_function_t
   if ( Ndata > Nfft ) Helper::halt( "Ndata cannot be larger than Nfft" );
 
   // Allocate storage for input/output
-  in = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * Nfft);
-  if ( in == NULL ) Helper::halt( "FFT failed to allocate input buffer" );
-  
-  out = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * Nfft);
-  if ( out == NULL ) Helper::halt( "FFT failed to allociate output buffer" );
+  in = (fftw_complex*) fftw_cache::alloc(sizeof(fftw_complex) * Nfft);
+  out = (fftw_complex*) fftw_cache::alloc(sizeof(fftw_complex) * Nfft);
 
   // Initialise (probably not necessary, but do anyway)
   for (int i=0;i<Nfft;i++) { in[i][0] = in[i][1] = 0; }
   
-  // Generate plan
-  p = fftw_plan_dft_1d( Nfft, in, out , type == FFT_FORWARD ? FFTW_FORWARD : FFTW_BACKWARD , FFTW_ESTIMATE );
+  // Get (shared) plan
+  p = fftw_cache::dft_1d( Nfft , type == FFT_FORWARD ? FFTW_FORWARD : FFTW_BACKWARD );
 
   //
   // We want to return only the positive spectrum, so set the cut-off
@@ -112,7 +281,7 @@ bool FFT::apply( const double * x , const int n )
   // Execute actual FFT
   // 
   
-  fftw_execute(p);
+  fftw_execute_dft( p , in , out );
   
 
   //
@@ -168,7 +337,7 @@ bool FFT::apply( const std::vector<std::complex<double> > & x )
       in[i][0] =  in[i][1] = 0;
     }
 
-  fftw_execute(p);
+  fftw_execute_dft( p , in , out );
 
   //
   // Calculate PSD
@@ -271,8 +440,121 @@ double FFT::width( frequency_band_t band )
 }
 
 
+pwelch_batch_t::pwelch_batch_t( int Fs , double M , window_function_t W , bool use_nextpow2 )
+  : Fs(Fs) , window(W)
+{
+
+  // as for PWELCH / FFT::init()
+
+  segment_points = M * Fs;
+
+  nfft = use_nextpow2 ? MiscMath::nextpow2( segment_points ) : segment_points ;
+
+  if ( segment_points > nfft ) Helper::halt( "Ndata cannot be larger than Nfft" );
+  
+  cutoff = nfft % 2 == 0 ? nfft/2+1 : (nfft+1)/2 ;
+
+  double T = nfft/(double)Fs;
+  freq.resize( cutoff );
+  for (int i=0;i<cutoff;i++) freq[i] = i/T;
+
+  w.resize( segment_points , 1 ); 
+  if      ( window == WINDOW_TUKEY50 ) w = MiscMath::tukey_window(segment_points,0.5);
+  else if ( window == WINDOW_HANN )    w = MiscMath::hann_window(segment_points);
+  else if ( window == WINDOW_HAMMING ) w = MiscMath::hamming_window(segment_points);
+
+  normalisation_factor = 0;
+  for (int i=0;i<segment_points;i++) normalisation_factor += w[i] * w[i];
+  normalisation_factor *= Fs;
+  normalisation_factor = 1.0/normalisation_factor;
+
+}
+
+
+bool pwelch_batch_t::psd( const double * x , int total_points , int noverlap_segments , std::vector<double> * psd ) const
+{
+
+  int noverlap_points          = noverlap_segments > 1 
+    ? ceil( ( noverlap_segments*segment_points - total_points  ) / double( noverlap_segments - 1 ) )
+    : 0 ;
+  
+  int segment_increment_points = segment_points - noverlap_points;
+
+  // (PWELCH would never advance past the first segment)
+  if ( segment_increment_points < 1 && total_points >= segment_points ) return false;
+  
+  const int segments = total_points < segment_points ? 0 
+    : ( total_points - segment_points ) / segment_increment_points + 1 ;
+  
+  psd->assign( cutoff , 0 );
+
+  const int nout = nfft/2+1;
+
+  const int bs = segments < block_size ? segments : block_size ;
+  
+  double * in = bs ? (double*)fftw_cache::alloc( sizeof(double) * nfft * bs ) : NULL ;
+  fftw_complex * out = bs ? (fftw_complex*)fftw_cache::alloc( sizeof(fftw_complex) * nout * bs ) : NULL ;
+
+  for (int s0 = 0 ; s0 < segments ; s0 += bs )
+    {
+      
+      const int ns = s0 + bs > segments ? segments - s0 : bs ;
+      
+      // load windowed (and zero-padded) segments
+      for (int k=0;k<ns;k++)
+	{
+	  const double * xx = x + (size_t)( s0 + k ) * segment_increment_points;
+	  double * ii = in + (size_t)k * nfft;
+	  if ( window == WINDOW_NONE )
+	    for (int i=0;i<segment_points;i++) ii[i] = xx[i];
+	  else
+	    for (int i=0;i<segment_points;i++) ii[i] = xx[i] * w[i];
+	  for (int i=segment_points;i<nfft;i++) ii[i] = 0;
+	}
+
+      fftw_execute_dft_r2c( fftw_cache::r2c_many( nfft , ns ) , in , out );
+
+      // accumulate, in segment order
+      for (int k=0;k<ns;k++)
+	{
+	  const fftw_complex * oo = out + (size_t)k * nout;
+	  for (int i=0;i<cutoff;i++)
+	    {
+	      double a = oo[i][0];
+	      double b = oo[i][1];
+	      double X = ( a*a + b*b ) * normalisation_factor;
+	      if ( i > 0 && i < cutoff-1 ) X *= 2;
+	      (*psd)[i] += X;
+	    }
+	}
+    }
+
+  fftw_cache::release( in , sizeof(double) * nfft * bs );
+  fftw_cache::release( out , sizeof(fftw_complex) * nout * bs );
+  
+  for (int i=0;i<cutoff;i++)
+    (*psd)[i] /= (double)segments;
+
+  return true;
+}
+
+
 void PWELCH::process()
 {
+
+  //
+  // Default: batched r2c (the average_adj option follows the original path below)
+  //
+
+  if ( ! average_adj )
+    {
+      pwelch_batch_t batch( Fs , M , window , use_nextpow2 );
+      if ( ! batch.psd( data->size() ? &((*data)[0]) : NULL , data->size() , noverlap_segments , &psd ) )
+	Helper::halt( "bad PWELCH parameters: overlapping segments do not advance" );
+      freq = batch.freq;
+      N = batch.cutoff;
+      return;
+    }
   
   // From MATLAB parameterizatopm:
   //  K = (M-NOVERLAP)/(L-NOVERLAP)
@@ -281,7 +563,7 @@ void PWELCH::process()
   //    K = noverlap_segments = desired number of (overlapping) segments of size 'L' within 'M'
   //    NOVERLAP = noverlap_points 
     
-  int total_points             = data.size();
+  int total_points             = data->size();
   int segment_size_points      = M * Fs;   // 'nfft' in Matlab
 
   int noverlap_points          = noverlap_segments > 1 
@@ -340,7 +622,7 @@ void PWELCH::process()
       
       //      FFT fft( nfft , Fs , FFT_FORWARD , window );
       
-      if ( p + segment_size_points > data.size() ) 
+      if ( p + segment_size_points > data->size() ) 
 	Helper::halt( "internal error in pwelch()" );
       
       const bool detrend = false;
@@ -350,20 +632,20 @@ void PWELCH::process()
       if ( detrend )
 	{
 	  std::vector<double> y( segment_size_points );
-	  for (int j=0;j<segment_size_points;j++) y[j] = data[p+j];
+	  for (int j=0;j<segment_size_points;j++) y[j] = (*data)[p+j];
 	  MiscMath::detrend(&y);      
 	  fft0.apply( y ); //wass fft.apply()
 	}
       else if ( zerocentre )
 	{
 	  std::vector<double> y( segment_size_points );
-	  for (int j=0;j<segment_size_points;j++) y[j] = data[p+j];
+	  for (int j=0;j<segment_size_points;j++) y[j] = (*data)[p+j];
 	  MiscMath::centre(&y);      
 	  fft0.apply( y ); //wass fft.apply()
 	}
       else
 	{
-	  fft0.apply( &(data[p]) , segment_size_points ); //wass fft.apply()
+	  fft0.apply( &((*data)[p]) , segment_size_points ); //wass fft.apply()
 	}
       
       if ( average_adj )
@@ -46,6 +46,45 @@ struct edf_t;
 
 std::map<double,double> fft_spectrum( const std::vector<double> * d , int Fs );
 
+
+//
+// Shared FFTW plans, keyed by size and type, and a pool of aligned
+// buffers; plans are made on pool buffers, and so can be executed on
+// any other fftw_cache::alloc() or fftw_malloc() arrays via the
+// fftw_execute_dft*() new-array interface; planner effort and an
+// optional wisdom file are set by 'fftw-plan' and 'fftw-wisdom'
+//
+
+namespace fftw_cache
+{
+  
+  // complex 1D DFT, sign = FFTW_FORWARD or FFTW_BACKWARD 
+  fftw_plan dft_1d( int n , int sign );
+
+  // out-of-place real-to-complex and complex-to-real 
+  fftw_plan r2c_1d( int n );
+  fftw_plan c2r_1d( int n );
+
+  // 'howmany' contiguous r2c transforms of size n (input stride n,
+  // output stride n/2+1)
+  fftw_plan r2c_many( int n , int howmany );
+
+  // aligned buffers, recycled by size
+  void * alloc( size_t bytes );
+  void release( void * p , size_t bytes );
+  
+  // current planner flags (FFTW_ESTIMATE, _MEASURE or _PATIENT)
+  unsigned flags();
+  
+  // import/export globals::fftw_wisdom (if set): load_wisdom() is
+  // called once 'fftw-wisdom' is set, and saves back at exit (from the
+  // same process only, i.e. not from -j workers)
+  void load_wisdom();
+  void save_wisdom();
+
+}
+
+
 class FFT
 {
   
@@ -54,7 +93,7 @@ class FFT
 
  public:
 
-  FFT() { } 
+  FFT() : in(NULL) , out(NULL) , p(NULL) , Nfft(0) { } 
 
   FFT( int Ndata , int Nfft , int Fs , fft_t type = FFT_FORWARD , window_function_t window = WINDOW_NONE ) 
     {
@@ -63,18 +102,18 @@ class FFT
 
   void init( int Ndata , int Nfft , int Fs , fft_t type = FFT_FORWARD , window_function_t window = WINDOW_NONE );
   
+  // plans are shared (fftw_cache), so only buffers are released here
   void reset() 
   {
-    fftw_destroy_plan(p);
-    fftw_free(in);
-    fftw_free(out);
+    fftw_cache::release( in , sizeof(fftw_complex) * Nfft );
+    fftw_cache::release( out , sizeof(fftw_complex) * Nfft );
+    in = out = NULL;
+    p = NULL;
   }
   
   ~FFT() 
     {    
-      fftw_destroy_plan(p);
-      fftw_free(in);
-      fftw_free(out);
+      reset();
     }
   
  private:
@@ -98,7 +137,7 @@ class FFT
   // Output signal
   fftw_complex *out;
   
-  // FFT plan from FFTW3
+  // FFT plan from FFTW3 (not owned, see fftw_cache)
   fftw_plan p;
 
   // Size (NFFT)
@@ -188,6 +227,39 @@ struct bin_t {
 
 
 
+//
+// Batched Welch PSD: the taper and normalisation are made once (per
+// segment size), and the segments of a series are transformed in
+// blocks through a single (cached) many-r2c plan; gives the same
+// spectrum as PWELCH (w/out average_adj).  psd() can be called from
+// several threads at once.
+//
+
+struct pwelch_batch_t {
+
+  pwelch_batch_t( int Fs , double M , window_function_t W = WINDOW_TUKEY50 , bool use_nextpow2 = false );
+
+  // one-sided PSD (size 'cutoff') of x[0..n-1], split into
+  // noverlap_segments segments of M seconds; as PWELCH, if x is shorter
+  // than one segment, all values are 0/0 (NaN); returns false (and
+  // leaves psd untouched) if the segments would not advance
+  bool psd( const double * x , int n , int noverlap_segments , std::vector<double> * psd ) const;
+  
+  int Fs;
+  int segment_points;
+  int nfft;
+  int cutoff;
+  window_function_t window;
+  double normalisation_factor;
+  
+  std::vector<double> w;
+  std::vector<double> freq;
+
+  // segments per many-r2c plan
+  static const int block_size = 32;
+};
+
+
 //
 // Welch's power spectral density estimate
 //
@@ -218,7 +290,7 @@ class PWELCH
 	 window_function_t W = WINDOW_TUKEY50 , 
 	 bool average_adj = false ,
 	 bool use_nextpow2 = false ) 
-   : data(data) , Fs(Fs) , M(M) , noverlap_segments(noverlap_segments) , 
+   : data(&data) , Fs(Fs) , M(M) , noverlap_segments(noverlap_segments) , 
      window(W), average_adj(average_adj) , use_nextpow2( use_nextpow2 )
   {
 
@@ -228,6 +300,12 @@ class PWELCH
 
     process(); 
   } 
+
+  // wrap an already computed spectrum (e.g. from pwelch_batch_t)
+ PWELCH( const std::vector<double> & freq , const std::vector<double> & psd )
+   : N( psd.size() ) , psd( psd ) , freq( freq ) , data( NULL ) , Fs( 0 ) , M( 0 ) , 
+     noverlap_segments( 0 ) , window( WINDOW_NONE ) , average_adj( false ) , use_nextpow2( false ) 
+  { } 
   
   
   //
@@ -274,7 +352,7 @@ class PWELCH
   void process();
   
   // input signal  
-  const std::vector<double> & data;
+  const std::vector<double> * data;
   
   // sampling rate (points per second)
   const int Fs; 
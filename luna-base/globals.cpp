@@ -36,10 +36,14 @@ std::string                        cmd_t::stout_file = "";
 std::string                        cmd_t::stout_template = "";
 bool                               cmd_t::append_stout_file = false;
 bool                               cmd_t::has_indiv_wildcard = false;
+int                                cmd_t::n_workers = 1;
 
 bool                               cmd_t::plaintext_mode = false;
 std::string                        cmd_t::plaintext_root = ".";
 
+bool                               cmd_t::columnar_mode = false;
+std::string                        cmd_t::columnar_file = "";
+
 std::map<std::string,std::string>  cmd_t::vars;
 std::map<std::string,std::map<std::string,std::string> >  cmd_t::ivars;
 
@@ -0,0 +1,72 @@
+//    --------------------------------------------------------------------
+//
+//    This file is part of Luna.
+//
+//    LUNA is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    Luna is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Luna. If not, see <http://www.gnu.org/licenses/>.
+//
+//    Please see LICENSE.txt for more details.
+//
+//    --------------------------------------------------------------------
+
+#ifndef __LUNA_THREADS_H__
+#define __LUNA_THREADS_H__
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+//
+// Minimal parallel-for: calls f(i) for i = 0 .. n-1, over up to nt
+// threads (items are handed out one at a time, so uneven jobs balance)
+//
+// The body must not touch the writer, logger or other shared state
+// (nor call Helper::halt()): compute into per-item slots, then emit
+// results serially, in order, after parallel_for() returns.
+//
+
+namespace luna_threads
+{
+
+  template<class F>
+    void parallel_for( const int n , int nt , F f )
+    {
+
+      nt = std::min( nt , n );
+
+      if ( nt <= 1 )
+	{
+	  for (int i=0; i<n; i++) f(i);
+	  return;
+	}
+
+      std::atomic<int> next( 0 );
+
+      std::vector<std::thread> pool;
+      for (int t=0; t<nt; t++)
+	pool.push_back( std::thread( [&]() {
+	      while ( 1 )
+		{
+		  const int i = next++;
+		  if ( i >= n ) break;
+		  f(i);
+		}
+	    } ) );
+
+      for (int t=0; t<nt; t++) pool[t].join();
+    }
+
+}
+
+#endif
@@ -39,7 +39,7 @@ std::map<std::string,int> Token::fn_map;
 
 void Eval::init( bool na )
 {
-  is_valid = false;
+  is_valid = parsed_valid = false;
   
   no_assignments = na;
 
@@ -733,63 +733,8 @@ bool Eval::execute( const std::vector<Token> & input )
 	      // Perform function calls:
 	      //
 	      
-	      // correct # of arguments? 
-	      // -1 means variable length
+	      res = function( c , args );
 	      
-	      const int nargs = Token::fn_map[ c.name() ]; 
-	      if ( args.size() != nargs && nargs != -1 ) 
-		{
-		  Helper::halt( "wrong number of arguments for " + c.name() );
-		  return false;
-		}
-
-
-	      // note: args are in reverse order here
-	      
-	      if      ( c.name() == "if" )     res = func.fn_set( args[0] );
-	      else if ( c.name() == "ifnot" )  res = func.fn_notset( args[0] );
-	      
-	      else if ( c.name() == "sqrt" )   res = func.fn_sqrt( args[0] );
-	      else if ( c.name() == "sqr" )    res = func.fn_sqr( args[0] );
-	      else if ( c.name() == "pow" )    res = func.fn_pow( args[1] , args[0] );
-
-	      else if ( c.name() == "rnd" )    res = func.fn_rnd();
-	      else if ( c.name() == "rand" )   res = func.fn_rnd( args[0] );
-
-	      else if ( c.name() == "exp" )    res = func.fn_exp( args[0] );
-	      else if ( c.name() == "log" )    res = func.fn_log( args[0] );
-	      else if ( c.name() == "log10" )  res = func.fn_log10( args[0] );
-	      
-	      else if ( c.name() == "ifelse" ) res = func.fn_ifelse( args[2], args[1], args[0] );
-	      
-	      // vector functions
-	
-	      else if ( c.name() == "element" )  res = func.fn_vec_extract( args[1] , args[0] );
-	      
-	      else if ( c.name() == "length" )   res = func.fn_vec_length( args[0] );	      
-	      else if ( c.name() == "size" )     res = func.fn_vec_length( args[0] );	      
-	      	      
-	      else if ( c.name() == "min" )      res = func.fn_vec_min( args[0] );	      
-	      else if ( c.name() == "max" )      res = func.fn_vec_maj( args[0] );
-	      
-	      else if ( c.name() == "sum" )      res = func.fn_vec_sum( args[0] );
-	      else if ( c.name() == "mean" )     res = func.fn_vec_mean( args[0] );
-	      else if ( c.name() == "sort" )     res = func.fn_vec_sort( args[0] );
-
-	      else if ( c.name() == "num_func" )  res = func.fn_vec_new_float( args );
-	      else if ( c.name() == "int_func" )  res = func.fn_vec_new_int( args );
-	      else if ( c.name() == "txt_func" )  res = func.fn_vec_new_str( args );     
-	      else if ( c.name() == "bool_func" ) res = func.fn_vec_new_bool( args ); 
-	      else if ( c.name() == "c_func" )    res = func.fn_vec_cat( args );
-	      
-	      else if ( c.name() == "any" )       res = func.fn_vec_any( args[0] );	      
-	      else if ( c.name() == "all" )       res = func.fn_vec_all( args[0] );	      
-	      else if ( c.name() == "contains" )  res = func.fn_vec_any( args[1] , args[0] );
-	      else if ( c.name() == "countif" )   res = func.fn_vec_count( args[1] , args[0] );
-	      
-
-	      	    	      
-	      else Helper::halt( "did not recognize function " + c.name() );
 
 	      
 	    }
@@ -900,6 +845,69 @@ bool Eval::execute( const std::vector<Token> & input )
   return false;
 }
 
+Token Eval::function( const Token & c , const std::vector<Token> & args )
+{
+  
+  // correct # of arguments? 
+  // -1 means variable length
+  
+  const int nargs = Token::fn_map[ c.name() ]; 
+  if ( args.size() != nargs && nargs != -1 ) 
+    {
+      Helper::halt( "wrong number of arguments for " + c.name() );
+      return Token();
+    }
+
+
+  // note: args are in reverse order here
+  
+  if      ( c.name() == "if" )     return func.fn_set( args[0] );
+  else if ( c.name() == "ifnot" )  return func.fn_notset( args[0] );
+  
+  else if ( c.name() == "sqrt" )   return func.fn_sqrt( args[0] );
+  else if ( c.name() == "sqr" )    return func.fn_sqr( args[0] );
+  else if ( c.name() == "pow" )    return func.fn_pow( args[1] , args[0] );
+
+  else if ( c.name() == "rnd" )    return func.fn_rnd();
+  else if ( c.name() == "rand" )   return func.fn_rnd( args[0] );
+
+  else if ( c.name() == "exp" )    return func.fn_exp( args[0] );
+  else if ( c.name() == "log" )    return func.fn_log( args[0] );
+  else if ( c.name() == "log10" )  return func.fn_log10( args[0] );
+  
+  else if ( c.name() == "ifelse" ) return func.fn_ifelse( args[2], args[1], args[0] );
+  
+  // vector functions
+	
+  else if ( c.name() == "element" )  return func.fn_vec_extract( args[1] , args[0] );
+  
+  else if ( c.name() == "length" )   return func.fn_vec_length( args[0] );	      
+  else if ( c.name() == "size" )     return func.fn_vec_length( args[0] );	      
+  	      
+  else if ( c.name() == "min" )      return func.fn_vec_min( args[0] );	      
+  else if ( c.name() == "max" )      return func.fn_vec_maj( args[0] );
+  
+  else if ( c.name() == "sum" )      return func.fn_vec_sum( args[0] );
+  else if ( c.name() == "mean" )     return func.fn_vec_mean( args[0] );
+  else if ( c.name() == "sort" )     return func.fn_vec_sort( args[0] );
+
+  else if ( c.name() == "num_func" )  return func.fn_vec_new_float( args );
+  else if ( c.name() == "int_func" )  return func.fn_vec_new_int( args );
+  else if ( c.name() == "txt_func" )  return func.fn_vec_new_str( args );     
+  else if ( c.name() == "bool_func" ) return func.fn_vec_new_bool( args ); 
+  else if ( c.name() == "c_func" )    return func.fn_vec_cat( args );
+  
+  else if ( c.name() == "any" )       return func.fn_vec_any( args[0] );	      
+  else if ( c.name() == "all" )       return func.fn_vec_all( args[0] );	      
+  else if ( c.name() == "contains" )  return func.fn_vec_any( args[1] , args[0] );
+  else if ( c.name() == "countif" )   return func.fn_vec_count( args[1] , args[0] );
+  
+  else Helper::halt( "did not recognize function " + c.name() );
+
+  return Token();
+}
+
+
 bool Eval::parse( const std::string & input )
 {
   
@@ -952,6 +960,8 @@ bool Eval::parse( const std::string & input )
   // set pointers to all variables now construction of tokens is complete
   for (int i=0; i<etok.size(); i++)  
     locate_symbols( output[i] ); 
+
+  parsed_valid = is_valid;
   
   return is_valid;
 
@@ -962,35 +972,34 @@ void Eval::assign_to( instance_t & m )
   func.attach( &m );
 }
 
-void Eval::bind( const std::map<std::string,annot_map_t> & inputs , 
-		 instance_t * outputs , 
-		 instance_t * accumulator , 
-		 const std::set<std::string> * global_vars , 
-		 bool reset )   
+// numeric, int, text and bool scalars, and vectors; UNDEFINED if not found
+static void set_token( Token * tok , avar_t * a )
 {
+  if ( a == NULL ) tok->set(); // UNDEFINED
 
+  else if ( a->atype() == globals::A_INT_T  )  { tok->set( a->int_value() ) ;  }
+  else if ( a->atype() == globals::A_DBL_T  )  { tok->set( a->double_value() ); }
+  else if ( a->atype() == globals::A_TXT_T  )  { tok->set( a->text_value() ); }
+  else if ( a->atype() == globals::A_BOOL_T )  { tok->set( a->bool_value() );   }	      
+
+  else if ( a->atype() == globals::A_INTVEC_T  )  { tok->set( a->int_vector() ) ;  }
+  else if ( a->atype() == globals::A_DBLVEC_T  )  { tok->set( a->double_vector() ); }
+  else if ( a->atype() == globals::A_TXTVEC_T  )  { tok->set( a->text_vector() ); }
+  else if ( a->atype() == globals::A_BOOLVEC_T )  { tok->set( a->bool_vector() );   }	      
   
-  if ( reset ) reset_symbols();  
-  
-  //
-  // Input: bind information from inputs and also from accumulator 
-  //
-  
-  //
-  // Output: either to outputs (i.e. which is assumed to be local) OR to the 'global' accumulator (i.e. 
-  // which is assumed to persist across evaluations
-  //
-  
+  else tok->set(); // UNDEFINED
+}
+
+void Eval::collate( const std::map<std::string,annot_map_t> & inputs , 
+		    instance_t * accumulator , 
+		    instance_t * m ) const
+{
 
   //
   // create a single instance that organizes all the information in
   // the annot_map_t above in a sane variable naming scheme
   // 
-  // nb. some redundancy here, as we copy stuff over that we might not need in the 
-  // expression;  can edit here to only copy variables that are in the vartb (i.e. 
-  // those that will actually be used in evaluating the expression)
-  //
-  
+
   std::map<std::string,std::vector<std::string> > accum_txt;
   std::map<std::string,std::vector<int> > accum_int;
   std::map<std::string,std::vector<double> > accum_dbl;
@@ -1059,38 +1068,36 @@ void Eval::bind( const std::map<std::string,annot_map_t> & inputs ,
   //
   // add all to a single instance_t to hand to the token parser
   //
-
-  instance_t m;
   
   std::map<std::string,std::vector<std::string> >::const_iterator ii1 = accum_txt.begin();
   while ( ii1 != accum_txt.end() )
     {
-      if ( ii1->second.size() == 1 ) m.set( ii1->first , ii1->second[0] );
-      else m.set( ii1->first , ii1->second );
+      if ( ii1->second.size() == 1 ) m->set( ii1->first , ii1->second[0] );
+      else m->set( ii1->first , ii1->second );
       ++ii1;
     }
 
   std::map<std::string,std::vector<double> >::const_iterator ii2 = accum_dbl.begin();
   while ( ii2 != accum_dbl.end() )
     {
-      if ( ii2->second.size() == 1 ) m.set( ii2->first , ii2->second[0] );
-      else m.set( ii2->first , ii2->second );
+      if ( ii2->second.size() == 1 ) m->set( ii2->first , ii2->second[0] );
+      else m->set( ii2->first , ii2->second );
       ++ii2;
     }
 
   std::map<std::string,std::vector<int> >::const_iterator ii3 = accum_int.begin();
   while ( ii3 != accum_int.end() )
     {
-      if ( ii3->second.size() == 1 ) m.set( ii3->first , ii3->second[0] );
-      else m.set( ii3->first , ii3->second );
+      if ( ii3->second.size() == 1 ) m->set( ii3->first , ii3->second[0] );
+      else m->set( ii3->first , ii3->second );
       ++ii3;
     }
   
   std::map<std::string,std::vector<bool> >::const_iterator ii4 = accum_bool.begin();
   while ( ii4 != accum_bool.end() )
     {
-      if ( ii4->second.size() == 1 ) m.set( ii4->first , ii4->second[0] );
-      else m.set( ii4->first , ii4->second );
+      if ( ii4->second.size() == 1 ) m->set( ii4->first , ii4->second[0] );
+      else m->set( ii4->first , ii4->second );
       ++ii4;
     }
 
@@ -1116,21 +1123,57 @@ void Eval::bind( const std::map<std::string,annot_map_t> & inputs ,
 	  
 	  globals::atype_t type = value->atype();
 	  
-	  if      ( type == globals::A_TXT_T ) m.set( meta_name , value->text_value() ); 
-	  else if ( type == globals::A_DBL_T ) m.set( meta_name , value->double_value() );
-	  else if ( type == globals::A_INT_T ) m.set( meta_name , value->int_value() );
-	  else if ( type == globals::A_BOOL_T ) m.set( meta_name , value->bool_value() );
-	  else if ( type == globals::A_TXTVEC_T ) m.set( meta_name , value->text_vector() ); 
-	  else if ( type == globals::A_DBLVEC_T ) m.set( meta_name , value->double_vector() );
-	  else if ( type == globals::A_INTVEC_T ) m.set( meta_name , value->int_vector() );
-	  else if ( type == globals::A_BOOLVEC_T ) m.set( meta_name , value->bool_vector() );
+	  if      ( type == globals::A_TXT_T ) m->set( meta_name , value->text_value() ); 
+	  else if ( type == globals::A_DBL_T ) m->set( meta_name , value->double_value() );
+	  else if ( type == globals::A_INT_T ) m->set( meta_name , value->int_value() );
+	  else if ( type == globals::A_BOOL_T ) m->set( meta_name , value->bool_value() );
+	  else if ( type == globals::A_TXTVEC_T ) m->set( meta_name , value->text_vector() ); 
+	  else if ( type == globals::A_DBLVEC_T ) m->set( meta_name , value->double_vector() );
+	  else if ( type == globals::A_INTVEC_T ) m->set( meta_name , value->int_vector() );
+	  else if ( type == globals::A_BOOLVEC_T ) m->set( meta_name , value->bool_vector() );
 	  
 	  // next meta-data
 	  ++kk;
 	} 
       
     }
+
+}
+
+
+void Eval::bind( const std::map<std::string,annot_map_t> & inputs , 
+		 instance_t * outputs , 
+		 instance_t * accumulator , 
+		 const std::set<std::string> * global_vars , 
+		 bool reset )   
+{
+
   
+  if ( reset ) reset_symbols();  
+  
+  //
+  // Input: bind information from inputs and also from accumulator 
+  //
+  
+  //
+  // Output: either to outputs (i.e. which is assumed to be local) OR to the 'global' accumulator (i.e. 
+  // which is assumed to persist across evaluations
+  //
+  
+
+  //
+  // create a single instance that organizes all the information in
+  // the annot_map_t above in a sane variable naming scheme
+  // 
+  // nb. some redundancy here, as we copy stuff over that we might not need in the 
+  // expression;  callers evaluating many epochs can first restrict 'inputs' to 
+  // annotations(), i.e. those that can supply variables in the vartb
+  //
+  
+  instance_t m;
+
+  collate( inputs , accumulator , &m );
+
   // Check...
   //    std::cout << m.print() << "\n";
 
@@ -1156,26 +1199,7 @@ void Eval::bind( const std::map<std::string,annot_map_t> & inputs ,
       while ( tok != i->second.end() )
 	{
 	  
-	  globals::atype_t mt = m.type( var_name );
-
-	  avar_t * a = m.find( var_name );
-	  
-	  // numeric, int, text and bool scalars
-	  // also allow vectors downstream
-	  
-	  if ( a == NULL ) (*tok)->set(); // UNDEFINED
-
-	  else if ( a->atype() == globals::A_INT_T  )  { (*tok)->set( a->int_value() ) ;  }
-	  else if ( a->atype() == globals::A_DBL_T  )  { (*tok)->set( a->double_value() ); }
-	  else if ( a->atype() == globals::A_TXT_T  )  { (*tok)->set( a->text_value() ); }
-	  else if ( a->atype() == globals::A_BOOL_T )  { (*tok)->set( a->bool_value() );   }	      
-
-	  else if ( a->atype() == globals::A_INTVEC_T  )  { (*tok)->set( a->int_vector() ) ;  }
-	  else if ( a->atype() == globals::A_DBLVEC_T  )  { (*tok)->set( a->double_vector() ); }
-	  else if ( a->atype() == globals::A_TXTVEC_T  )  { (*tok)->set( a->text_vector() ); }
-	  else if ( a->atype() == globals::A_BOOLVEC_T )  { (*tok)->set( a->bool_vector() );   }	      
-	  
-	  else (*tok)->set(); // UNDEFINED
+	  set_token( *tok , m.find( var_name ) );
 	    	  
 	  ++tok;
 	}
@@ -1226,12 +1250,245 @@ void Eval::bind( const Token * ntok )
 bool Eval::evaluate( const bool v )
 {
   verbose = v;
+  is_valid = parsed_valid;
   for (int i=0; i<neval; i++)
     if ( is_valid ) 
       is_valid = execute( output[i] );
   return is_valid;
 }
 
+std::vector<std::string> Eval::annotations( const std::vector<std::string> & names ) const
+{
+  std::vector<std::string> r;
+  for (int a=0; a<names.size(); a++)
+    {
+      const std::string & n = names[a];
+      std::map<std::string,std::set<Token*> >::const_iterator i = vartb.begin();
+      while ( i != vartb.end() )
+	{
+	  const std::string & v = i->first;
+	  if ( v.compare( 0 , n.size() , n ) == 0 
+	       && ( v.size() == n.size() 
+		    || v.compare( n.size() , std::string::npos , "_sec" ) == 0 
+		    || v[ n.size() ] == '.' ) )
+	    {
+	      r.push_back( n );
+	      break;
+	    }
+	  ++i;
+	}
+    }
+  return r;
+}
+
+
+bool Eval::columnwise() const
+{
+  int nrnd = 0;
+  for (int i=0; i<neval; i++)
+    for (int j=0; j<output[i].size(); j++)
+      {
+	const Token & t = output[i][j];
+	if ( t.is_assignment() ) return false;
+	if ( t.is_function() && ( t.name() == "rnd" || t.name() == "rand" ) ) ++nrnd;
+      }
+  return nrnd <= 1;
+}
+
+
+bool Eval::evaluate( const std::vector<std::map<std::string,annot_map_t> > & inputs , 
+		     std::vector<Token> * results , 
+		     std::vector<bool> * valid , 
+		     instance_t * accumulator , 
+		     const bool v )
+{
+  
+  const int n = inputs.size();
+  
+  results->resize( n );
+  
+  if ( v || ! columnwise() )
+    {
+      bool any = false;
+      valid->resize( n );
+      for (int r=0; r<n; r++)
+	{
+	  instance_t dummy;
+	  bind( inputs[r] , &dummy , accumulator );
+	  (*valid)[r] = evaluate( v );
+	  (*results)[r] = e;
+	  if ( (*valid)[r] ) any = true;
+	}
+      return any;
+    }
+  
+  // column-wise, validity does not vary by row
+  is_valid = parsed_valid;
+  
+  valid->assign( n , is_valid );
+  
+  for (int r=0; r<n; r++) (*results)[r].set();
+  
+  if ( n == 0 || ! is_valid ) return is_valid;
+
+  //
+  // resolve each variable once, as a column of per-row values
+  //
+  
+  std::map<std::string,std::vector<Token> > symbols;
+  std::map<std::string,std::set<Token*> >::const_iterator i = vartb.begin();
+  while ( i != vartb.end() )
+    {
+      symbols[ i->first ].resize( n );
+      ++i;
+    }
+  
+  for (int r=0; r<n; r++)
+    {
+      instance_t m;
+      collate( inputs[r] , accumulator , &m );
+      std::map<std::string,std::vector<Token> >::iterator ss = symbols.begin();
+      while ( ss != symbols.end() )
+	{
+	  set_token( &ss->second[r] , m.find( ss->first ) );
+	  ++ss;
+	}
+    }
+
+  // as evaluate(): every statement is run, the last gives the value
+  for (int i=0; i<neval; i++)
+    execute( output[i] , symbols , n , results );
+  
+  return is_valid;
+}
+
+
+bool Eval::execute( const std::vector<Token> & input , 
+		    const std::map<std::string,std::vector<Token> > & symbols , 
+		    const int n , 
+		    std::vector<Token> * res )
+{
+
+  //
+  // As execute(), but each stack slot is a column of n values (or a
+  // single value, if constant over rows): each operator is applied
+  // over all rows in one pass, rather than interpreting the whole
+  // expression once per row
+  //
+
+  struct column_t { 
+    column_t() : constant( true ) { } 
+    bool constant;
+    std::vector<Token> v;
+    const Token & operator[]( const int r ) const { return constant ? v[0] : v[r]; }
+  };
+  
+  // variable tokens, by address (their values are not bound here)
+  std::map<const Token*,const std::vector<Token>*> vars;
+  std::map<std::string,std::set<Token*> >::const_iterator i = vartb.begin();
+  while ( i != vartb.end() )
+    {
+      std::set<Token*>::const_iterator k = i->second.begin();
+      while ( k != i->second.end() ) 
+	{ 
+	  vars[ *k ] = &symbols.find( i->first )->second;
+	  ++k; 
+	}
+      ++i;
+    }
+
+  std::vector<column_t> stack;
+
+  for (unsigned int i = 0 ; i < input.size() ; i++ )
+    {
+      
+      const Token & c = input[i];
+      
+      if ( c.is_ident() )
+	{
+	  column_t col;
+	  std::map<const Token*,const std::vector<Token>*>::const_iterator vv = vars.find( &c );
+	  if ( vv != vars.end() ) 
+	    {
+	      col.constant = false;
+	      col.v = *vv->second;
+	    }
+	  else
+	    col.v.push_back( c );
+	  stack.push_back( col );
+	}
+      
+      else if ( c.is_operator() || c.is_function() )
+	{
+	  
+	  int nargs = op_arg_count(c);
+	  
+	  if ( (int)stack.size() < nargs && nargs != -1 ) 
+	    {
+	      Helper::halt( "not enough arguments for " + c.name() ) ;
+	      return false;
+	    }
+	  
+	  // the number of arguments of variadic functions is a literal
+	  if ( c.is_function() && nargs == -1 ) 
+	    {
+	      nargs = stack.back()[0].as_int();
+	      stack.pop_back();
+	    }
+	  
+	  if ( ! c.is_function() ) nargs = nargs == 1 ? 1 : 2 ; 
+	  
+	  // args[0] is the top of the stack, as for execute()
+	  std::vector<column_t> args( nargs );
+	  for (int a=0; a<nargs; a++)
+	    {
+	      std::swap( args[a] , stack.back() );
+	      stack.pop_back();
+	    }
+	  
+	  // random draws are made per row
+	  bool constant = ! ( c.is_function() && ( c.name() == "rnd" || c.name() == "rand" ) );
+	  for (int a=0; a<nargs; a++) 
+	    if ( ! args[a].constant ) constant = false;
+
+	  const int nr = constant ? 1 : n ;
+
+	  column_t col;
+	  col.constant = constant;
+	  col.v.resize( nr );
+	  
+	  std::vector<Token> rargs( nargs );
+	  Token oper = c;
+	  
+	  for (int r=0; r<nr; r++)
+	    {
+	      for (int a=0; a<nargs; a++) rargs[a] = args[a][r];
+	      
+	      if ( c.is_function() ) 
+		col.v[r] = function( c , rargs );
+	      else if ( nargs == 1 ) 
+		col.v[r] = oper.operands( rargs[0] );
+	      else
+		col.v[r] = oper.operands( rargs[0] , rargs[1] );
+	    }
+	  
+	  stack.push_back( col );
+	}
+    }
+  
+  if ( stack.size() != 1 ) 
+    {
+      Helper::halt( "badly formed eval expression" );
+      return false;
+    }
+  
+  for (int r=0; r<n; r++)
+    (*res)[r] = stack[0][r];
+
+  return true;
+}
+
+
 bool Eval::valid() const 
 {
   return is_valid;
@@ -1254,6 +1511,11 @@ Token::tok_type Eval::rtype() const
 }
 
 bool Eval::value(bool & b)
+{
+  return value( e , b );
+}
+
+bool Eval::value( const Token & e , bool & b )
 {
 
   if ( e.is_bool(&b) ) return true;
@@ -73,6 +73,32 @@ struct Eval {
   void bind( const Token * );
 
   bool evaluate( const bool v = false );
+
+  //
+  // Compile-once use over many rows (e.g. epochs): parse once, bind
+  // only the annotations that can supply the expression's variables,
+  // then evaluate each statement one operator at a time over all rows
+  //
+
+  // the subset of annotations 'names' that any variable can come from
+  // (i.e. X, X_sec or X.var, for annotation X)
+  std::vector<std::string> annotations( const std::vector<std::string> & names ) const;
+
+  // column-wise evaluation is possible if there are no assignments and
+  // at most one random-number draw (so the sequence of draws is as when
+  // evaluating row by row)
+  bool columnwise() const;
+
+  // inputs[r] holds the annotations for row r; results[r] and valid[r]
+  // are the value of the expression for that row and whether it was
+  // valid, i.e. as value() after bind() and evaluate().  Rows are
+  // evaluated one-by-one if ! columnwise() or verbose (with any
+  // assignments going to a dummy instance); returns F if no row is valid
+  bool evaluate( const std::vector<std::map<std::string,annot_map_t> > & inputs , 
+		 std::vector<Token> * results , 
+		 std::vector<bool> * valid , 
+		 instance_t * accumulator = NULL , 
+		 const bool v = false );
     
   bool valid() const;
   
@@ -84,6 +110,7 @@ struct Eval {
 
   // queries into value of expression
   bool value(bool & b);
+  static bool value( const Token & , bool & b );
   bool value(int & );
   bool value(double &);
   bool value(std::string &);
@@ -98,6 +125,14 @@ struct Eval {
   bool get_token( std::string & input ,  Token & );
   bool previous_value;
   bool execute( const std::vector<Token> & );
+  bool execute( const std::vector<Token> & , 
+		const std::map<std::string,std::vector<Token> > & symbols , 
+		const int n , 
+		std::vector<Token> * res );
+  Token function( const Token & c , const std::vector<Token> & args );
+  void collate( const std::map<std::string,annot_map_t> & inputs , 
+		instance_t * accumulator , 
+		instance_t * m ) const;
   bool shunting_yard( const std::string & input, std::vector<Token> & );  
   
   // helpers
@@ -108,8 +143,10 @@ struct Eval {
   // expression in RPN notation (post parse) (for each eval)
   std::vector< std::vector<Token> >output;   
   
-  // keep track of state (errors?)
+  // keep track of state (errors?): is_valid is reset to parsed_valid
+  // at the start of each evaluate(), i.e. is per row when reused
   bool is_valid;
+  bool parsed_valid;
   std::string errs;
   
   // slot for final expression value
@@ -8,6 +8,7 @@
 #include <cstdlib>
 #include <cmath>
 #include "ica/lica_matrix.h"
+#include "stats/statistics.h"
 #include "helper/helper.h"
 
 
@@ -213,16 +214,8 @@ void mat_sub( Data::Matrix<double> & A, Data::Matrix<double> & B,  Data::Matrix<
  */
 void mat_mult( Data::Matrix<double> & A, Data::Matrix<double> & B, Data::Matrix<double> &  R )
 {
-  const int rows_A = A.dim1();
-  const int cols_A = A.dim2();
-  const int cols_B = B.dim2();
-
-  mat_zeroize(R , rows_A, cols_B);
-
-  for(int i=0; i<rows_A; i++ )
-    for(int j=0; j<cols_B; j++)
-      for(int k=0; k<cols_A; k++)
-	R[i][j] += A[i][k] * B[k][j];
+  // blocked, column-major kernel (same summation order as before)
+  R = Statistics::matrix_multiply( A , B );
 }
 
 
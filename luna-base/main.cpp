@@ -28,8 +28,15 @@
 #include "helper/token.h"
 #include "helper/token-eval.h"
 #include "cwt/cwt.h"
+#include "db/colstore.h"
 
 #include <fstream>
+#include <cstdio>
+#include <cerrno>
+#ifndef WINDOWS
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 extern globals global;
 
@@ -37,6 +44,9 @@ extern writer_t writer;
 
 extern logger_t logger;
 
+// set if any -j worker process failed (i.e. exit non-zero)
+static bool failed_workers = false;
+
 int main(int argc , char ** argv )
 {
 
@@ -52,7 +62,7 @@ int main(int argc , char ** argv )
   // usgae
   //
 
-  std::string usage_msg = "usage: luna [sample-list|EDF] [n1] [n2] [@parameter-file] [sig=s1,s2] [v1=val1] < command-file";
+  std::string usage_msg = "usage: luna [sample-list|EDF] [n1] [n2] [-j N] [@parameter-file] [sig=s1,s2] [v1=val1] < command-file";
   
   //
   // initiate global defintions
@@ -251,6 +261,13 @@ int main(int argc , char ** argv )
       writer.commit();
       std::exit(0);
     }
+  else if ( argc == 2 && strcmp( argv[1] , "--suds-bank" ) == 0 ) 
+    {
+      param_t param;
+      build_param_from_cmdline( &param );
+      suds_bank_t::compile( param );
+      std::exit(0);
+    }
   else if ( argc >= 2 )
     {  
       
@@ -325,6 +342,26 @@ int main(int argc , char ** argv )
 	      cmd_t::plaintext_root = argv[ ++i ];
 	      cmd_t::plaintext_mode = true;
 	    }
+
+	  // specify columnar file for output
+
+	  else if ( Helper::iequals( tok[0] , "-c" ) )
+	    {
+	      // next arg will be the (single) columnar output file
+	      if ( i + 1 >= argc ) Helper::halt( "expecting file name after -c" );
+	      cmd_t::columnar_file = argv[ ++i ];
+	      cmd_t::columnar_mode = true;
+	    }
+
+	  // process N EDFs from the sample-list at once
+	  
+	  else if ( Helper::iequals( tok[0] , "-j" ) || Helper::iequals( tok[0] , "--threads" ) )
+	    {
+	      // next arg will be number of workers
+	      if ( i + 1 >= argc ) Helper::halt( "expecting number of workers after -j/--threads" );
+	      if ( ! Helper::str2int( argv[ ++i ] , &cmd_t::n_workers ) || cmd_t::n_workers < 1 ) 
+		Helper::halt( "expecting a positive integer after -j/--threads" );
+	    }
 	  
 	  // luna-script from command line
 	  
@@ -463,6 +500,11 @@ int main(int argc , char ** argv )
     {
       writer.use_plaintext( cmd_t::plaintext_root );
     }
+  // columnar-file mode?
+  else if ( cmd_t::columnar_mode )
+    {
+      writer.use_columnar( cmd_t::columnar_file );
+    }
   // was an output db specified?
   else if ( cmd_t::stout_file != "" )
     {
@@ -579,13 +621,118 @@ int main(int argc , char ** argv )
   if ( failed == 0 ) logger << " all of which passed" << "\n";
   else logger << failed << " of which failed\n";
 
-  exit(0);
+  exit( failed_workers ? 1 : 0 );
   
 }
 
 
 
 
+//
+// Parallel sample-list mode (-j N): each EDF is handed to a forked
+// worker process (i.e. with its own edf_t, writer_t and logger_t);
+// workers write stdout/stderr to temporary files, and if writing to a
+// single output DB, to a job-specific DB; all are then emitted/merged
+// by the parent strictly in sample-list order (not on Windows, where
+// EDFs are always processed serially)
+//
+
+#ifndef WINDOWS
+
+// worker exit status for an EDF that could not be loaded (and was
+// skipped, as in serial mode); any other non-zero status is a failure
+
+static const int worker_skipped = 2;
+
+struct edf_job_t
+{
+  edf_job_t() : pid(-1) , done(false) , status(0) , out(NULL) , err(NULL) { }
+  pid_t pid;
+  bool done;
+  int status;
+  std::string id;
+  std::string db;
+  FILE * out;
+  FILE * err;
+};
+
+static void emit_tmpfile( FILE * f , std::ostream & os )
+{
+  if ( f == NULL ) return;
+  rewind( f );
+  char buf[ 65536 ];
+  size_t n;
+  while ( ( n = fread( buf , 1 , sizeof(buf) , f ) ) > 0 )
+    os.write( buf , n );
+  os.flush();
+  fclose( f );
+}
+
+static void wait_for_job( std::vector<edf_job_t> & jobs )
+{
+  // block until one (tracked) worker has finished
+  while ( 1 ) 
+    {
+      int status = 0;
+      pid_t pid = waitpid( -1 , &status , 0 );
+      if ( pid == -1 ) 
+	{
+	  if ( errno == EINTR ) continue;
+	  Helper::halt( "internal error waiting for worker processes" );
+	}
+      for (int j=0;j<jobs.size();j++)
+	if ( jobs[j].pid == pid )
+	  {
+	    jobs[j].done = true;
+	    jobs[j].status = WIFEXITED( status ) ? WEXITSTATUS( status ) : 1 ;
+	    return;
+	  }
+    }
+}
+
+static void flush_jobs( std::vector<edf_job_t> & jobs , int * flushed )
+{
+  // only emit a job once all prior jobs have been emitted
+  while ( *flushed < jobs.size() && jobs[ *flushed ].done )
+    {
+      edf_job_t & job = jobs[ *flushed ];
+      emit_tmpfile( job.out , std::cout );
+      emit_tmpfile( job.err , std::cerr );
+      job.out = job.err = NULL;
+      if ( job.status != 0 && job.status != worker_skipped )
+	{
+	  logger << "**warning: worker for " << job.id << " failed (exit status " << job.status << "), output not merged\n";
+	  failed_workers = true;
+	}
+      ++(*flushed);
+    }
+}
+
+static void worker_exit( const int status )
+{
+  // close out a forked worker: no logger close-out message, and
+  // _exit() so that no other parent state (e.g. static dtors) is run
+  logger.off();
+  writer.close();
+  std::cout.flush();
+  std::cerr.flush();
+  fflush( NULL );
+  _exit( status );
+}
+
+static void worker_bail( const std::string & msg )
+{
+  // Helper::halt() in a worker: as above, rather than std::exit(), so
+  // that the parent's atexit() handlers are not run in every worker
+  logger.off();
+  std::cerr << "error : " << msg << "\n";
+  globals::bail_function = NULL;
+  worker_exit( 1 );
+}
+
+#endif
+
+
 void process_edfs( cmd_t & cmd )
 {
   
@@ -645,6 +792,44 @@ void process_edfs( cmd_t & cmd )
     }
   
 
+  //
+  // Run multiple EDFs in parallel? 
+  //
+
+#ifdef WINDOWS
+  if ( cmd_t::n_workers > 1 ) 
+    logger << "  ** -j is not supported on Windows: processing EDFs serially\n";
+  const bool parallel = false;
+#else
+  const bool parallel = cmd_t::n_workers > 1 && ! single_edf;
+#endif
+
+  // writing all to a single output DB, i.e. that needs merging?
+  const bool single_db = parallel 
+    && ! cmd_t::plaintext_mode 
+    && ! cmd_t::columnar_mode 
+    && cmd_t::stout_file != "" 
+    && ! cmd_t::has_indiv_wildcard;
+
+  // likewise, for a single columnar file: each worker writes its own, and
+  // the chunks are then concatenated
+  const bool single_col = parallel && cmd_t::columnar_mode;
+  
+#ifndef WINDOWS
+  std::vector<edf_job_t> jobs;
+  int running = 0;
+  int flushed = 0;
+#endif
+  bool worker = false;
+  
+  if ( parallel ) 
+    {
+      logger << "running " << cmd_t::n_workers << " EDFs in parallel\n";
+      // do not carry an open DB connection across fork()
+      if ( single_db || single_col ) writer.close();
+    }
+
+  
   //
   // Start iterating through it
   //
@@ -759,6 +944,74 @@ void process_edfs( cmd_t & cmd )
 	}
       
 
+      //
+      // In parallel mode, the parent forks a worker for this EDF and
+      // moves to the next
+      //
+
+#ifndef WINDOWS      
+      if ( parallel )
+	{
+	  
+	  // wait for a free slot (also capping the number of finished
+	  // jobs waiting on a slow, earlier one)
+	  while ( running > 0 && 
+		  ( running >= cmd_t::n_workers || jobs.size() - flushed >= 8 * cmd_t::n_workers ) )
+	    {
+	      wait_for_job( jobs );
+	      --running;
+	      flush_jobs( jobs , &flushed );
+	    }
+	  
+	  edf_job_t job;
+	  job.id  = rootname;
+	  job.out = tmpfile();
+	  job.err = tmpfile();
+	  if ( job.out == NULL || job.err == NULL ) 
+	    Helper::halt( "could not create temporary files for worker" );
+	  
+	  if ( single_db ) 
+	    job.db = cmd_t::stout_file + ".job" + Helper::int2str( (int)jobs.size() + 1 );
+	  else if ( single_col )
+	    job.db = cmd_t::columnar_file + ".job" + Helper::int2str( (int)jobs.size() + 1 );
+
+	  std::cout.flush();
+	  std::cerr.flush();
+	  fflush( NULL );
+	  
+	  pid_t pid = fork();
+
+	  if ( pid < 0 ) 
+	    Helper::halt( "could not fork worker process" );
+	  
+	  if ( pid == 0 ) 
+	    {
+	      // worker: capture all output, and process this EDF below 
+	      worker = true;
+	      dup2( fileno( job.out ) , STDOUT_FILENO );
+	      dup2( fileno( job.err ) , STDERR_FILENO );
+	      globals::bail_function = worker_bail;
+	      if ( single_db ) 
+		{
+		  Helper::deleteFile( job.db );
+		  writer.attach( job.db );
+		}
+	      else if ( single_col )
+		writer.use_columnar( job.db );
+	    }
+	  else
+	    {
+	      // parent: track job, move to next EDF 
+	      job.pid = pid;
+	      jobs.push_back( job );
+	      ++running;
+	      ++processed;
+	      continue;
+	    }
+	}
+#endif
+      
+
       //
       // Begin running through the series of commands
       //
@@ -863,6 +1116,10 @@ void process_edfs( cmd_t & cmd )
 	 	  
 	  writer.commit();
 
+#ifndef WINDOWS
+	  if ( worker ) worker_exit( worker_skipped );
+#endif
+	  
 	  continue;
 	}
       
@@ -1124,6 +1381,14 @@ void process_edfs( cmd_t & cmd )
       if ( cmd_t::has_indiv_wildcard || cmd_t::plaintext_mode ) 
 	writer.close();
 
+      //
+      // worker processes handle only a single EDF
+      //
+
+#ifndef WINDOWS
+      if ( worker ) worker_exit( 0 );
+#endif
+      
       //
       // all done / next EDF
       //
@@ -1139,6 +1404,57 @@ void process_edfs( cmd_t & cmd )
   
   if ( ! single_edf ) 
     EDFLIST.close();
+
+
+  //
+  // Parallel mode: wait for all workers, emit remaining output, and
+  // merge any job-specific DBs (in sample-list order), except from
+  // failed workers
+  //
+
+#ifndef WINDOWS
+  if ( parallel )
+    {
+      
+      while ( running > 0 ) 
+	{
+	  wait_for_job( jobs );
+	  --running;
+	  flush_jobs( jobs , &flushed );
+	}
+      
+      for (int j=0;j<jobs.size();j++)
+	if ( jobs[j].status == 0 ) ++actual;
+      
+      if ( single_db ) 
+	{
+	  writer.attach( cmd_t::stout_file );
+	  writer.begin();
+	  for (int j=0;j<jobs.size();j++)
+	    {
+	      if ( ! Helper::fileExists( jobs[j].db ) ) continue;
+	      if ( jobs[j].status == 0 || jobs[j].status == worker_skipped ) 
+		writer.append_from( jobs[j].db );
+	      Helper::deleteFile( jobs[j].db );
+	      Helper::deleteFile( jobs[j].db + "-journal" ); // if halted mid-transaction
+	    }
+	  writer.commit();
+	}
+
+      if ( single_col )
+	{
+	  writer.use_columnar( cmd_t::columnar_file );
+	  for (int j=0;j<jobs.size();j++)
+	    {
+	      if ( ! Helper::fileExists( jobs[j].db ) ) continue;
+	      if ( jobs[j].status == 0 || jobs[j].status == worker_skipped ) 
+		writer.append_columnar( jobs[j].db );
+	      Helper::deleteFile( jobs[j].db );
+	    }
+	  writer.close();
+	}
+    }
+#endif
   
 
   //
@@ -1188,6 +1504,21 @@ void proc_eval_tester( const bool verbose )
 
 
 
+// -d checks: report, and exit with 0 (OK) or 1 (FAILED); file-based
+// checks write to the given file (or a default name) and remove it
+
+static void selftest_exit( const std::string & label , const bool okay )
+{
+  std::cout << label << ": " << ( okay ? "OK" : "FAILED" ) << "\n";
+  std::exit( okay ? 0 : 1 );
+}
+
+static std::string selftest_file( const std::string & p2 , const std::string & ext )
+{
+  return p2 != "" ? p2 : "luna-selftest." + ext ;
+}
+
+
 // DUMMY : a generic placeholder/scratchpad for templating new things
 
 void proc_dummy( const std::string & p , const std::string & p2 )
@@ -1262,7 +1593,52 @@ void proc_dummy( const std::string & p , const std::string & p2 )
       ctest();
       std::exit(0);
     }
+
+  if ( p == "annot-extract" )
+    {
+      int n = 100000;
+      if ( p2 != "" && ! Helper::str2int( p2 , &n ) ) Helper::halt( "expecting -d annot-extract {n}" );
+      annot_t::benchmark_extract( n );
+      std::exit(0);
+    }
+
+  if ( p == "matrix" )
+    {
+      int n = 5;
+      if ( p2 != "" && ! Helper::str2int( p2 , &n ) ) Helper::halt( "expecting -d matrix {reps}" );
+      Statistics::matrix_benchmark( n );
+      std::exit(0);
+    }
+  
+  if ( p == "pdc-index" )
+    selftest_exit( "PD-LIB index vs full scan" , pdc_vptree_t::selftest() );
+
+  if ( p == "sampen" )
+    selftest_exit( "SampEn (grid) vs reference" , mse_t::selftest() );
+
+  if ( p == "cwt-peak" )
+    selftest_exit( "CWT wavelet peak vs full FFT" , CWT::selftest() );
   
+  if ( p == "edfz" )
+    selftest_exit( "EDFZ index round-trip" , edfz_t::selftest( selftest_file( p2 , "edfz" ) ) );
+
+  if ( p == "bgzf" )
+    {
+      int mb = 64;
+      if ( p2 != "" && ! Helper::str2int( p2 , &mb ) ) Helper::halt( "expecting -d bgzf {MB}" );
+      edfz_t::benchmark( "luna-benchmark.edfz" , mb );
+      std::exit(0);
+    }
+
+  if ( p == "suds-bank" )
+    selftest_exit( "SUDSBNK1 round-trip" , suds_bank_t::selftest( selftest_file( p2 , "suds" ) ) );
+
+  if ( p == "pdc" )
+    selftest_exit( "LUNAPDC1 round-trip and all-by-all kernel" , pdc_t::selftest( selftest_file( p2 , "pdc" ) ) );
+
+  if ( p == "colstore" )
+    selftest_exit( "LUNACOL1 round-trip" , colstore_reader_t::selftest( selftest_file( p2 , "col" ) ) );
+
   if ( p == "cmddefs" ) 
     {
       
@@ -1608,7 +1984,7 @@ void proc_dummy( const std::string & p , const std::string & p2 )
       
       mse_t mse( 1,20,1,2,0.15 );
       
-      std::map<int,double> mses = mse.calc( x );
+      std::map<int,double> mses = mse.calc( x , globals::n_threads );
 
       std::map<int,double>::const_iterator ii = mses.begin();
       while ( ii != mses.end() )
@@ -109,3 +109,43 @@ int CRandom::rand (int n)
   return r;
 }
 
+
+
+
+CRandomStream::CRandomStream( long unsigned i )
+{
+
+  idum = -i;
+  iy = 0;
+  iv.resize( CRandom::NTAB );
+
+  if (-idum < 1) idum=1;
+  else idum = -idum;
+  for (int j=CRandom::NTAB+7;j>=0;j--) {
+    int k=idum/CRandom::IQ;
+    idum=CRandom::IA*(idum-k*CRandom::IQ)-CRandom::IR*k;
+    if (idum < 0) idum += CRandom::IM;
+    if (j < CRandom::NTAB) iv[j] = idum;
+  }
+  iy=iv[0];
+
+}
+
+double CRandomStream::rand()
+{
+  int k=idum/CRandom::IQ;
+  idum=CRandom::IA*(idum-k*CRandom::IQ)-CRandom::IR*k;
+  if (idum < 0) idum += CRandom::IM;
+  int j=iy/CRandom::NDIV;
+  iy=iv[j];
+  iv[j] = idum;
+  double temp = CRandom::AM*iy;
+  return temp > CRandom::RNMX ? CRandom::RNMX : temp;
+}
+
+int CRandomStream::rand( int n )
+{
+  int r = int(rand() * n);
+  if (r == n) r--;
+  return r;
+}
@@ -54,4 +54,25 @@ class CRandom
   
 };
 
+
+// As CRandom, but with per-instance state, so that independent streams
+// (e.g. one per permutation replicate) can be used from worker threads
+
+class CRandomStream
+{
+ public:
+
+  CRandomStream( long unsigned iseed = 1 );
+
+  double rand();
+  int rand( int );
+
+ private:
+
+  int idum;
+  int iy;
+  std::vector<int> iv;
+
+};
+
 #endif
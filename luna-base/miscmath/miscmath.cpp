@@ -398,8 +398,9 @@ double MiscMath::turning_rate( const std::vector<double> * d , int sr , int es ,
 	{
 	  int pj = p + j;
 	  //std::cerr << " pj = " << p << " " << j << " " << pj << " " << d->size() << "\n";
+	  // skip repeated values (nb. compare against the last point kept)
 	  if ( extract.size() == 0 ) extract.push_back( (*d)[p+j] );
-	  else if ( extract[j-1] != (*d)[p+j] ) extract.push_back( (*d)[p+j] );
+	  else if ( extract.back() != (*d)[p+j] ) extract.push_back( (*d)[p+j] );
 	}
 
       int turns = 0; 
@@ -375,30 +375,46 @@ void pdc_t::exe_calc_matrix_and_cluster( edf_t & edf , param_t & param ,
   const bool use_whole_trace = ne_by_ne && ! edf.timeline.epoched() ; 
 
   
+  // max. number of clusters (stopping rule)
+  int preK = param.has( "k" ) ? param.requires_int( "k" ) : 0 ;
+
+  // constraint on maximum size of each cluster (0 = no constraint)
+  int maxS = param.has( "mx" ) ? param.requires_int( "mx" ) : 0 ;
+
+  const bool cluster = preK != 0 || maxS != 0;
+
+  if ( ! ( cluster || write_matrix ) ) return;
+
+  // write the full matrix as text, rather than the binary upper triangle
+  const bool text = param.has( "txt" );
+  
   //
-  // Calculate distance matrix
+  // Calculate distance matrix (the full matrix is only needed for clustering)
   //
   
-  
-  Data::Matrix<double> D = all_by_all();
-  
-  
-  if ( D.dim1() != nobs ) 
-    Helper::halt( "internal error in pdc_t::similarity_matrix()" );
+  Data::Matrix<double> D;
+
+  std::vector<double> P;
+
+  if ( cluster )
+    {
+      D = all_by_all();
+      if ( D.dim1() != nobs ) 
+	Helper::halt( "internal error in pdc_t::similarity_matrix()" );
+    }
+  else
+    P = all_by_all_packed();
   
   if ( write_matrix )
     {
 
-      std::ofstream OUT1( outfile.c_str() , std::ios::out );
-      for (int i=0;i<nobs;i++)
-	{
-	  for (int j=0;j<nobs;j++) OUT1 << ( j ? "\t" : "" ) << D[i][j];
-	  OUT1 << "\n";
-	}
-      OUT1.close();
+      if ( cluster )
+	write_distance_matrix( outfile , D , text );
+      else
+	write_distance_matrix( outfile , nobs , P , text );
 
       logger << "  output distance matrix for " << nobs
-	     << " observations to " << outfile << "\n";
+	     << " observations to " << outfile << ( text ? "" : " (binary)" ) << "\n";
 
       // channel/epoch labels?
       if ( ne_by_ne )
@@ -440,25 +456,19 @@ void pdc_t::exe_calc_matrix_and_cluster( edf_t & edf , param_t & param ,
     logger << "  clustering epochs...\n";
 
   
-  cluster_t cluster;
-
-  // max. number of clusters (stopping rule)
-  int preK = param.has( "k" ) ? param.requires_int( "k" ) : 0 ;
-
-  // constraint on maximum size of each cluster (0 = no constraint)
-  int maxS = param.has( "mx" ) ? param.requires_int( "mx" ) : 0 ;
-
   //
   // do we want to cluster?
   //
 
-  if ( preK == 0 && maxS == 0 ) return;
+  if ( ! cluster ) return;
     
   //
   // get cluster solution
   //
 
-  cluster_solution_t sol = cluster.build( D , preK , maxS );
+  cluster_t clusters;
+
+  cluster_solution_t sol = clusters.build( D , preK , maxS );
   
   if ( sol.best.size() != nobs )
     Helper::halt( "internal error in ExE" );
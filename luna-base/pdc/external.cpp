@@ -136,17 +136,14 @@ void pdc_t::external( param_t & param )
   encode_ts();
 	
   //
-  // Generate all-by-all matric
+  // Generate all-by-all matrix (upper triangle) and write, as binary
+  // unless 'txt'
   //
 
-  Data::Matrix<double> D = all_by_all();
-
-  //
-  // Write
-  //
+  const int n = obs.size();
   
-  std::ofstream OUT( output.c_str() , std::ios::out );
-  OUT << D.dump();
-  OUT.close();
+  std::vector<double> P = all_by_all_packed();
+
+  write_distance_matrix( output , n , P , param.has( "txt" ) );
   
 }
@@ -29,11 +29,15 @@
 #include "edf/edf.h"
 #include "edf/slice.h"
 #include "dsp/resample.h"
+#include "helper/threads.h"
+#include "miscmath/crandom.h"
 
 #include <string>
 #include <iostream>
 #include <cmath>
 #include <set>
+#include <sstream>
+#include <cstdio>
 
 
 
@@ -46,6 +50,7 @@ int pdc_t::t = 1;
 int pdc_t::q = 0;
 bool pdc_t::store_ts = true;
 std::vector<pdc_obs_t> pdc_t::obs;
+pdc_vptree_t pdc_t::pdlib_index;
 std::set<std::string> pdc_t::labels;
 std::map<std::string,int> pdc_t::label_count;
 std::map<std::string,int> pdc_t::channels;  
@@ -746,9 +751,82 @@ void pdc_t::test()
 }
 
 
-Data::Matrix<double> pdc_t::all_by_all()
+//
+// All-by-all distances: as distance(), but with each PD stored once as
+// sqrt(p), in one contiguous row per observation, so that each symmetric
+// alpha-divergence is 4 * ( 1 - pd_dot() ); pairs are taken in tiles of
+// tile_size x tile_size observations (upper triangle only), split over threads
+//
+
+template<class F>
+void pdc_t::pairwise( F store )
 {
 
+  const int N = obs.size();
+
+  if ( q == 0 || N == 0 ) return;
+
+  // channel k is at [ off[k] , off[k+1] ) in each row
+  std::vector<int> off( q + 1 , 0 );
+  for (int k=0; k<q; k++)
+    off[k+1] = off[k] + obs[0].pd[k].size();
+
+  const int len = off[q];
+
+  for (int i=0; i<N; i++)
+    for (int k=0; k<q; k++)
+      if ( obs[i].pd[k].size() != off[k+1] - off[k] )
+	Helper::halt( "incompatible PD -- check similar m used" );
+
+  std::vector<double> x( (size_t)N * len );
+  for (int i=0; i<N; i++)
+    for (int k=0; k<q; k++)
+      for (int j=0; j<off[k+1]-off[k]; j++)
+	x[ (size_t)i * len + off[k] + j ] = sqrt( obs[i].pd[k][j] );
+
+  const int nt = ( N + tile_size - 1 ) / tile_size;
+
+  std::vector<std::pair<int,int> > tiles;
+  for (int a=0; a<nt; a++)
+    for (int b=a; b<nt; b++)
+      tiles.push_back( std::make_pair( a , b ) );
+
+  luna_threads::parallel_for( tiles.size() , globals::n_threads , [&]( int p ) {
+
+      const int i0 = tiles[p].first * tile_size;
+      const int i1 = std::min( i0 + tile_size , N );
+      const int j0 = tiles[p].second * tile_size;
+      const int j1 = std::min( j0 + tile_size , N );
+
+      for (int i=i0; i<i1; i++)
+	{
+	  const double * a = &x[ (size_t)i * len ];
+
+	  for (int j = std::max( j0 , i + 1 ); j < j1; j++)
+	    {
+	      const double * b = &x[ (size_t)j * len ];
+
+	      // univariate
+	      if ( q == 1 )
+		{
+		  store( i , j , 4 * ( 1 - pd_dot( a , b , len ) ) );
+		  continue;
+		}
+
+	      // in multichannel case, define total obs-obs distance as sqrt( sum(d^2) )
+	      double d = 0;
+	      for (int k=0; k<q; k++)
+		d += MiscMath::sqr( 4 * ( 1 - pd_dot( a + off[k] , b + off[k] , off[k+1] - off[k] ) ) );
+	      store( i , j , sqrt( d ) );
+	    }
+	}
+    } );
+
+}
+
+
+Data::Matrix<double> pdc_t::all_by_all()
+{
 
   const int N = obs.size();
 
@@ -757,17 +835,224 @@ Data::Matrix<double> pdc_t::all_by_all()
   if ( N == 0 ) Helper::halt("internal error: PD not encoded in pdc_t");
 
   Data::Matrix<double> D( N , N );
-//   for (int i=0;i<N;i++) 
-//     D[i].resize(N,0);
-  
-  for (int i=0;i<(N-1);i++)
-    for (int j=i+1;j<N;j++)
-      D[i][j] = D[j][i] = distance( obs[i] , obs[j] );
+
+  pairwise( [&]( int i , int j , double d ) { D(i,j) = D(j,i) = d; } );
 
   return D;
 }
 
 
+std::vector<double> pdc_t::all_by_all_packed()
+{
+
+  const int N = obs.size();
+
+  logger << "  calculating " << N << "-by-" << N << " distance matrix (upper triangle)\n";
+
+  if ( N == 0 ) Helper::halt("internal error: PD not encoded in pdc_t");
+
+  std::vector<double> P( (size_t)N * ( N - 1 ) / 2 , 0 );
+
+  pairwise( [&]( int i , int j , double d ) { P[ packed_index( N , i , j ) ] = d; } );
+
+  return P;
+}
+
+
+// binary header: magic, byte-order word (and 4 reserved bytes, so that
+// the doubles are 8-byte aligned), then n
+
+static const uint32_t pdc_byte_order = 0x01020304;
+
+void pdc_t::write_distance_header( std::ofstream & OUT1 , const int n )
+{
+  const uint32_t order = pdc_byte_order;
+  const uint32_t reserved = 0;
+  const uint64_t n64 = n;
+  OUT1.write( "LUNAPDC1" , 8 );
+  OUT1.write( (const char*)&order , sizeof( uint32_t ) );
+  OUT1.write( (const char*)&reserved , sizeof( uint32_t ) );
+  OUT1.write( (const char*)&n64 , sizeof( uint64_t ) );
+}
+
+
+void pdc_t::write_distance_matrix( const std::string & filename , const int n , const std::vector<double> & P , const bool text )
+{
+
+  if ( P.size() != (size_t)n * ( n - 1 ) / 2 )
+    Helper::halt( "internal error in pdc_t::write_distance_matrix()" );
+
+  if ( text )
+    {
+      std::ofstream OUT1( filename.c_str() , std::ios::out );
+      for (int i=0;i<n;i++)
+	{
+	  for (int j=0;j<n;j++)
+	    OUT1 << ( j ? "\t" : "" )
+		 << ( i == j ? 0 : i < j ? P[ packed_index( n , i , j ) ] : P[ packed_index( n , j , i ) ] );
+	  OUT1 << "\n";
+	}
+      OUT1.close();
+      return;
+    }
+
+  std::ofstream OUT1( filename.c_str() , std::ios::out | std::ios::binary );
+  write_distance_header( OUT1 , n );
+  if ( P.size() ) OUT1.write( (const char*)P.data() , P.size() * sizeof( double ) );
+  OUT1.close();
+}
+
+
+void pdc_t::write_distance_matrix( const std::string & filename , const Data::Matrix<double> & D , const bool text )
+{
+
+  const int n = D.dim1();
+
+  if ( text )
+    {
+      std::ofstream OUT1( filename.c_str() , std::ios::out );
+      for (int i=0;i<n;i++)
+	{
+	  for (int j=0;j<n;j++) OUT1 << ( j ? "\t" : "" ) << D(i,j);
+	  OUT1 << "\n";
+	}
+      OUT1.close();
+      return;
+    }
+
+  // D is symmetric, so row i of the upper triangle is (stored) column i,
+  // below the diagonal
+
+  std::ofstream OUT1( filename.c_str() , std::ios::out | std::ios::binary );
+  write_distance_header( OUT1 , n );
+  for (int i=0;i<n-1;i++)
+    OUT1.write( (const char*)( D.col_data( i ) + i + 1 ) , ( n - i - 1 ) * sizeof( double ) );
+  OUT1.close();
+}
+
+
+void pdc_t::read_distance_matrix( const std::string & filename , int * n , std::vector<double> * P )
+{
+
+  std::ifstream IN1( filename.c_str() , std::ios::in | std::ios::binary );
+  if ( ! IN1.good() ) Helper::halt( "could not open " + filename );
+
+  char magic[8];
+  uint32_t order = 0 , reserved = 0;
+  uint64_t n64 = 0;
+  IN1.read( magic , 8 );
+  IN1.read( (char*)&order , sizeof( uint32_t ) );
+  IN1.read( (char*)&reserved , sizeof( uint32_t ) );
+  IN1.read( (char*)&n64 , sizeof( uint64_t ) );
+  if ( ! IN1.good() || std::string( magic , 8 ) != "LUNAPDC1" ) 
+    Helper::halt( filename + " is not a binary PDC distance matrix" );
+
+  if ( order != pdc_byte_order )
+    Helper::halt( filename + " was written on a machine with a different byte order" );
+
+  *n = n64;
+  P->resize( n64 < 2 ? 0 : (size_t)n64 * ( n64 - 1 ) / 2 );
+  if ( P->size() ) IN1.read( (char*)P->data() , P->size() * sizeof( double ) );
+  if ( ! IN1.good() || IN1.peek() != EOF ) 
+    Helper::halt( "bad or truncated distance matrix " + filename );
+  IN1.close();
+}
+
+
+bool pdc_t::selftest( const std::string & filename )
+{
+
+  CRandomStream rnd( 1234 );
+
+  bool okay = true;
+
+  const int ns[] = { 0 , 1 , 2 , 37 };
+
+  for (int k=0;k<4;k++)
+    {
+
+      const int n = ns[k];
+      
+      // a symmetric matrix (zero diagonal) and its packed upper triangle
+      Data::Matrix<double> D( n , n );
+      std::vector<double> P( n < 2 ? 0 : (size_t)n * ( n - 1 ) / 2 );
+      for (int i=0;i<n;i++)
+	for (int j=i+1;j<n;j++)
+	  D(i,j) = D(j,i) = P[ packed_index( n , i , j ) ] = rnd.rand();
+
+      // both writers give the same file, which reads back exactly
+      const std::string f2 = filename + ".2";
+
+      write_distance_matrix( filename , D , false );
+      write_distance_matrix( f2 , n , P , false );
+
+      int n1 = -1 , n2 = -1;
+      std::vector<double> P1 , P2;
+      read_distance_matrix( filename , &n1 , &P1 );
+      read_distance_matrix( f2 , &n2 , &P2 );
+      if ( n1 != n || n2 != n || P1 != P || P2 != P ) okay = false;
+      
+      // ... as for the text forms
+      write_distance_matrix( filename , D , true );
+      write_distance_matrix( f2 , n , P , true );
+      std::ifstream IN1( filename.c_str() ) , IN2( f2.c_str() );
+      std::stringstream t1 , t2;
+      t1 << IN1.rdbuf();
+      t2 << IN2.rdbuf();
+      if ( t1.str() != t2.str() ) okay = false;
+      
+      remove( filename.c_str() );
+      remove( f2.c_str() );
+    }
+
+  // the tiled all-by-all kernel (sqrt-PDs, pd_dot()) should match
+  // distance() for every pair, for univariate and multichannel PDs,
+  // with some empty PD cells, and with N spanning several tiles
+
+  std::vector<pdc_obs_t> obs0 = obs;
+  const int q0 = q;
+
+  const int qs[] = { 1 , 3 };
+  
+  for (int k=0;k<2;k++)
+    {
+      q = qs[k];
+      const int N = tile_size + 37;
+      const int m = 24; // i.e. m=4
+      
+      obs.clear();
+      for (int i=0;i<N;i++)
+	{
+	  pdc_obs_t ob( q );
+	  for (int c=0;c<q;c++)
+	    {
+	      std::vector<double> pd( m );
+	      double sum = 0;
+	      for (int j=0;j<m;j++)
+		{
+		  pd[j] = rnd.rand() < 0.2 ? 0 : rnd.rand();
+		  sum += pd[j];
+		}
+	      for (int j=0;j<m;j++) pd[j] /= sum;
+	      ob.pd[c] = pd;
+	    }
+	  obs.push_back( ob );
+	}
+      
+      const std::vector<double> P = all_by_all_packed();
+      for (int i=0;i<N;i++)
+	for (int j=i+1;j<N;j++)
+	  if ( fabs( P[ packed_index( N , i , j ) ] - distance( obs[i] , obs[j] ) ) > 1e-12 ) 
+	    okay = false;
+    }
+
+  obs = obs0;
+  q = q0;
+  
+  return okay;
+}
+
+
 
 
 void pdc_t::encode_ts()
@@ -777,6 +1062,8 @@ void pdc_t::encode_ts()
   // encode each observation in PD space, /if not already encoded/
   const int N = obs.size();
 
+  pdlib_index.reset();
+
   for (int i=0;i<N;i++)
     if ( ! obs[i].encoded ) 
       obs[i].encode( m , t );
@@ -825,6 +1112,9 @@ void pdc_t::entropy_heuristic( int m_min , int m_max , int t_min , int t_max , b
   const int n = obs.size();
   if ( n == 0 ) Helper::halt( "no time series loaded" );
 
+  // obs are re-encoded below
+  pdlib_index.reset();
+
   double min_entropy = 1; 
   
   for (int mi = m_min ; mi <= m_max ; mi++ )
@@ -945,6 +1235,7 @@ void pdc_t::entropy_heuristic( int m_min , int m_max , int t_min , int t_max , b
 
 void pdc_t::add( const pdc_obs_t & ob ) {
   obs.push_back( ob );
+  pdlib_index.reset();
   labels.insert( ob.label );
   label_count[ ob.label ]++;
   // channels are preset so do not record here
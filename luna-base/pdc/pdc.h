@@ -30,6 +30,7 @@
 
 #include "helper/helper.h"
 #include "stats/matrix.h"
+#include "pdc/vptree.h"
 
 struct edf_t;
 
@@ -143,6 +144,8 @@ struct pd_dist_t {
 struct pdc_t { 
 
   friend struct pdc_obs_t;
+
+  friend struct pdc_vptree_t;
   
   pdc_t( const bool b = true ) 
   { 
@@ -209,6 +212,7 @@ struct pdc_t {
     label_count.clear();
     q=0;
     channels.clear();
+    pdlib_index.reset();
   }
 
   
@@ -311,6 +315,36 @@ struct pdc_t {
 
   static Data::Matrix<double> all_by_all();
 
+  // ... or only the upper triangle (i < j), packed row by row, i.e. D(i,j)
+  // is at packed_index(n,i,j) (about half the memory, for large n)
+
+  static std::vector<double> all_by_all_packed();
+
+  static size_t packed_index( const int n , const int i , const int j )
+  {
+    return (size_t)i * ( 2 * n - i - 1 ) / 2 + ( j - i - 1 );
+  }
+
+  //
+  // Write a distance matrix, either as binary (default) or text; binary is
+  // "LUNAPDC1", a byte-order word 0x01020304 (uint32, then 4 reserved
+  // bytes), n (uint64), then the n(n-1)/2 doubles of the packed upper
+  // triangle (native byte order); text is the full n x n matrix, tab-delimited
+  //
+
+  static void write_distance_matrix( const std::string & filename , const int n , const std::vector<double> & P , const bool text );
+
+  static void write_distance_matrix( const std::string & filename , const Data::Matrix<double> & D , const bool text );
+
+  // read a binary (packed) distance matrix, as above
+
+  static void read_distance_matrix( const std::string & filename , int * n , std::vector<double> * P );
+
+  // write (from both forms), read back and compare; also compares the
+  // all-by-all kernel with distance() (-d pdc)
+
+  static bool selftest( const std::string & filename );
+
 
   //
   // For a single observation, find the best nmatches in terms of 'label'
@@ -318,6 +352,16 @@ struct pdc_t {
   
   static std::set<pd_dist_t> match( const pdc_obs_t & target , const int nbest = 10 );
 
+  //
+  // Build the VP-tree index used by match(), if not already built (i.e. after
+  // the PD-LIB is loaded, before calling match() from multiple threads)
+  //
+
+  static void index_pdlib()
+  {
+    if ( ! pdlib_index.built() ) pdlib_index.build();
+  }
+
   static std::map<std::string,double> summarize( const std::set<pd_dist_t> & matches , std::string * cat , double * conf );
 
   // might end of being redundant, but edit this to allow unequal ref/class N
@@ -350,6 +394,9 @@ private:
 
   static std::vector<pdc_obs_t> obs;
 
+  // metric index over obs, for match(); reset whenever obs changes
+  static pdc_vptree_t pdlib_index;
+
   //
   // track channels (these will be similar for all pdc_obs_t)
   //
@@ -387,6 +434,17 @@ private:
   static double squared_hellinger( const std::vector<double> & , const std::vector<double> & );
   
   static double symmetricAlphaDivergence( const std::vector<double> & , const std::vector<double> & );
+
+  static void write_distance_header( std::ofstream & , const int n );
+  
+  // dot product (for sqrt-PDs, in all_by_all())
+  static double pd_dot( const double * , const double * , const int );
+
+  // all_by_all(): calls store(i,j,d) for each pair i < j (from worker threads)
+  template<class F> static void pairwise( F store );
+
+  // observations per tile (i.e. tile_size x tile_size pairs per job)
+  static const int tile_size = 64;
   
   static int codebook( const std::vector<double> & , int, int, int );
 
@@ -23,6 +23,12 @@
 
 #include "pdc.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 
 double pdc_t::symmetricAlphaDivergence( const std::vector<double> & x , const std::vector<double> & y )
 {
@@ -44,6 +50,54 @@ double pdc_t::symmetricAlphaDivergence( const std::vector<double> & x , const st
 
 
 
+double pdc_t::pd_dot( const double * x , const double * y , const int n )
+{
+
+  // sum_i x[i] * y[i], i.e. with sqrt-PDs, 1 - SAD/4 ; several partial
+  // sums (SIMD, if available), so the order of summation differs from a
+  // simple loop
+
+  int i = 0;
+
+  double s = 0;
+
+#if defined(__AVX2__)
+  __m256d a0 = _mm256_setzero_pd();
+  __m256d a1 = _mm256_setzero_pd();
+  for ( ; i + 8 <= n ; i += 8 )
+    {
+      a0 = _mm256_add_pd( a0 , _mm256_mul_pd( _mm256_loadu_pd( x + i ) , _mm256_loadu_pd( y + i ) ) );
+      a1 = _mm256_add_pd( a1 , _mm256_mul_pd( _mm256_loadu_pd( x + i + 4 ) , _mm256_loadu_pd( y + i + 4 ) ) );
+    }
+  double t[4];
+  _mm256_storeu_pd( t , _mm256_add_pd( a0 , a1 ) );
+  s = ( t[0] + t[1] ) + ( t[2] + t[3] );
+#elif defined(__SSE2__)
+  __m128d a0 = _mm_setzero_pd();
+  __m128d a1 = _mm_setzero_pd();
+  __m128d a2 = _mm_setzero_pd();
+  __m128d a3 = _mm_setzero_pd();
+  for ( ; i + 8 <= n ; i += 8 )
+    {
+      a0 = _mm_add_pd( a0 , _mm_mul_pd( _mm_loadu_pd( x + i     ) , _mm_loadu_pd( y + i     ) ) );
+      a1 = _mm_add_pd( a1 , _mm_mul_pd( _mm_loadu_pd( x + i + 2 ) , _mm_loadu_pd( y + i + 2 ) ) );
+      a2 = _mm_add_pd( a2 , _mm_mul_pd( _mm_loadu_pd( x + i + 4 ) , _mm_loadu_pd( y + i + 4 ) ) );
+      a3 = _mm_add_pd( a3 , _mm_mul_pd( _mm_loadu_pd( x + i + 6 ) , _mm_loadu_pd( y + i + 6 ) ) );
+    }
+  double t[2];
+  _mm_storeu_pd( t , _mm_add_pd( _mm_add_pd( a0 , a1 ) , _mm_add_pd( a2 , a3 ) ) );
+  s = t[0] + t[1];
+#endif
+
+  // remainder (or all, if no SIMD)
+  for ( ; i < n ; i++ )
+    s += x[i] * y[i];
+
+  return s;
+}
+
+
+
 double pdc_t::squared_hellinger( const std::vector<double> & x , const std::vector<double> & y )
 {
   
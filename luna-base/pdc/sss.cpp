@@ -38,6 +38,7 @@
 
 #include "db/db.h"
 #include "helper/logger.h"
+#include "helper/threads.h"
 
 extern writer_t writer;
 
@@ -121,6 +122,9 @@ void pdc_t::simple_sleep_scorer( edf_t & edf , param_t & param )
       if ( obs.size() == 0 ) 
 	Helper::halt( "no valid PDLIB specified" );
     }
+
+  // build the VP-tree index (once)
+  index_pdlib();
   
 
 
@@ -443,6 +447,22 @@ void pdc_t::simple_sleep_scorer( edf_t & edf , param_t & param )
   //
   // For each segment, find the best match; 
   //
+
+  // matching is done up-front, for all 3 x epochs segments in parallel;
+  // if any segment cannot use the index (i.e. would fall back to a full
+  // scan, which may halt on incompatible PDs) then do all serially
+  
+  const int nseg = targets.size() * 3;
+
+  bool indexed = true;
+  for (int k=0; k<nseg; k++)
+    if ( ! pdlib_index.accepts( targets[k/3][k%3] ) ) { indexed = false; break; }
+  
+  std::vector<std::set<pd_dist_t> > matches( nseg );
+  
+  luna_threads::parallel_for( nseg , indexed ? globals::n_threads : 1 , [&]( int k ) {
+      matches[k] = match( targets[k/3][k%3] , nmatch );
+    } );
   
   std::vector<std::string> stages;
   
@@ -452,9 +472,9 @@ void pdc_t::simple_sleep_scorer( edf_t & edf , param_t & param )
       writer.epoch( edf.timeline.display_epoch( e ) );
 
       // each epoch has three 10-second intervals
-      std::set<pd_dist_t> matches1 = match( targets[e][0] , nmatch );
-      std::set<pd_dist_t> matches2 = match( targets[e][1] , nmatch );
-      std::set<pd_dist_t> matches3 = match( targets[e][2] , nmatch );
+      const std::set<pd_dist_t> & matches1 = matches[ 3 * e ];
+      const std::set<pd_dist_t> & matches2 = matches[ 3 * e + 1 ];
+      const std::set<pd_dist_t> & matches3 = matches[ 3 * e + 2 ];
       
       std::string match1, match2, match3;
       double conf1, conf2, conf3;
@@ -600,6 +620,10 @@ std::set<pd_dist_t> pdc_t::match( const pdc_obs_t & target , const int nbest )
 {
 
   const int N = obs.size();
+
+  // exact k-NN from the VP-tree, if built (see index_pdlib()) and usable for this target
+  if ( nbest > 0 && nbest < N && pdlib_index.built() && pdlib_index.accepts( target ) )
+    return pdlib_index.search( target , nbest );
   
   std::set<pd_dist_t> dist, final;
   
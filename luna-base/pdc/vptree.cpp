@@ -0,0 +1,485 @@
+//    --------------------------------------------------------------------
+//
+//    This file is part of Luna.
+//
+//    LUNA is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    Luna is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Luna. If not, see <http://www.gnu.org/licenses/>.
+//
+//    Please see LICENSE.txt for more details.
+//
+//    --------------------------------------------------------------------
+
+#include "pdc/vptree.h"
+#include "pdc/pdc.h"
+
+#include "helper/threads.h"
+#include "helper/logger.h"
+#include "defs/defs.h"
+#include "miscmath/crandom.h"
+
+#include <cmath>
+#include <algorithm>
+#include <queue>
+#include <limits>
+
+extern logger_t logger;
+
+const double pdc_vptree_t::eps = 2e-6;
+
+static const double inf = std::numeric_limits<double>::infinity();
+
+// PDs must sum to 1 within this, for d = 2.rho^2 to hold
+static const double pd_sum_tol = 1e-13;
+
+static bool normalized( const pdc_obs_t & ob , const int q , const int npd )
+{
+  if ( ob.pd.size() != q ) return false;
+  for (int k=0; k<q; k++)
+    {
+      if ( ob.pd[k].size() != npd ) return false;
+      double s = 0;
+      for (int j=0; j<npd; j++) s += ob.pd[k][j];
+      if ( fabs( s - 1.0 ) > pd_sum_tol ) return false;
+    }
+  return true;
+}
+
+
+void pdc_vptree_t::reset()
+{
+  valid = usable = false;
+  npd = dim = 0;
+  nodes.clear();
+  items.clear();
+  std::vector<float>().swap( sq );
+}
+
+
+void pdc_vptree_t::embed( const pdc_obs_t & ob , float * p ) const
+{
+  for (int k=0; k<pdc_t::q; k++)
+    for (int j=0; j<npd; j++)
+      *p++ = sqrt( ob.pd[k][j] );
+}
+
+
+double pdc_vptree_t::rho( const float * a , const float * b , const double cut ) const
+{
+
+  // L4 norm (over channels) of Euclidean distances between sqrt-PDs; as
+  // terms are non-negative, stop as soon as the partial sum exceeds 'cut'
+  // (i.e. then returning something > cut, but not rho itself)
+
+  const double cut4 = cut * cut * cut * cut;
+
+  double r4 = 0;
+
+  for (int k=0; k<pdc_t::q; k++)
+    {
+      double s0 = 0 , s1 = 0 , s2 = 0 , s3 = 0;
+
+      int j = 0;
+
+      while ( j + 4 <= npd )
+	{
+	  const int j1 = std::min( j + 32 , npd - npd % 4 );
+
+	  for ( ; j < j1 ; j += 4 )
+	    {
+	      const double t0 = (double)a[j]   - (double)b[j];
+	      const double t1 = (double)a[j+1] - (double)b[j+1];
+	      const double t2 = (double)a[j+2] - (double)b[j+2];
+	      const double t3 = (double)a[j+3] - (double)b[j+3];
+	      s0 += t0 * t0;
+	      s1 += t1 * t1;
+	      s2 += t2 * t2;
+	      s3 += t3 * t3;
+	    }
+
+	  const double e2 = ( s0 + s1 ) + ( s2 + s3 );
+	  if ( r4 + e2 * e2 > cut4 ) return sqrt( sqrt( r4 + e2 * e2 ) );
+	}
+
+      for ( ; j < npd ; j++ )
+	{
+	  const double t = (double)a[j] - (double)b[j];
+	  s0 += t * t;
+	}
+
+      const double e2 = ( s0 + s1 ) + ( s2 + s3 );
+
+      r4 += e2 * e2;
+
+      a += npd;
+      b += npd;
+    }
+
+  return sqrt( sqrt( r4 ) );
+}
+
+
+void pdc_vptree_t::build()
+{
+
+  reset();
+
+  valid = true;
+
+  const std::vector<pdc_obs_t> & obs = pdc_t::obs;
+
+  const int N = obs.size();
+
+  if ( N == 0 || pdc_t::q == 0 ) return;
+
+  npd = obs[0].pd[0].size();
+
+  if ( npd == 0 ) return;
+
+  for (int i=0; i<N; i++)
+    if ( ! normalized( obs[i] , pdc_t::q , npd ) )
+      {
+	logger << "  PD-LIB has incomplete or unnormalized PDs, will not index\n";
+	npd = 0;
+	return;
+      }
+
+  dim = pdc_t::q * npd;
+
+  sq.resize( (size_t)N * dim );
+  for (int i=0; i<N; i++)
+    embed( obs[i] , &sq[ (size_t)i * dim ] );
+
+  items.resize( N );
+  for (int i=0; i<N; i++) items[i] = i;
+
+  nodes.reserve( 2 * ( N / leaf_size + 1 ) );
+
+  // fixed seed, so the tree does not depend on, or disturb, CRandom
+  uint64_t rng = 12345;
+
+  build_node( 0 , N , &rng );
+
+  // put sqrt-PDs in tree order, so that nodes are contiguous
+  std::vector<float> tsq( sq.size() );
+  for (int i=0; i<N; i++)
+    std::copy( sq.begin() + (size_t)items[i] * dim ,
+	       sq.begin() + (size_t)( items[i] + 1 ) * dim ,
+	       tsq.begin() + (size_t)i * dim );
+  sq.swap( tsq );
+
+  usable = true;
+
+  logger << "  indexed " << N << " PD-LIB observations (" << nodes.size() << " nodes)\n";
+
+}
+
+
+int pdc_vptree_t::build_node( const int b , const int e , uint64_t * rng )
+{
+
+  const int idx = nodes.size();
+
+  nodes.push_back( node_t() );
+
+  node_t nd;
+  nd.vp = -1;
+  nd.begin = b;
+  nd.end = e;
+  nd.inner = nd.outer = -1;
+  nd.in_lo = nd.in_hi = nd.out_lo = nd.out_hi = 0;
+
+  if ( e - b <= leaf_size )
+    {
+      nodes[idx] = nd;
+      return idx;
+    }
+
+  // random vantage point, moved to the front
+  *rng = *rng * UINT64_C(6364136223846793005) + UINT64_C(1442695040888963407);
+  std::swap( items[b] , items[ b + (int)( ( *rng >> 33 ) % (uint64_t)( e - b ) ) ] );
+
+  nd.vp = items[b];
+
+  const float * pv = &sq[ (size_t)nd.vp * dim ];
+
+  // distance from vp to all others (in parallel, for large nodes)
+  const int n = e - b - 1;
+
+  std::vector<std::pair<double,int> > dist( n );
+
+  luna_threads::parallel_for( n , n >= 4096 ? globals::n_threads : 1 , [&]( int i ) {
+      const int j = items[ b + 1 + i ];
+      dist[i] = std::make_pair( rho( pv , &sq[ (size_t)j * dim ] , inf ) , j );
+    } );
+
+  // split at the median: inner [0,mid), outer [mid,n)
+  const int mid = n / 2;
+
+  std::nth_element( dist.begin() , dist.begin() + mid , dist.end() );
+
+  nd.in_lo = nd.in_hi = dist[0].first;
+  nd.out_lo = nd.out_hi = dist[mid].first;
+
+  for (int i=0; i<n; i++)
+    {
+      items[ b + 1 + i ] = dist[i].second;
+      double & lo = i < mid ? nd.in_lo : nd.out_lo;
+      double & hi = i < mid ? nd.in_hi : nd.out_hi;
+      if ( dist[i].first < lo ) lo = dist[i].first;
+      if ( dist[i].first > hi ) hi = dist[i].first;
+    }
+
+  std::vector<std::pair<double,int> >().swap( dist );
+
+  if ( mid > 0 ) nd.inner = build_node( b + 1 , b + 1 + mid , rng );
+  nd.outer = build_node( b + 1 + mid , e , rng );
+
+  nodes[idx] = nd;
+
+  return idx;
+}
+
+
+bool pdc_vptree_t::accepts( const pdc_obs_t & target ) const
+{
+  return usable && normalized( target , pdc_t::q , npd );
+}
+
+
+std::set<pd_dist_t> pdc_vptree_t::search( const pdc_obs_t & target , const int nbest ) const
+{
+
+  const unsigned nb = nbest;
+
+  std::vector<float> tq( dim );
+  embed( target , &tq[0] );
+
+  //
+  // Approximate search: the nbest smallest (approximate) rho so far, as a
+  // max-heap, and all candidates within 2.eps of the nbest-th
+  //
+
+  std::priority_queue<double> heap;
+
+  std::vector<std::pair<double,int> > cand;
+
+  // (node, lower bound on approximate rho for anything below it)
+  std::vector<std::pair<int,double> > stack;
+  stack.push_back( std::make_pair( 0 , 0.0 ) );
+
+  while ( ! stack.empty() )
+    {
+
+      const int ni = stack.back().first;
+      const double lb = stack.back().second;
+      stack.pop_back();
+
+      if ( heap.size() == nb && lb > heap.top() + 2 * eps ) continue;
+
+      const node_t & nd = nodes[ ni ];
+
+      const int e = nd.leaf() ? nd.end : nd.begin + 1;
+
+      // leaf items are only needed if within the current cut-off; for a
+      // vantage point, need the actual rho
+      const double cut = nd.leaf() && heap.size() == nb ? heap.top() + 2 * eps : inf;
+
+      double r = 0;
+
+      for (int i = nd.begin ; i < e ; i++)
+	{
+	  r = rho( &tq[0] , &sq[ (size_t)i * dim ] , cut );
+
+	  if ( heap.size() < nb ) heap.push( r );
+	  else if ( r < heap.top() ) { heap.pop(); heap.push( r ); }
+
+	  if ( r <= heap.top() + 2 * eps )
+	    cand.push_back( std::make_pair( r , items[i] ) );
+	}
+
+      if ( nd.leaf() ) continue;
+
+      // lower bounds (triangle inequality, with vp at rho 'r') for each
+      // child: each of the three rho's is within eps of the true value
+      const double lb_in  = std::max( 0.0 , std::max( nd.in_lo - r , r - nd.in_hi ) - 3 * eps );
+      const double lb_out = std::max( 0.0 , std::max( nd.out_lo - r , r - nd.out_hi ) - 3 * eps );
+
+      // push the further child first, so the nearer is searched first
+      if ( lb_in <= lb_out )
+	{
+	  stack.push_back( std::make_pair( nd.outer , lb_out ) );
+	  if ( nd.inner != -1 ) stack.push_back( std::make_pair( nd.inner , lb_in ) );
+	}
+      else
+	{
+	  if ( nd.inner != -1 ) stack.push_back( std::make_pair( nd.inner , lb_in ) );
+	  stack.push_back( std::make_pair( nd.outer , lb_out ) );
+	}
+
+    }
+
+  //
+  // Exact: score remaining candidates with pdc_t::distance()
+  //
+
+  const double tau = heap.top() + 2 * eps;
+
+  std::set<pd_dist_t> best;
+
+  for (int c=0; c<cand.size(); c++)
+    {
+      if ( cand[c].first > tau ) continue;
+
+      pd_dist_t m( pdc_t::distance( target , pdc_t::obs[ cand[c].second ] ) , cand[c].second );
+
+      if ( best.size() < nb ) best.insert( m );
+      else if ( m < *best.rbegin() )
+	{
+	  best.insert( m );
+	  best.erase( --best.end() );
+	}
+    }
+
+  return best;
+}
+
+
+//
+// search() vs a full scan with pdc_t::distance() (-d pdc-index), on
+// random normalized PDs (with some empty cells), for q = 1 and 3 and
+// a range of nbest; the library includes exact duplicates (ties) and
+// near-duplicates (distances within eps of each other), and targets
+// include copies of library observations (d = 0)
+//
+
+bool pdc_vptree_t::selftest()
+{
+
+  std::vector<pdc_obs_t> obs0 = pdc_t::obs;
+  const int q0 = pdc_t::q;
+
+  CRandomStream rnd( 2468 );
+
+  bool okay = true;
+  
+  const int qs[] = { 1 , 3 };
+  const int npds[] = { 6 , 24 };
+
+  for (int qi=0; qi<2; qi++)
+    for (int pi=0; pi<2; pi++)
+      {
+	const int q = qs[qi];
+	const int npd = npds[pi];
+	
+	pdc_t::q = q;
+	pdc_t::obs.clear();
+	
+	const int N = 1500;
+	
+	for (int i=0; i<N; i++)
+	  {
+	    pdc_obs_t ob( q );
+	    const int mode = rnd.rand( 10 );
+	    if ( i > 0 && mode == 0 ) // exact duplicate 
+	      ob = pdc_t::obs[ rnd.rand( i ) ];
+	    else if ( i > 0 && mode == 1 ) // near-duplicate
+	      {
+		ob = pdc_t::obs[ rnd.rand( i ) ];
+		for (int k=0; k<q; k++)
+		  {
+		    std::vector<double> & pd = ob.pd[k];
+		    int a = rnd.rand( npd ) , b = rnd.rand( npd );
+		    const double delta = std::min( pd[a] , 1e-9 );
+		    pd[a] -= delta;
+		    pd[b] += delta;
+		  }
+	      }
+	    else
+	      for (int k=0; k<q; k++)
+		{
+		  std::vector<double> pd( npd );
+		  double s = 0;
+		  for (int j=0; j<npd; j++) 
+		    {
+		      pd[j] = rnd.rand() < 0.3 ? 0 : rnd.rand();
+		      s += pd[j];
+		    }
+		  if ( s == 0 ) { pd[0] = 1; s = 1; } 
+		  for (int j=0; j<npd; j++) pd[j] /= s;
+		  ob.pd[k] = pd;
+		}
+	    pdc_t::obs.push_back( ob );
+	  }
+	
+	pdc_vptree_t tree;
+	tree.build();
+
+	// a full library of normalized PDs should be indexed
+	if ( ! tree.usable ) okay = false;
+	
+	for (int t=0; t<300 && okay; t++)
+	  {
+	    // copies of library items, or new random PDs
+	    pdc_obs_t target( q );
+	    if ( t % 3 == 0 ) 
+	      target = pdc_t::obs[ rnd.rand( N ) ];
+	    else
+	      for (int k=0; k<q; k++)
+		{
+		  std::vector<double> pd( npd );
+		  double s = 0;
+		  for (int j=0; j<npd; j++) { pd[j] = rnd.rand(); s += pd[j]; }
+		  for (int j=0; j<npd; j++) pd[j] /= s;
+		  target.pd[k] = pd;
+		}
+
+	    if ( ! tree.accepts( target ) ) { okay = false; break; }
+	    
+	    std::set<pd_dist_t> all;
+	    for (int i=0; i<N; i++)
+	      all.insert( pd_dist_t( pdc_t::distance( target , pdc_t::obs[i] ) , i ) );
+
+	    const int nbs[] = { 1 , 2 , 10 , 50 };
+	    for (int b=0; b<4; b++)
+	      {
+		std::set<pd_dist_t> scan;
+		std::set<pd_dist_t>::const_iterator ii = all.begin();
+		while ( ii != all.end() && scan.size() < nbs[b] ) scan.insert( *ii++ );
+		
+		const std::set<pd_dist_t> found = tree.search( target , nbs[b] );
+		
+		// identical indices (i.e. incl. tie-breaking) and distances
+		bool same = found.size() == scan.size();
+		std::set<pd_dist_t>::const_iterator ff = found.begin() , ss = scan.begin();
+		while ( same && ff != found.end() )
+		  {
+		    if ( ff->ix != ss->ix || ff->d != ss->d ) same = false;
+		    ++ff; ++ss;
+		  }
+		if ( ! same ) okay = false;
+	      }
+	  }
+	
+	// and an unnormalized target is not accepted
+	pdc_obs_t bad = pdc_t::obs[0];
+	bad.pd[0][0] += 1e-6;
+	if ( tree.accepts( bad ) ) okay = false;
+	
+      }
+  
+  pdc_t::obs = obs0;
+  pdc_t::q = q0;
+  pdc_t::pdlib_index.reset();
+  
+  return okay;
+}
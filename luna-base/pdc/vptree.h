@@ -0,0 +1,125 @@
+//    --------------------------------------------------------------------
+//
+//    This file is part of Luna.
+//
+//    LUNA is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    Luna is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Luna. If not, see <http://www.gnu.org/licenses/>.
+//
+//    Please see LICENSE.txt for more details.
+//
+//    --------------------------------------------------------------------
+
+#ifndef __LUNA_PDC_VPTREE_H__
+#define __LUNA_PDC_VPTREE_H__
+
+#include <vector>
+#include <set>
+#include <stdint.h>
+
+struct pdc_obs_t;
+struct pd_dist_t;
+
+//
+// Vantage-point tree over the PD-LIB (pdc_t::obs), for exact k-NN
+// queries in pdc_t::match()
+//
+// For normalized PDs, the symmetric alpha-divergence between two channels
+// is 2.|| sqrt(x) - sqrt(y) ||^2, and so the (multi-channel) pdc_t::distance()
+// is d = 2.sqrt( sum_k e_k^4 ), where e_k is the Euclidean distance between
+// the sqrt-PDs of channel k.  rho = sqrt( d / 2 ), i.e. the L4 norm of the
+// e_k, is therefore a true metric, and has the same ordering as d.
+//
+// The tree holds the sqrt-PDs (as floats, in tree order), and is built and
+// searched on rho computed from these, which is cheap (no sqrt() per bin)
+// and within eps of the exact value.  Any observation that could be among
+// the nbest (i.e. approximate rho within 2.eps of the nbest-th) is then
+// scored with pdc_t::distance() itself, and matches are ranked on that, so
+// results are identical to a full scan.
+//
+// The index is only used if every library observation has all q channels,
+// with PDs of the same size that sum to 1; otherwise (and for any
+// target that does not), match() falls back to a full scan.  'luna -d
+// pdc-index' checks search() against a full scan, including ties
+//
+
+struct pdc_vptree_t
+{
+
+  pdc_vptree_t() : valid(false) , usable(false) , npd(0) , dim(0) { }
+
+  // (re)build over the current pdc_t::obs
+  void build();
+
+  // mark as stale (i.e. after obs changes)
+  void reset();
+
+  bool built() const { return valid; }
+
+  // can the index be used for this target?
+  bool accepts( const pdc_obs_t & target ) const;
+
+  // nbest matches, as pdc_t::match()
+  std::set<pd_dist_t> search( const pdc_obs_t & target , const int nbest ) const;
+
+  // search() vs a full scan, on random PD libraries (-d pdc-index)
+  static bool selftest();
+
+  // buckets of at most this many observations are scanned directly
+  static const int leaf_size = 8;
+
+  // bound on the error of an approximate rho (float sqrt-PDs, and
+  // rounding in pdc_t::distance())
+  static const double eps;
+
+ private:
+
+  // flag that build() has been called, and whether the library is OK
+  bool valid;
+  bool usable;
+
+  // PD size per channel (all channels), and q x npd
+  int npd;
+  int dim;
+
+  struct node_t
+  {
+    // vantage point is items[begin], unless a leaf, which is
+    // the bucket items[begin] .. items[end-1]
+    int vp;
+    int begin, end;
+
+    // children (-1 if none) and, for each, the range of rho to vp
+    int inner, outer;
+    double in_lo, in_hi;
+    double out_lo, out_hi;
+
+    bool leaf() const { return vp == -1; }
+  };
+
+  std::vector<node_t> nodes;
+
+  // obs index, in tree order
+  std::vector<int> items;
+
+  // sqrt-PDs, dim per row; in obs order during build(), then in tree order
+  std::vector<float> sq;
+
+  int build_node( const int b , const int e , uint64_t * rng );
+
+  void embed( const pdc_obs_t & ob , float * p ) const;
+
+  double rho( const float * a , const float * b , const double cut ) const;
+
+};
+
+#endif
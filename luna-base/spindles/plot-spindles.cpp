@@ -370,6 +370,7 @@ void draw_spindles( edf_t & edf ,
 	  cwt.add_wavelet( f , num_cycles );  // f( Fc , number of cycles ) 
 	  fx.push_back(f);
 	}
+      cwt.store_phase_vectors( false );
       cwt.load( &d );
       cwt.run();
       
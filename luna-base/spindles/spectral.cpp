@@ -30,6 +30,7 @@
 #include "db/db.h"
 #include "fftw/fftwrap.h"
 #include "dsp/mse.h"
+#include "helper/threads.h"
 #include "miscmath/dynam.h"
 
 
@@ -181,6 +182,27 @@ annot_t * spectral_power( edf_t & edf ,
 
   logger << "  calculating PSD for " << ns << " signals\n"; 
 
+
+  //
+  // Batched Welch: for each block of up to 'nthreads' channels, epochs
+  // are sliced (serially) a block at a time, and spectra for that block
+  // of epochs x channels are then computed in parallel; output is
+  // unchanged.  (The 'average-adj' option uses the original, per-epoch
+  // PWELCH.)
+  //
+
+  const bool batch_psd = ! average_adj;
+
+  // epochs sliced at once (per channel)
+  const int epoch_block = 32 * globals::n_threads;
+  
+  int block_start = 0 , block_end = 0;
+  
+  // per channel (in block) x epoch
+  std::vector<std::vector<std::vector<double> > > block_psd;
+  std::vector<std::vector<double> > block_freq;
+  
+
   for (int s = 0 ; s < ns; s++ )
     {
       
@@ -193,6 +215,94 @@ annot_t * spectral_power( edf_t & edf ,
 	continue;
       
 
+      //
+      // Start of a new block of channels?
+      //
+
+      if ( batch_psd && s >= block_end )
+	{
+	  
+	  block_start = s;
+	  block_end = s + globals::n_threads < ns ? s + globals::n_threads : ns ;
+	  const int nb = block_end - block_start;
+	  
+	  std::vector<pwelch_batch_t> engines;
+	  std::vector<bool> data_channel( nb );
+	  for (int s2 = block_start ; s2 < block_end ; s2++ )
+	    {
+	      engines.push_back( pwelch_batch_t( Fs[s2] , fft_segment_size , window_function , use_nextpow2 ) );
+	      data_channel[ s2 - block_start ] = ! edf.header.is_annotation_channel( signals(s2) );
+	    }
+
+	  std::vector<int> block_epochs;
+	  edf.timeline.first_epoch();
+	  while ( 1 ) 
+	    {
+	      int epoch = edf.timeline.next_epoch();      
+	      if ( epoch == -1 ) break;
+	      block_epochs.push_back( epoch );
+	    }
+	  
+	  const int ne = block_epochs.size();
+
+	  block_psd.assign( nb , std::vector<std::vector<double> >() );
+	  block_freq.assign( nb , std::vector<double>() );
+	  for (int j=0; j<nb; j++)
+	    {
+	      if ( ! data_channel[j] ) continue;
+	      block_psd[j].resize( ne );
+	      block_freq[j] = engines[j].freq;
+	    }
+	  
+	  for (int e0 = 0 ; e0 < ne ; e0 += epoch_block )
+	    {
+	      
+	      const int e1 = e0 + epoch_block < ne ? e0 + epoch_block : ne ;
+	      const int nbe = e1 - e0;
+
+	      // channel x epoch (in this block of epochs)
+	      std::vector<std::vector<double> > block_data( nb * nbe );
+
+	      for (int j=0; j<nb; j++)
+		{
+		  if ( ! data_channel[j] ) continue;
+		  for (int e = e0 ; e < e1 ; e++ )
+		    {
+		      slice_t slice( edf , signals( block_start + j ) , edf.timeline.epoch( block_epochs[e] ) );
+		      std::vector<double> * d = slice.nonconst_pdata();
+		      if ( mean_centre_epoch ) 
+			MiscMath::centre( d );
+		      block_data[ j * nbe + e - e0 ].swap( *d );
+		    }
+		}
+	      
+	      std::vector<char> okay( nb * nbe , 1 );
+	      
+	      luna_threads::parallel_for( nb * nbe , globals::n_threads , [&]( int k ) {
+		  
+		  const int j = k / nbe;
+		  if ( ! data_channel[j] ) return;
+		  const int e = e0 + k % nbe;
+		  const int s2 = block_start + j;
+		  
+		  const int segment_points = fft_segment_size * Fs[s2];
+		  const int noverlap_points  = fft_segment_overlap * Fs[s2];
+		  
+		  std::vector<double> & d = block_data[k];
+		  const int total_points = d.size();
+		  int noverlap_segments = floor( ( total_points - noverlap_points) 
+						 / (double)( segment_points - noverlap_points ) );
+		  okay[k] = engines[j].psd( total_points ? &(d[0]) : NULL , total_points , noverlap_segments , &block_psd[j][e] );
+		  std::vector<double>().swap( d );
+		} );
+	      
+	      for (int k=0; k<nb*nbe; k++)
+		if ( ! okay[k] ) 
+		  Helper::halt( "bad PSD segment/overlap parameters: segments do not advance" );
+	    }
+	}
+
+
       //
       // Stratify output by channel
       //
@@ -247,53 +357,58 @@ annot_t * spectral_power( edf_t & edf ,
 	    writer.epoch( edf.timeline.display_epoch( epoch ) );
 
 	   //
-	   // Get data
+	   // pwelch() to obtain full PSD (already done, if batched)
 	   //
-
-	   slice_t slice( edf , signals(s) , interval );
 	   
-	   std::vector<double> * d = slice.nonconst_pdata();
+	   std::vector<double> epoch_freq, epoch_psd;
 
-	   //
-	   // mean centre epoch?
-	   //
-
-	   if ( mean_centre_epoch ) 
-	     MiscMath::centre( d );
-	   
-	   //
-	   // pwelch() to obtain full PSD
-	   //
-	   
-	   const double overlap_sec = fft_segment_overlap;
-	   const double segment_sec  = fft_segment_size;
-	   
-	   const int total_points = d->size();
-	   const int segment_points = segment_sec * Fs[s];
-	   const int noverlap_points  = overlap_sec * Fs[s];
-	   
-	   // implied number of segments
-	   int noverlap_segments = floor( ( total_points - noverlap_points) 
-					  / (double)( segment_points - noverlap_points ) );
-	   
-	   
-// 	   logger << "total_points = " << total_points << "\n";
-// 	   logger << "nooverlap_segments = " << noverlap_segments << "\n";
-// 	   logger << "noverlap_points = " << noverlap_points << "\n";
-// 	   logger << "segment_points = " << segment_points << "\n";
-	   
-// 	   std::cout << "about to fly...\n";
-// 	   std::cout << "Fs = " << Fs[s] << "\n";
+	   if ( batch_psd )
+	     {
+	       epoch_freq = block_freq[ s - block_start ];
+	       epoch_psd.swap( block_psd[ s - block_start ][ total_epochs - 1 ] );
+	     }
+	   else
+	     {
 
-	   PWELCH pwelch( *d , 
+	       //
+	       // Get data
+	       //
+	       
+	       slice_t slice( edf , signals(s) , interval );
+	       
+	       std::vector<double> * d = slice.nonconst_pdata();
+	       
+	       //
+	       // mean centre epoch?
+	       //
+	       
+	       if ( mean_centre_epoch ) 
+		 MiscMath::centre( d );
+	   	       
+	       const double overlap_sec = fft_segment_overlap;
+	       const double segment_sec  = fft_segment_size;
+	       
+	       const int total_points = d->size();
+	       const int segment_points = segment_sec * Fs[s];
+	       const int noverlap_points  = overlap_sec * Fs[s];
+	       
+	       // implied number of segments
+	       int noverlap_segments = floor( ( total_points - noverlap_points) 
+					      / (double)( segment_points - noverlap_points ) );
+	       
+	       PWELCH pw( *d , 
 			  Fs[s] , 
 			  segment_sec , 
 			  noverlap_segments , 
 			  window_function , 
 			  average_adj ,
 			  use_nextpow2 );
-	   
-	   //	   std::cout << "done\n";
+
+	       epoch_freq = pw.freq;
+	       epoch_psd = pw.psd;
+	     }
+
+	   PWELCH pwelch( epoch_freq , epoch_psd );
 
 
 	   double this_slowwave   = pwelch.psdsum( SLOW )  ;      /// globals::band_width( SLOW );
@@ -648,7 +763,7 @@ annot_t * spectral_power( edf_t & edf ,
 	      
 	      writer.level( globals::band( ii->first ) , globals::band_strat );
 	      
-	      std::map<int,double> mses = mse.calc( ii->second );
+	      std::map<int,double> mses = mse.calc( ii->second , globals::n_threads );
 	      
 	      writer.var( "MSE" , "Multiscale entropy" );
 	      
@@ -392,6 +392,9 @@ annot_t * spindle_wavelet( edf_t & edf , param_t & param )
 	    cwt.add_wavelet( frq[fi] , num_cycles );  // f( Fc , number of cycles ) 
 	}
       
+      // only power is used
+      cwt.store_phase_vectors( false );
+
       cwt.load( d );
 
       cwt.run();
@@ -1144,16 +1147,21 @@ annot_t * spindle_wavelet( edf_t & edf , param_t & param )
 	  // Cache spindle infor
 	  //
 
+	  // moved (not copied) into the cache; below, use the cached buffer
+	  cache_t<double>::buffer_t cached_corr;
+	  
 	  if ( cache_data )
 	    {
 	      cache_t<double> * cache_num = edf.timeline.cache.find_num( cache_name );
-	      cache_num->add( ckey_t( "wavelet-power" , writer.faclvl() ) , averaged_corr );
+	      cached_corr = cache_num->add( ckey_t( "wavelet-power" , writer.faclvl() ) , std::move( averaged_corr ) );
 	      
 	      // cache_t<uint64_t> * cache_tp = edf.timeline.cache_tp( cache_name );
 	      // cache_tp->add( ckey_t( "spindle-peaks" , writer.faclvl() ) , averaged_corr );	      
 
 	    }
 
+	  const std::vector<double> * p_corr = cache_data ? cached_corr.get() : &averaged_corr ;
+	  
 	  
 	  //
 	  // Optional slow-wave coupling?
@@ -1180,7 +1188,7 @@ annot_t * spindle_wavelet( edf_t & edf , param_t & param )
 		  // 36 bins = 10-degree bins; 18 = 20-deg bins
 		  int nbins = 36/2;
 		  
-		  std::vector<double> pl_spindle = p_sw->phase_locked_averaging( &averaged_corr , nbins );
+		  std::vector<double> pl_spindle = p_sw->phase_locked_averaging( p_corr , nbins );
 		  
 		  if ( pl_spindle.size() > 0 ) 
 		    {
@@ -1205,7 +1213,7 @@ annot_t * spindle_wavelet( edf_t & edf , param_t & param )
 		  //
 		  
 		  // +1/-1 1 second
-		  std::vector<double> tl_spindle = p_sw->time_locked_averaging( &averaged_corr , Fs[s] , 1 , 1 );
+		  std::vector<double> tl_spindle = p_sw->time_locked_averaging( p_corr , Fs[s] , 1 , 1 );
 		  
 		  writer.var( "SOTL_CWT" , "Slow wave time-locked average spindle power" );
 		  
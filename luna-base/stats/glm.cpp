@@ -331,7 +331,7 @@ bool GLM::fit_linear()
   
   bool okay = true;
 
-  Data::Matrix<double> S0 = Statistics::inverse( Statistics::transpose( X ) * X , & okay );
+  Data::Matrix<double> S0 = Statistics::inverse( Statistics::transpose_multiply( X , X ) , & okay );
   
   if ( ! okay ) 
     {
@@ -34,28 +34,66 @@ template<class T> void Data::Matrix<T>::cbind( const Data::Matrix<T> & rhs )
     add_col( rhs.col(c) );
 }
     
-template<class T> void Data::Matrix<T>::add_row( const Vector<T> & r ) 
-{ 
-  if ( r.size() != ncol ) 
-    { 
-      if ( nrow == 0 ) { ncol = r.size(); resize(0,r.size()); }
-      else { Helper::warn("bad row addition"); return; }
+template<class T> void Data::Matrix<T>::relayout( const int new_ld )
+{
+  std::vector<T> d( (size_t)ncol * new_ld );
+  for (int c=0; c<ncol; c++)
+    {
+      const T * p = col_data( c );
+      T * pd = d.data() + (size_t)c * new_ld;
+      for (int i=0; i<nrow; i++) pd[i] = p[i];
+    }
+  data.swap( d );
+  ld = new_ld;
+}
+
+template<class T> void Data::Matrix<T>::resize( const int r , const int c , const T & t )
+{
+  
+  // keep the overlapping block; as add_row() may have left slack, only
+  // re-layout if the new rows do not fit 
+
+  if ( r > ld ) 
+    {
+      if ( c < ncol ) ncol = c;
+      relayout( r );
     }
   
-  for( int i=0; i<ncol; i++ ) data[i].push_back( r[i] );
-  ++nrow;
+  data.resize( (size_t)c * ld );
+
+  const int nr = nrow < r ? nrow : r;
+  const int nc = ncol < c ? ncol : c;
+  
+  for (int j=0; j<c; j++)
+    {
+      T * p = col_data( j );
+      for (int i = j < nc ? nr : 0 ; i<r; i++) p[i] = t;
+    }
+  
+  nrow = r;
+  ncol = c;
+  row_mask.resize( nrow , false ); // masked-out
+}
+
+template<class T> void Data::Matrix<T>::add_row( const Vector<T> & r ) 
+{ 
+  add_row( r.extract() );
 }
 
 template<class T> void Data::Matrix<T>::add_row( const std::vector<T> & r ) 
 { 
   if ( r.size() != ncol ) 
     {
-      if ( nrow == 0 ) { ncol = r.size(); resize(0,r.size()); }
+      if ( nrow == 0 ) resize( 0 , r.size() );
       else { Helper::warn("bad row addition"); return; }
     }
   
-  for( int i=0; i<ncol; i++ ) data[i].push_back( r[i] );
+  // grow geometrically, so that building a matrix row-by-row is linear
+  if ( nrow == ld ) relayout( ld < 8 ? 16 : 2 * ld );
+  
+  for( int i=0; i<ncol; i++ ) data[ (size_t)i * ld + nrow ] = r[i];
   ++nrow;
+  row_mask.push_back( false );
 }
 
 template<class T> Data::Vector<T> Data::Vector<T>::operator*( const Data::Matrix<T> & rhs ) const
@@ -89,16 +127,20 @@ template<class T> void Data::Vector<T>::inplace_multiply( const double x )
 
 template<class T> void Data::Matrix<T>::inplace_add( const double x )
 {
-  for (int i=0; i<dim1(); i++) 
-    for (int j=0; j<dim2(); j++) 
-      (*this)(i,j) += x;
+  for (int j=0; j<ncol; j++) 
+    {
+      T * p = col_data( j );
+      for (int i=0; i<nrow; i++) p[i] += x;
+    }
 }
 
 template<class T> void Data::Matrix<T>::inplace_multiply( const double x )
 {
-  for (int i=0; i<dim1(); i++) 
-    for (int j=0; j<dim2(); j++) 
-      (*this)(i,j) *= x;
+  for (int j=0; j<ncol; j++) 
+    {
+      T * p = col_data( j );
+      for (int i=0; i<nrow; i++) p[i] *= x;
+    }
 }
 
 template<class T> Data::Matrix<T> Data::Matrix<T>::operator*( const Data::Matrix<T> & rhs ) const
@@ -25,6 +25,7 @@
 
 #include <vector>
 #include <string>
+#include <algorithm>
 
 namespace Data { 
 
@@ -97,6 +98,13 @@ namespace Data {
 
   
 
+  //
+  // Matrix: column-major, contiguous storage; element (i,j) is at
+  // data[ j * ld + i ], where the leading dimension ld >= nrow leaves
+  // room for add_row() to grow without moving every column each time.
+  // col_data(c) gives a raw pointer to the nrow elements of a column
+  //
+
   template<class T = double> class Matrix {
     
     public:
@@ -122,33 +130,100 @@ namespace Data {
       const Matrix & mat;      
     };
     
+    // column access: a view of one column of the contiguous storage,
+    // with the accessors of the per-column Vector<T> it replaces; writes
+    // go straight to the matrix, but data_pointer() is a copy held by
+    // the view, i.e. only valid while the view is
+
+    struct Col
+    {
+      Col( Matrix & m , int j ) : mat(m) , col(j) { }
+      Col( const Col & rhs ) : mat(rhs.mat) , col(rhs.col) { }
+      Col & operator=( const Vector<T> & rhs ) { return assign( rhs.extract() ); }
+      Col & operator=( const std::vector<T> & rhs ) { return assign( rhs ); }
+      Col * operator->() { return this; }
+      T & operator[](const int i) { return mat(i,col); }
+      T & operator()(const int i) { return mat(i,col); }
+      T operator[](const int i) const { return mat(i,col); }
+      T operator()(const int i) const { return mat(i,col); }
+      int size() const { return mat.dim1(); }
+      int dim1() const { return mat.dim1(); }
+      operator Vector<T>() const { return Vector<T>( extract() ); }
+      std::vector<T> extract() const { const T * p = mat.col_data(col); return std::vector<T>( p , p + size() ); }
+      const std::vector<T> * data_pointer() const { buf = extract(); return size() ? &buf : NULL; }
+      T * elem_pointer( const int i ) { return size() ? mat.col_data(col) + i : NULL; }
+      void inplace_add( const double x ) { T * p = mat.col_data(col); for (int i=0; i<size(); i++) p[i] += x; }
+      void inplace_multiply( const double x ) { T * p = mat.col_data(col); for (int i=0; i<size(); i++) p[i] *= x; }
+      private:
+      Col & assign( const std::vector<T> & r ) 
+      {
+	const int n = r.size() < size() ? r.size() : size();
+	std::copy( r.begin() , r.begin() + n , mat.col_data(col) );
+	return *this;
+      }
+      Matrix & mat;
+      int col;
+      mutable std::vector<T> buf;
+    };
+
+    struct ConstCol
+    {
+      ConstCol( const Matrix & m , int j ) : mat(m) , col(j) { }
+      ConstCol( const ConstCol & rhs ) : mat(rhs.mat) , col(rhs.col) { }
+      const ConstCol * operator->() const { return this; }
+      T operator[](const int i) const { return mat(i,col); }
+      T operator()(const int i) const { return mat(i,col); }
+      int size() const { return mat.dim1(); }
+      int dim1() const { return mat.dim1(); }
+      operator Vector<T>() const { return Vector<T>( extract() ); }
+      std::vector<T> extract() const { const T * p = mat.col_data(col); return std::vector<T>( p , p + size() ); }
+      const std::vector<T> * data_pointer() const { buf = extract(); return size() ? &buf : NULL; }
+      private:
+      const Matrix & mat;
+      int col;
+      mutable std::vector<T> buf;
+    };
+    
     Matrix() { clear(); } 
-    Matrix(const int r, const int c) { resize(r,c); }
-    Matrix(const int r, const int c, const T & t) { resize(r,c,t); }
+    Matrix(const int r, const int c) { clear(); resize(r,c); }
+    Matrix(const int r, const int c, const T & t) { clear(); resize(r,c,t); }
     
-    T operator() (const unsigned int i, const unsigned int j ) const { return data[j][i]; }
-    T & operator() (const unsigned int i, const unsigned int j ) { return data[j][i]; }
+    T operator() (const unsigned int i, const unsigned int j ) const { return data[ j * ld + i ]; }
+    T & operator() (const unsigned int i, const unsigned int j ) { return data[ j * ld + i ]; }
     
     Row operator[] ( const unsigned int i) { return Row(*this,i); }
     ConstRow operator[] ( const unsigned int i) const { return ConstRow(*this,i); }
     
-    Vector<T> row( const int r ) 
+    Vector<T> row( const int r ) const
     { 
       Vector<T> d( ncol );
       for (int c=0; c<ncol; c++) d[c] = (*this)(r,c);
       return d;
     } 
 
-    Vector<T> col( const int c ) const { return data[c]; } 
-    Vector<T> & col( const int c ) { return data[c]; } 
-    const Vector<T> * col_pointer( const int c ) const { return &data[c]; }
-    Vector<T> * col_nonconst_pointer( const int c ) { return &data[c]; } 
+    // a copy of column c (without element masks), or a mutable view
+    Vector<T> col( const int c ) const 
+    { 
+      const T * p = col_data( c );
+      return Vector<T>( std::vector<T>( p , p + nrow ) );
+    } 
+
+    Col col( const int c ) { return Col( *this , c ); }
+
+    // as above, for the former col_pointer(c)->... idiom; pointers from
+    // data_pointer() are valid while the returned view is
+    ConstCol col_pointer( const int c ) const { return ConstCol( *this , c ); }
+    Col col_nonconst_pointer( const int c ) { return Col( *this , c ); }
 
+    // raw access: column c is col_data(c)[0 .. nrow-1]; columns are
+    // stride() elements apart
+    const T * col_data( const int c ) const { return data.data() + (size_t)c * ld; }
+    T * col_data( const int c ) { return data.data() + (size_t)c * ld; }
+    int stride() const { return ld; }
+    
     void add_col( const Vector<T> & r ) 
     { 
-      if ( ncol == 0 ) nrow = r.size(); 
-      data.push_back(r);  // add data
-      ++ncol;             // track increase in col count
+      add_col( r.extract() );
       
       // propagate case-wise missingness across columns for each row
       for (int i=0; i<r.size(); i++) 
@@ -157,8 +232,12 @@ namespace Data {
     
     void add_col( const std::vector<T> & r ) 
     { 
-      if ( ncol == 0 ) nrow = r.size();
-      data.push_back( Vector<T>(r) ); ++ncol; 
+      if ( ncol == 0 ) { nrow = ld = r.size(); row_mask.assign( nrow , false ); }
+      data.resize( (size_t)( ncol + 1 ) * ld );
+      T * p = col_data( ncol );
+      const int n = r.size() < nrow ? r.size() : nrow ;
+      for (int i=0; i<n; i++) p[i] = r[i];
+      ++ncol;
     }
     
     void cbind( const Data::Matrix<T> & rhs );
@@ -179,7 +258,7 @@ namespace Data {
       return true; // mask out-of-range items
     }
 
-    void clear() { data.clear(); row_mask.clear(); nrow = ncol = 0; }
+    void clear() { data.clear(); row_mask.clear(); nrow = ncol = ld = 0; }
 
     Matrix<T> purge_rows() 
     {
@@ -188,29 +267,18 @@ namespace Data {
       Matrix<T> v( sz , ncol );
       for (int c = 0 ; c < ncol ; c++ ) 
 	{
+	  const T * p = col_data( c );
+	  T * pv = v.col_data( c );
 	  int sz = 0;
-	  for (int r=0; r<nrow; r++) if ( ! row_mask[r] ) v( sz++ , c ) = data[c][r]; 
+	  for (int r=0; r<nrow; r++) if ( ! row_mask[r] ) pv[ sz++ ] = p[r]; 
 	}      
       return v;
     }
     
-    void resize(const int r, const int c) 
-    { 
-      nrow = r;
-      ncol = c;
-      row_mask.resize( nrow , false ); // masked-out
-      data.resize(c); 
-      for (int j=0; j<c; j++) data[j].resize( nrow );
-    }
+    // existing elements are kept; new elements are set to T() or t
+    void resize(const int r, const int c) { resize( r , c , T() ); }
     
-    void resize(const int r, const int c, const T & t ) 
-    { 
-      nrow = r;
-      ncol = c;
-      row_mask.resize( nrow , false ); // masked-out
-      data.resize(c); 
-      for (int j=0; j<c; j++) data[j].resize( nrow , t );
-    }
+    void resize(const int r, const int c, const T & t );
 
     int dim1() const { return nrow; }
     int dim2() const { return ncol; }
@@ -236,13 +304,16 @@ namespace Data {
 
     private:
     
-    std::vector< Vector<T> > data;
+    // move to a new leading dimension (>= nrow)
+    void relayout( const int new_ld );
+
+    std::vector<T> data;
     std::vector<bool> row_mask;
     int nrow ;
     int ncol ;
+    int ld ;
   };
 
-
   
   
 
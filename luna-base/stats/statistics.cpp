@@ -25,10 +25,12 @@
 #include "matrix.h"
 #include "dcdflib.h"
 #include "ipmpar.h"
+#include "miscmath/crandom.h"
 
 #include <iostream>
 #include <cmath>
 #include <algorithm>
+#include <ctime>
 
 
 #ifndef M_2PI
@@ -229,9 +231,21 @@ Data::Matrix<double> Statistics::transpose( const Data::Matrix<double> & d )
   const int row = d.dim1();
   const int col = d.dim2();
   Data::Matrix<double> r( col, row );
-  for (int i = 0; i < row; i++)
-    for (int j = 0; j < col; j++)
-      r(j,i) = d(i,j);
+
+  // tiled, so that both the reads and the (strided) writes stay in cache
+  const int bs = 32;
+  for (int i0 = 0; i0 < row; i0 += bs)
+    for (int j0 = 0; j0 < col; j0 += bs)
+      {
+	const int i1 = std::min( i0 + bs , row );
+	const int j1 = std::min( j0 + bs , col );
+	for (int j = j0; j < j1; j++)
+	  {
+	    const double * pd = d.col_data( j );
+	    for (int i = i0; i < i1; i++)
+	      r(j,i) = pd[i];
+	  }
+      }
   return r;
 }
 
@@ -1374,6 +1388,22 @@ bool Statistics::EV_tqli( Data::Vector<double> & d ,
 }
 
 
+//
+// Matrix products, on the contiguous column-major storage of Data::Matrix
+//
+// C = A * B is formed one column at a time, as C[,j] += A[,k] * B[k,j],
+// blocked over rows (mm_row_block) and over k (mm_inner_block) so that a
+// panel of A stays in cache while it is applied to every column of B.
+// Within a block, four columns of A are folded into each pass over C[,j],
+// but each element still sums its terms strictly in increasing k, i.e.
+// results are identical to the textbook triple loop.  The inner loops are
+// unit-stride and free of dependencies across i, so the compiler can
+// vectorize them
+//
+
+static const int mm_row_block = 256;
+static const int mm_inner_block = 64;
+
 Data::Matrix<double> Statistics::matrix_multiply( const Data::Matrix<double> & a, const Data::Matrix<double> & b )
 {
   //  int ar ac x br bc
@@ -1383,23 +1413,113 @@ Data::Matrix<double> Statistics::matrix_multiply( const Data::Matrix<double> & a
   const int ncol = b.dim2();
   const int nk = a.dim2();
   Data::Matrix<double> r(nrow,ncol);
-  for (int i=0;i<nrow;i++)
-    for(int j=0; j<ncol;j++)
-      for (int k=0; k<nk; k++)
-	r(i,j) += a(i,k) * b(k,j); 	
+
+  for (int i0=0; i0<nrow; i0+=mm_row_block)
+    {
+      const int ni = std::min( mm_row_block , nrow - i0 );
+
+      for (int k0=0; k0<nk; k0+=mm_inner_block)
+	{
+	  const int k1 = std::min( k0 + mm_inner_block , nk );
+	  
+	  for (int j=0; j<ncol; j++)
+	    {
+	      double * pr = r.col_data( j ) + i0;
+	      const double * pb = b.col_data( j );
+	      
+	      int k = k0;
+	      
+	      for (; k+3<k1; k+=4)
+		{
+		  const double * pa0 = a.col_data( k ) + i0;
+		  const double * pa1 = a.col_data( k+1 ) + i0;
+		  const double * pa2 = a.col_data( k+2 ) + i0;
+		  const double * pa3 = a.col_data( k+3 ) + i0;
+		  const double b0 = pb[k] , b1 = pb[k+1] , b2 = pb[k+2] , b3 = pb[k+3];
+		  for (int i=0; i<ni; i++)
+		    pr[i] = ( ( ( pr[i] + pa0[i] * b0 ) + pa1[i] * b1 ) + pa2[i] * b2 ) + pa3[i] * b3;
+		}
+	      
+	      for (; k<k1; k++)
+		{
+		  const double * pa = a.col_data( k ) + i0;
+		  const double bk = pb[k];
+		  for (int i=0; i<ni; i++)
+		    pr[i] += pa[i] * bk;
+		}
+	    }
+	}
+    }
+
+  return r;
+}
+
+Data::Matrix<double> Statistics::transpose_multiply( const Data::Matrix<double> & a, const Data::Matrix<double> & b )
+{
+  // C = t(A) * B: every element is a dot product of two (contiguous)
+  // columns, so no transposed copy of A is needed; four columns of A are
+  // taken against each column of B at once (independent sums, each in
+  // increasing k, so again identical to transpose(A) * B)
+  
+  if ( a.dim1() != b.dim1() ) Helper::halt("non-conformable matrix multiplication requested");     
+
+  const int nrow = a.dim2();
+  const int ncol = b.dim2();
+  const int nk = a.dim1();
+  Data::Matrix<double> r(nrow,ncol);
+
+  for (int j=0; j<ncol; j++)
+    {
+      const double * pb = b.col_data( j );
+      double * pr = r.col_data( j );
+      
+      int i = 0;
+      
+      for (; i+3<nrow; i+=4)
+	{
+	  const double * pa0 = a.col_data( i );
+	  const double * pa1 = a.col_data( i+1 );
+	  const double * pa2 = a.col_data( i+2 );
+	  const double * pa3 = a.col_data( i+3 );
+	  double s0 = 0 , s1 = 0 , s2 = 0 , s3 = 0;
+	  for (int k=0; k<nk; k++)
+	    {
+	      const double bk = pb[k];
+	      s0 += pa0[k] * bk;
+	      s1 += pa1[k] * bk;
+	      s2 += pa2[k] * bk;
+	      s3 += pa3[k] * bk;
+	    }
+	  pr[i] = s0; pr[i+1] = s1; pr[i+2] = s2; pr[i+3] = s3;
+	}
+      
+      for (; i<nrow; i++)
+	{
+	  const double * pa = a.col_data( i );
+	  double s = 0;
+	  for (int k=0; k<nk; k++) s += pa[k] * pb[k];
+	  pr[i] = s;
+	}
+    }
+  
   return r;
 }
 
 Data::Vector<double> Statistics::matrix_multiply( const Data::Matrix<double> & a , const Data::Vector<double> & b)
 {
   if ( a.dim2() != b.dim1() ) Helper::halt("non-conformable matrix multiplication requested");     
-  Data::Vector<double> r( a.dim1() );
   const int nrow = a.dim1();
   const int nk = a.dim2();
-  for (int i=0;i<nrow;i++)
-    for (int k=0; k<nk; k++)
-      r(i) += a(i,k) * b(k); 	
-  return r;
+  std::vector<double> r( nrow , 0 );
+  double * pr = r.data();
+  for (int k=0; k<nk; k++)
+    {
+      const double * pa = a.col_data( k );
+      const double bk = b(k);
+      for (int i=0;i<nrow;i++)
+	pr[i] += pa[i] * bk;
+    }
+  return Data::Vector<double>( r );
 }
 
 Data::Vector<double> Statistics::matrix_multiply( const Data::Vector<double> & a , const Data::Matrix<double> & b )
@@ -1409,11 +1529,94 @@ Data::Vector<double> Statistics::matrix_multiply( const Data::Vector<double> & a
   const int nrow = b.dim2();
   const int nk = a.dim1();
   for (int i=0;i<nrow;i++)
-    for (int k=0; k<nk; k++)
-      r(i) += a(k) * b(k,i);
+    {
+      const double * pb = b.col_data( i );
+      double s = 0;
+      for (int k=0; k<nk; k++)
+	s += a(k) * pb[k];
+      r(i) = s;
+    }
   return r;
 }
 
+void Statistics::matrix_benchmark( const int reps )
+{
+
+  //
+  // typical shapes: SUDS projections (epochs x spectral features, times
+  // V and DW), GLM t(X) * X, and fastICA (W * X, and GWX * t(X)) for a
+  // handful of channels over an hour of 256 Hz data
+  //
+
+  struct shape_t { const char * label; int n , k , m; bool tr; };
+  
+  const shape_t shapes[] = {
+    { "SUDS  PSD * V" , 1000 , 300 , 10 , false } ,
+    { "SUDS  U * DW" , 1000 , 10 , 10 , false } ,
+    { "GLM   t(X) * X" , 20 , 5000 , 20 , true } ,
+    { "ICA   W * X" , 8 , 8 , 921600 , false } ,
+    { "ICA   GWX * t(X)" , 8 , 921600 , 8 , false } ,
+    { "dense 500^3" , 500 , 500 , 500 , false } };
+
+  const int nshapes = sizeof( shapes ) / sizeof( shape_t );
+  
+  CRandom::srand( 12345 );
+
+  for (int s=0; s<nshapes; s++)
+    {
+      const shape_t & sh = shapes[s];
+
+      // A is n x k (or k x n, if tr), B is k x m
+      Data::Matrix<double> A( sh.tr ? sh.k : sh.n , sh.tr ? sh.n : sh.k );
+      Data::Matrix<double> B( sh.k , sh.m );
+      
+      for (int j=0; j<A.dim2(); j++)
+	for (int i=0; i<A.dim1(); i++) A(i,j) = CRandom::rand() - 0.5;
+      for (int j=0; j<B.dim2(); j++)
+	for (int i=0; i<B.dim1(); i++) B(i,j) = CRandom::rand() - 0.5;
+
+      if ( sh.tr ) B = A;
+      
+      // naive reference, as the previous implementation: element-wise
+      // access, i-j-k order
+      clock_t c0 = clock();
+      
+      Data::Matrix<double> R0;
+      for (int r=0; r<reps; r++)
+	{
+	  const Data::Matrix<double> At = sh.tr ? Statistics::transpose( A ) : A ;
+	  R0.resize( 0 , 0 );
+	  R0.resize( sh.n , sh.m );
+	  for (int i=0; i<sh.n; i++)
+	    for (int j=0; j<sh.m; j++)
+	      for (int k=0; k<sh.k; k++)
+		R0(i,j) += At(i,k) * B(k,j);
+	}
+      
+      clock_t c1 = clock();
+
+      Data::Matrix<double> R1;
+      for (int r=0; r<reps; r++)
+	R1 = sh.tr ? Statistics::transpose_multiply( A , B ) : Statistics::matrix_multiply( A , B );
+      
+      clock_t c2 = clock();
+      
+      double maxdiff = 0;
+      for (int j=0; j<sh.m; j++)
+	for (int i=0; i<sh.n; i++)
+	  maxdiff = std::max( maxdiff , fabs( R0(i,j) - R1(i,j) ) );
+      
+      const double t0 = 1e3 * ( c1 - c0 ) / (double)CLOCKS_PER_SEC / (double)reps;
+      const double t1 = 1e3 * ( c2 - c1 ) / (double)CLOCKS_PER_SEC / (double)reps;
+      
+      std::cout << sh.label << " [" << sh.n << " x " << sh.k << "] * [" << sh.k << " x " << sh.m << "] : "
+		<< "naive " << t0 << " ms , "
+		<< "blocked " << t1 << " ms , "
+		<< "speed-up " << ( t1 > 0 ? t0 / t1 : 0 ) << "x , "
+		<< "max |diff| " << maxdiff << "\n";
+    }
+}
+
 double Statistics::matrix_inner_product( const Data::Vector<double> & a , const Data::Vector<double> & b )
 {
   if ( a.dim1() != b.dim1() ) 
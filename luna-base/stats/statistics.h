@@ -112,9 +112,13 @@ namespace Statistics {
   Data::Matrix<double> matrix_multiply( const Data::Matrix<double> & , const Data::Matrix<double> & );
   Data::Vector<double> matrix_multiply( const Data::Matrix<double> & , const Data::Vector<double> & );  
   Data::Vector<double> matrix_multiply( const Data::Vector<double> & , const Data::Matrix<double> & );
+  Data::Matrix<double> transpose_multiply( const Data::Matrix<double> & , const Data::Matrix<double> & ); // t(A) * B
   double matrix_inner_product( const Data::Vector<double> & , const Data::Vector<double> & );
   Data::Matrix<double> matrix_outer_product( const Data::Vector<double> & , const Data::Vector<double> & );  
 
+  // times matrix kernels against the naive loops (luna -d matrix)
+  void matrix_benchmark( const int reps );
+
   // Mean, variance and covariance
 
   double sum( const Data::Vector<double> & );
@@ -0,0 +1,521 @@
+//    --------------------------------------------------------------------
+//
+//    This file is part of Luna.
+//
+//    LUNA is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    Luna is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Luna. If not, see <http://www.gnu.org/licenses/>.
+//
+//    Please see LICENSE.txt for more details.
+//
+//    --------------------------------------------------------------------
+
+
+#include "suds.h"
+
+#include "helper/helper.h"
+#include "helper/logger.h"
+#include "defs/defs.h"
+#include "miscmath/crandom.h"
+
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+
+#ifndef WINDOWS
+#include <sys/mman.h>
+#endif
+
+extern logger_t logger;
+
+static const char * suds_bank_magic = "SUDSBNK1";
+static const int suds_bank_magic_len = 8;
+
+// written in native byte order, so the reader can tell if its own differs
+static const int32_t suds_bank_byte_order = 0x01020304;
+
+
+//
+// (de)serialisation helpers
+//
+
+static void put_i32( std::string & b , const int32_t x ) { b.append( (const char*)&x , 4 ); }
+static void put_dbl( std::string & b , const double x ) { b.append( (const char*)&x , 8 ); }
+static void put_str( std::string & b , const std::string & s ) { put_i32( b , s.size() ); b.append( s ); }
+
+static void put_vec( std::string & b , const Data::Vector<double> & v )
+{
+  put_i32( b , v.size() );
+  for (int i=0;i<v.size();i++) put_dbl( b , v[i] );
+}
+
+// column-major, i.e. as Data::Matrix
+static void put_mat( std::string & b , const Data::Matrix<double> & m )
+{
+  put_i32( b , m.dim1() );
+  put_i32( b , m.dim2() );
+  for (int j=0;j<m.dim2();j++)
+    b.append( (const char*)m.col_data(j) , (size_t)m.dim1() * 8 );
+}
+
+static void put_counts( std::string & b , const std::map<std::string,int> & c )
+{
+  put_i32( b , c.size() );
+  std::map<std::string,int>::const_iterator cc = c.begin();
+  while ( cc != c.end() )
+    {
+      put_str( b , cc->first );
+      put_i32( b , cc->second );
+      ++cc;
+    }
+}
+
+
+struct suds_bank_cursor_t
+{
+  suds_bank_cursor_t( const char * b , const size_t n , size_t * p ) : b(b) , n(n) , p(p) { }
+  const char * b;
+  const size_t n;
+  size_t * p;
+  void need( const size_t k ) { if ( *p + k > n ) Helper::halt( "corrupt SUDS bank (truncated)" ); }
+  int32_t i32() { int32_t x; need(4); memcpy( &x , b + *p , 4 ); *p += 4; return x; }
+  double dbl() { double x; need(8); memcpy( &x , b + *p , 8 ); *p += 8; return x; }
+  // a length/count, i.e. must not be negative
+  int32_t len() { const int32_t k = i32(); if ( k < 0 ) Helper::halt( "corrupt SUDS bank (negative length)" ); return k; }
+  std::string str() { const int32_t k = len(); need(k); std::string s( b + *p , k ); *p += k; return s; }
+  void skip( const size_t k ) { need(k); *p += k; }
+
+  void vec( Data::Vector<double> * v )
+  {
+    const int32_t k = len();
+    need( (size_t)k * 8 );
+    v->resize( k );
+    for (int i=0;i<k;i++) (*v)[i] = dbl();
+  }
+
+  void mat( Data::Matrix<double> * m )
+  {
+    const int32_t r = len();
+    const int32_t c = len();
+    // i.e. r * c * 8 <= bytes left, without overflow for corrupt r and c
+    if ( r != 0 && (size_t)c > ( n - *p ) / 8 / r ) 
+      Helper::halt( "corrupt SUDS bank (truncated)" );
+    m->resize( r , c );
+    for (int j=0;j<c;j++)
+      {
+	need( (size_t)r * 8 );
+	memcpy( m->col_data(j) , b + *p , (size_t)r * 8 );
+	*p += (size_t)r * 8;
+      }
+  }
+
+  void counts( std::map<std::string,int> * c )
+  {
+    c->clear();
+    const int32_t k = len();
+    for (int i=0;i<k;i++)
+      {
+	const std::string s = str();
+	(*c)[ s ] = i32();
+      }
+  }
+};
+
+
+bool suds_bank_t::is_bank( const std::string & filename )
+{
+  std::ifstream IN1( filename.c_str() , std::ios::in | std::ios::binary );
+  char m[ suds_bank_magic_len ];
+  IN1.read( m , suds_bank_magic_len );
+  return IN1.good() && memcmp( m , suds_bank_magic , suds_bank_magic_len ) == 0;
+}
+
+
+suds_bank_t::suds_bank_t( const std::string & filename )
+  : filename( filename ) , mapped( NULL ) , mapped_size( 0 ) , p( 0 ) , n( 0 )
+{
+
+  FILE * file = fopen( filename.c_str() , "rb" );
+  if ( file == NULL ) Helper::halt( "could not open " + filename );
+
+  fseek( file , 0 , SEEK_END );
+  const size_t sz = ftell( file );
+  fseek( file , 0 , SEEK_SET );
+
+#ifndef WINDOWS
+  void * m = sz > 0 ? mmap( NULL , sz , PROT_READ , MAP_PRIVATE , fileno( file ) , 0 ) : MAP_FAILED;
+  if ( m != MAP_FAILED )
+    {
+      madvise( m , sz , MADV_SEQUENTIAL );
+      mapped = (const char*)m;
+      mapped_size = sz;
+    }
+#endif
+
+  if ( mapped == NULL )
+    {
+      buffer.resize( sz );
+      if ( sz > 0 && fread( &buffer[0] , 1 , sz , file ) != sz )
+	Helper::halt( "problem reading " + filename );
+    }
+
+  fclose( file );
+
+  //
+  // header: check that signals and options match, as for text trainers
+  //
+
+  suds_bank_cursor_t c( data() , sz , &p );
+
+  c.skip( suds_bank_magic_len );
+
+  if ( c.i32() != suds_bank_byte_order )
+    Helper::halt( filename + " was written on a machine with a different byte order" );
+
+  const int this_ns = c.i32();
+  const int this_nc = c.i32();
+  n = c.len();
+
+  if ( this_nc != suds_t::nc || this_ns != suds_t::ns )
+    Helper::halt( "different trainer nc " + Helper::int2str( this_nc ) + " in " + filename );
+
+  for (int s=0;s<suds_t::ns;s++)
+    {
+      const std::string this_siglab = c.str();
+      const int this_sr = c.i32();
+      const double this_lwr = c.dbl();
+      const double this_upr = c.dbl();
+      const int this_fac = c.i32();
+
+      if ( this_siglab != suds_t::siglab[s] ) Helper::halt( "different signals: " + this_siglab
+							    + ", but expecting " + suds_t::siglab[s] );
+      if ( this_sr != suds_t::sr[s] ) Helper::halt( "different SR: " + this_siglab
+						    + ", but expecting " + suds_t::siglab[s] );
+      if ( this_lwr != suds_t::lwr[s] ) Helper::halt( "different lower-freq: " + Helper::dbl2str( this_lwr )
+						      + ", but expecting " + Helper::dbl2str( suds_t::lwr[s] ) );
+      if ( this_upr != suds_t::upr[s] ) Helper::halt( "different upper-freq: " + Helper::dbl2str( this_upr )
+						      + ", but expecting " + Helper::dbl2str( suds_t::upr[s] )) ;
+      if ( this_fac != suds_t::fac[s] ) Helper::halt( "different fac: " + Helper::int2str( this_fac )
+						      + ", but expecting " + Helper::int2str( suds_t::fac[s] ) ) ;
+    }
+
+}
+
+
+suds_bank_t::~suds_bank_t()
+{
+#ifndef WINDOWS
+  if ( mapped != NULL )
+    munmap( (void*)mapped , mapped_size );
+#endif
+}
+
+
+void suds_bank_t::next( suds_indiv_t * trainer , bool load_psd )
+{
+
+  suds_bank_cursor_t c( data() , mapped != NULL ? mapped_size : buffer.size() , &p );
+
+  const int ns = suds_t::ns;
+  const int nc = suds_t::nc;
+
+  trainer->id = c.str();
+  trainer->trainer = true;
+  trainer->nve = c.len();
+  trainer->nbins = c.len();
+
+  const int nve = trainer->nve;
+
+  trainer->mean_h2.resize( ns );
+  trainer->sd_h2.resize( ns );
+  trainer->mean_h3.resize( ns );
+  trainer->sd_h3.resize( ns );
+
+  for (int s=0;s<ns;s++)
+    {
+      trainer->mean_h2[s] = c.dbl();
+      trainer->sd_h2[s] = c.dbl();
+      trainer->mean_h3[s] = c.dbl();
+      trainer->sd_h3[s] = c.dbl();
+    }
+
+  c.counts( &trainer->counts );
+
+  c.vec( &trainer->W );
+  c.mat( &trainer->V );
+
+  if ( trainer->W.size() != nc || trainer->V.dim2() != nc || trainer->V.dim1() != trainer->nbins )
+    Helper::halt( "corrupt SUDS bank (bad dimensions for " + trainer->id + ")" );
+
+  // stages
+  trainer->epochs.resize( nve );
+  trainer->y.resize( nve );
+  for (int i=0;i<nve;i++) trainer->epochs[i] = c.i32();
+  for (int i=0;i<nve;i++) trainer->y[i] = c.str();
+  trainer->obs_stage = suds_t::type( trainer->y );
+
+  // LDA model (i.e. as from fit_lda())
+  lda_model_t & model = trainer->model;
+  model.valid = c.i32();
+  model.errmsg = c.str();
+  c.vec( &model.prior );
+  c.counts( &model.counts );
+  c.mat( &model.means );
+  c.mat( &model.scaling );
+  model.n = c.i32();
+  c.vec( &model.svd );
+  model.labels.resize( c.len() );
+  for (int i=0;i<model.labels.size();i++) model.labels[i] = c.str();
+
+  // PSD, always stored, but only read if needed
+  if ( load_psd )
+    c.mat( &trainer->PSD );
+  else
+    {
+      const int32_t r = c.len();
+      const int32_t k = c.len();
+      c.skip( (size_t)r * k * 8 );
+    }
+
+}
+
+
+static void put_header( std::string & b , const int n )
+{
+  b.append( suds_bank_magic , suds_bank_magic_len );
+
+  put_i32( b , suds_bank_byte_order );
+
+  put_i32( b , suds_t::ns );
+  put_i32( b , suds_t::nc );
+  put_i32( b , n );
+
+  for (int s=0;s<suds_t::ns;s++)
+    {
+      put_str( b , suds_t::siglab[s] );
+      put_i32( b , suds_t::sr[s] );
+      put_dbl( b , suds_t::lwr[s] );
+      put_dbl( b , suds_t::upr[s] );
+      put_i32( b , suds_t::fac[s] );
+    }
+}
+
+
+static void put_trainer( std::string & b , const suds_indiv_t & trainer )
+{
+
+  put_str( b , trainer.id );
+  put_i32( b , trainer.nve );
+  put_i32( b , trainer.nbins );
+
+  for (int s=0;s<suds_t::ns;s++)
+    {
+      put_dbl( b , trainer.mean_h2[s] );
+      put_dbl( b , trainer.sd_h2[s] );
+      put_dbl( b , trainer.mean_h3[s] );
+      put_dbl( b , trainer.sd_h3[s] );
+    }
+
+  put_counts( b , trainer.counts );
+
+  put_vec( b , trainer.W );
+  put_mat( b , trainer.V );
+
+  for (int e=0;e<trainer.nve;e++) put_i32( b , trainer.epochs[e] );
+  for (int e=0;e<trainer.nve;e++) put_str( b , trainer.y[e] );
+
+  const lda_model_t & model = trainer.model;
+  put_i32( b , model.valid );
+  put_str( b , model.errmsg );
+  put_vec( b , model.prior );
+  put_counts( b , model.counts );
+  put_mat( b , model.means );
+  put_mat( b , model.scaling );
+  put_i32( b , model.valid ? model.n : 0 );
+  put_vec( b , model.svd );
+  put_i32( b , model.labels.size() );
+  for (int j=0;j<model.labels.size();j++) put_str( b , model.labels[j] );
+
+  put_mat( b , trainer.PSD );
+
+}
+
+
+void suds_bank_t::compile( param_t & param )
+{
+
+  suds_t::set_options( param );
+
+  const std::string folder = param.requires( "db" );
+
+  const std::string filename = param.requires( "bank" );
+
+  std::vector<std::string> trainer_ids = suds_t::list_folder( folder );
+
+  std::ofstream OUT1( filename.c_str() , std::ios::out | std::ios::binary );
+
+  if ( ! OUT1.good() ) Helper::halt( "could not open " + filename );
+
+  std::string b;
+
+  put_header( b , trainer_ids.size() );
+
+  OUT1.write( b.data() , b.size() );
+
+  //
+  // each trainer, in the order attach_db() would read them
+  //
+
+  for (int i=0;i<trainer_ids.size();i++)
+    {
+
+      suds_indiv_t trainer;
+
+      // as attach_db(), i.e. also checks signals/options
+      trainer.reload( folder + globals::folder_delimiter + trainer_ids[i] , true );
+
+      trainer.fit_lda();
+
+      b.clear();
+
+      put_trainer( b , trainer );
+
+      OUT1.write( b.data() , b.size() );
+
+    }
+
+  OUT1.close();
+
+  logger << "  wrote " << trainer_ids.size() << " trainers from " << folder
+	 << " to bank " << filename << "\n";
+
+}
+
+
+//
+// Round-trip check (luna -d suds-bank): random trainers are written to a
+// bank, read back, and compared field by field (doubles bit-for-bit)
+//
+
+static bool same( const Data::Vector<double> & a , const Data::Vector<double> & b )
+{
+  if ( a.size() != b.size() ) return false;
+  for (int i=0;i<a.size();i++)
+    {
+      const double x = a[i] , y = b[i];
+      if ( memcmp( &x , &y , 8 ) != 0 ) return false;
+    }
+  return true;
+}
+
+static bool same( const Data::Matrix<double> & a , const Data::Matrix<double> & b )
+{
+  if ( a.dim1() != b.dim1() || a.dim2() != b.dim2() ) return false;
+  for (int j=0;j<a.dim2();j++)
+    if ( memcmp( a.col_data(j) , b.col_data(j) , (size_t)a.dim1() * 8 ) != 0 ) return false;
+  return true;
+}
+
+bool suds_bank_t::selftest( const std::string & filename )
+{
+
+  suds_t::nc = 3;
+  suds_t::ns = 2;
+  suds_t::siglab.clear();
+  suds_t::siglab.push_back( "C3" );
+  suds_t::siglab.push_back( "C4" );
+  suds_t::sr.assign( 2 , 128 );
+  suds_t::lwr.assign( 2 , 0.5 );
+  suds_t::upr.assign( 2 , 20 );
+  suds_t::fac.assign( 2 , 1 );
+
+  const char * stg[] = { "W" , "N1" , "N2" , "N3" , "REM" };
+
+  std::vector<suds_indiv_t> trainers( 3 );
+
+  for (int t=0;t<trainers.size();t++)
+    {
+      suds_indiv_t & tr = trainers[t];
+      tr.id = "id" + Helper::int2str( t );
+      tr.nve = 50 + t;
+      tr.nbins = 7;
+      for (int s=0;s<suds_t::ns;s++)
+	{
+	  tr.mean_h2.push_back( CRandom::rand() );
+	  tr.sd_h2.push_back( CRandom::rand() );
+	  tr.mean_h3.push_back( CRandom::rand() );
+	  tr.sd_h3.push_back( CRandom::rand() );
+	}
+      tr.W.resize( suds_t::nc );
+      for (int j=0;j<suds_t::nc;j++) tr.W[j] = 1 + CRandom::rand();
+      tr.V.resize( tr.nbins , suds_t::nc );
+      for (int i=0;i<tr.nbins;i++)
+	for (int j=0;j<suds_t::nc;j++) tr.V(i,j) = CRandom::rand() - 0.5;
+      tr.U.resize( tr.nve , suds_t::nc );
+      tr.PSD.resize( tr.nve , tr.nbins );
+      for (int e=0;e<tr.nve;e++)
+	{
+	  tr.epochs.push_back( e * 2 );
+	  tr.y.push_back( stg[ e % 5 ] );
+	  tr.counts[ tr.y[e] ]++;
+	  for (int j=0;j<suds_t::nc;j++) tr.U(e,j) = CRandom::rand() + ( e % 5 ) * ( j + 1 );
+	  for (int j=0;j<tr.nbins;j++) tr.PSD(e,j) = CRandom::rand();
+	}
+      tr.fit_lda();
+    }
+
+  std::string b;
+  put_header( b , trainers.size() );
+  for (int t=0;t<trainers.size();t++) put_trainer( b , trainers[t] );
+
+  std::ofstream OUT1( filename.c_str() , std::ios::out | std::ios::binary );
+  OUT1.write( b.data() , b.size() );
+  OUT1.close();
+
+  bool okay = is_bank( filename );
+
+  {
+    suds_bank_t bank( filename );
+
+    okay = okay && bank.size() == trainers.size();
+
+    for (int t=0;t<trainers.size() && okay;t++)
+      {
+	const suds_indiv_t & a = trainers[t];
+	suds_indiv_t r;
+	// skip spectra for the first trainer
+	bank.next( &r , t != 0 );
+
+	okay = r.id == a.id && r.nve == a.nve && r.nbins == a.nbins
+	  && same( r.mean_h2 , a.mean_h2 ) && same( r.sd_h2 , a.sd_h2 )
+	  && same( r.mean_h3 , a.mean_h3 ) && same( r.sd_h3 , a.sd_h3 )
+	  && r.counts == a.counts
+	  && same( r.W , a.W ) && same( r.V , a.V )
+	  && r.epochs == a.epochs && r.y == a.y
+	  && r.obs_stage == suds_t::type( a.y )
+	  && r.model.valid == a.model.valid && r.model.errmsg == a.model.errmsg
+	  && same( r.model.prior , a.model.prior ) && r.model.counts == a.model.counts
+	  && same( r.model.means , a.model.means ) && same( r.model.scaling , a.model.scaling )
+	  && r.model.n == a.model.n && same( r.model.svd , a.model.svd )
+	  && r.model.labels == a.model.labels
+	  && ( t == 0 ? r.PSD.dim1() == 0 : same( r.PSD , a.PSD ) );
+      }
+
+    // all bytes consumed
+    okay = okay && bank.p == ( bank.mapped != NULL ? bank.mapped_size : bank.buffer.size() );
+  }
+
+  remove( filename.c_str() );
+
+  return okay;
+}
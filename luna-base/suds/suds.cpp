@@ -27,9 +27,11 @@
 #include <map>
 #include <set>
 #include <iomanip>
+#include <algorithm>
 
 #include "helper/helper.h"
 #include "helper/logger.h"
+#include "helper/threads.h"
 #include "db/db.h"
 
 #include "dirent.h"
@@ -606,10 +608,11 @@ int suds_indiv_t::proc( edf_t & edf , param_t & param , bool is_trainer )
   if ( suds_t::denoise_fac > 0 ) 
     for (int j=0;j<nc;j++)
       {
-	std::vector<double> * col = U.col_nonconst_pointer(j)->data_nonconst_pointer();
-	double sd = MiscMath::sdev( *col );
+	std::vector<double> col = U.col(j).extract();
+	double sd = MiscMath::sdev( col );
 	double lambda = suds_t::denoise_fac * sd;
-	dsptools::TV1D_denoise( *col , lambda );
+	dsptools::TV1D_denoise( col , lambda );
+	std::copy( col.begin() , col.end() , U.col_data(j) );
       }
     
 
@@ -915,15 +918,9 @@ void suds_indiv_t::reload( const std::string & filename , bool load_psd )
 }
 
 
-void suds_t::attach_db( const std::string & folder , bool read_psd )
+std::vector<std::string> suds_t::list_folder( const std::string & folder )
 {
 
-  std::set<suds_indiv_t> * b = read_psd ? &wbank : &bank ;
-    
-  // already done?
-  if ( b->size() > 0 ) return;
-  
-  // find all files in this folder
   std::vector<std::string> trainer_ids;
 
   DIR *dir;
@@ -942,6 +939,32 @@ void suds_t::attach_db( const std::string & folder , bool read_psd )
     {
       Helper::halt( "could not open directory " + folder );      
     }
+
+  return trainer_ids;
+}
+
+
+void suds_t::attach_db( const std::string & folder , bool read_psd )
+{
+
+  std::set<suds_indiv_t> * b = read_psd ? &wbank : &bank ;
+    
+  // already done?
+  if ( b->size() > 0 ) return;
+  
+  // either a binary bank (with LDA models already fit), or
+  // find all files in this folder
+  suds_bank_t * bk = NULL;
+
+  std::vector<std::string> trainer_ids;
+
+  if ( suds_bank_t::is_bank( folder ) )
+    {
+      bk = new suds_bank_t( folder );
+      trainer_ids.resize( bk->size() );
+    }
+  else
+    trainer_ids = list_folder( folder );
   
   //
   // for primary trainers only (! read_psd ) track H2 and H3 distributions
@@ -960,10 +983,15 @@ void suds_t::attach_db( const std::string & folder , bool read_psd )
   for ( int i=0; i<trainer_ids.size() ; i++)
     {
       suds_indiv_t trainer;
-      
-      trainer.reload( folder + globals::folder_delimiter + trainer_ids[i] , read_psd );      
-      
-      trainer.fit_lda();
+
+      if ( bk != NULL )
+	bk->next( &trainer , read_psd );
+      else
+	{
+	  trainer.reload( folder + globals::folder_delimiter + trainer_ids[i] , read_psd );      
+	  
+	  trainer.fit_lda();
+	}
 
       b->insert( trainer );
 
@@ -980,6 +1008,8 @@ void suds_t::attach_db( const std::string & folder , bool read_psd )
           
     }
   
+  if ( bk != NULL ) delete bk;
+
   logger << "  read " << b->size() << " trainers ("
 	 << ( read_psd ? "with spectra" : "w/out spectra" )
 	 << ") from " << folder << "\n";
@@ -1050,11 +1080,26 @@ lda_posteriors_t suds_indiv_t::predict( const suds_indiv_t & trainer )
   if ( trainer.W.size() != suds_t::nc || trainer.V.dim2() != suds_t::nc )
     Helper::halt( "V of incorrect column dimension in suds_indiv_t::predict()");
   
-  Data::Matrix<double> trainer_DW( suds_t::nc , suds_t::nc );  
+  U_projected = project( trainer.V , trainer.W );
+
+  //
+  // predict using trainer model
+  //
+
+  lda_posteriors_t pp = lda_t::predict( trainer.model , U_projected );
+
+  return pp;
+}
+
+
+Data::Matrix<double> suds_indiv_t::project( const Data::Matrix<double> & V , const Data::Vector<double> & W ) const
+{
+
+  Data::Matrix<double> DW( suds_t::nc , suds_t::nc );  
   for (int i=0;i< suds_t::nc; i++)
-    trainer_DW(i,i) = 1.0 / trainer.W[i];
+    DW(i,i) = 1.0 / W[i];
   
-  U_projected = PSD * trainer.V * trainer_DW;
+  Data::Matrix<double> P = PSD * V * DW;
   
   //
   // smooth U (projected)
@@ -1063,20 +1108,14 @@ lda_posteriors_t suds_indiv_t::predict( const suds_indiv_t & trainer )
   if ( suds_t::denoise_fac > 0 ) 
     for (int j=0;j<suds_t::nc;j++)
       {
-	std::vector<double> * col = U_projected.col_nonconst_pointer(j)->data_nonconst_pointer();
-	double sd = MiscMath::sdev( *col );
+	std::vector<double> col = P.col(j).extract();
+	double sd = MiscMath::sdev( col );
 	double lambda = suds_t::denoise_fac * sd;
-	dsptools::TV1D_denoise( *col , lambda );
+	dsptools::TV1D_denoise( col , lambda );
+	std::copy( col.begin() , col.end() , P.col_data(j) );
       }
 
-
-  //
-  // predict using trainer model
-  //
-
-  lda_posteriors_t pp = lda_t::predict( trainer.model , U_projected );
-
-  return pp;
+  return P;
 }
 
 
@@ -1138,38 +1177,74 @@ void suds_t::score( edf_t & edf , param_t & param ) {
   
 
   //
-  // iterate over trainers
+  // Trainers and weight trainers, in bank order
   //
-  
+
+  std::vector<const suds_indiv_t*> trainers;
   std::set<suds_indiv_t>::const_iterator tt = bank.begin();
+  while ( tt != bank.end() ) { trainers.push_back( &(*tt) ); ++tt; }
 
-  int cntr = 0;
+  std::vector<const suds_indiv_t*> wtrainers;
+  std::set<suds_indiv_t>::const_iterator ww = wbank.begin();
+  while ( ww != wbank.end() ) { wtrainers.push_back( &(*ww) ); ++ww; }
 
-  while ( tt != bank.end() )
+  const int nt = trainers.size();
+  const int nw = wtrainers.size();
+
+  
+  //
+  // Predict target given each trainer, after projecting target PSD into trainer-defined space 
+  // ( i.e. based on target.PSD and the trainer's V, W and LDA model; as the target is not
+  //   modified, this is done for all trainers in parallel, with results in per-trainer slots )
+  //
+
+  for (int t=0; t<nt; t++)
     {
-      
-      if ( (cntr+1) % 50 == 0 ) logger << "   ... " << (cntr+1) << "/" << bank.size() << " trainers\n";
+      const suds_indiv_t & trainer = *trainers[t];
+      if ( trainer.W.size() != suds_t::nc || trainer.V.dim2() != suds_t::nc )
+	Helper::halt( "V of incorrect column dimension in suds_indiv_t::predict()");
+      if ( trainer.model.means.dim2() != suds_t::nc )
+	Helper::halt( "wrong number of columns in lda_t::predict()" );  
+      if ( target.PSD.dim2() != trainer.V.dim1() )
+	Helper::halt( "incompatible PSD dimensions for target and trainer " + trainer.id );
+    }
+  
+  std::vector<lda_posteriors_t> predictions( nt );
 
-      //
-      // Extract this one trainer
-      //
+  luna_threads::parallel_for( nt , globals::n_threads , [&]( int t ) {
+      const suds_indiv_t & trainer = *trainers[t];
+      predictions[t] = lda_t::predict( trainer.model , target.project( trainer.V , trainer.W ) );
+    } );
 
-      const suds_indiv_t & trainer = *tt;
+  
+  //
+  // Reweighting (using individuals specified in wbank, if any) 
+  //
+  // Consider that target's predicted stages (from this one particular trainer)
+  // are in fact the real/observed stages for this target.    Now, the 'target'
+  // stages and target model is used to predict other people (i.e. called 'weight trainers', 
+  // and they are effectively targets in this context)
+  //
+  // Requires at least 2 predicted stages (of sufficient N) have been predicted by the trainer
+  // before doing this step 
+  
+  //  trainer --> target                         : using trainer model (to define U)
+  //              target ---> weight trainer1    : using target model (to define U)
+  //              target ---> weight trainer2
+  //              target ---> weight trainer3
 
-      
-      //
-      // Verbose output: TRAINER x WEIGHT TRAINER STATS: not yet
-      //
+  // the target model is fit per trainer (from that trainer's predicted stages) 
+  // but on target.U, i.e. the target's own SVD
+  
+  std::vector<lda_model_t> target_models( nt );
+  std::vector<bool> okay_to_fit_model( nt , false );
 
-      
-      //
-      // Predict target given trainer, after project target PSD into trainer-defined space 
-      // ( i.e. this generates target.U_projected based on trainer, and then uses it to 
-      //        predict target class given the trainer model )
-      //
-      
-      lda_posteriors_t prediction = target.predict( trainer );
+  for (int t=0; t<nt; t++)
+    {
 
+      if ( (t+1) % 50 == 0 ) logger << "   ... " << (t+1) << "/" << nt << " trainers\n";
+
+      const lda_posteriors_t & prediction = predictions[t];
       
       //
       // Save predictions
@@ -1177,35 +1252,7 @@ void suds_t::score( edf_t & edf , param_t & param ) {
 
       target.prd_stage = suds_t::type( prediction.cl );   
 
-      target.add( tt->id , prediction );
-      
-
-      //
-      // Reweighting (using individuals specified in wbank, if any) 
-      //
-      // Consider that target's predicted stages (from this one particular trainer)
-      // are in fact the real/observed stages for this target.    Now, the 'target'
-      // stages and target model is used to predict other people (i.e. called 'weight trainers', 
-      // and they are effectively targets in this context)
-      //
-      // Requires at least 2 predicted stages (of sufficient N) have been predicted by the trainer
-      // before doing this step 
- 
-      //  trainer --> target                         : using trainer model (to define U)
-      //              target ---> weight trainer1    : using target model (to define U)
-      //              target ---> weight trainer2
-      //              target ---> weight trainer3
-
-
-      //
-      // Now consider how well this predicts all the weight-trainers
-      // i.e. where we also have true stage information
-      //
-      
-      double max_kappa = 0;
-      double mean_kappa = 0;
-      int n_kappa50 = 0;
-      int n_kappa_all = 0;
+      target.add( trainers[t]->id , prediction );
       
       std::map<std::string,int> counts;
       for (int i=0;i<prediction.cl.size();i++) counts[ prediction.cl[ i ] ]++;
@@ -1218,101 +1265,103 @@ void suds_t::score( edf_t & edf , param_t & param ) {
 	}
 
       // save for output
-      nr_trainer[ cntr ] = nr;
+      nr_trainer[ t ] = nr;
 
 
       //
       // If prior staging is available, report on kappa for this single trainer
       //
 
-      double k3;
       if ( prior_staging )
 	{
 	  // obs_stage for valid epochs only
 	  double kappa3 =  MiscMath::kappa( NRW( str( target.prd_stage ) ) , NRW( str( target.obs_stage_valid ) ) );	  
-	  k3_prior[ cntr ] = kappa3;
-	  
-	  // tmp
-	  k3 = kappa3;
-	  //	  suds_t::tabulate( NRW( str( target.prd_stage ) ) , NRW( str( target.obs_stage_valid ) ) , true  );	  
+	  k3_prior[ t ] = kappa3;
 	}
       
-      
-      
-      bool okay_to_fit_model = nr > 1;
+      okay_to_fit_model[t] = nr > 1 ;
 
-      if ( okay_to_fit_model )
-	{
-	  
-	  // std::cout << "U\n" << target.U.print() << "\n";
-	  // for (int i=0;i<prediction.cl.size();i++) std::cout << prediction.cl[i] << "\n";
-	  // std::cout << "\n";
-	  	  
-	  //
-	  // Generate model for prediction based on 'dummy' target (imputed) stages
-	  // but U basd on the target's own SVD (i.e. not projected into trainer space);  
-	  // This we use target.U, which is the original for the target, based on their own data
-	  // (we ignore the U_projected which is based on the trainer model)
-	  //
+      //
+      // Generate model for prediction based on 'dummy' target (imputed) stages
+      // but U basd on the target's own SVD (i.e. not projected into trainer space);  
+      // This we use target.U, which is the original for the target, based on their own data
+      // (we ignore the U_projected which is based on the trainer model)
+      //
 
+      if ( okay_to_fit_model[t] && nw > 0 )
+	{
 	  lda_t lda( prediction.cl , target.U );
-      
-	  target.model = lda.fit();
-	  
-	  std::set<suds_indiv_t>::iterator ww = wbank.begin();
-	  while ( ww != wbank.end() )
-	    {
-	      
-	      suds_indiv_t & weight_trainer = (suds_indiv_t&)(*ww);
-	      
-	      // only use self-training
-	      // if ( trainer.id != weight_trainer.id ) { ++ww; continue; } 
-	      //	  std::cout << "WEIGHT TRAINER " << weight_trainer.id << "\n";
-	      
-	      lda_posteriors_t reprediction = weight_trainer.predict( target );
-	      
-	      weight_trainer.prd_stage = suds_t::type( reprediction.cl );
-	      
-	      // obs_stage for predicted/valid epochs only
-	      double kappa = MiscMath::kappa( NRW( reprediction.cl ) , NRW( str( weight_trainer.obs_stage ) ) );
-	      
-	      //logger << "trainer/wt kappa = " << trainer.id << " " << weight_trainer.id << " " << k3 << "\t" << kappa << "\n";
-	      //suds_t::tabulate(  NRW( reprediction.cl ) , NRW(str( weight_trainer.obs_stage ) ) , true );
-	      
-	      ++n_kappa_all;
-	      if ( kappa > 0.5 ) n_kappa50++;
-	      if ( kappa > max_kappa ) max_kappa = kappa;
-	      mean_kappa +=  kappa  ;
-	      
-	      if ( suds_t::verbose ) 
-		wtrainer_mean_k3[ weight_trainer.id ] += kappa;
-	      
-	      ++ww;
-	    }
-	  
+	  target_models[t] = lda.fit();
+	  if ( target_models[t].means.dim2() != suds_t::nc )
+	    Helper::halt( "wrong number of columns in lda_t::predict()" );  
 	}
+    }
 
-          
-          
-     
-      //
-      // Trainer weights
-      //
+
+  //
+  // Now consider how well each target model predicts all the weight-trainers
+  // i.e. where we also have true stage information; the weight trainers are
+  // projected into the target space (which does not depend on the trainer) 
+  // once, then each (trainer, weight trainer) pair is scored in parallel
+  //
+
+  std::vector<double> kappas( (size_t)nt * nw );
+
+  if ( nw > 0 )
+    {
+
+      // checked here, as project() would otherwise halt on a worker thread
+      for (int w=0; w<nw; w++)
+	if ( wtrainers[w]->PSD.dim2() != target.V.dim1() )
+	  Helper::halt( "incompatible PSD dimensions for target and weight trainer " + wtrainers[w]->id );
       
-      if ( wbank.size() > 0 && okay_to_fit_model ) 
-	{
-	  wgt_max[ cntr ] = max_kappa;
-	  wgt_mean[ cntr ] = ( mean_kappa ) / (double)n_kappa_all ;
-	  wgt_n50[ cntr ] = n_kappa50;
-	}
+      std::vector<Data::Matrix<double> > wU( nw );
+
+      luna_threads::parallel_for( nw , globals::n_threads , [&]( int w ) {
+	  wU[w] = wtrainers[w]->project( target.V , target.W );
+	} );
       
-      //
-      // Next trainer
-      //
+      luna_threads::parallel_for( nt * nw , globals::n_threads , [&]( int k ) {
+	  const int t = k / nw;
+	  const int w = k % nw;
+	  if ( ! okay_to_fit_model[t] ) return;
+	  lda_posteriors_t reprediction = lda_t::predict( target_models[t] , wU[w] );
+	  // obs_stage for predicted/valid epochs only
+	  kappas[k] = MiscMath::kappa( NRW( reprediction.cl ) , NRW( str( wtrainers[w]->obs_stage ) ) );
+	} );
+    }
 
-      ++cntr;
-      ++tt;
+  
+  //
+  // Trainer weights (accumulated in trainer, then weight-trainer order)
+  //
+  
+  for (int t=0; t<nt; t++)
+    {
 
+      if ( ! ( nw > 0 && okay_to_fit_model[t] ) ) continue;
+      
+      double max_kappa = 0;
+      double mean_kappa = 0;
+      int n_kappa50 = 0;
+      int n_kappa_all = 0;
+      
+      for (int w=0; w<nw; w++)
+	{
+	  const double kappa = kappas[ (size_t)t * nw + w ];
+
+	  ++n_kappa_all;
+	  if ( kappa > 0.5 ) n_kappa50++;
+	  if ( kappa > max_kappa ) max_kappa = kappa;
+	  mean_kappa +=  kappa  ;
+	  
+	  if ( suds_t::verbose ) 
+	    wtrainer_mean_k3[ wtrainers[w]->id ] += kappa;
+	}
+
+      wgt_max[ t ] = max_kappa;
+      wgt_mean[ t ] = ( mean_kappa ) / (double)n_kappa_all ;
+      wgt_n50[ t ] = n_kappa50;
     }
 
 
@@ -1333,7 +1382,7 @@ void suds_t::score( edf_t & edf , param_t & param ) {
   Data::Vector<double> wgt( bank.size() );
 
   tt = bank.begin();
-  cntr = 0;
+  int cntr = 0;
 
   while ( tt != bank.end() )
     {
@@ -75,6 +75,11 @@ struct suds_indiv_t {
   // make predictions given a different individuals signal data
   lda_posteriors_t predict( const suds_indiv_t & trainer );
 
+  // project PSD into the space defined by V and W (and smooth), i.e. as
+  // for U_projected, but leaving this unchanged (so can be used from
+  // multiple threads)
+  Data::Matrix<double> project( const Data::Matrix<double> & V , const Data::Vector<double> & W ) const;
+
   // add a prediction from one trainer
   void add( const std::string & id , const lda_posteriors_t & );
   
@@ -140,10 +145,71 @@ struct suds_indiv_t {
 };
 
 
+//
+// Binary trainer bank: all trainers from a folder (as written by
+// MAKE-SUDS) in a single file, along with their fitted LDA models, so
+// that attaching a bank is one (memory-mapped) read, rather than parsing
+// and refitting each trainer in turn.  Made by --suds-bank:
+//
+//   "SUDSBNK1" | byte-order | ns nc n | per-signal label/sr/lwr/upr/fac | n trainers
+//
+// where each trainer holds the same data as the text format (but for U,
+// which is only needed to fit the LDA model) plus the model itself; PSD
+// is stored last, so it is only touched if loaded (i.e. for wdb).  Values
+// are stored in native byte order, as given by a marker (0x01020304) after
+// the magic string, and a bank from a machine with the other order is
+// rejected on load.
+//
+
+struct suds_bank_t {
+
+  // map file, and check signals/options against suds_t
+  suds_bank_t( const std::string & filename );
+
+  ~suds_bank_t();
+
+  // number of trainers
+  int size() const { return n; }
+
+  // read the next trainer
+  void next( suds_indiv_t * trainer , bool load_psd );
+
+  static bool is_bank( const std::string & filename );
+
+  // compile folder 'db' into file 'bank'
+  static void compile( param_t & param );
+
+  // write, read back and compare a bank of random trainers (-d suds-bank)
+  static bool selftest( const std::string & filename );
+
+ private:
+
+  std::string filename;
+
+  const char * mapped;
+  size_t mapped_size;
+
+  // if not memory-mapped
+  std::vector<char> buffer;
+
+  size_t p;
+
+  int n;
+
+  const char * data() const { return mapped != NULL ? mapped : buffer.data(); }
+
+  // not copyable: the destructor unmaps 'mapped'
+  suds_bank_t( const suds_bank_t & );
+  suds_bank_t & operator=( const suds_bank_t & );
+  
+};
+
+
 struct suds_t { 
 
   //  friend struct suds_indiv_t;
     
+  // attach either a folder of trainers, or a binary bank
   static void attach_db( const std::string & , bool );
   
   static void score( edf_t & edf , param_t & param );
@@ -282,6 +348,9 @@ struct suds_t {
   static std::string eannot_prepend;
 
   static std::string mat_dump_file;
+
+  // all (trainer) files in a folder
+  static std::vector<std::string> list_folder( const std::string & folder );
   
 private: 
 
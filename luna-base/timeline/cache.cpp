@@ -23,9 +23,97 @@
 #include "timeline/cache.h"
 
 #include "db/db.h"
+#include "helper/logger.h"
+#include "defs/defs.h"
 
 extern writer_t writer;
 
+extern logger_t logger;
+
+
+uint64_t caches_t::bytes() const
+{
+  std::set<const void*> seen;
+  uint64_t b = 0;
+  
+  std::map<std::string,cache_t<int> >::const_iterator ii = cache_int.begin();
+  while ( ii != cache_int.end() ) { b += ii->second.bytes( &seen ); ++ii; }
+
+  std::map<std::string,cache_t<double> >::const_iterator nn = cache_num.begin();
+  while ( nn != cache_num.end() ) { b += nn->second.bytes( &seen ); ++nn; }
+
+  std::map<std::string,cache_t<uint64_t> >::const_iterator tt = cache_tp.begin();
+  while ( tt != cache_tp.end() ) { b += tt->second.bytes( &seen ); ++tt; }
+
+  return b;
+}
+
+
+// least-recently used entry over one type of cache
+template<class T>
+static bool cache_oldest( std::map<std::string,cache_t<T> > & caches , const void * keep , 
+			  uint64_t * used , cache_t<T> ** c , const ckey_t ** k )
+{
+  bool found = false;
+  typename std::map<std::string,cache_t<T> >::iterator ii = caches.begin();
+  while ( ii != caches.end() )
+    {
+      uint64_t u = 0;
+      const ckey_t * k1 = ii->second.oldest( keep , &u );
+      if ( k1 != NULL && ( *k == NULL || u < *used ) )
+	{
+	  *used = u;
+	  *c = &ii->second;
+	  *k = k1;
+	  found = true;
+	}
+      ++ii;
+    }
+  return found;
+}
+
+
+void caches_t::enforce( const void * keep )
+{
+
+  if ( globals::cache_budget == 0 ) return;
+
+  uint64_t b = bytes();
+  
+  int nevicted = 0;
+  
+  while ( b > globals::cache_budget )
+    {
+      uint64_t used = 0;
+      const ckey_t * k = NULL;
+      cache_t<int> * ci = NULL;
+      cache_t<double> * cn = NULL;
+      cache_t<uint64_t> * ct = NULL;
+      
+      // only the last type to find an older entry is used
+      int type = 0;
+      if ( cache_oldest( cache_int , keep , &used , &ci , &k ) ) type = 1;
+      if ( cache_oldest( cache_num , keep , &used , &cn , &k ) ) type = 2;
+      if ( cache_oldest( cache_tp , keep , &used , &ct , &k ) ) type = 3;
+      
+      if ( type == 0 ) break; // nothing left to evict
+
+      const ckey_t key = *k;
+      if      ( type == 1 ) ci->erase( key );
+      else if ( type == 2 ) cn->erase( key );
+      else ct->erase( key );
+      
+      ++nevicted;
+      b = bytes();
+    }
+  
+  if ( nevicted ) 
+    logger << "  evicted " << nevicted << " cache entries (budget " 
+	   << globals::cache_budget / ( 1024.0 * 1024.0 ) << " MB, now using " 
+	   << b / ( 1024.0 * 1024.0 ) << " MB)\n";
+
+}
+
 void ctest()
 {
   
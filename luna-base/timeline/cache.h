@@ -27,7 +27,11 @@
 #include <iostream>
 #include <string>
 #include <map>
+#include <set>
 #include <vector>
+#include <unordered_map>
+#include <memory>
+#include <stdint.h>
 #include "helper/helper.h"
 
 // a temporary store that can be used for different commands to communicate to each other
@@ -44,6 +48,13 @@
 //       SO saves SO time-points and slow phase
 //  the cache is also defined by stratifiers, e.g. label1 / F=11 / CH == C3
 //   
+// keys are hashed once (on construction/add()); values are held as
+// shared, immutable buffers, so they can be moved in and retrieved by
+// const reference without copying, and the same buffer can be stored
+// under several keys; caches_t reports the (de-duplicated) footprint,
+// and if a budget is set (cache-mb) evicts the least-recently used 
+// entries once it is exceeded
+//
 
 
 
@@ -56,35 +67,62 @@ struct ckey_t {
   ckey_t( const std::string & name , const std::map<std::string,std::string> & stratum )
     : name( name ) , stratum( stratum )
   {
+    rehash();
   }
   
   ckey_t( const std::string & name ) : name( name )
   {
+    rehash();
   }
   
   void add( const std::string & key , const std::string & val )
   {
     stratum[key] = val;
+    rehash();
   }
   
   void add( const std::string & key , const int & val )
   {
     stratum[key] = Helper::int2str( val );
+    rehash();
   }
   
   void add( const std::string & key , const double & val )
   {
     stratum[key] = Helper::dbl2str( val );
+    rehash();
   }
   
   void add( const std::string & key , const bool val )
   {
     stratum[key] = Helper::int2str( val );
+    rehash();
   } 
   
   std::string name;
 
   std::map<std::string,std::string> stratum;
+
+  // of name and stratum: kept up-to-date by add(), so call rehash() 
+  // after changing either directly
+  size_t hash;
+  
+  void rehash()
+  {
+    std::hash<std::string> h;
+    hash = h( name );
+    std::map<std::string,std::string>::const_iterator ii = stratum.begin();
+    while ( ii != stratum.end() )
+      {
+	hash ^= h( ii->first ) + 0x9e3779b9 + ( hash << 6 ) + ( hash >> 2 );
+	hash ^= h( ii->second ) + 0x9e3779b9 + ( hash << 6 ) + ( hash >> 2 );
+	++ii;
+      }
+  }
+
+  bool operator==(const ckey_t & rhs ) const {
+    return hash == rhs.hash && name == rhs.name && stratum == rhs.stratum;
+  }
   
   bool operator<(const ckey_t & rhs ) const {
     if ( name < rhs.name ) return true;
@@ -106,24 +144,56 @@ struct ckey_t {
   }
   
 };
-  
+
+struct ckey_hash_t {
+  size_t operator()( const ckey_t & k ) const { return k.hash; }
+};
+
+
+// shared (across all caches) use counter, for LRU eviction
+inline uint64_t cache_tick() { static uint64_t t = 0; return ++t; }
+
+struct caches_t;
   
 template<class T>
 struct cache_t {
 
-  //  cache_t() { } 
+  typedef std::shared_ptr<const std::vector<T> > buffer_t;
 
-  cache_t( const std::string & name ) : name(name) { }   
+  struct entry_t {
+    buffer_t data;
+    mutable uint64_t used;
+  };
+  
+  typedef std::unordered_map<ckey_t,entry_t,ckey_hash_t> store_t;
+  
+  cache_t( const std::string & name ) : name(name) , owner(NULL) { }   
 
   std::string name;
 
-  std::map<ckey_t,std::vector<T> > store;
+  store_t store;
+
+  // set by caches_t, to apply any memory budget on add()
+  caches_t * owner;
+  
+  // member functions: store a copy, move a vector in, or share an
+  // existing buffer; returns the stored buffer
+  
+  buffer_t add( const ckey_t & key , const std::vector<T> & value )
+  {
+    return add( key , buffer_t( new std::vector<T>( value ) ) );
+  }
+
+  buffer_t add( const ckey_t & key , std::vector<T> && value )
+  {
+    return add( key , buffer_t( new std::vector<T>( std::move( value ) ) ) );
+  }
 
-  // member functions
+  buffer_t add( const ckey_t & key , const buffer_t & value );
   
-  void add( const ckey_t & key , const std::vector<T> & value )
+  void erase( const ckey_t & key )
   {
-    store[key] = value;
+    store.erase( key );
   }
 
   void clear()
@@ -134,7 +204,7 @@ struct cache_t {
   // get all keys matching a particular label
   std::set<ckey_t> keys( const std::string & n ) const {
     std::set<ckey_t> k;
-    typename std::map<ckey_t,std::vector<T> >::const_iterator ii = store.begin();
+    typename store_t::const_iterator ii = store.begin();
     while ( ii != store.end() )
       {
 	if ( ii->first.name == n ) k.insert( ii->first );
@@ -142,21 +212,79 @@ struct cache_t {
       }
     return k;
   }
-  
+
+  // zero-copy access: NULL if not found; only valid until the entry is
+  // replaced, erased or evicted (use share() to hold on to it)
+  const std::vector<T> * find( const ckey_t & key ) const {
+    typename store_t::const_iterator ii = store.find( key );
+    if ( ii == store.end() ) return NULL;
+    ii->second.used = cache_tick();
+    return ii->second.data.get();
+  }
+
+  buffer_t share( const ckey_t & key ) const {
+    typename store_t::const_iterator ii = store.find( key );
+    if ( ii == store.end() ) return buffer_t();
+    ii->second.used = cache_tick();
+    return ii->second.data;
+  }
+
+  // a copy (empty if not found)
   std::vector<T> fetch( const ckey_t & key ) const {
-    typename std::map<ckey_t,std::vector<T> >::const_iterator ii = store.find( key );
-    if ( ii == store.end() )
+    const std::vector<T> * p = find( key );
+    if ( p == NULL )
       {
 	std::vector<T> dummy; return dummy; 
       }
-    return ii->second;
+    return *p;
+  }
+
+  // bytes held by buffers not already in 'seen' (which is updated)
+  uint64_t bytes( std::set<const void*> * seen ) const {
+    uint64_t b = 0;
+    typename store_t::const_iterator ii = store.begin();
+    while ( ii != store.end() )
+      {
+	const std::vector<T> * p = ii->second.data.get();
+	if ( seen->insert( p ).second ) b += p->capacity() * sizeof(T);
+	++ii;
+      }
+    return b;
   }
 
+  uint64_t bytes() const {
+    std::set<const void*> seen;
+    return bytes( &seen );
+  }
+
+  // least-recently used entry, other than buffer 'keep'
+  const ckey_t * oldest( const void * keep , uint64_t * used ) const {
+    const ckey_t * k = NULL;
+    typename store_t::const_iterator ii = store.begin();
+    while ( ii != store.end() )
+      {
+	if ( ii->second.data.get() != keep && ( k == NULL || ii->second.used < *used ) )
+	  {
+	    k = &ii->first;
+	    *used = ii->second.used;
+	  }
+	++ii;
+      }
+    return k;
+  }
 	  
   void dump() const {
     std::cout << "cache: " << name << "\n";
-    typename std::map<ckey_t,std::vector<T> >::const_iterator ss = store.begin();
-    while ( ss != store.end() )
+    // in key order
+    std::map<ckey_t,const entry_t*> sorted;
+    typename store_t::const_iterator ii = store.begin();
+    while ( ii != store.end() ) 
+      {
+	sorted[ ii->first ] = &ii->second;
+	++ii;
+      }
+    typename std::map<ckey_t,const entry_t*>::const_iterator ss = sorted.begin();
+    while ( ss != sorted.end() )
       {
 	std::cout << "\t" << ss->first.name << "\n";
 	std::map<std::string,std::string>::const_iterator kk = ss->first.stratum.begin();
@@ -165,9 +293,12 @@ struct cache_t {
 	    std::cout << "\t" << kk->first << " --> " << kk->second << "\n";
 	    ++kk;
 	  }
-	std::cout << "\tdata: " << ss->second.size() << " element vector\n";
+	std::cout << "\tdata: " << ss->second->data->size() << " element vector";
+	if ( ss->second->data.use_count() > 1 ) std::cout << " (shared)";
+	std::cout << "\n";
 	++ss;
       }
+    std::cout << "\tfootprint: " << bytes() << " bytes\n";
   }
   
   
@@ -203,27 +334,46 @@ struct caches_t {
   cache_t<int> * find_int( const std::string & n )
   {
     if ( ! has_int( n ) ) cache_int.insert( std::pair<std::string,cache_t<int> >( n , cache_t<int>( n ) ) );;
-    return &(cache_int.find( n )->second );
+    cache_t<int> * c = &(cache_int.find( n )->second );
+    c->owner = this;
+    return c;
   }
 
   cache_t<double> * find_num( const std::string & n )
   {
     if ( ! has_num( n ) ) cache_num.insert( std::pair<std::string,cache_t<double> >( n , cache_t<double>( n ) ) );;
-    return &(cache_num.find( n )->second );
+    cache_t<double> * c = &(cache_num.find( n )->second );
+    c->owner = this;
+    return c;
   }
 
   cache_t<uint64_t> * find_tp( const std::string & n )
   {
     if ( ! has_tp( n ) ) cache_tp.insert( std::pair<std::string,cache_t<uint64_t> >( n , cache_t<uint64_t>( n ) ) );;
-    return &(cache_tp.find( n )->second );
+    cache_t<uint64_t> * c = &(cache_tp.find( n )->second );
+    c->owner = this;
+    return c;
   }
 
+  // total footprint, counting each shared buffer once
+  uint64_t bytes() const;
 
+  // evict least-recently used entries (other than buffer 'keep') while 
+  // over globals::cache_budget bytes (if set)
+  void enforce( const void * keep );
   
 };
 
 
-#endif
-
+template<class T>
+typename cache_t<T>::buffer_t cache_t<T>::add( const ckey_t & key , const buffer_t & value )
+{
+  entry_t & e = store[ key ];
+  e.data = value;
+  e.used = cache_tick();
+  if ( owner != NULL ) owner->enforce( value.get() );
+  return value;
+}
 
 
+#endif
@@ -0,0 +1,88 @@
+//    --------------------------------------------------------------------
+//
+//    This file is part of Luna.
+//
+//    LUNA is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    Luna is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Luna. If not, see <http://www.gnu.org/licenses/>.
+//
+//    Please see LICENSE.txt for more details.
+//
+//    --------------------------------------------------------------------
+
+#include "timeline/epoch-map.h"
+
+#include "edf/edf.h"
+#include "edf/slice.h"
+
+epoch_map_t::epoch_map_t( edf_t & edf , const signal_list_t & signals )
+  : edf( edf ) , signals( signals )
+{
+
+  edf.timeline.first_epoch();
+
+  while ( 1 ) 
+    {
+      int epoch = edf.timeline.next_epoch();
+      if ( epoch == -1 ) break;
+      epochs.push_back( epoch );
+      intervals.push_back( edf.timeline.epoch( epoch ) );
+    }
+  
+  const int ns = signals.size();
+  
+  for (int s=0; s<ns; s++)
+    {
+      if ( edf.header.is_annotation_channel( signals(s) ) ) continue;
+      chs.push_back( s );
+      srs.push_back( edf.header.sampling_freq( signals(s) ) );
+    }
+  
+}
+
+
+int epoch_map_t::load( const int c0 )
+{
+
+  const int ne = epochs.size();
+
+  data.clear();
+
+  uint64_t held = 0;
+  
+  int c = c0;
+
+  while ( c < chs.size() )
+    {
+
+      // expected size of this channel, i.e. do not exceed the budget,
+      // unless this is the first channel of the block
+
+      uint64_t n = 0;
+      for (int e=0; e<ne; e++)
+	n += intervals[e].duration_sec() * srs[c];
+      
+      if ( c != c0 && held + n > max_block_samples ) break;
+      
+      for (int e=0; e<ne; e++)
+	{
+	  slice_t slice( edf , signals( chs[c] ) , intervals[e] );
+	  data.push_back( std::vector<double>() );
+	  data.back().swap( *slice.nonconst_pdata() );
+	}
+      
+      held += n;
+      ++c;
+    }
+
+  return c;
+}
@@ -0,0 +1,153 @@
+//    --------------------------------------------------------------------
+//
+//    This file is part of Luna.
+//
+//    LUNA is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    Luna is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Luna. If not, see <http://www.gnu.org/licenses/>.
+//
+//    Please see LICENSE.txt for more details.
+//
+//    --------------------------------------------------------------------
+
+#ifndef __LUNA_EPOCH_MAP_H__
+#define __LUNA_EPOCH_MAP_H__
+
+#include <vector>
+#include <iterator>
+#include <stdint.h>
+
+#include "intervals/intervals.h"
+#include "edf/signal-list.h"
+#include "helper/threads.h"
+#include "defs/defs.h"
+
+struct edf_t;
+
+//
+// Epoch x channel executor, i.e. for the usual
+//
+//   for each channel
+//     for each epoch ( next_epoch() )
+//       slice_t, compute, writer.value()
+//
+// pattern: the (unmasked) epochs are listed once; then, for a block of
+// channels at a time, the data for every epoch are sliced (serially, as
+// edf_t is not thread-safe) and compute() is called for all channel x
+// epoch pairs in parallel (over globals::n_threads); each pair's result
+// goes to its own slot, and emit() is then called serially for each
+// channel in turn (in signal-list order, with results in epoch order),
+// so output does not depend on the number of threads.
+//
+// compute() runs on worker threads, so must not use the writer, logger,
+// edf_t or Helper::halt() (see helper/threads.h)
+//
+
+struct epoch_view_t
+{
+  // channel: index into the signal_list_t, and its sampling rate
+  int s;
+  int sr;
+
+  // epoch: 0-based index in epochs[], and as from next_epoch()
+  int e;
+  int epoch;
+
+  interval_t interval;
+
+  // data for this channel/epoch only: owned by this call, so may be
+  // modified in place (e.g. mean-centred); released afterwards
+  std::vector<double> * data;
+};
+
+
+struct epoch_map_t
+{
+
+  // lists the current (unmasked) epochs, and the data channels of
+  // 'signals' (i.e. annotation channels are skipped)
+  epoch_map_t( edf_t & edf , const signal_list_t & signals );
+
+  // C: R compute( const epoch_view_t & )
+  // E: void emit( int s , std::vector<R> & results )   [ results[e] ]
+
+  template<class R , class C , class E>
+    void run( C compute , E emit , int nt = globals::n_threads )
+    {
+
+      const int ne = epochs.size();
+
+      int c0 = 0;
+
+      while ( c0 < chs.size() )
+	{
+
+	  // slice the next block of channels
+	  const int c1 = load( c0 );
+	  const int nb = c1 - c0;
+
+	  std::vector<R> res( (size_t)nb * ne );
+
+	  luna_threads::parallel_for( nb * ne , nt , [&]( int k ) {
+	      const int j = k / ne;
+	      const int e = k % ne;
+	      epoch_view_t v;
+	      v.s = chs[ c0 + j ];
+	      v.sr = srs[ c0 + j ];
+	      v.e = e;
+	      v.epoch = epochs[e];
+	      v.interval = intervals[e];
+	      v.data = &data[k];
+	      res[k] = compute( v );
+	      std::vector<double>().swap( data[k] );
+	    } );
+
+	  data.clear();
+
+	  for (int j=0; j<nb; j++)
+	    {
+	      std::vector<R> r( std::make_move_iterator( res.begin() + (size_t)j * ne ) ,
+				std::make_move_iterator( res.begin() + (size_t)( j + 1 ) * ne ) );
+	      emit( chs[ c0 + j ] , r );
+	    }
+
+	  c0 = c1;
+	}
+    }
+
+  // epochs (as from next_epoch()), in order, and their intervals
+  std::vector<int> epochs;
+  std::vector<interval_t> intervals;
+
+  // data channels (indices into signals), and sampling rates
+  std::vector<int> chs;
+  std::vector<int> srs;
+
+  // at most this many samples are held at once (but always at
+  // least one whole channel)
+  static const uint64_t max_block_samples = (uint64_t)1 << 25;
+
+ private:
+
+  edf_t & edf;
+
+  signal_list_t signals;
+
+  // slice channels c0, c0+1, ... into data[] (channel-major, ne
+  // epochs per channel); returns one past the last channel loaded
+  int load( const int c0 );
+
+  std::vector<std::vector<double> > data;
+
+};
+
+#endif
@@ -33,6 +33,7 @@
 #include "helper/logger.h"
 #include "helper/token-eval.h"
 #include <cstddef>
+#include <algorithm>
 
 extern writer_t writer;
 
@@ -50,40 +51,141 @@ bool timeline_t::discontinuity( const std::vector<uint64_t> & t , int sr , int s
 
 int timeline_t::first_record() const
 {
-  if ( rec2tp.size() == 0 ) return -1; //empty
-  return rec2tp.begin()->first;
+  if ( rec_id.size() == 0 ) return -1; //empty
+  return rec_id[0];
 }
 
 int timeline_t::next_record(const int r) const
 {
-  std::map<int,uint64_t>::const_iterator i = rec2tp.find(r);
-  if ( i == rec2tp.end() ) return -1;
-  ++i;
-  if ( i == rec2tp.end() ) return -1;
-  return i->first;
+  if ( ! retained(r) ) return -1;
+  const int k = rec_slot[r] + 1;
+  if ( k == rec_id.size() ) return -1;
+  return rec_id[k];
 }
 
 bool timeline_t::retained(const int r ) const
 {
-  std::map<int,uint64_t>::const_iterator i = rec2tp.find(r);
-  return i != rec2tp.end();
+  return r >= 0 && r < rec_slot.size() && rec_slot[r] != -1;
 }
 
 
-void timeline_t::init_timeline( bool okay_to_reinit ) 
+void timeline_t::index_records()
 {
+
+  //
+  // given rec_id/rec_start/rec_stop (in record order), build the
+  // record -> slot lookup, the time-point ordered table and the runs
+  //
+
+  const int n = rec_id.size();
+
+  rec_slot.assign( n == 0 ? 0 : rec_id[n-1] + 1 , -1 );
+  for (int k=0; k<n; k++) rec_slot[ rec_id[k] ] = k;
+
+  // time-point order: as for a map keyed on start, if two records
+  // share a start, the later record is the one indexed
   
-  if ( rec2tp.size() != 0 && ! okay_to_reinit ) 
-    Helper::halt( "internal error: cannot re-init timeline" );
+  std::vector<int> order( n );
+  for (int k=0; k<n; k++) order[k] = k;
+
+  bool sorted = true;
+  for (int k=1; k<n; k++)
+    if ( rec_start[k] <= rec_start[k-1] ) { sorted = false; break; }
+
+  if ( ! sorted )
+    {
+      std::stable_sort( order.begin() , order.end() ,
+			[&]( int i , int j ) { return rec_start[i] < rec_start[j]; } );
+      
+      std::vector<int> uniq;
+      for (int k=0; k<n; k++)
+	{
+	  if ( k+1 < n && rec_start[ order[k+1] ] == rec_start[ order[k] ] ) continue;
+	  uniq.push_back( order[k] );
+	}
+      order = uniq;
+    }
   
-  tp2rec.clear();
-  rec2tp.clear();
-  rec2tp_end.clear();
+  const int nt = order.size();
 
+  tp_start.resize( nt );
+  tp_rec.resize( nt );
+
+  for (int k=0; k<nt; k++)
+    {
+      tp_start[k] = rec_start[ order[k] ];
+      tp_rec[k] = rec_id[ order[k] ];
+    }
+
+  // runs of abutting records; these are only valid if records are in
+  // time-point order and do not overlap: otherwise, leave no runs, and
+  // tp_lower_bound() searches all records (as for the old tp2rec map)
+  
+  const uint64_t dur = edf->header.record_duration_tp;
+
+  runs.clear();
+
+  if ( ! sorted ) return;
+
+  for (int k=1; k<nt; k++)
+    if ( tp_start[k] < tp_start[k-1] + dur ) return;
+
+  for (int k=0; k<nt; k++)
+    {
+      if ( k != 0 && tp_start[k] == tp_start[k-1] + dur )
+	runs.back().stop = tp_start[k] + dur - 1LLU;
+      else
+	{
+	  rec_run_t run;
+	  run.start = tp_start[k];
+	  run.stop = tp_start[k] + dur - 1LLU;
+	  run.first = k;
+	  runs.push_back( run );
+	}
+    }
+  
+}
+
+
+int timeline_t::tp_lower_bound( const uint64_t tp ) const
+{
+
+  // no runs (unordered or overlapping records)
+  if ( runs.size() == 0 ) 
+    return std::lower_bound( tp_start.begin() , tp_start.end() , tp ) - tp_start.begin();
+
+  // first run that ends at or after tp
+  std::vector<rec_run_t>::const_iterator rr =
+    std::lower_bound( runs.begin() , runs.end() , tp ,
+		      []( const rec_run_t & run , uint64_t t ) { return run.stop < t; } );
+  
+  if ( rr == runs.end() ) return tp_start.size();
+
+  if ( tp <= rr->start ) return rr->first;
+
+  // first record in this run starting at or after tp (or, if tp is
+  // in the final record of the run, the first record of the next run)
+
+  const uint64_t dur = edf->header.record_duration_tp;
+
+  return rr->first + ( tp - rr->start + dur - 1LLU ) / dur;
+}
+
+
+void timeline_t::init_timeline( bool okay_to_reinit ) 
+{
+  
+  if ( rec_id.size() != 0 && ! okay_to_reinit ) 
+    Helper::halt( "internal error: cannot re-init timeline" );
   
   clear_epoch_mapping();
   
+  const int nr = edf->header.nr;
 
+  rec_id.resize( nr );
+  rec_start.resize( nr );
+  rec_stop.resize( nr );
+  
   //
   // Continuous timeline?
   //
@@ -99,9 +201,9 @@ void timeline_t::init_timeline( bool okay_to_reinit )
 
       for (int r = 0;r < edf->header.nr;r++)
 	{	  
-	  tp2rec[tp] = r;	
-       	  rec2tp[r] = tp;
-	  rec2tp_end[r] = tp + edf->header.record_duration_tp - 1LLU;
+	  rec_id[r] = r;
+	  rec_start[r] = tp;
+	  rec_stop[r] = tp + edf->header.record_duration_tp - 1LLU;
 	  tp += edf->header.record_duration_tp;
 	}            
 
@@ -124,13 +226,15 @@ void timeline_t::init_timeline( bool okay_to_reinit )
       for (int r = 0;r < edf->header.nr;r++)
 	{
 	  uint64_t tp = edf->timepoint_from_EDF(r);
-	  tp2rec[tp] = r;
-	  rec2tp[r] = tp;
-	  rec2tp_end[r] = last_time_point_tp = tp + edf->header.record_duration_tp - 1LLU;
+	  rec_id[r] = r;
+	  rec_start[r] = tp;
+	  rec_stop[r] = last_time_point_tp = tp + edf->header.record_duration_tp - 1LLU;
 	  // last_time_point_tp will be updated, 
 	  // and end up being thelast (i.e. record nr-1).
 	}
     }
+
+  index_records();
 }
 
 
@@ -147,34 +251,30 @@ void timeline_t::restructure( const std::set<int> & keep )
   total_duration_tp = 
     (uint64_t)edf->header.nr * edf->header.record_duration_tp;      
   last_time_point_tp = 0;
-  
-  std::map<uint64_t,int> copy_tp2rec;    
-  std::map<int,uint64_t> copy_rec2tp;    
-  std::map<int,uint64_t> copy_rec2tp_end;
 
-  int r = first_record();
-
-  while ( r != -1 ) 
+  // compact the record table (in place, as kept records stay in order)
+  
+  int n = 0;
+  
+  for (int k=0; k<rec_id.size(); k++)
     {
-      if ( keep.find(r) != keep.end() )
+      if ( keep.find( rec_id[k] ) != keep.end() )
 	{	  
-	  uint64_t tp = rec2tp[r];
-	  copy_rec2tp[r] = tp;
-	  copy_rec2tp_end[r] = rec2tp_end[r];
-	  copy_tp2rec[tp] = r;
-	  if ( rec2tp_end[r] > last_time_point_tp ) 
-	    last_time_point_tp = rec2tp_end[r];
+	  rec_id[n] = rec_id[k];
+	  rec_start[n] = rec_start[k];
+	  rec_stop[n] = rec_stop[k];
+	  if ( rec_stop[n] > last_time_point_tp ) 
+	    last_time_point_tp = rec_stop[n];
+	  ++n;
 	}
-      
-      r = next_record(r);
     }
   
-  // copy over
-
-  tp2rec     = copy_tp2rec;
-  rec2tp     = copy_rec2tp;
-  rec2tp_end = copy_rec2tp_end;
+  rec_id.resize( n );
+  rec_start.resize( n );
+  rec_stop.resize( n );
 
+  index_records();
+  
   // reset epochs (but retain epoch-level annotations)
   reset_epochs();
 
@@ -187,10 +287,9 @@ void timeline_t::restructure( const std::set<int> & keep )
 
 interval_t timeline_t::record2interval( int r ) const
 { 
-  std::map<int,uint64_t>::const_iterator ll = rec2tp.find(r);
-  std::map<int,uint64_t>::const_iterator uu = rec2tp_end.find(r);
-  if ( ll == rec2tp.end() ) return interval_t(0,0);
-  return interval_t( ll->second , uu->second );
+  if ( ! retained(r) ) return interval_t(0,0);
+  const int k = rec_slot[r];
+  return interval_t( rec_start[k] , rec_stop[k] );
 }
 
 
@@ -283,14 +382,17 @@ bool timeline_t::interval2records( const interval_t & interval ,
       
       //
       // For a discontinuous EDF+ we need to search 
-      // explicitly across record timepoints
+      // explicitly across record timepoints (over runs of
+      // contiguous records, see tp_lower_bound())
       //
+
+      const int nt = tp_start.size();
       
       //
       // Get first record that is not less than start search point (i.e. equal to or greater than)
       //
       
-      std::map<uint64_t,int>::const_iterator lwr = tp2rec.lower_bound( interval.start ); 
+      int lwr = tp_lower_bound( interval.start ); 
            
       //
       // This will find the first record AFTER the start; thus, if the
@@ -303,11 +405,11 @@ bool timeline_t::interval2records( const interval_t & interval ,
       
       bool in_gap = false;
       
-      if ( lwr != tp2rec.begin() ) 
+      if ( lwr != 0 ) 
 	{
 	  // go back one record
 	  --lwr;
-	  uint64_t previous_rec_start = lwr->first;
+	  uint64_t previous_rec_start = tp_start[ lwr ];
 	  uint64_t previous_rec_end   = previous_rec_start + edf->header.record_duration_tp - 1LLU;
 
 	  // does the start point fall within this previous record?
@@ -319,18 +421,18 @@ bool timeline_t::interval2records( const interval_t & interval ,
 	      ++lwr;
 	    }
 	}
-      else if ( lwr == tp2rec.begin() )
+      else if ( nt != 0 )
        	{
 	  // If the search point occurs before /all/ records, need to
 	  // indicate that we are in a gap also	  
 	  
-	  if ( interval.start < lwr->first ) 
+	  if ( interval.start < tp_start[ lwr ] ) 
 	    in_gap = true;	      
 	  
 	}
       
       // problem? return empty record set
-      if ( lwr == tp2rec.end() ) 
+      if ( lwr == nt ) 
 	{
 	  *start_rec = 0;
 	  *start_smp = 0;	  
@@ -340,7 +442,7 @@ bool timeline_t::interval2records( const interval_t & interval ,
 	}
 
       
-      *start_rec = lwr->second;
+      *start_rec = tp_rec[ lwr ];
       
       if ( in_gap )
 	*start_smp = 0; // i.e. use start of this record, as it is after the 'true' start site
@@ -358,19 +460,19 @@ bool timeline_t::interval2records( const interval_t & interval ,
       // for upper bound, find the record whose end is equal/greater *greater* 
       // 
       
-      std::map<uint64_t,int>::const_iterator upr = tp2rec.upper_bound( stop_tp ); 
+      int upr = tp_lower_bound( stop_tp + 1LLU ); 
       
       //
       // this should have returned one past the one we are looking for 
       // i.e. that starts *after* the search point
       //
       
-      bool ends_before = upr == tp2rec.begin() ;
+      bool ends_before = upr == 0 ;
       
       if ( ! ends_before ) 
 	{
 	  --upr;  
-	  *stop_rec  = upr->second;
+	  *stop_rec  = tp_rec[ upr ];
 	}
       else
 	{
@@ -378,7 +480,7 @@ bool timeline_t::interval2records( const interval_t & interval ,
 	}
 
       // get samples within (as above)      
-      uint64_t previous_rec_start = upr->first;
+      uint64_t previous_rec_start = tp_start[ upr ];
       uint64_t previous_rec_end   = previous_rec_start + edf->header.record_duration_tp - 1;
       in_gap = ! ( stop_tp >= previous_rec_start && stop_tp <= previous_rec_end );
       
@@ -534,7 +636,7 @@ int timeline_t::calc_epochs()
       if ( r == -1 ) return 0;
       
       // epochs have to be continuous in clocktime
-      uint64_t estart = rec2tp[r];
+      uint64_t estart = rec_start[ rec_slot[r] ];
 
       // for purpose of searching, skip last point
       // i.e. normally intervals are defined as END if 1 past the last point
@@ -564,17 +666,17 @@ int timeline_t::calc_epochs()
 	  // Start and end of this current record	  
 	  //
 
-	  uint64_t rec_start = rec2tp[r];
-	  uint64_t rec_end   = rec2tp_end[r];
+	  uint64_t rec_begin = rec_start[ rec_slot[r] ];
+	  uint64_t rec_end   = rec_stop[ rec_slot[r] ];
 	  
-// 	  std::cout << "dets " << rec_start << " " << rec_end << "\t"
+// 	  std::cout << "dets " << rec_begin << " " << rec_end << "\t"
 // 		    << estart << " " << erestart << " " << estop << "\n";
 
 	  //
 	  // Will the next epoch potentially come from this record?
 	  //
 	  
-	  if ( erestart >= rec_start && erestart <= rec_end )
+	  if ( erestart >= rec_begin && erestart <= rec_end )
 	    {
 	      // track this is the restarting record
 	      restart_rec = r;	      
@@ -657,7 +759,7 @@ int timeline_t::calc_epochs()
 		  // set start point here, as this record may skip ahead of
 		  // assumed eretsart
 
-		  erestart = rec2tp[r];
+		  erestart = rec_start[ rec_slot[r] ];
 
 		}
 	      else
@@ -721,7 +823,7 @@ int timeline_t::calc_epochs()
 	      // these two values should be EQUAL is
 	      // they are contiguous 
 	      
-	      uint64_t rec2_start = rec2tp[r];
+	      uint64_t rec2_start = rec_start[ rec_slot[r] ];
 	      
 	      //std::cout << "recs " << rec2_start << "\t" << rec_end << "\n";
 
@@ -1568,7 +1670,7 @@ std::set<int> timeline_t::records_in_interval( const interval_t & interval ) con
   int r = start_rec;
   while ( r != -1 ) 
     {
-      recs.insert(r);
+      recs.insert( recs.end() , r );
       r = next_record(r);
       if ( r > stop_rec ) break;
     }
@@ -2018,14 +2120,13 @@ void timeline_t::annotate_epochs( const std::string & label ,
 uint64_t timeline_t::timepoint( int r , int s , int nsamples ) const
 {
 
-  std::map<int,uint64_t>::const_iterator rr = rec2tp.find(r);
-  if ( rr == rec2tp.end() ) return 0;
+  if ( ! retained(r) ) return 0;
   
   uint64_t x = s != 0 && nsamples != 0 
     ? edf->header.record_duration_tp * s / nsamples 
     : 0 ;
 
-  return rr->second + x;
+  return rec_start[ rec_slot[r] ] + x;
 }
 
 
@@ -2935,10 +3036,21 @@ void timeline_t::apply_eval_mask( const std::string & str , int mask_mode , cons
   
 
   //
-  // Get all existing annotations (overkill...)
+  // Compile the expression once; this is set to not allow any
+  // assignments.... this makes it cleaner and easier to spot
+  // bad//undefined variables as errors.
   //
+
+  const bool no_assignments = true;
   
-  std::vector<std::string> names = annotations.names();
+  Eval tok( expression , no_assignments );
+
+
+  //
+  // Only the annotations that can supply variables in the expression
+  //
+  
+  std::vector<std::string> names = tok.annotations( annotations.names() );
 
 
   //
@@ -2961,14 +3073,15 @@ void timeline_t::apply_eval_mask( const std::string & str , int mask_mode , cons
   int cnt_now_unmasked = 0;
   int cnt_basic_match = 0;  
 
-  
+
   //
-  // Iterate over epochs
+  // Get annotations for every epoch
   //
 
-  first_epoch();
+  std::vector<int> es;
+  std::vector<std::map<std::string,annot_map_t> > inputs;
   
-  int acc_total = 0 , acc_retval = 0 , acc_valid = 0; 
+  first_epoch();
   
   while ( 1 ) 
     {
@@ -2979,45 +3092,43 @@ void timeline_t::apply_eval_mask( const std::string & str , int mask_mode , cons
       
       interval_t interval = epoch( e );
 	  
-      std::map<std::string,annot_map_t> inputs;
+      es.push_back( e );
+      inputs.resize( es.size() );
       
-      // get each annotations
+      // get overlapping annotations for this epoch
       for (int a=0;a<names.size();a++)
-	{
-	  
-	  annot_t * annot = annotations.find( names[a] );
-	  
-	  // get overlapping annotations for this epoch
-	  annot_map_t events = annot->extract( interval );
-	  
-	  // store
-	  inputs[ names[a] ] = events;
-	}
+	inputs.back()[ names[a] ] = annotations.find( names[a] )->extract( interval );
+    }
 
-      //
-      // create a dummy new instance for the output variables (not saved)
-      //
-      
-      instance_t dummy;
-      
-      //
-      // evaluate the expression, but note, this is set to not 
-      // allow any assignments.... this makes it cleaner and easier 
-      // to spot bad//undefined variables as errors.
-      //
 
-      const bool no_assignments = true;
-      
-      Eval tok( expression , no_assignments );
+  //
+  // evaluate the expression, over all epochs at once (column-wise)
+  // unless verbose
+  //
+  
+  std::vector<Token> results;
 
-      tok.bind( inputs , &dummy );
+  std::vector<bool> valid;
+  
+  tok.evaluate( inputs , &results , &valid , NULL , verbose );
+
+  
+  //
+  // Iterate over epochs
+  //
+  
+  int acc_total = 0 , acc_retval = 0 , acc_valid = 0; 
+  
+  for (int i=0; i<es.size(); i++)
+    {
 
-      bool is_valid = tok.evaluate( verbose );
+      const int e = es[i];
+      
+      bool is_valid = valid[i];
       
       bool matches;
       
-      if ( ! tok.value( matches ) ) is_valid = false;
-
+      if ( ! Eval::value( results[i] , matches ) ) is_valid = false;
 
 
       //
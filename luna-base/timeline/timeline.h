@@ -116,11 +116,6 @@ struct timeline_t
   // Record-level time-point information
   //
   
-      
-  std::map<uint64_t,int> tp2rec;
-  std::map<int,uint64_t>  rec2tp;
-  std::map<int,uint64_t>  rec2tp_end;
-  
   bool interval2records( const interval_t & interval , 
 			 uint64_t srate , 
 			 int * start_rec , 
@@ -691,6 +686,44 @@ struct timeline_t
   std::map<int,std::set<int> > epoch2rec;
   std::map<int,std::set<int> > rec2epoch;
   
+  //
+  // Record table (retained records only): flat arrays, rebuilt by
+  // index_records() whenever the set of records changes
+  //
+
+  // in record order: id, first and last time-point
+  std::vector<int>       rec_id;
+  std::vector<uint64_t>  rec_start;
+  std::vector<uint64_t>  rec_stop;
+
+  // record -> slot in the above, or -1 if not retained
+  std::vector<int>       rec_slot;
+
+  // in time-point order (i.e. as the old tp2rec map; this will match
+  // record order for any well-formed EDF+D)
+  std::vector<uint64_t>  tp_start;
+  std::vector<int>       tp_rec;
+
+  // runs of abutting records, in time-point order: the k-th record of
+  // a run starts at start + k * record duration, so a time-point can be
+  // located by a search over runs (a single run, if no gaps) and then
+  // arithmetic, rather than a search over all records; left empty if
+  // records are out of order or overlap, when all records are searched
+
+  struct rec_run_t
+  {
+    uint64_t start;  // first tp of first record
+    uint64_t stop;   // last tp of last record
+    int first;       // index into tp_start[]
+  };
+
+  std::vector<rec_run_t> runs;
+
+  void index_records();
+
+  // as std::lower_bound() on tp_start[]
+  int tp_lower_bound( const uint64_t tp ) const;
+  
   // original <--> current epoch mappings
   // i.e. track if masks have been applied
   
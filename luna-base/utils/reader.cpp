@@ -30,6 +30,7 @@
 #include <cstring>
 
 #include "luna.h"
+#include "db/colstore.h"
 
 // #include "defs/defs.h"
 // #include "helper/helper.h"
@@ -152,6 +153,10 @@ void display();
 void summary();
 void pre_summary();
 void get_matching_strata( bool show_table = true );
+void colstore_extract( const std::string & cmd_spec , 
+		       const std::set<std::string> & args_rvar , 
+		       const std::set<std::string> & args_cvar , 
+		       const std::set<std::string> & args_ind );
 
 struct request_t;
 struct reqvar_t;
@@ -420,6 +425,16 @@ int main(int argc , char ** argv )
   if ( databases.size() == 0 ) 
     Helper::halt( "no STOUT databases specified" );
 
+  //
+  // Columnar files (luna -c) are read directly from their chunk index
+  //
+
+  if ( Helper::fileExists( databases[0] ) && colstore_reader_t::is_colstore( databases[0] ) )
+    {
+      colstore_extract( cmd_spec , args_rvar , args_cvar , args_ind );
+      std::exit(0);
+    }
+
   //
   // For now, if >1 databse, no not allow col-stratifiers
   // (i.e. no check in place to get uniform cols across db yet)
@@ -1893,3 +1908,336 @@ strata_t merge_strata( const strata_t & s1 , const strata_t & s2 )
   
   return s;
 }
+
+
+
+//
+// Columnar files: the footer index is used to skip any chunks not
+// matching the requested individuals (-i), command (+CMD), row-factors
+// (-r, incl. any FAC/lvl1,lvl2 levels) or variables (-v), i.e. without
+// reading/decompressing them.  Output is a single wide table, as for
+// the database form
+//
+
+static std::string colstore_print( const colstore_column_t & col , const int r )
+{
+  if ( col.missing( r ) ) return "NA";
+  
+  // no formating for numerics
+  if ( options.full ) return col.str( r );
+  
+  double dval;
+  if ( col.type != colstore_column_t::COL_TXT )
+    dval = col.num[r];
+  else if ( ! Helper::str2dbl( col.txt[r] , &dval ) ) 
+    return col.txt[r];
+  
+  std::stringstream ss;
+  ss << std::fixed  << std::setprecision( options.prec ) << dval ;
+  return ss.str();
+}
+
+void colstore_extract( const std::string & cmd_spec , 
+		       const std::set<std::string> & args_rvar , 
+		       const std::set<std::string> & args_cvar , 
+		       const std::set<std::string> & args_ind )
+{
+
+  if ( args_cvar.size() ) 
+    Helper::halt( "cannot specify -c with columnar files currently" );
+
+  const std::string cmd = cmd_spec == "." ? "" : cmd_spec.substr(1);
+
+  // requested row-factors, and any level restrictions
+  std::set<std::string> facs;
+  std::map<std::string,std::set<std::string> > flvls;
+  std::set<std::string>::const_iterator rr = args_rvar.begin();
+  while ( rr != args_rvar.end() )
+    {
+      request_t req( *rr );
+      if ( req.fac[0] != '_' ) 
+	{
+	  facs.insert( req.fac );
+	  if ( req.is_level_specific() ) flvls[ req.fac ] = req.levels;
+	}
+      ++rr;
+    }
+  
+  const bool summary_mode = run_summary || run_dictionary || ( cmd == "" && facs.size() == 0 );
+
+  //
+  // Summary: tables, from the index only
+  //
+  
+  if ( summary_mode ) 
+    {
+
+      for (int d=0;d<databases.size();d++)
+	{
+	  colstore_reader_t reader( databases[d] );
+	  
+	  std::map<std::string,std::set<std::string> > tvars;
+	  std::map<std::string,uint64_t> trows;
+	  std::set<std::string> inds, allvars;
+	  uint64_t nrows = 0;
+
+	  for (int i=0;i<reader.index.size();i++)
+	    {
+	      const colstore_chunk_t & c = reader.index[i];
+	      std::string t = "[" + c.cmd + "]\t";
+	      for (int f=0;f<c.facs.size();f++) t += ( f ? " " : "" ) + c.facs[f];
+	      if ( c.facs.size() == 0 ) t += ".";
+	      for (int v=0;v<c.vars.size();v++) 
+		{
+		  tvars[ t ].insert( c.vars[v] );
+		  allvars.insert( c.vars[v] );
+		}
+	      trows[ t ] += c.nrows;
+	      nrows += c.nrows;
+	      inds.insert( c.indiv );
+	    }
+	  
+	  std::cerr << "--------------------------------------------------------------------------------\n"
+		    << databases[d] << ": " 
+		    << reader.index.size() << " chunk(s), " 
+		    << inds.size() << " individual(s), " 
+		    << allvars.size() << " variable(s), " 
+		    << nrows << " rows\n"
+		    << "--------------------------------------------------------------------------------\n";
+
+	  std::cerr << "distinct strata group(s):\n";
+	  std::cerr << "  commands      : factors           : rows          : variables \n";
+	  std::cerr << "----------------:-------------------:---------------:---------------------------\n";
+	  
+	  std::map<std::string,std::set<std::string> >::const_iterator tt = tvars.begin();
+	  while ( tt != tvars.end() )
+	    {
+	      std::vector<std::string> tok = Helper::parse( tt->first , "\t" );
+	      std::cerr << "  " 
+			<< std::left << std::setw( 14 ) << tok[0]
+			<< std::left << std::setw( 20 ) << ": " + tok[1] 
+			<< std::left << std::setw( 16 ) << ": " + Helper::int2str( (int)trows[ tt->first ] )
+			<< ":";
+	      std::set<std::string>::const_iterator vv = tt->second.begin();
+	      while ( vv != tt->second.end() ) { std::cerr << " " << *vv; ++vv; }
+	      std::cerr << "\n";
+	      ++tt;
+	    }
+	  std::cerr << "----------------:-------------------:---------------:---------------------------\n";
+	}
+      
+      return;
+    }
+
+
+  //
+  // Extract: first, select chunks from the index alone (individual,
+  // command, factors, levels, variables); output rows are keyed on
+  // individual + levels (in order of first appearance), and columns on
+  // command + variable
+  //
+
+  struct colstore_sel_t
+  {
+    int d;
+    int i;
+    std::vector<int> cols;
+  };
+
+  std::vector<colstore_reader_t*> readers;
+  std::map<std::string,std::vector<colstore_sel_t> > sel;
+  std::vector<std::string> sel_indiv;
+  std::map<std::string,std::set<std::string> > var2cmds;
+  
+  int nread = 0 , nskipped = 0;
+
+  for (int d=0;d<databases.size();d++)
+    {
+      
+      if ( ! colstore_reader_t::is_colstore( databases[d] ) )
+	Helper::halt( "cannot mix columnar files and databases: " + databases[d] );
+
+      readers.push_back( new colstore_reader_t( databases[d] ) );
+
+      const colstore_reader_t & reader = *readers.back();
+      
+      for (int i=0;i<reader.index.size();i++)
+	{
+
+	  const colstore_chunk_t & c = reader.index[i];
+	  
+	  //
+	  // predicate pushdown: individual, command, factors, levels
+	  //
+
+	  bool okay = args_ind.size() == 0 || args_ind.find( c.indiv ) != args_ind.end();
+	  
+	  if ( okay && cmd != "" && c.cmd != cmd ) okay = false;
+	  
+	  if ( okay ) 
+	    okay = std::set<std::string>( c.facs.begin() , c.facs.end() ) == facs;
+	  
+	  std::map<std::string,std::set<std::string> >::const_iterator ll = flvls.begin();
+	  while ( okay && ll != flvls.end() )
+	    {
+	      okay = c.may_include( ll->first , ll->second );
+	      ++ll;
+	    }
+	  
+	  // variables
+	  colstore_sel_t s;
+	  s.d = d;
+	  s.i = i;
+	  if ( okay ) 
+	    {
+	      for (int v=0;v<c.vars.size();v++)
+		if ( vars.size() == 0 
+		     || vars.find( reqvar_t( c.vars[v] ) ) != vars.end() 
+		     || vars.find( reqvar_t( c.vars[v] + "/" + c.cmd ) ) != vars.end() ) 
+		  {
+		    s.cols.push_back( v );
+		    var2cmds[ c.vars[v] ].insert( c.cmd );
+		  }
+	      okay = s.cols.size() > 0;
+	    }
+	  
+	  if ( ! okay ) { ++nskipped; continue; }
+	  
+	  ++nread;
+	  
+	  if ( sel.find( c.indiv ) == sel.end() ) sel_indiv.push_back( c.indiv );
+	  sel[ c.indiv ].push_back( s );
+	}
+    }
+
+  if ( nread == 0 ) 
+    Helper::halt( "No matching strata found" );
+
+  //
+  // Output columns: a variable given by more than one command (i.e. 
+  // when no +CMD was specified) is split by command, as VAR/CMD
+  //
+
+  std::map<std::string,std::map<std::string,std::string> > col_label;
+  std::set<std::string> ovars;
+  std::map<std::string,std::set<std::string> >::const_iterator vc = var2cmds.begin();
+  while ( vc != var2cmds.end() )
+    {
+      std::set<std::string>::const_iterator cc = vc->second.begin();
+      while ( cc != vc->second.end() )
+	{
+	  const std::string lab = vc->second.size() == 1 ? vc->first : vc->first + "/" + *cc;
+	  col_label[ *cc ][ vc->first ] = lab;
+	  ovars.insert( lab );
+	  ++cc;
+	}
+      ++vc;
+    }
+  
+  std::map<std::string,int> ovaridx;
+  std::set<std::string>::const_iterator vv = ovars.begin();
+  while ( vv != ovars.end() ) { int n = ovaridx.size(); ovaridx[ *vv ] = n; ++vv; }
+  
+  std::cout << "ID";
+  std::set<std::string>::const_iterator ff = facs.begin();
+  while ( ff != facs.end() ) { std::cout << "\t" << *ff; ++ff; }
+  vv = ovars.begin();
+  while ( vv != ovars.end() ) { std::cout << "\t" << *vv; ++vv; }
+  std::cout << "\n";
+  
+
+  //
+  // Read and display one individual at a time: rows never span
+  // individuals, so only the current one is held in memory
+  //
+
+  int nrows = 0;
+
+  colstore_table_t t;
+
+  for (int k=0;k<sel_indiv.size();k++)
+    {
+      
+      const std::vector<colstore_sel_t> & chunks = sel[ sel_indiv[k] ];
+
+      std::map<std::string,int> rowidx;
+      std::vector<std::vector<std::string> > row_lvls;
+      std::vector<std::vector<std::string> > row_vals;
+      
+      for (int i=0;i<chunks.size();i++)
+	{
+	  
+	  const colstore_sel_t & s = chunks[i];
+
+	  readers[ s.d ]->read( readers[ s.d ]->index[ s.i ] , &t );
+	  
+	  // factor order as in output (i.e. sorted)
+	  std::vector<int> fidx;
+	  std::set<std::string>::const_iterator ff = facs.begin();
+	  while ( ff != facs.end() )
+	    {
+	      for (int f=0;f<t.facs.size();f++) 
+		if ( t.facs[f] == *ff ) fidx.push_back( f );
+	      ++ff;
+	    }
+	  
+	  // output column for each selected variable
+	  const std::map<std::string,std::string> & labels = col_label[ t.cmd ];
+	  std::vector<int> oidx( s.cols.size() );
+	  for (int j=0;j<s.cols.size();j++)
+	    oidx[j] = ovaridx[ labels.find( t.vars[ s.cols[j] ] )->second ];
+	  
+	  for (int r=0;r<t.nrows;r++)
+	    {
+	      
+	      std::vector<std::string> lvls( fidx.size() );
+	      std::string key;
+	      bool include = true;
+	      for (int f=0;f<fidx.size();f++)
+		{
+		  lvls[f] = t.lvls[ fidx[f] ][r];
+		  std::map<std::string,std::set<std::string> >::const_iterator ll = flvls.find( t.facs[ fidx[f] ] );
+		  if ( ll != flvls.end() && ll->second.find( lvls[f] ) == ll->second.end() ) include = false;
+		  key.push_back( '\0' );
+		  key += lvls[f];
+		}
+	      
+	      if ( ! include ) continue;
+
+	      std::map<std::string,int>::const_iterator kk = rowidx.find( key );
+	      int row;
+	      if ( kk != rowidx.end() ) row = kk->second;
+	      else
+		{
+		  row = row_lvls.size();
+		  rowidx[ key ] = row;
+		  row_lvls.push_back( lvls );
+		  row_vals.push_back( std::vector<std::string>( ovars.size() , "NA" ) );
+		}
+	      
+	      for (int j=0;j<s.cols.size();j++)
+		{
+		  const colstore_column_t & col = t.cols[ s.cols[j] ];
+		  if ( col.missing( r ) ) continue;
+		  row_vals[ row ][ oidx[j] ] = colstore_print( col , r );
+		}
+	    }
+	}
+      
+      for (int r=0;r<row_lvls.size();r++)
+	{
+	  std::cout << sel_indiv[k];
+	  for (int f=0;f<row_lvls[r].size();f++) std::cout << "\t" << row_lvls[r][f];
+	  for (int v=0;v<row_vals[r].size();v++) std::cout << "\t" << row_vals[r][v];
+	  std::cout << "\n";
+	}
+      
+      nrows += row_lvls.size();
+    }
+
+  for (int d=0;d<readers.size();d++) delete readers[d];
+
+  if ( nrows == 0 ) 
+    Helper::halt( "No matching strata found" );
+  
+}